@@ -0,0 +1,113 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/*
+ * Smallest chunk we bother mallocing. Keeps tiny inputs (and tests) from
+ * making a pile of small chunks.
+ */
+#define ARENA_MIN_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	alignas(max_align_t) char data[];
+};
+
+void arena_init(struct arena *arena, size_t size_hint)
+{
+	arena->head = NULL;
+	arena->chunk_size = size_hint < ARENA_MIN_CHUNK_SIZE ? ARENA_MIN_CHUNK_SIZE : size_hint;
+	arena->num_chunks = 0;
+}
+
+static size_t align_up(size_t n, size_t align)
+{
+	return (n + align - 1) & ~(align - 1);
+}
+
+static void arena_new_chunk(struct arena *arena, size_t min_size)
+{
+	size_t size = arena->chunk_size;
+	if (size < min_size) {
+		size = min_size;
+	}
+
+	struct arena_chunk *chunk = malloc(sizeof(*chunk) + size);
+	if (chunk == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	chunk->next = arena->head;
+	chunk->size = size;
+	chunk->used = 0;
+
+	arena->head = chunk;
+	arena->num_chunks++;
+
+	// Grow chunks geometrically so a bad size hint still only costs a
+	// logarithmic number of mallocs.
+	arena->chunk_size = size * 2;
+}
+
+void *arena_alloc(struct arena *arena, size_t size, size_t align)
+{
+	struct arena_chunk *chunk = arena->head;
+	if (chunk != NULL) {
+		size_t start = align_up(chunk->used, align);
+		if (start + size <= chunk->size) {
+			chunk->used = start + size;
+			return chunk->data + start;
+		}
+	}
+
+	// Chunk data is max_align_t aligned, so an empty chunk needs no padding
+	// for any alignment we hand out.
+	arena_new_chunk(arena, size);
+	arena->head->used = size;
+	return arena->head->data;
+}
+
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size, size_t align)
+{
+	struct arena_chunk *chunk = arena->head;
+	if (ptr != NULL && chunk != NULL && (char *) ptr + old_size == chunk->data + chunk->used) {
+		size_t start = (char *) ptr - chunk->data;
+		if (start + new_size <= chunk->size) {
+			chunk->used = start + new_size;
+			return ptr;
+		}
+	}
+
+	void *new_ptr = arena_alloc(arena, new_size, align);
+	if (ptr != NULL) {
+		memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	}
+	return new_ptr;
+}
+
+char *arena_strndup(struct arena *arena, const char *s, size_t len)
+{
+	char *copy = arena_alloc(arena, len + 1, 1);
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+void arena_destroy(struct arena *arena)
+{
+	struct arena_chunk *chunk = arena->head;
+	while (chunk != NULL) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = NULL;
+	arena->num_chunks = 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Bump allocator. Allocations are carved out of large chunks and can't be
+ * freed individually; destroying the arena releases everything at once.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+
+struct arena_chunk;
+
+struct arena {
+	/** Chunk currently being bumped into. Older chunks are linked behind it. */
+	struct arena_chunk *head;
+	/** Minimum size of the next chunk we allocate. */
+	size_t chunk_size;
+	/** Number of chunks malloced so far (useful for benchmarks). */
+	size_t num_chunks;
+};
+
+/*
+ * Initializes an empty arena. `size_hint` is the number of bytes the caller
+ * expects to allocate in total; the first chunk is sized from it so a good
+ * hint means a single malloc. No memory is allocated until the first
+ * `arena_alloc`.
+ */
+void arena_init(struct arena *arena, size_t size_hint);
+
+/*
+ * Returns `size` bytes aligned to `align` (a power of two). Never returns
+ * NULL; exits on allocation failure like the rest of the assembler.
+ */
+void *arena_alloc(struct arena *arena, size_t size, size_t align);
+
+/*
+ * Resizes the allocation at `ptr` from `old_size` to `new_size` bytes. If
+ * `ptr` was the most recent allocation and there is room it grows in place,
+ * otherwise the contents are copied into a fresh allocation (the old space is
+ * reclaimed when the arena is destroyed).
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size, size_t align);
+
+/*
+ * Copies `len` bytes of `s` into the arena and NUL terminates them.
+ */
+char *arena_strndup(struct arena *arena, const char *s, size_t len);
+
+/*
+ * Frees every chunk. Cost is proportional to the number of chunks, not the
+ * number of allocations.
+ */
+void arena_destroy(struct arena *arena);
@@ -2,45 +2,203 @@
 #include <stdio.h>
 #include <unistd.h>
 
+#include "cache.h"
+#include "codegen.h"
+#include "input.h"
+#include "object.h"
+#include "optimize.h"
+#include "parallel.h"
 #include "parser.h"
+#include "resolver.h"
 
-int main(int argc, char **argv)
+static void print_optimize_stats(const struct asm_optimize_stats *stats)
 {
+	size_t removed = stats->instructions_before - stats->instructions_after;
+	fprintf(stderr, "peephole: %zu -> %zu instructions (-%zu, %.1f%%)\n", stats->instructions_before,
+		stats->instructions_after, removed,
+		stats->instructions_before > 0 ? 100.0 * removed / stats->instructions_before : 0.0);
+	for (int rule = 0; rule < ASM_PEEPHOLE_NUM_RULES; rule++) {
+		fprintf(stderr, "  %-18s %zu\n", asm_peephole_rule_name(rule), stats->rule_hits[rule]);
+	}
+}
 
-	FILE *fp = argc > 1 ? fopen(argv[1], "r") : stdin;
-	if (!fp) {
-		perror("fopen failed");
-		exit(EXIT_FAILURE);
+/*
+ * Single threaded parse, resolve and encode, optionally running the peephole
+ * optimizer in between and reporting what it did on stderr.
+ */
+static enum asm_parse_error assemble(const char *source, size_t len, bool optimize, bool verbose,
+				     uint16_t **words, size_t *num_words)
+{
+	asm_declarations declarations = asm_declarations_create(len);
+	enum asm_parse_error err = parse_asm_declarations(source, len, &declarations);
+	if (err == ASM_PARSE_ERROR_NO_ERROR && optimize) {
+		struct asm_optimize_stats stats;
+		asm_optimize_declarations(&declarations, &stats);
+		if (verbose) {
+			print_optimize_stats(&stats);
+		}
 	}
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_resolve_symbols(&declarations);
+	}
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		*words = malloc(declarations.len * sizeof(uint16_t) + 1);
+		if (*words == NULL) {
+			fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+		*num_words = asm_declarations_encode(&declarations, *words);
+	}
+	asm_declarations_destroy(declarations);
+	return err;
+}
 
-	int page_size = sysconf(_SC_PAGESIZE);
+/*
+ * Assembles each input into its own object, through the cache if there is
+ * one, and links them in order. Returns the first error, printing which input
+ * it came from.
+ */
+static enum asm_parse_error assemble_inputs(struct asm_input *inputs, char **paths, size_t num_inputs,
+					    const char *cache_dir, uint16_t **words, size_t *num_words)
+{
+	struct asm_object *objects = malloc(num_inputs * sizeof(*objects));
+	if (objects == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
 
-	size_t input_size = 0;
-	char *input = NULL;
-	while (true) {
-		// Increase buffer size
-		input_size += page_size;
-		if ((input = realloc(input, input_size)) == NULL) {
-			fprintf(stderr, "realloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
-			exit(EXIT_FAILURE);
+	enum asm_parse_error err = ASM_PARSE_ERROR_NO_ERROR;
+	size_t num_objects = 0;
+	while (num_objects < num_inputs && err == ASM_PARSE_ERROR_NO_ERROR) {
+		struct asm_input *input = &inputs[num_objects];
+		struct asm_object *object = &objects[num_objects++];
+		if (cache_dir != NULL) {
+			bool hit;
+			err = asm_cache_assemble(cache_dir, input->data, input->len, object, &hit);
+		} else {
+			err = asm_object_assemble(input->data, input->len, object);
 		}
+		if (err != ASM_PARSE_ERROR_NO_ERROR) {
+			fprintf(stderr, "%s: ", paths != NULL ? paths[num_objects - 1] : "stdin");
+		}
+	}
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_objects_link(objects, num_objects, words, num_words);
+	}
+
+	for (size_t i = 0; i < num_objects; i++) {
+		asm_object_destroy(&objects[i]);
+	}
+	free(objects);
+	return err;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-bOv] [-c cache_dir] [-j threads] [-o output] [input.asm...]\n", prog);
+	fprintf(stderr, "  -b  write raw big endian 16 bit words instead of .hack text\n");
+	fprintf(stderr, "  -O  run the peephole optimizer on a single uncached input on one thread\n");
+	fprintf(stderr, "  -v  report what the optimizer did on stderr\n");
+	fprintf(stderr, "  -c  reuse objects cached in cache_dir for inputs that haven't changed\n");
+	fprintf(stderr, "  -j  assemble a single uncached input on this many threads (default 1)\n");
+	fprintf(stderr, "  -o  write to output instead of stdout\n");
+	fprintf(stderr, "Several inputs are assembled separately and linked, in order, into one program.\n");
+	exit(EXIT_FAILURE);
+}
 
-		// Copy input to buffer
-		char *result = fgets(input, page_size, fp);
-		if (result == NULL) {
+int main(int argc, char **argv)
+{
+	enum hack_output_format format = HACK_OUTPUT_TEXT;
+	const char *output_path = NULL;
+	const char *cache_dir = NULL;
+	size_t num_threads = 1;
+	bool optimize = false;
+	bool verbose = false;
+
+	int c;
+	while ((c = getopt(argc, argv, "bc:j:o:Ov")) != -1) {
+		switch (c) {
+		case 'b':
+			format = HACK_OUTPUT_BINARY;
+			break;
+		case 'c':
+			cache_dir = optarg;
+			break;
+		case 'j':
+			num_threads = strtoul(optarg, NULL, 10);
+			if (num_threads == 0) {
+				usage(argv[0]);
+			}
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
+		case 'O':
+			optimize = true;
 			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// No paths means a single input from stdin
+	char **paths = optind < argc ? argv + optind : NULL;
+	size_t num_inputs = optind < argc ? (size_t) (argc - optind) : 1;
+	bool linking = num_inputs > 1 || cache_dir != NULL;
+	// The optimizer rewrites a whole program's declarations, which the
+	// sharded and per-object paths never build
+	if ((linking && num_threads > 1) || (optimize && (linking || num_threads > 1))) {
+		usage(argv[0]);
+	}
+
+	struct asm_input *inputs = malloc(num_inputs * sizeof(*inputs));
+	if (inputs == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < num_inputs; i++) {
+		bool ok = paths != NULL ? asm_input_open(paths[i], &inputs[i]) : asm_input_read_stream(stdin, &inputs[i]);
+		if (!ok) {
+			perror(paths != NULL ? paths[i] : "failed to read input");
+			exit(EXIT_FAILURE);
 		}
 	}
 
-	if (fp != stdin) {
-		fclose(fp);
+	uint16_t *words;
+	size_t num_words;
+	enum asm_parse_error err;
+	if (linking) {
+		err = assemble_inputs(inputs, paths, num_inputs, cache_dir, &words, &num_words);
+	} else if (num_threads > 1) {
+		err = asm_assemble_parallel(inputs[0].data, inputs[0].len, num_threads, &words, &num_words);
+	} else {
+		err = assemble(inputs[0].data, inputs[0].len, optimize, verbose, &words, &num_words);
+	}
+	for (size_t i = 0; i < num_inputs; i++) {
+		asm_input_close(&inputs[i]);
 	}
+	free(inputs);
 
-	asm_declarations declarations = asm_declarations_create();
-	enum asm_parse_error err = parse_asm_declarations(input, &declarations);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "error: %d\n", err);
+		exit(EXIT_FAILURE);
+	}
 
-	free(input);
-	asm_declarations_destroy(declarations);
+	FILE *out = output_path != NULL ? fopen(output_path, "w") : stdout;
+	if (out == NULL) {
+		perror("fopen failed");
+		exit(EXIT_FAILURE);
+	}
+	if (!hack_write(out, words, num_words, format) || fflush(out) != 0) {
+		perror("failed to write output");
+		exit(EXIT_FAILURE);
+	}
+	if (out != stdout) {
+		fclose(out);
+	}
 
-	printf("error: %d\n", err);
+	free(words);
 }
@@ -0,0 +1,317 @@
+#include <errno.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "error.h"
+#include "input.h"
+#include "object.h"
+#include "symbol_table.h"
+
+/*
+ * Bump the version whenever the layout below or the encoding changes, so old
+ * entries turn into misses instead of wrong output.
+ */
+#define ASM_CACHE_MAGIC "HACKOBJ\x02"
+
+/*
+ * A cache entry is this header followed by:
+ *
+ * - `num_labels` then `num_references` fixups, as `struct cache_fixup`
+ * - `num_symbols` name lengths, as uint32_t
+ * - `num_words` encoded words, as uint16_t
+ * - `names_len` bytes of symbol names, back to back without terminators
+ * - the `source_len` bytes of source the entry was assembled from
+ *
+ * in that order, so every array is naturally aligned. Everything is in host
+ * byte order; the cache isn't meant to be shared between machines, and an
+ * entry from a machine with the other byte order fails the magic check.
+ *
+ * The hash only names the file: an entry is a hit only if its copy of the
+ * source matches byte for byte, so a hash collision is a miss rather than
+ * another file's object.
+ */
+struct cache_header {
+	char magic[8];
+	uint64_t hash;
+	uint64_t source_len;
+	uint64_t num_words;
+	uint64_t num_labels;
+	uint64_t num_references;
+	uint64_t num_symbols;
+	uint64_t names_len;
+};
+
+struct cache_fixup {
+	/** Index into the entry's symbols */
+	uint32_t symbol;
+	uint32_t index;
+};
+
+uint64_t asm_cache_hash(const char *source, size_t len)
+{
+	// Each step is a bijection of the running hash, so two inputs that only
+	// differ in one word can't collide
+	uint64_t hash = 0x9E3779B97F4A7C15ULL ^ len;
+	for (size_t i = 0; i < len; i += 8) {
+		uint64_t word = 0;
+		memcpy(&word, source + i, len - i < 8 ? len - i : 8);
+		hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+static char *cache_path(const char *cache_dir, uint64_t hash)
+{
+	size_t size = strlen(cache_dir) + sizeof("/0123456789abcdef.hobj");
+	char *path = malloc(size);
+	if (path == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	snprintf(path, size, "%s/%016llx.hobj", cache_dir, (unsigned long long) hash);
+	return path;
+}
+
+/*
+ * Bounds checked cursor over a mapped cache entry.
+ */
+struct reader {
+	const char *p;
+	size_t left;
+};
+
+static const char *take(struct reader *reader, uint64_t count, size_t size)
+{
+	if (count > reader->left / size) {
+		return NULL;
+	}
+	const char *p = reader->p;
+	reader->p += count * size;
+	reader->left -= count * size;
+	return p;
+}
+
+static bool load_fixups(struct asm_fixup *fixups, const char *p, size_t num_fixups,
+			struct asm_symbol **symbols, size_t num_symbols, size_t max_index)
+{
+	for (size_t i = 0; i < num_fixups; i++) {
+		struct cache_fixup fixup;
+		memcpy(&fixup, p + i * sizeof(fixup), sizeof(fixup));
+		if (fixup.symbol >= num_symbols || fixup.index > max_index) {
+			return false;
+		}
+		fixups[i] = (struct asm_fixup) {.symbol = symbols[fixup.symbol], .index = fixup.index};
+	}
+	return true;
+}
+
+/*
+ * Rebuilds `object` from the entry at `path`. Returns false, leaving nothing
+ * to destroy, if there is no usable entry for this source.
+ */
+static bool load_object(const char *path, uint64_t hash, const char *source, size_t source_len,
+			struct asm_object *object)
+{
+	struct asm_input input;
+	if (!asm_input_open(path, &input)) {
+		return false;
+	}
+
+	struct reader reader = {.p = input.data, .left = input.len};
+	struct cache_header header;
+	const char *p = take(&reader, 1, sizeof(header));
+	if (p == NULL) {
+		asm_input_close(&input);
+		return false;
+	}
+	memcpy(&header, p, sizeof(header));
+	if (memcmp(header.magic, ASM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+	    header.hash != hash || header.source_len != source_len) {
+		asm_input_close(&input);
+		return false;
+	}
+
+	const char *labels = take(&reader, header.num_labels, sizeof(struct cache_fixup));
+	const char *references = take(&reader, header.num_references, sizeof(struct cache_fixup));
+	const char *lens = take(&reader, header.num_symbols, sizeof(uint32_t));
+	const char *words = take(&reader, header.num_words, sizeof(uint16_t));
+	const char *names = take(&reader, header.names_len, 1);
+	const char *entry_source = take(&reader, header.source_len, 1);
+	if (labels == NULL || references == NULL || lens == NULL || words == NULL || names == NULL ||
+	    entry_source == NULL || reader.left != 0 ||
+	    (source_len != 0 && memcmp(entry_source, source, source_len) != 0)) {
+		asm_input_close(&input);
+		return false;
+	}
+
+	*object = (struct asm_object) {.declarations = asm_declarations_create(0)};
+	asm_declarations *declarations = &object->declarations;
+	struct arena *arena = &declarations->arena;
+
+	// Interning puts builtins back in their resolved state, just like the
+	// parser would have
+	bool ok = true;
+	struct asm_symbol **symbols = malloc(header.num_symbols * sizeof(*symbols) + 1);
+	if (symbols == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	size_t name_start = 0;
+	for (size_t i = 0; ok && i < header.num_symbols; i++) {
+		uint32_t len;
+		memcpy(&len, lens + i * sizeof(len), sizeof(len));
+		ok = len > 0 && len <= header.names_len - name_start;
+		if (ok) {
+			symbols[i] = asm_symbol_table_intern(&declarations->symbols, arena, names + name_start, len);
+			name_start += len;
+		}
+	}
+	ok = ok && name_start == header.names_len;
+
+	if (ok) {
+		object->num_words = header.num_words;
+		object->words = arena_alloc(arena, header.num_words * sizeof(uint16_t), alignof(uint16_t));
+		memcpy(object->words, words, header.num_words * sizeof(uint16_t));
+
+		object->num_labels = header.num_labels;
+		object->labels = arena_alloc(arena, header.num_labels * sizeof(struct asm_fixup),
+					     alignof(struct asm_fixup));
+		object->num_references = header.num_references;
+		object->references = arena_alloc(arena, header.num_references * sizeof(struct asm_fixup),
+						 alignof(struct asm_fixup));
+
+		// A label may sit right after the last word, a reference may not
+		ok = load_fixups(object->labels, labels, header.num_labels, symbols, header.num_symbols,
+				 header.num_words) &&
+			(header.num_references == 0 ||
+			 load_fixups(object->references, references, header.num_references, symbols,
+				     header.num_symbols, header.num_words - 1));
+	}
+
+	free(symbols);
+	asm_input_close(&input);
+	if (!ok) {
+		asm_object_destroy(object);
+	}
+	return ok;
+}
+
+static bool write_fixups(FILE *fp, const struct asm_fixup *fixups, size_t num_fixups,
+			 const struct asm_symbol_table *symbols, const uint32_t *ordinals)
+{
+	for (size_t i = 0; i < num_fixups; i++) {
+		struct cache_fixup fixup = {
+			.symbol = ordinals[asm_symbol_table_index(symbols, fixups[i].symbol)],
+			.index = fixups[i].index,
+		};
+		if (fwrite(&fixup, sizeof(fixup), 1, fp) != 1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool write_object(FILE *fp, const struct asm_object *object, uint64_t hash, const char *source,
+			 size_t source_len)
+{
+	// Symbols are written in slot order, and fixups refer to them by their
+	// position in that order
+	const struct asm_symbol_table *symbols = &object->declarations.symbols;
+	uint32_t *ordinals = malloc(symbols->capacity * sizeof(*ordinals) + 1);
+	if (ordinals == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	struct cache_header header = {
+		.hash = hash,
+		.source_len = source_len,
+		.num_words = object->num_words,
+		.num_labels = object->num_labels,
+		.num_references = object->num_references,
+	};
+	memcpy(header.magic, ASM_CACHE_MAGIC, sizeof(header.magic));
+	for (size_t i = 0; i < symbols->capacity; i++) {
+		const struct asm_symbol *symbol = symbols->slots[i].symbol;
+		if (symbol != NULL) {
+			ordinals[i] = header.num_symbols++;
+			header.names_len += symbol->len;
+		}
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+		write_fixups(fp, object->labels, object->num_labels, symbols, ordinals) &&
+		write_fixups(fp, object->references, object->num_references, symbols, ordinals);
+	for (size_t i = 0; ok && i < symbols->capacity; i++) {
+		const struct asm_symbol *symbol = symbols->slots[i].symbol;
+		uint32_t len = symbol != NULL ? symbol->len : 0;
+		ok = symbol == NULL || fwrite(&len, sizeof(len), 1, fp) == 1;
+	}
+	ok = ok && fwrite(object->words, sizeof(uint16_t), object->num_words, fp) == object->num_words;
+	for (size_t i = 0; ok && i < symbols->capacity; i++) {
+		const struct asm_symbol *symbol = symbols->slots[i].symbol;
+		ok = symbol == NULL || fwrite(symbol->name, 1, symbol->len, fp) == symbol->len;
+	}
+	// An empty file's source may be NULL
+	ok = ok && (source_len == 0 || fwrite(source, 1, source_len, fp) == source_len);
+
+	free(ordinals);
+	return ok;
+}
+
+/*
+ * Writes the entry under a temporary name and renames it into place, so a
+ * concurrent build never sees half an entry.
+ */
+static void save_object(const char *cache_dir, const char *path, const struct asm_object *object, uint64_t hash,
+			const char *source, size_t source_len)
+{
+	if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST) {
+		return;
+	}
+
+	size_t size = strlen(path) + sizeof(".tmp.4294967295");
+	char *tmp_path = malloc(size);
+	if (tmp_path == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	snprintf(tmp_path, size, "%s.tmp.%u", path, (unsigned) getpid());
+
+	FILE *fp = fopen(tmp_path, "wb");
+	if (fp != NULL) {
+		bool ok = write_object(fp, object, hash, source, source_len);
+		ok = fclose(fp) == 0 && ok;
+		if (!ok || rename(tmp_path, path) != 0) {
+			unlink(tmp_path);
+		}
+	}
+	free(tmp_path);
+}
+
+enum asm_parse_error asm_cache_assemble(const char *cache_dir, const char *source, size_t len,
+					struct asm_object *object, bool *hit)
+{
+	uint64_t hash = asm_cache_hash(source, len);
+	char *path = cache_path(cache_dir, hash);
+
+	*hit = load_object(path, hash, source, len, object);
+	if (*hit) {
+		free(path);
+		return ASM_PARSE_ERROR_NO_ERROR;
+	}
+
+	enum asm_parse_error err = asm_object_assemble(source, len, object);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		save_object(cache_dir, path, object, hash, source, len);
+	}
+	free(path);
+	return err;
+}
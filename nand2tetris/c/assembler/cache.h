@@ -0,0 +1,32 @@
+/*
+ * On-disk cache of assembled objects, keyed by a hash of the source each one
+ * was assembled from, so a rebuild only re-parses the files that changed.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "object.h"
+
+/*
+ * 64 bit hash of `len` bytes of `source`, used as the cache key. Any change
+ * confined to a single aligned 8 byte word always changes the hash.
+ */
+uint64_t asm_cache_hash(const char *source, size_t len);
+
+/*
+ * Same as `asm_object_assemble`, except that the object is loaded from
+ * `cache_dir` if the same source was assembled there before, and saved there
+ * otherwise. `*hit` says which happened. The directory is created if needed.
+ *
+ * The cache never changes the result: a missing, stale or corrupt entry is
+ * just a miss, a failure to save is ignored, and sources that don't assemble
+ * are never cached. A loaded object has no declarations, only the words,
+ * labels and references the linker needs.
+ */
+enum asm_parse_error asm_cache_assemble(const char *cache_dir, const char *source, size_t len,
+					struct asm_object *object, bool *hit);
@@ -0,0 +1,231 @@
+#include "unity.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "object.h"
+
+static char cache_dir[] = "/tmp/hack-cache-test-XXXXXX";
+
+void setUp(void)
+{
+	TEST_ASSERT_NOT_NULL(mkdtemp(cache_dir));
+}
+
+void tearDown(void)
+{
+	DIR *dir = opendir(cache_dir);
+	if (dir != NULL) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			char path[sizeof(cache_dir) + 256];
+			snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+			unlink(path);
+		}
+		closedir(dir);
+	}
+	rmdir(cache_dir);
+	strcpy(cache_dir + strlen(cache_dir) - 6, "XXXXXX");
+}
+
+#define NUM_FILES 3
+
+static const char *files[NUM_FILES] = {
+	"@i\n"
+	"M=1\n"
+	"(LOOP)\n"
+	"@sum\n"
+	"D=M\n"
+	"@END\n"
+	"D;JGT\n",
+
+	"// second file\n"
+	"@i\n"
+	"D=M\n"
+	"@sum\n"
+	"M=D+M\n"
+	"@LOOP\n"
+	"0;JMP\n",
+
+	"(END)\n"
+	"@SCREEN\n"
+	"@later\n"
+	"@END\n"
+	"0;JMP\n",
+};
+
+/*
+ * Assembles `sources` as separate objects, through the cache if `use_cache`,
+ * links them, and returns how many came from the cache.
+ */
+static size_t assemble_files(const char **sources, bool use_cache, uint16_t **words, size_t *num_words)
+{
+	struct asm_object objects[NUM_FILES];
+	size_t hits = 0;
+	for (size_t i = 0; i < NUM_FILES; i++) {
+		enum asm_parse_error err;
+		if (use_cache) {
+			bool hit;
+			err = asm_cache_assemble(cache_dir, sources[i], strlen(sources[i]), &objects[i], &hit);
+			hits += hit;
+		} else {
+			err = asm_object_assemble(sources[i], strlen(sources[i]), &objects[i]);
+		}
+		TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	}
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_objects_link(objects, NUM_FILES, words, num_words));
+	for (size_t i = 0; i < NUM_FILES; i++) {
+		asm_object_destroy(&objects[i]);
+	}
+	return hits;
+}
+
+static void assert_cached_build(const char **sources, size_t expected_hits)
+{
+	uint16_t *expected, *words;
+	size_t num_expected, num_words;
+	assemble_files(sources, false, &expected, &num_expected);
+	TEST_ASSERT_EQUAL_size_t(expected_hits, assemble_files(sources, true, &words, &num_words));
+	TEST_ASSERT_EQUAL_size_t(num_expected, num_words);
+	TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, words, num_words);
+	free(expected);
+	free(words);
+}
+
+void test_cache_hits_link_identically()
+{
+	assert_cached_build(files, 0);
+	assert_cached_build(files, NUM_FILES);
+}
+
+void test_cache_changed_file_misses()
+{
+	assert_cached_build(files, 0);
+
+	const char *edited[NUM_FILES] = {files[0], files[1], files[2]};
+	edited[1] = "// second file\n"
+		    "@i\n"
+		    "D=M\n"
+		    "@total\n"
+		    "M=D+M\n"
+		    "@LOOP\n"
+		    "0;JMP\n";
+	assert_cached_build(edited, NUM_FILES - 1);
+	assert_cached_build(files, NUM_FILES);
+}
+
+void test_cache_corrupt_entry_misses()
+{
+	assert_cached_build(files, 0);
+
+	// Truncate every entry, then garble every entry
+	const char *contents[] = {"", "HACKOBJ\x02 garbage"};
+	for (size_t i = 0; i < sizeof(contents) / sizeof(contents[0]); i++) {
+		DIR *dir = opendir(cache_dir);
+		TEST_ASSERT_NOT_NULL(dir);
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (entry->d_name[0] == '.') {
+				continue;
+			}
+			char path[sizeof(cache_dir) + 256];
+			snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+			FILE *fp = fopen(path, "w");
+			TEST_ASSERT_NOT_NULL(fp);
+			fputs(contents[i], fp);
+			fclose(fp);
+		}
+		closedir(dir);
+
+		assert_cached_build(files, 0);
+		assert_cached_build(files, NUM_FILES);
+	}
+}
+
+void test_cache_hash_collision_misses()
+{
+	// Same length, different code: pass off the first one's entry as the
+	// second one's, as if their hashes collided
+	const char *first = "@1\nD=A\n";
+	const char *second = "@2\nD=A\n";
+	size_t len = strlen(first);
+	struct asm_object object;
+	bool hit;
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_cache_assemble(cache_dir, first, len, &object, &hit));
+	asm_object_destroy(&object);
+
+	uint64_t first_hash = asm_cache_hash(first, len);
+	uint64_t second_hash = asm_cache_hash(second, len);
+	char first_path[sizeof(cache_dir) + 32], second_path[sizeof(cache_dir) + 32];
+	snprintf(first_path, sizeof(first_path), "%s/%016llx.hobj", cache_dir, (unsigned long long) first_hash);
+	snprintf(second_path, sizeof(second_path), "%s/%016llx.hobj", cache_dir, (unsigned long long) second_hash);
+	TEST_ASSERT_EQUAL_INT(0, rename(first_path, second_path));
+	FILE *fp = fopen(second_path, "r+b");
+	TEST_ASSERT_NOT_NULL(fp);
+	TEST_ASSERT_EQUAL_INT(0, fseek(fp, 8, SEEK_SET));
+	TEST_ASSERT_EQUAL_size_t(1, fwrite(&second_hash, sizeof(second_hash), 1, fp));
+	fclose(fp);
+
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_cache_assemble(cache_dir, second, len, &object, &hit));
+	TEST_ASSERT_FALSE(hit);
+	TEST_ASSERT_EQUAL_size_t(2, object.num_words);
+	TEST_ASSERT_EQUAL_HEX16(0x0002, object.words[0]);
+	asm_object_destroy(&object);
+}
+
+void test_cache_empty_source()
+{
+	// An empty file has no data to point at, and still caches like any other
+	for (int i = 0; i < 2; i++) {
+		struct asm_object object;
+		bool hit;
+		TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_cache_assemble(cache_dir, NULL, 0, &object, &hit));
+		TEST_ASSERT_EQUAL_INT(i == 1, hit);
+		TEST_ASSERT_EQUAL_size_t(0, object.num_words);
+		asm_object_destroy(&object);
+	}
+}
+
+void test_cache_skips_errors()
+{
+	const char *source = "@1\nD=Q\n";
+	for (int i = 0; i < 2; i++) {
+		struct asm_object object;
+		bool hit;
+		TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_C_A_COMP_MALFORMED,
+				      asm_cache_assemble(cache_dir, source, strlen(source), &object, &hit));
+		TEST_ASSERT_FALSE(hit);
+		asm_object_destroy(&object);
+	}
+}
+
+void test_cache_hash()
+{
+	// Flipping any single byte changes the hash, and so does the length
+	char source[] = "@SP\nAM=M+1\nA=A-1\nM=D\n";
+	size_t len = strlen(source);
+	uint64_t hash = asm_cache_hash(source, len);
+	TEST_ASSERT_TRUE(hash != asm_cache_hash(source, len - 1));
+	for (size_t i = 0; i < len; i++) {
+		source[i] ^= 1;
+		TEST_ASSERT_TRUE(hash != asm_cache_hash(source, len));
+		source[i] ^= 1;
+	}
+	TEST_ASSERT_TRUE(hash == asm_cache_hash(source, len));
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_cache_hits_link_identically);
+	RUN_TEST(test_cache_changed_file_misses);
+	RUN_TEST(test_cache_corrupt_entry_misses);
+	RUN_TEST(test_cache_hash_collision_misses);
+	RUN_TEST(test_cache_empty_source);
+	RUN_TEST(test_cache_skips_errors);
+	RUN_TEST(test_cache_hash);
+	return UNITY_END();
+}
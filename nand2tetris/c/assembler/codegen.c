@@ -0,0 +1,275 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen.h"
+#include "parser.h"
+
+/*
+ * `a cccccc` bits for each comp, indexed by `enum asm_c_a_comp`.
+ */
+static const uint16_t comp_bits[] = {
+	[ASM_C_A_COMP_ZERO] = 0x2A,        // 0 101010
+	[ASM_C_A_COMP_ONE] = 0x3F,         // 0 111111
+	[ASM_C_A_COMP_NEG_ONE] = 0x3A,     // 0 111010
+	[ASM_C_A_COMP_D] = 0x0C,           // 0 001100
+	[ASM_C_A_COMP_A] = 0x30,           // 0 110000
+	[ASM_C_A_COMP_M] = 0x70,           // 1 110000
+	[ASM_C_A_COMP_NOT_D] = 0x0D,       // 0 001101
+	[ASM_C_A_COMP_NOT_A] = 0x31,       // 0 110001
+	[ASM_C_A_COMP_NOT_M] = 0x71,       // 1 110001
+	[ASM_C_A_COMP_NEG_D] = 0x0F,       // 0 001111
+	[ASM_C_A_COMP_NEG_A] = 0x33,       // 0 110011
+	[ASM_C_A_COMP_NEG_M] = 0x73,       // 1 110011
+	[ASM_C_A_COMP_D_PLUS_ONE] = 0x1F,  // 0 011111
+	[ASM_C_A_COMP_A_PLUS_ONE] = 0x37,  // 0 110111
+	[ASM_C_A_COMP_M_PLUS_ONE] = 0x77,  // 1 110111
+	[ASM_C_A_COMP_D_MINUS_ONE] = 0x0E, // 0 001110
+	[ASM_C_A_COMP_A_MINUS_ONE] = 0x32, // 0 110010
+	[ASM_C_A_COMP_M_MINUS_ONE] = 0x72, // 1 110010
+	[ASM_C_A_COMP_D_PLUS_A] = 0x02,    // 0 000010
+	[ASM_C_A_COMP_D_PLUS_M] = 0x42,    // 1 000010
+	[ASM_C_A_COMP_D_MINUS_A] = 0x13,   // 0 010011
+	[ASM_C_A_COMP_D_MINUS_M] = 0x53,   // 1 010011
+	[ASM_C_A_COMP_A_MINUS_D] = 0x07,   // 0 000111
+	[ASM_C_A_COMP_M_MINUS_D] = 0x47,   // 1 000111
+	[ASM_C_A_COMP_D_AND_A] = 0x00,     // 0 000000
+	[ASM_C_A_COMP_D_AND_M] = 0x40,     // 1 000000
+	[ASM_C_A_COMP_D_OR_A] = 0x15,      // 0 010101
+	[ASM_C_A_COMP_D_OR_M] = 0x55,      // 1 010101
+};
+
+/*
+ * `ddd` bits for each dest, indexed by `enum asm_c_dest`.
+ */
+static const uint16_t dest_bits[] = {
+	[ASM_C_DEST_NULL] = 0x0,
+	[ASM_C_DEST_M] = 0x1,
+	[ASM_C_DEST_D] = 0x2,
+	[ASM_C_DEST_MD] = 0x3,
+	[ASM_C_DEST_A] = 0x4,
+	[ASM_C_DEST_AM] = 0x5,
+	[ASM_C_DEST_AD] = 0x6,
+	[ASM_C_DEST_AMD] = 0x7,
+};
+
+/*
+ * `jjj` bits for each jump, indexed by `enum asm_c_jump`.
+ */
+static const uint16_t jump_bits[] = {
+	[ASM_C_JUMP_NULL] = 0x0,
+	[ASM_C_JUMP_JGT] = 0x1,
+	[ASM_C_JUMP_JEQ] = 0x2,
+	[ASM_C_JUMP_JGE] = 0x3,
+	[ASM_C_JUMP_JLT] = 0x4,
+	[ASM_C_JUMP_JNE] = 0x5,
+	[ASM_C_JUMP_JLE] = 0x6,
+	[ASM_C_JUMP_JMP] = 0x7,
+};
+
+uint16_t asm_instruction_encode(const struct asm_instruction *instruction)
+{
+	switch (instruction->type) {
+	case ASM_INST_A:
+		// 0 vvvvvvvvvvvvvvv
+		if (instruction->a_instruction.type == ASM_A_INST_ADDRESS) {
+			return instruction->a_instruction.address;
+		}
+		return instruction->a_instruction.label->value & 0x7FFF;
+	case ASM_INST_C:
+		// 111 a cccccc ddd jjj
+		return 0xE000 |
+			comp_bits[instruction->c_instruction.a_comp] << 6 |
+			dest_bits[instruction->c_instruction.dest] << 3 |
+			jump_bits[instruction->c_instruction.jump];
+	}
+	return 0;
+}
+
+size_t asm_declarations_encode(const asm_declarations *declarations, uint16_t *words)
+{
+	size_t len = 0;
+	for (size_t i = 0; i < declarations->len; i++) {
+		const struct asm_declaration *declaration = &declarations->declarations[i];
+		if (declaration->type == ASM_DECL_INSTRUCTION) {
+			words[len++] = asm_instruction_encode(&declaration->instruction);
+		}
+	}
+	return len;
+}
+
+/*
+ * Size of the staging buffer for formatted output. Multiple of both the text
+ * (17 bytes) and binary (2 bytes) word sizes.
+ */
+#define HACK_WRITE_BUFFER_WORDS 4096
+
+static bool flush(FILE *fp, const char *buffer, size_t len)
+{
+	return fwrite(buffer, 1, len, fp) == len;
+}
+
+/*
+ * Each byte of a word expands to 8 characters, so all 256 expansions are
+ * spelled out here instead of testing 16 bits per word. Built by the
+ * compiler, so there's nothing to initialize when several threads write.
+ */
+#define BYTE_BIT(b, bit) (((b) >> (bit)) & 1 ? '1' : '0')
+#define BYTE_CHARS(b) \
+	{BYTE_BIT(b, 7), BYTE_BIT(b, 6), BYTE_BIT(b, 5), BYTE_BIT(b, 4), \
+	 BYTE_BIT(b, 3), BYTE_BIT(b, 2), BYTE_BIT(b, 1), BYTE_BIT(b, 0)}
+#define BYTE_CHARS_2(b) BYTE_CHARS(b), BYTE_CHARS((b) + 1)
+#define BYTE_CHARS_4(b) BYTE_CHARS_2(b), BYTE_CHARS_2((b) + 2)
+#define BYTE_CHARS_8(b) BYTE_CHARS_4(b), BYTE_CHARS_4((b) + 4)
+#define BYTE_CHARS_16(b) BYTE_CHARS_8(b), BYTE_CHARS_8((b) + 8)
+#define BYTE_CHARS_32(b) BYTE_CHARS_16(b), BYTE_CHARS_16((b) + 16)
+#define BYTE_CHARS_64(b) BYTE_CHARS_32(b), BYTE_CHARS_32((b) + 32)
+#define BYTE_CHARS_128(b) BYTE_CHARS_64(b), BYTE_CHARS_64((b) + 64)
+
+static const char byte_chars[256][8] = {BYTE_CHARS_128(0), BYTE_CHARS_128(128)};
+
+static bool hack_write_text(FILE *fp, const uint16_t *words, size_t len)
+{
+	char buffer[HACK_WRITE_BUFFER_WORDS * 17];
+	size_t used = 0;
+	for (size_t i = 0; i < len; i++) {
+		char *out = buffer + used;
+		memcpy(out, byte_chars[words[i] >> 8], 8);
+		memcpy(out + 8, byte_chars[words[i] & 0xFF], 8);
+		out[16] = '\n';
+		used += 17;
+
+		if (used == sizeof(buffer)) {
+			if (!flush(fp, buffer, used)) {
+				return false;
+			}
+			used = 0;
+		}
+	}
+	return flush(fp, buffer, used);
+}
+
+static bool hack_write_binary(FILE *fp, const uint16_t *words, size_t len)
+{
+	char buffer[HACK_WRITE_BUFFER_WORDS * 2];
+	size_t used = 0;
+	for (size_t i = 0; i < len; i++) {
+		buffer[used++] = words[i] >> 8;
+		buffer[used++] = words[i] & 0xFF;
+
+		if (used == sizeof(buffer)) {
+			if (!flush(fp, buffer, used)) {
+				return false;
+			}
+			used = 0;
+		}
+	}
+	return flush(fp, buffer, used);
+}
+
+bool hack_write(FILE *fp, const uint16_t *words, size_t len, enum hack_output_format format)
+{
+	switch (format) {
+	case HACK_OUTPUT_TEXT:
+		return hack_write_text(fp, words, len);
+	case HACK_OUTPUT_BINARY:
+		return hack_write_binary(fp, words, len);
+	}
+	return false;
+}
+
+bool asm_instruction_decode(uint16_t word, struct asm_instruction *instruction)
+{
+	if (!(word & 0x8000)) {
+		*instruction = (struct asm_instruction) {
+			.type = ASM_INST_A,
+			.a_instruction = {.type = ASM_A_INST_ADDRESS, .address = word},
+		};
+		return true;
+	}
+
+	// The dest and jump tables above are the identity, so only the comp
+	// needs looking up. Bits 13 and 14 are ignored, like the CPU does.
+	uint16_t comp = (word >> 6) & 0x7F;
+	for (size_t i = 0; i < sizeof(comp_bits) / sizeof(comp_bits[0]); i++) {
+		if (comp_bits[i] == comp) {
+			*instruction = (struct asm_instruction) {
+				.type = ASM_INST_C,
+				.c_instruction = {
+					.dest = (word >> 3) & 0x7,
+					.a_comp = i,
+					.jump = word & 0x7,
+				},
+			};
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Parses lines of exactly 16 '0'/'1' characters. Blank lines (and a missing
+ * final newline, or CRLF endings) are fine.
+ */
+static bool hack_read_text(const char *data, size_t len, uint16_t *words, size_t *num_words)
+{
+	size_t count = 0;
+	size_t i = 0;
+	while (i < len) {
+		size_t start = i;
+		uint16_t word = 0;
+		while (i < len && (data[i] == '0' || data[i] == '1')) {
+			word = word << 1 | (data[i] - '0');
+			i++;
+		}
+		size_t digits = i - start;
+		if (i < len && data[i] == '\r') {
+			i++;
+		}
+		if (i < len && data[i] != '\n') {
+			return false;
+		}
+		i++;
+
+		if (digits == 16) {
+			words[count++] = word;
+		} else if (digits != 0) {
+			return false;
+		}
+	}
+	*num_words = count;
+	return true;
+}
+
+bool hack_read(const char *data, size_t len, enum hack_output_format format, uint16_t **words, size_t *num_words)
+{
+	// Text needs at least 17 bytes per word, binary 2
+	uint16_t *read = malloc((len / 2 + 1) * sizeof(uint16_t));
+	if (read == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	bool ok = false;
+	switch (format) {
+	case HACK_OUTPUT_TEXT:
+		ok = hack_read_text(data, len, read, num_words);
+		break;
+	case HACK_OUTPUT_BINARY:
+		ok = len % 2 == 0;
+		for (size_t i = 0; ok && i < len / 2; i++) {
+			read[i] = (uint16_t) (unsigned char) data[2 * i] << 8 | (unsigned char) data[2 * i + 1];
+		}
+		*num_words = len / 2;
+		break;
+	}
+
+	if (!ok) {
+		free(read);
+		return false;
+	}
+	*words = read;
+	return true;
+}
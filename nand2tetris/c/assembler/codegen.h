@@ -0,0 +1,54 @@
+/*
+ * Hack machine code generation.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "parser.h"
+
+/*
+ * Output formats for assembled programs.
+ */
+enum hack_output_format {
+	/** The course's .hack format: one line of 16 '0'/'1' characters per word */
+	HACK_OUTPUT_TEXT,
+	/** Raw 16 bit words, big endian, no separators */
+	HACK_OUTPUT_BINARY,
+};
+
+/*
+ * Encodes a single instruction as a 16 bit Hack word. A instructions that
+ * reference a symbol use its resolved value, so symbols must be resolved first.
+ */
+uint16_t asm_instruction_encode(const struct asm_instruction *instruction);
+
+/*
+ * Turns a Hack word back into an instruction, the inverse of
+ * `asm_instruction_encode` (A instructions always come back as addresses).
+ * Returns false if the comp bits aren't one of the 28 valid computations.
+ */
+bool asm_instruction_decode(uint16_t word, struct asm_instruction *instruction);
+
+/*
+ * Encodes every instruction in `declarations` (skipping labels) into `words`,
+ * which must have room for `declarations->len` words. Returns the number of
+ * words written.
+ */
+size_t asm_declarations_encode(const asm_declarations *declarations, uint16_t *words);
+
+/*
+ * Writes `len` words to `fp` in the given format. Returns false and sets errno
+ * if writing fails.
+ */
+bool hack_write(FILE *fp, const uint16_t *words, size_t len, enum hack_output_format format);
+
+/*
+ * Reads `len` bytes of a program written by `hack_write` in the given format.
+ * Returns false if it's malformed; otherwise `*words` is a malloced array of
+ * `*num_words` words.
+ */
+bool hack_read(const char *data, size_t len, enum hack_output_format format, uint16_t **words, size_t *num_words);
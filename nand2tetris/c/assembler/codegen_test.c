@@ -0,0 +1,181 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "codegen.h"
+#include "parser.h"
+#include "resolver.h"
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+
+/*
+ * Parses, resolves and encodes `source`, returning the number of words.
+ */
+static size_t assemble(const char *source, uint16_t *words)
+{
+	asm_declarations declarations = asm_declarations_create(0);
+	enum asm_parse_error err = parse_asm_declarations(source, strlen(source), &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	err = asm_resolve_symbols(&declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	size_t len = asm_declarations_encode(&declarations, words);
+	asm_declarations_destroy(declarations);
+	return len;
+}
+
+void test_encode_add_program()
+{
+	// projects/06/add/Add.asm, with its CRLF line endings
+	const char *source = "// Computes R0 = 2 + 3  (R0 refers to RAM[0])\r\n"
+			     "\r\n"
+			     "@2\r\n"
+			     "D=A\r\n"
+			     "@3\r\n"
+			     "D=D+A\r\n"
+			     "@0\r\n"
+			     "M=D\r\n";
+	uint16_t expected[] = {
+		0x0002, // 0000000000000010
+		0xEC10, // 1110110000010000
+		0x0003, // 0000000000000011
+		0xE090, // 1110000010010000
+		0x0000, // 0000000000000000
+		0xE308, // 1110001100001000
+	};
+
+	uint16_t words[16];
+	size_t len = assemble(source, words);
+	TEST_ASSERT_EQUAL_size_t(6, len);
+	TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, words, 6);
+}
+
+void test_encode_symbols()
+{
+	const char *source = "(START)\n"
+			     "@i\n"
+			     "M=1\n"
+			     "@SCREEN\n"
+			     "(LOOP)\n"
+			     "@LOOP\n"
+			     "0;JMP\n"
+			     "@START\n";
+	uint16_t expected[] = {
+		16,
+		0xEFC8, // 111 0 111111 001 000
+		16384,
+		3,
+		0xEA87, // 111 0 101010 000 111
+		0,
+	};
+
+	uint16_t words[16];
+	size_t len = assemble(source, words);
+	TEST_ASSERT_EQUAL_size_t(6, len);
+	TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, words, 6);
+}
+
+void test_encode_all_comps()
+{
+	// Straight from the comp table in chapter 4 of the book
+	const struct {
+		const char *comp;
+		const char *bits;
+	} comps[] = {
+		{"0", "0101010"}, {"1", "0111111"}, {"-1", "0111010"},
+		{"D", "0001100"}, {"A", "0110000"}, {"M", "1110000"},
+		{"!D", "0001101"}, {"!A", "0110001"}, {"!M", "1110001"},
+		{"-D", "0001111"}, {"-A", "0110011"}, {"-M", "1110011"},
+		{"D+1", "0011111"}, {"A+1", "0110111"}, {"M+1", "1110111"},
+		{"D-1", "0001110"}, {"A-1", "0110010"}, {"M-1", "1110010"},
+		{"D+A", "0000010"}, {"D+M", "1000010"},
+		{"D-A", "0010011"}, {"D-M", "1010011"},
+		{"A-D", "0000111"}, {"M-D", "1000111"},
+		{"D&A", "0000000"}, {"D&M", "1000000"},
+		{"D|A", "0010101"}, {"D|M", "1010101"},
+	};
+
+	for (size_t i = 0; i < sizeof(comps) / sizeof(comps[0]); i++) {
+		char source[16];
+		snprintf(source, sizeof(source), "AMD=%s;JMP", comps[i].comp);
+
+		uint16_t expected = 0xE000 | strtol(comps[i].bits, NULL, 2) << 6 | 0x7 << 3 | 0x7;
+		uint16_t word;
+		TEST_ASSERT_EQUAL_size_t(1, assemble(source, &word));
+		TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected, word, comps[i].comp);
+	}
+}
+
+void test_hack_write()
+{
+	uint16_t words[] = {0x0002, 0xEC10};
+
+	char *buffer = NULL;
+	size_t size = 0;
+	FILE *fp = open_memstream(&buffer, &size);
+	TEST_ASSERT_TRUE(hack_write(fp, words, 2, HACK_OUTPUT_TEXT));
+	fclose(fp);
+	TEST_ASSERT_EQUAL_STRING("0000000000000010\n1110110000010000\n", buffer);
+	free(buffer);
+
+	fp = open_memstream(&buffer, &size);
+	TEST_ASSERT_TRUE(hack_write(fp, words, 2, HACK_OUTPUT_BINARY));
+	fclose(fp);
+	TEST_ASSERT_EQUAL_size_t(4, size);
+	const char expected[] = {0x00, 0x02, (char) 0xEC, 0x10};
+	TEST_ASSERT_EQUAL_MEMORY(expected, buffer, 4);
+	free(buffer);
+}
+
+void test_decode_round_trip()
+{
+	// Every valid comp with every dest and jump, plus A instructions
+	size_t num_valid = 0;
+	for (uint32_t word = 0; word <= 0xFFFF; word++) {
+		struct asm_instruction instruction;
+		// The two unused bits of a C instruction are always written as ones
+		if ((word & 0x8000) && (word & 0x6000) != 0x6000) {
+			continue;
+		}
+		if (asm_instruction_decode(word, &instruction)) {
+			TEST_ASSERT_EQUAL_HEX16(word, asm_instruction_encode(&instruction));
+			num_valid++;
+		}
+	}
+	TEST_ASSERT_EQUAL_size_t(32768 + 28 * 8 * 8, num_valid);
+}
+
+void test_hack_read()
+{
+	uint16_t *words;
+	size_t num_words;
+	const char text[] = "0000000000000010\r\n\n1110110000010000\n";
+	TEST_ASSERT_TRUE(hack_read(text, strlen(text), HACK_OUTPUT_TEXT, &words, &num_words));
+	TEST_ASSERT_EQUAL_size_t(2, num_words);
+	TEST_ASSERT_EQUAL_HEX16(0x0002, words[0]);
+	TEST_ASSERT_EQUAL_HEX16(0xEC10, words[1]);
+	free(words);
+
+	const char binary[] = {0x00, 0x02, (char) 0xEC, 0x10};
+	TEST_ASSERT_TRUE(hack_read(binary, 4, HACK_OUTPUT_BINARY, &words, &num_words));
+	TEST_ASSERT_EQUAL_size_t(2, num_words);
+	TEST_ASSERT_EQUAL_HEX16(0xEC10, words[1]);
+	free(words);
+
+	TEST_ASSERT_FALSE(hack_read("000000000000001\n", 16, HACK_OUTPUT_TEXT, &words, &num_words));
+	TEST_ASSERT_FALSE(hack_read("000000000000002\n", 16, HACK_OUTPUT_TEXT, &words, &num_words));
+	TEST_ASSERT_FALSE(hack_read(binary, 3, HACK_OUTPUT_BINARY, &words, &num_words));
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_encode_add_program);
+	RUN_TEST(test_encode_symbols);
+	RUN_TEST(test_encode_all_comps);
+	RUN_TEST(test_hack_write);
+	RUN_TEST(test_decode_round_trip);
+	RUN_TEST(test_hack_read);
+	return UNITY_END();
+}
@@ -15,6 +15,9 @@ enum asm_parse_error {
 	ASM_PARSE_ERROR_A_INSTRUCTION_MISSING_AT_SYMBOL,
 	ASM_PARSE_ERROR_A_INSTRUCTION_ADDRESS_TOO_LARGE,
 
+	ASM_PARSE_ERROR_LABEL_MALFORMED,
+	ASM_PARSE_ERROR_LABEL_REDEFINED,
+
 	ASM_PARSE_ERROR_C_MALFORMED,
 	ASM_PARSE_ERROR_C_DEST_MALFORMED,
 	ASM_PARSE_ERROR_C_A_COMP_MALFORMED,
@@ -0,0 +1,119 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "input.h"
+
+/*
+ * Chunk size used when streaming input we can't mmap. Much larger than a page
+ * so a few hundred MB of generated assembly only takes a handful of reads and
+ * reallocs.
+ */
+#define ASM_INPUT_STREAM_CHUNK (1 << 20)
+
+bool asm_input_read_stream(FILE *fp, struct asm_input *input)
+{
+	size_t capacity = 0;
+	size_t len = 0;
+	char *data = NULL;
+
+	while (true) {
+		// Grow geometrically so total copying stays linear in input size
+		if (capacity - len < ASM_INPUT_STREAM_CHUNK) {
+			capacity = capacity == 0 ? ASM_INPUT_STREAM_CHUNK : capacity * 2;
+			char *new_data = realloc(data, capacity);
+			if (new_data == NULL) {
+				free(data);
+				return false;
+			}
+			data = new_data;
+		}
+
+		size_t n = fread(data + len, 1, capacity - len, fp);
+		len += n;
+		if (n == 0) {
+			break;
+		}
+	}
+
+	if (ferror(fp)) {
+		int saved_errno = errno;
+		free(data);
+		errno = saved_errno;
+		return false;
+	}
+
+	input->data = data;
+	input->len = len;
+	input->mapped = false;
+	return true;
+}
+
+bool asm_input_open(const char *path, struct asm_input *input)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return false;
+	}
+
+	// mmap refuses zero-length mappings, so empty files are just empty
+	// views.
+	if (S_ISREG(st.st_mode) && st.st_size == 0) {
+		close(fd);
+		input->data = NULL;
+		input->len = 0;
+		input->mapped = false;
+		return true;
+	}
+
+	// mmap only works on regular files. Anything else gets streamed.
+	if (S_ISREG(st.st_mode)) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			// We parse strictly front to back, so let the kernel read
+			// ahead aggressively.
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+			input->data = data;
+			input->len = st.st_size;
+			input->mapped = true;
+			return true;
+		}
+	}
+
+	FILE *fp = fdopen(fd, "r");
+	if (fp == NULL) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return false;
+	}
+	bool ok = asm_input_read_stream(fp, input);
+	fclose(fp);
+	return ok;
+}
+
+void asm_input_close(struct asm_input *input)
+{
+	if (input->mapped) {
+		munmap((void *) input->data, input->len);
+	} else {
+		free((void *) input->data);
+	}
+	input->data = NULL;
+	input->len = 0;
+	input->mapped = false;
+}
@@ -0,0 +1,35 @@
+/*
+ * Loads assembler source into memory as a length-bounded, read-only view.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Source text handed to the parser. The data is NOT guaranteed to be NUL
+ * terminated, so always use `len`.
+ */
+struct asm_input {
+	const char *data;
+	size_t len;
+	/** True if `data` is an mmap of the file, false if it was malloced. */
+	bool mapped;
+};
+
+/*
+ * Opens `path` and maps it read-only. Falls back to streaming the file into a
+ * buffer if it can't be mapped (pipes, character devices, etc). Returns false
+ * and sets errno on failure.
+ */
+bool asm_input_open(const char *path, struct asm_input *input);
+
+/*
+ * Reads all of `fp` into a heap buffer in large chunks. Used for stdin and
+ * other unmappable inputs. Returns false and sets errno on failure.
+ */
+bool asm_input_read_stream(FILE *fp, struct asm_input *input);
+
+void asm_input_close(struct asm_input *input);
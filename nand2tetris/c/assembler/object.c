@@ -0,0 +1,174 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+#include "codegen.h"
+#include "error.h"
+#include "object.h"
+#include "parser.h"
+#include "resolver.h"
+#include "symbol_table.h"
+
+static bool is_reference(const struct asm_declaration *declaration)
+{
+	return declaration->type == ASM_DECL_INSTRUCTION &&
+		declaration->instruction.type == ASM_INST_A &&
+		declaration->instruction.a_instruction.type == ASM_A_INST_LABEL;
+}
+
+enum asm_parse_error asm_object_assemble(const char *source, size_t len, struct asm_object *object)
+{
+	*object = (struct asm_object) {.declarations = asm_declarations_create(len)};
+	asm_declarations *declarations = &object->declarations;
+
+	enum asm_parse_error err = parse_asm_declarations(source, len, declarations);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		return err;
+	}
+
+	// Count first so every array is a single exact allocation
+	size_t num_words = 0, num_labels = 0, num_references = 0;
+	for (size_t i = 0; i < declarations->len; i++) {
+		const struct asm_declaration *declaration = &declarations->declarations[i];
+		if (declaration->type == ASM_DECL_LABEL) {
+			num_labels++;
+		} else {
+			num_words++;
+			num_references += is_reference(declaration);
+		}
+	}
+
+	struct arena *arena = &declarations->arena;
+	object->words = arena_alloc(arena, num_words * sizeof(uint16_t), alignof(uint16_t));
+	object->labels = arena_alloc(arena, num_labels * sizeof(struct asm_fixup), alignof(struct asm_fixup));
+	object->references = arena_alloc(arena, num_references * sizeof(struct asm_fixup), alignof(struct asm_fixup));
+
+	for (size_t i = 0; i < declarations->len; i++) {
+		const struct asm_declaration *declaration = &declarations->declarations[i];
+		if (declaration->type == ASM_DECL_LABEL) {
+			object->labels[object->num_labels++] = (struct asm_fixup) {
+				.symbol = declaration->label,
+				.index = object->num_words,
+			};
+		} else if (is_reference(declaration)) {
+			object->references[object->num_references++] = (struct asm_fixup) {
+				.symbol = declaration->instruction.a_instruction.label,
+				.index = object->num_words,
+			};
+			object->words[object->num_words++] = 0;
+		} else {
+			object->words[object->num_words++] = asm_instruction_encode(&declaration->instruction);
+		}
+	}
+
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
+
+void asm_object_destroy(struct asm_object *object)
+{
+	asm_declarations_destroy(object->declarations);
+}
+
+/*
+ * Binds every label to its final ROM address in a program-wide symbol table.
+ * This mirrors the first pass of `asm_resolve_symbols`.
+ */
+static enum asm_parse_error link_labels(struct asm_object *objects, size_t num_objects,
+					struct asm_symbol_table *symbols, struct arena *arena)
+{
+	size_t base = 0;
+	for (size_t i = 0; i < num_objects; i++) {
+		const struct asm_object *object = &objects[i];
+		for (size_t j = 0; j < object->num_labels; j++) {
+			const struct asm_symbol *local = object->labels[j].symbol;
+			struct asm_symbol *symbol = asm_symbol_table_intern(symbols, arena, local->name, local->len);
+			if (symbol->kind != ASM_SYMBOL_UNRESOLVED) {
+				return ASM_PARSE_ERROR_LABEL_REDEFINED;
+			}
+			symbol->kind = ASM_SYMBOL_LABEL;
+			symbol->value = base + object->labels[j].index;
+		}
+		base += object->num_words;
+	}
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
+
+/*
+ * Copies each object's words into place and patches its references,
+ * allocating variables as they are first seen. This mirrors the second pass of
+ * `asm_resolve_symbols`.
+ *
+ * Each object's own symbols are used as a cache: the first reference to a
+ * symbol in an object looks it up in the program-wide table and copies the
+ * result over, so later references from the same object don't hash again.
+ * Builtins were resolved when the object interned them and never need the
+ * program-wide table at all.
+ */
+static enum asm_parse_error link_references(struct asm_object *objects, size_t num_objects,
+					    struct asm_symbol_table *symbols, struct arena *arena,
+					    uint16_t *words)
+{
+	uint32_t next_variable = ASM_FIRST_VARIABLE_ADDRESS;
+	size_t base = 0;
+	for (size_t i = 0; i < num_objects; i++) {
+		const struct asm_object *object = &objects[i];
+		memcpy(words + base, object->words, object->num_words * sizeof(uint16_t));
+
+		for (size_t j = 0; j < object->num_references; j++) {
+			struct asm_symbol *local = object->references[j].symbol;
+			if (local->kind == ASM_SYMBOL_UNRESOLVED) {
+				struct asm_symbol *symbol = asm_symbol_table_intern(symbols, arena, local->name, local->len);
+				if (symbol->kind == ASM_SYMBOL_UNRESOLVED) {
+					symbol->kind = ASM_SYMBOL_VARIABLE;
+					symbol->value = next_variable++;
+				}
+				local->kind = symbol->kind;
+				local->value = symbol->value;
+			}
+
+			if (local->value > ASM_MAX_ADDRESS) {
+				return ASM_PARSE_ERROR_A_INSTRUCTION_ADDRESS_TOO_LARGE;
+			}
+			words[base + object->references[j].index] = local->value;
+		}
+		base += object->num_words;
+	}
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
+
+enum asm_parse_error asm_objects_link(struct asm_object *objects, size_t num_objects,
+				      uint16_t **words, size_t *num_words)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < num_objects; i++) {
+		total += objects[i].num_words;
+	}
+
+	uint16_t *linked = malloc(total * sizeof(uint16_t) + 1);
+	if (linked == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	struct arena arena;
+	arena_init(&arena, 0);
+	struct asm_symbol_table symbols;
+	asm_symbol_table_init(&symbols);
+
+	enum asm_parse_error err = link_labels(objects, num_objects, &symbols, &arena);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = link_references(objects, num_objects, &symbols, &arena, linked);
+	}
+	arena_destroy(&arena);
+
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		free(linked);
+		return err;
+	}
+	*words = linked;
+	*num_words = total;
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
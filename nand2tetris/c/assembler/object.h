@@ -0,0 +1,62 @@
+/*
+ * Relocatable objects: a piece of a program encoded on its own, with the
+ * symbol references it couldn't resolve left as fixups for the linker.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+#include "parser.h"
+#include "symbol_table.h"
+
+/*
+ * A symbol at a word index within an object. For label definitions `index` is
+ * the address of the instruction after the label relative to the start of the
+ * object; for references it is the A instruction word to patch.
+ */
+struct asm_fixup {
+	struct asm_symbol *symbol;
+	size_t index;
+};
+
+struct asm_object {
+	/** Owns the arena everything below is allocated from, and the symbols */
+	asm_declarations declarations;
+
+	/** Encoded words, with 0 in place of every symbolic A instruction */
+	uint16_t *words;
+	size_t num_words;
+
+	/** (LABEL) declarations in source order */
+	struct asm_fixup *labels;
+	size_t num_labels;
+
+	/** Symbolic A instructions in source order */
+	struct asm_fixup *references;
+	size_t num_references;
+};
+
+/*
+ * Parses and encodes `len` bytes of `source` into `object` without resolving
+ * any symbols, so pieces of one program can be assembled independently. Must
+ * be destroyed with `asm_object_destroy` even on error.
+ */
+enum asm_parse_error asm_object_assemble(const char *source, size_t len, struct asm_object *object);
+
+void asm_object_destroy(struct asm_object *object);
+
+/*
+ * Links `num_objects` objects, in order, into a single program: each object's
+ * words are placed after the previous one's, labels are bound to their final
+ * ROM addresses, variables are allocated from 16 in order of first use across
+ * all objects, and references are patched. The result is identical to
+ * assembling the concatenated sources in one go, including which error is
+ * reported.
+ *
+ * On success `*words` is a malloced array of `*num_words` words.
+ */
+enum asm_parse_error asm_objects_link(struct asm_object *objects, size_t num_objects,
+				      uint16_t **words, size_t *num_words);
@@ -0,0 +1,246 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "optimize.h"
+#include "parser.h"
+#include "symbol_table.h"
+
+/*
+ * Bits of `enum asm_c_dest`, which is laid out like the ddd field.
+ */
+#define DEST_A_BIT 4
+
+static bool is_label(const struct asm_declaration *declaration)
+{
+	return declaration->type == ASM_DECL_LABEL;
+}
+
+static bool is_a(const struct asm_declaration *declaration)
+{
+	return declaration->type == ASM_DECL_INSTRUCTION && declaration->instruction.type == ASM_INST_A;
+}
+
+/*
+ * True for exactly `dest=comp`, with no jump.
+ */
+static bool is_c(const struct asm_declaration *declaration, enum asm_c_dest dest, enum asm_c_a_comp a_comp)
+{
+	if (declaration->type != ASM_DECL_INSTRUCTION || declaration->instruction.type != ASM_INST_C) {
+		return false;
+	}
+	const struct asm_c_instruction *c = &declaration->instruction.c_instruction;
+	return c->dest == dest && c->a_comp == a_comp && c->jump == ASM_C_JUMP_NULL;
+}
+
+static bool writes_a(const struct asm_declaration *declaration)
+{
+	return declaration->type == ASM_DECL_INSTRUCTION && declaration->instruction.type == ASM_INST_C &&
+		(declaration->instruction.c_instruction.dest & DEST_A_BIT);
+}
+
+/*
+ * Gets the value of an A instruction if it's already known before symbols are
+ * resolved, which is for numbers and predefined symbols.
+ */
+static bool a_constant(const struct asm_a_instruction *a, uint16_t *value)
+{
+	if (a->type == ASM_A_INST_ADDRESS) {
+		*value = a->address;
+		return true;
+	}
+	if (a->label->kind == ASM_SYMBOL_BUILTIN) {
+		*value = a->label->value;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * True if both A instructions certainly load the same value. Symbols are
+ * interned, so the same name is the same pointer.
+ */
+static bool same_a(const struct asm_a_instruction *x, const struct asm_a_instruction *y)
+{
+	uint16_t x_value, y_value;
+	if (a_constant(x, &x_value) && a_constant(y, &y_value)) {
+		return x_value == y_value;
+	}
+	return x->type == ASM_A_INST_LABEL && y->type == ASM_A_INST_LABEL && x->label == y->label;
+}
+
+static bool is_sp(const struct asm_declaration *declaration)
+{
+	uint16_t value;
+	return is_a(declaration) && a_constant(&declaration->instruction.a_instruction, &value) && value == 0;
+}
+
+static bool is_push_pop(const struct asm_declaration *d)
+{
+	return is_sp(&d[0]) && is_c(&d[1], ASM_C_DEST_A, ASM_C_A_COMP_M) && is_c(&d[2], ASM_C_DEST_M, ASM_C_A_COMP_D) &&
+		is_sp(&d[3]) && is_c(&d[4], ASM_C_DEST_M, ASM_C_A_COMP_M_PLUS_ONE) &&
+		is_sp(&d[5]) && is_c(&d[6], ASM_C_DEST_AM, ASM_C_A_COMP_M_MINUS_ONE) &&
+		is_c(&d[7], ASM_C_DEST_D, ASM_C_A_COMP_M);
+}
+
+#define PUSH_POP_LEN 8
+
+/*
+ * State of one pass: declarations are read at `in` and written back at `out`,
+ * which never gets ahead of `in`, so the array is compacted in place.
+ */
+struct pass {
+	struct asm_declaration *declarations;
+	size_t len;
+	size_t in;
+	size_t out;
+
+	/** What the last A instruction emitted loaded, if A hasn't changed since */
+	bool a_known;
+	struct asm_a_instruction a;
+};
+
+static void emit(struct pass *pass, struct asm_declaration declaration)
+{
+	if (is_label(&declaration) || writes_a(&declaration)) {
+		pass->a_known = false;
+	} else if (is_a(&declaration)) {
+		pass->a_known = true;
+		pass->a = declaration.instruction.a_instruction;
+	}
+	pass->declarations[pass->out++] = declaration;
+}
+
+static void emit_c(struct pass *pass, enum asm_c_dest dest, enum asm_c_a_comp a_comp)
+{
+	emit(pass, (struct asm_declaration) {
+		.type = ASM_DECL_INSTRUCTION,
+		.instruction = {
+			.type = ASM_INST_C,
+			.c_instruction = {.dest = dest, .a_comp = a_comp, .jump = ASM_C_JUMP_NULL},
+		},
+	});
+}
+
+/*
+ * Tries every rule at `pass->in`. Returns the rule that fired, having consumed
+ * its window and emitted the replacement, or ASM_PEEPHOLE_NUM_RULES if none did.
+ */
+static enum asm_peephole_rule apply_rules(struct pass *pass)
+{
+	struct asm_declaration *d = &pass->declarations[pass->in];
+	size_t left = pass->len - pass->in;
+
+	if (left >= PUSH_POP_LEN && is_push_pop(d)) {
+		pass->in += PUSH_POP_LEN;
+		if (pass->in == pass->len || !is_a(&pass->declarations[pass->in])) {
+			emit(pass, d[0]);
+			emit_c(pass, ASM_C_DEST_A, ASM_C_A_COMP_M);
+		}
+		return ASM_PEEPHOLE_PUSH_POP;
+	}
+
+	if (is_a(d)) {
+		if (left >= 2 && is_a(&d[1])) {
+			pass->in++;
+			return ASM_PEEPHOLE_DEAD_A_LOAD;
+		}
+		if (pass->a_known && same_a(&pass->a, &d->instruction.a_instruction)) {
+			pass->in++;
+			return ASM_PEEPHOLE_REDUNDANT_A_LOAD;
+		}
+		return ASM_PEEPHOLE_NUM_RULES;
+	}
+
+	if (left < 2) {
+		return ASM_PEEPHOLE_NUM_RULES;
+	}
+
+	if ((is_c(&d[0], ASM_C_DEST_M, ASM_C_A_COMP_M_PLUS_ONE) && is_c(&d[1], ASM_C_DEST_M, ASM_C_A_COMP_M_MINUS_ONE)) ||
+	    (is_c(&d[0], ASM_C_DEST_M, ASM_C_A_COMP_M_MINUS_ONE) && is_c(&d[1], ASM_C_DEST_M, ASM_C_A_COMP_M_PLUS_ONE))) {
+		pass->in += 2;
+		return ASM_PEEPHOLE_INC_DEC;
+	}
+	if ((is_c(&d[0], ASM_C_DEST_M, ASM_C_A_COMP_M_PLUS_ONE) && is_c(&d[1], ASM_C_DEST_AM, ASM_C_A_COMP_M_MINUS_ONE)) ||
+	    (is_c(&d[0], ASM_C_DEST_M, ASM_C_A_COMP_M_MINUS_ONE) && is_c(&d[1], ASM_C_DEST_AM, ASM_C_A_COMP_M_PLUS_ONE))) {
+		pass->in += 2;
+		emit_c(pass, ASM_C_DEST_A, ASM_C_A_COMP_M);
+		return ASM_PEEPHOLE_INC_DEC;
+	}
+
+	if ((is_c(&d[0], ASM_C_DEST_M, ASM_C_A_COMP_D) && is_c(&d[1], ASM_C_DEST_D, ASM_C_A_COMP_M)) ||
+	    (is_c(&d[0], ASM_C_DEST_D, ASM_C_A_COMP_M) && is_c(&d[1], ASM_C_DEST_M, ASM_C_A_COMP_D))) {
+		pass->in += 2;
+		emit(pass, d[0]);
+		return ASM_PEEPHOLE_STORE_LOAD;
+	}
+
+	return ASM_PEEPHOLE_NUM_RULES;
+}
+
+/*
+ * Runs every rule once over the whole program. Returns true if anything
+ * changed.
+ */
+static bool optimize_pass(asm_declarations *declarations, size_t *rule_hits)
+{
+	struct pass pass = {
+		.declarations = declarations->declarations,
+		.len = declarations->len,
+	};
+
+	bool changed = false;
+	while (pass.in < pass.len) {
+		enum asm_peephole_rule rule = apply_rules(&pass);
+		if (rule == ASM_PEEPHOLE_NUM_RULES) {
+			emit(&pass, pass.declarations[pass.in++]);
+		} else {
+			rule_hits[rule]++;
+			changed = true;
+		}
+	}
+	declarations->len = pass.out;
+	return changed;
+}
+
+static size_t count_instructions(const asm_declarations *declarations)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < declarations->len; i++) {
+		count += !is_label(&declarations->declarations[i]);
+	}
+	return count;
+}
+
+void asm_optimize_declarations(asm_declarations *declarations, struct asm_optimize_stats *stats)
+{
+	struct asm_optimize_stats local_stats;
+	if (stats == NULL) {
+		stats = &local_stats;
+	}
+	*stats = (struct asm_optimize_stats) {0};
+
+	stats->instructions_before = count_instructions(declarations);
+	// Every pass that changes anything shrinks the program, so this ends
+	while (optimize_pass(declarations, stats->rule_hits)) {
+	}
+	stats->instructions_after = count_instructions(declarations);
+}
+
+const char *asm_peephole_rule_name(enum asm_peephole_rule rule)
+{
+	switch (rule) {
+	case ASM_PEEPHOLE_DEAD_A_LOAD:
+		return "dead A load";
+	case ASM_PEEPHOLE_REDUNDANT_A_LOAD:
+		return "redundant A load";
+	case ASM_PEEPHOLE_INC_DEC:
+		return "inc/dec";
+	case ASM_PEEPHOLE_STORE_LOAD:
+		return "store/load";
+	case ASM_PEEPHOLE_PUSH_POP:
+		return "push/pop";
+	case ASM_PEEPHOLE_NUM_RULES:
+		break;
+	}
+	return "unknown";
+}
@@ -0,0 +1,58 @@
+/*
+ * Peephole optimizer over parsed declarations, run between parsing and symbol
+ * resolution. Dropping instructions there is free: labels get their ROM
+ * addresses afterwards, so they automatically account for the shorter code.
+ */
+
+#pragma once
+
+#include <stdlib.h>
+
+#include "parser.h"
+
+/*
+ * The rewrites the optimizer knows. Windows never span a label, since code
+ * after a label can be jumped to with different register contents.
+ */
+enum asm_peephole_rule {
+	/** `@X` straight after `@Y`: the first load is never used */
+	ASM_PEEPHOLE_DEAD_A_LOAD,
+	/** `@X` when A already holds X, and nothing since wrote A */
+	ASM_PEEPHOLE_REDUNDANT_A_LOAD,
+	/** `M=M+1` then `M=M-1` (or the reverse) cancel out; `M=M+1` then
+	 * `AM=M-1` (or the reverse) is just `A=M` */
+	ASM_PEEPHOLE_INC_DEC,
+	/** `M=D` then `D=M`, or `D=M` then `M=D`: the second is a no-op */
+	ASM_PEEPHOLE_STORE_LOAD,
+	/**
+	 * A VM translator push of D straight followed by a pop into D:
+	 *
+	 *     @SP, A=M, M=D, @SP, M=M+1, @SP, AM=M-1, D=M
+	 *
+	 * leaves SP and D as they were, so it becomes `@SP, A=M`, or nothing at
+	 * all when A is reloaded next. This one relies on the VM's stack
+	 * discipline: the word at SP is free, so it doesn't matter that the
+	 * push no longer stores there.
+	 */
+	ASM_PEEPHOLE_PUSH_POP,
+	ASM_PEEPHOLE_NUM_RULES,
+};
+
+struct asm_optimize_stats {
+	/** Instructions (not labels) before and after optimizing */
+	size_t instructions_before;
+	size_t instructions_after;
+	/** How many times each `enum asm_peephole_rule` fired */
+	size_t rule_hits[ASM_PEEPHOLE_NUM_RULES];
+};
+
+/*
+ * Rewrites `declarations` in place, applying every rule until none fires. Must
+ * run before `asm_resolve_symbols`. `stats` may be NULL.
+ */
+void asm_optimize_declarations(asm_declarations *declarations, struct asm_optimize_stats *stats);
+
+/*
+ * Short name of a rule, for reports.
+ */
+const char *asm_peephole_rule_name(enum asm_peephole_rule rule);
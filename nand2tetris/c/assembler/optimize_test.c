@@ -0,0 +1,126 @@
+#include "unity.h"
+
+#include <string.h>
+
+#include "codegen.h"
+#include "optimize.h"
+#include "parser.h"
+#include "resolver.h"
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+
+static size_t assemble(const char *source, bool optimize, uint16_t *words, struct asm_optimize_stats *stats)
+{
+	asm_declarations declarations = asm_declarations_create(0);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, parse_asm_declarations(source, strlen(source), &declarations));
+	if (optimize) {
+		asm_optimize_declarations(&declarations, stats);
+	}
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_resolve_symbols(&declarations));
+	size_t len = asm_declarations_encode(&declarations, words);
+	asm_declarations_destroy(declarations);
+	return len;
+}
+
+/*
+ * Checks `source` optimizes to exactly what `expected` assembles to, with
+ * `rule` firing `hits` times.
+ */
+static void assert_optimizes_to(const char *source, const char *expected, enum asm_peephole_rule rule, size_t hits)
+{
+	uint16_t expected_words[64], words[64];
+	size_t num_expected = assemble(expected, false, expected_words, NULL);
+	struct asm_optimize_stats stats;
+	size_t num_words = assemble(source, true, words, &stats);
+
+	TEST_ASSERT_EQUAL_size_t(num_expected, num_words);
+	if (num_words > 0) {
+		TEST_ASSERT_EQUAL_HEX16_ARRAY(expected_words, words, num_words);
+	}
+	TEST_ASSERT_EQUAL_size_t(num_words, stats.instructions_after);
+	if (rule < ASM_PEEPHOLE_NUM_RULES) {
+		TEST_ASSERT_EQUAL_size_t(hits, stats.rule_hits[rule]);
+	}
+}
+
+static void assert_unchanged(const char *source)
+{
+	assert_optimizes_to(source, source, ASM_PEEPHOLE_NUM_RULES, 0);
+}
+
+void test_optimize_a_loads()
+{
+	assert_optimizes_to("@1\n@2\nD=A\n", "@2\nD=A\n", ASM_PEEPHOLE_DEAD_A_LOAD, 1);
+	assert_optimizes_to("@x\nM=0\n@x\nM=M+1\n", "@x\nM=0\nM=M+1\n", ASM_PEEPHOLE_REDUNDANT_A_LOAD, 1);
+	// SP and R0 are both 0, and a conditional jump falls through with A intact
+	assert_optimizes_to("@SP\nD;JGT\n@R0\nM=D\n", "@SP\nD;JGT\nM=D\n", ASM_PEEPHOLE_REDUNDANT_A_LOAD, 1);
+
+	// A written in between, or a label that could be jumped to
+	assert_unchanged("@x\nA=M\n@x\nM=0\n");
+	assert_unchanged("@x\nM=0\n(L)\n@x\nM=0\n");
+	// Different symbols might resolve to the same address, but we can't know
+	assert_unchanged("@x\nM=0\n@y\nM=0\n");
+}
+
+void test_optimize_inc_dec()
+{
+	assert_optimizes_to("@SP\nM=M+1\nM=M-1\nD=M\n", "@SP\nD=M\n", ASM_PEEPHOLE_INC_DEC, 1);
+	assert_optimizes_to("@SP\nM=M+1\n@SP\nAM=M-1\nD=M\n", "@SP\nA=M\nD=M\n", ASM_PEEPHOLE_INC_DEC, 1);
+	assert_unchanged("@SP\nM=M+1\nM=M+1\n");
+}
+
+void test_optimize_store_load()
+{
+	assert_optimizes_to("@x\nM=D\nD=M\nD;JEQ\n", "@x\nM=D\nD;JEQ\n", ASM_PEEPHOLE_STORE_LOAD, 1);
+	assert_optimizes_to("@x\nD=M\nM=D\n", "@x\nD=M\n", ASM_PEEPHOLE_STORE_LOAD, 1);
+	assert_unchanged("@x\nM=D\nD=M;JEQ\n");
+}
+
+void test_optimize_push_pop()
+{
+	// push constant 7 then if-goto, as the VM translator writes them
+	const char *push_pop = "@7\nD=A\n"
+			       "@SP\nA=M\nM=D\n@SP\nM=M+1\n"
+			       "@SP\nAM=M-1\nD=M\n";
+	char source[256];
+	strcpy(source, push_pop);
+	strcat(source, "@END\nD;JNE\n(END)\n");
+	assert_optimizes_to(source, "@7\nD=A\n@END\nD;JNE\n(END)\n", ASM_PEEPHOLE_PUSH_POP, 1);
+
+	// A is used next, so it has to end up pointing at the stack top
+	strcpy(source, push_pop);
+	strcat(source, "M=0\n");
+	assert_optimizes_to(source, "@7\nD=A\n@SP\nA=M\nM=0\n", ASM_PEEPHOLE_PUSH_POP, 1);
+}
+
+void test_optimize_vm_binary_op()
+{
+	// push constant 2, then add: the push's SP increment and the add's
+	// decrement cancel once the second @SP is gone
+	assert_optimizes_to("@2\nD=A\n@SP\nA=M\nM=D\n@SP\nM=M+1\n"
+			    "@SP\nM=M-1\nA=M-1\nD=M\nA=A+1\nD=D+M\n@SP\nA=M-1\nM=D\n",
+			    "@2\nD=A\n@SP\nA=M\nM=D\n"
+			    "@SP\nA=M-1\nD=M\nA=A+1\nD=D+M\n@SP\nA=M-1\nM=D\n",
+			    ASM_PEEPHOLE_INC_DEC, 1);
+}
+
+void test_optimize_labels_still_resolve()
+{
+	// Labels after removed instructions move up with them
+	assert_optimizes_to("@1\n@2\n(A)\n@A\n0;JMP\n", "@2\n(A)\n@A\n0;JMP\n", ASM_PEEPHOLE_DEAD_A_LOAD, 1);
+	assert_unchanged("");
+	assert_unchanged("(A)\n");
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_optimize_a_loads);
+	RUN_TEST(test_optimize_inc_dec);
+	RUN_TEST(test_optimize_store_load);
+	RUN_TEST(test_optimize_push_pop);
+	RUN_TEST(test_optimize_vm_binary_op);
+	RUN_TEST(test_optimize_labels_still_resolve);
+	return UNITY_END();
+}
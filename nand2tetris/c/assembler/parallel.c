@@ -0,0 +1,111 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "error.h"
+#include "object.h"
+#include "parallel.h"
+
+struct shard {
+	const char *source;
+	size_t len;
+	/** Points into the array handed to the linker */
+	struct asm_object *object;
+	enum asm_parse_error err;
+};
+
+static void *assemble_shard(void *arg)
+{
+	struct shard *shard = arg;
+	shard->err = asm_object_assemble(shard->source, shard->len, shard->object);
+	return NULL;
+}
+
+/*
+ * Cuts `source` into `num_shards` pieces of about `len / num_shards` bytes,
+ * moving each cut forward to just past the next newline. Every declaration
+ * (and comment) is a single line, so each piece parses on its own exactly as
+ * it would in context. Pieces may come out empty when lines are long.
+ */
+static void split_shards(const char *source, size_t len, struct shard *shards, struct asm_object *objects,
+			 size_t num_shards)
+{
+	size_t start = 0;
+	for (size_t i = 0; i < num_shards; i++) {
+		size_t end = len;
+		if (i + 1 < num_shards) {
+			end = len / num_shards * (i + 1);
+			if (end < start) {
+				end = start;
+			}
+			const char *newline = memchr(source + end, '\n', len - end);
+			end = newline != NULL ? (size_t) (newline - source) + 1 : len;
+		}
+		shards[i] = (struct shard) {.source = source + start, .len = end - start, .object = &objects[i]};
+		start = end;
+	}
+}
+
+enum asm_parse_error asm_assemble_parallel(const char *source, size_t len, size_t num_threads,
+					   uint16_t **words, size_t *num_words)
+{
+	if (len == 0) {
+		// An empty file is read as no data at all, and source may be NULL.
+		// It's an empty program, just as on one thread.
+		*words = malloc(1);
+		if (*words == NULL) {
+			fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+		*num_words = 0;
+		return ASM_PARSE_ERROR_NO_ERROR;
+	}
+	if (num_threads == 0) {
+		num_threads = 1;
+	}
+	// The parser treats a NUL byte as the end of input, so later shards
+	// mustn't see anything past one either
+	len = strnlen(source, len);
+
+	struct shard *shards = malloc(num_threads * sizeof(*shards));
+	struct asm_object *objects = malloc(num_threads * sizeof(*objects));
+	pthread_t *threads = malloc(num_threads * sizeof(*threads));
+	if (shards == NULL || objects == NULL || threads == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	split_shards(source, len, shards, objects, num_threads);
+
+	// The calling thread takes the first shard itself
+	for (size_t i = 1; i < num_threads; i++) {
+		int rc = pthread_create(&threads[i], NULL, assemble_shard, &shards[i]);
+		if (rc != 0) {
+			fprintf(stderr, "pthread_create failed: %s\n", strerror(rc));
+			exit(EXIT_FAILURE);
+		}
+	}
+	assemble_shard(&shards[0]);
+	for (size_t i = 1; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Parse errors come before any symbol errors, and the first shard with
+	// one has the error the single threaded parser would have stopped at
+	enum asm_parse_error err = ASM_PARSE_ERROR_NO_ERROR;
+	for (size_t i = 0; i < num_threads && err == ASM_PARSE_ERROR_NO_ERROR; i++) {
+		err = shards[i].err;
+	}
+
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_objects_link(objects, num_threads, words, num_words);
+	}
+
+	for (size_t i = 0; i < num_threads; i++) {
+		asm_object_destroy(&objects[i]);
+	}
+	free(objects);
+	free(threads);
+	free(shards);
+	return err;
+}
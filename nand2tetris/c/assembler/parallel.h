@@ -0,0 +1,22 @@
+/*
+ * Assembles one large program on several threads.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "error.h"
+
+/*
+ * Splits `source` at line boundaries into `num_threads` shards of roughly
+ * equal size, parses and encodes each shard into an `asm_object` on its own
+ * thread, then links the objects on the calling thread. The output (and any
+ * error) is identical to parsing, resolving and encoding the whole source on
+ * one thread.
+ *
+ * On success `*words` is a malloced array of `*num_words` words.
+ */
+enum asm_parse_error asm_assemble_parallel(const char *source, size_t len, size_t num_threads,
+					   uint16_t **words, size_t *num_words);
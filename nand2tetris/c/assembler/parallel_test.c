@@ -0,0 +1,130 @@
+#include "unity.h"
+
+#include <string.h>
+
+#include "codegen.h"
+#include "parallel.h"
+#include "parser.h"
+#include "resolver.h"
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+
+#define MAX_THREADS 8
+
+static enum asm_parse_error assemble_single(const char *source, uint16_t **words, size_t *num_words)
+{
+	asm_declarations declarations = asm_declarations_create(0);
+	enum asm_parse_error err = parse_asm_declarations(source, strlen(source), &declarations);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_resolve_symbols(&declarations);
+	}
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		*words = malloc(declarations.len * sizeof(uint16_t) + 1);
+		*num_words = asm_declarations_encode(&declarations, *words);
+	}
+	asm_declarations_destroy(declarations);
+	return err;
+}
+
+/*
+ * Checks that every thread count gives the same result as the single
+ * threaded assembler.
+ */
+static void assert_same_as_single(const char *source)
+{
+	uint16_t *expected = NULL;
+	size_t num_expected = 0;
+	enum asm_parse_error expected_err = assemble_single(source, &expected, &num_expected);
+
+	for (size_t threads = 1; threads <= MAX_THREADS; threads++) {
+		uint16_t *words = NULL;
+		size_t num_words = 0;
+		enum asm_parse_error err = asm_assemble_parallel(source, strlen(source), threads, &words, &num_words);
+		TEST_ASSERT_EQUAL_INT(expected_err, err);
+		if (err == ASM_PARSE_ERROR_NO_ERROR) {
+			TEST_ASSERT_EQUAL_size_t(num_expected, num_words);
+			if (num_words > 0) {
+				TEST_ASSERT_EQUAL_HEX16_ARRAY(expected, words, num_words);
+			}
+			free(words);
+		}
+	}
+	free(expected);
+}
+
+void test_parallel_labels_and_variables()
+{
+	// Backward and forward jumps, and variables first used in an order
+	// that differs from where they're defined, spread thinly enough that
+	// most thread counts put them in different shards
+	assert_same_as_single("// header comment\n"
+			      "@i\n"
+			      "M=1\n"
+			      "(LOOP)\n"
+			      "@sum\n"
+			      "D=M\n"
+			      "@END\n"
+			      "D;JGT\n"
+			      "@i\n"
+			      "D=M\n"
+			      "@sum\n"
+			      "M=D+M\n"
+			      "@LOOP\n"
+			      "0;JMP\n"
+			      "@later\n"
+			      "M=0\n"
+			      "(END)\n"
+			      "@END\n"
+			      "0;JMP\n"
+			      "@SCREEN\n"
+			      "@R13\n"
+			      "@i\n"
+			      "@later\n"
+			      "@END\n");
+}
+
+void test_parallel_edge_shapes()
+{
+	assert_same_as_single("");
+	assert_same_as_single("\n\n\n");
+	assert_same_as_single("@1");
+	assert_same_as_single("@x\r\nD=M\r\n(x)\r\n@x\r\n");
+	assert_same_as_single("// a single very long comment line to make the other shards empty\n@2\nD=A\n");
+}
+
+void test_parallel_empty_input()
+{
+	// What asm_input_open() gives back for an empty file
+	for (size_t threads = 1; threads <= MAX_THREADS; threads++) {
+		uint16_t *words = NULL;
+		size_t num_words = 1;
+		TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_assemble_parallel(NULL, 0, threads, &words, &num_words));
+		TEST_ASSERT_EQUAL_size_t(0, num_words);
+		free(words);
+	}
+}
+
+void test_parallel_errors()
+{
+	// Parse error in the last shard
+	assert_same_as_single("@1\n@2\n@3\n@4\n@5\n@6\n@7\nD=Q\n");
+	// Two different parse errors, the first one wins
+	assert_same_as_single("@1\nX=D\n@3\n@4\n@5\n@6\n@7\nD;JXX\n");
+	// Parse errors are reported ahead of a label redefinition
+	assert_same_as_single("(A1)\n@1\n(A1)\n@4\n@5\n@6\n@7\nD=Q\n");
+	// Label redefined across shards
+	assert_same_as_single("(A1)\n@1\n@2\n@3\n@4\n@5\n@6\n(A1)\n");
+	// Builtin redefined as a label
+	assert_same_as_single("@1\n@2\n@3\n@4\n@5\n@6\n@7\n(KBD)\n");
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_parallel_labels_and_variables);
+	RUN_TEST(test_parallel_edge_shapes);
+	RUN_TEST(test_parallel_empty_input);
+	RUN_TEST(test_parallel_errors);
+	return UNITY_END();
+}
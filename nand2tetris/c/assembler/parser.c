@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdalign.h>
 #include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
@@ -6,8 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
 #include "error.h"
 #include "parser.h"
+#include "scan.h"
 #include "substring.h"
 
 /*
@@ -15,24 +18,32 @@
  * traversing past lines or the end of the string.
  */
 struct parser_state {
-	/** Input string */
+	/** Input string. Not necessarily NUL terminated. */
 	const char *source;
+	/** Length of the input string */
+	size_t len;
 	/** Current position in the input string */
 	size_t pos;
 	// TODO: size_t lineno; (for error reporting. keep track of this in advance)
+	/** Where parsed symbols are interned and allocated */
+	asm_declarations *declarations;
 };
 
-struct parser_state parser_state_create(const char *source)
+struct parser_state parser_state_create(const char *source, size_t len, asm_declarations *declarations)
 {
-	struct parser_state state = {.source = source, .pos = 0};
+	struct parser_state state = {.source = source, .len = len, .pos = 0, .declarations = declarations};
 	return state;
 }
 
 /*
- * Returns the character at the current pos.
+ * Returns the character at the current pos, or \0 if we are at the end of the
+ * input.
  */
 static char parser_state_current_char(const struct parser_state *state)
 {
+	if (state->pos >= state->len) {
+		return '\0';
+	}
 	return state->source[state->pos];
 }
 
@@ -42,7 +53,7 @@ static char parser_state_current_char(const struct parser_state *state)
  */
 static char parser_state_peek(struct parser_state *state)
 {
-	if (!parser_state_current_char(state)) {
+	if (!parser_state_current_char(state) || state->pos + 1 >= state->len) {
 		return '\0';
 	}
 	return state->source[state->pos + 1];
@@ -59,13 +70,22 @@ static void parser_state_advance(struct parser_state *state)
 }
 
 /*
- * Advances through current line while eating space chars (' ') and comments
- * (//)
+ * Whitespace within a line. Carriage returns count so CRLF sources (like the
+ * course's own .asm files) parse the same as LF ones.
+ */
+static bool is_line_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/*
+ * Advances through current line while eating whitespace (see `is_line_space`)
+ * and comments (//)
  */
 static void eat_line_space_comments(struct parser_state *state)
 {
 	// First eat all whitespace
-	while (parser_state_current_char(state) == ' ') {
+	while (is_line_space(parser_state_current_char(state))) {
 		parser_state_advance(state);
 	}
 
@@ -128,10 +148,10 @@ static bool valid_symbol_char(char c)
  * (_), dot (.), dollar sign ($), and colon (:) that does not begin with a
  * digit.
  *
- * Note that this function mallocs the symbol string, which should be freed
- * later!
+ * The symbol is interned in the declarations' symbol table, so every
+ * occurrence of the same name gets the same `asm_symbol`.
  */
-static enum asm_parse_error asm_parse_symbol(struct parser_state *state, char **symbol)
+static enum asm_parse_error asm_parse_symbol(struct parser_state *state, struct asm_symbol **symbol)
 {
 	size_t start = state->pos;
 	if (!(valid_symbol_start_char(parser_state_current_char(state)))) {
@@ -147,10 +167,8 @@ static enum asm_parse_error asm_parse_symbol(struct parser_state *state, char **
 
 	const char *symbol_start = state->source + start;
 	size_t symbol_len = state->pos - start;
-	if ((*symbol = strndup(symbol_start, symbol_len)) == NULL) {
-		fprintf(stderr, "strdup malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
-		exit(EXIT_FAILURE);
-	}
+	asm_declarations *declarations = state->declarations;
+	*symbol = asm_symbol_table_intern(&declarations->symbols, &declarations->arena, symbol_start, symbol_len);
 
 	return ASM_PARSE_ERROR_NO_ERROR;
 }
@@ -191,11 +209,71 @@ static enum asm_parse_error parse_a_instruction(struct parser_state *state, stru
 	return ASM_PARSE_ERROR_NO_ERROR;
 }
 
+/*
+ * Parses a label declaration like (LOOP) starting at the current parse
+ * position.
+ */
+static enum asm_parse_error parse_label(struct parser_state *state, struct asm_symbol **label)
+{
+	if (parser_state_current_char(state) != '(') {
+		return ASM_PARSE_ERROR_LABEL_MALFORMED;
+	}
+	parser_state_advance(state);
+
+	if (parser_state_current_char(state) == '\0') {
+		return ASM_PARSE_ERROR_UNEXPECTED_EOF;
+	}
+
+	enum asm_parse_error symbol_error = asm_parse_symbol(state, label);
+	if (symbol_error != ASM_PARSE_ERROR_NO_ERROR) {
+		return symbol_error;
+	}
+
+	if (parser_state_current_char(state) != ')') {
+		return ASM_PARSE_ERROR_LABEL_MALFORMED;
+	}
+	parser_state_advance(state);
+
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
+
+/*
+ * Packs a mnemonic of up to three characters into an integer so dest, comp and
+ * jump can each be decoded with a single switch instead of a chain of string
+ * comparisons. Missing characters are zero.
+ */
+#define MNEMONIC_KEY(c0, c1, c2) ((uint32_t) (unsigned char) (c0) | (uint32_t) (unsigned char) (c1) << 8 | (uint32_t) (unsigned char) (c2) << 16)
+
+/*
+ * Returns the packed key for a substring, or 0 if it is empty or too long to be
+ * a mnemonic (no valid key is 0).
+ */
+static uint32_t mnemonic_key(struct substring s)
+{
+	const char *p = s.source + s.start;
+	switch (s.end - s.start) {
+	case 1:
+		return MNEMONIC_KEY(p[0], 0, 0);
+	case 2:
+		return MNEMONIC_KEY(p[0], p[1], 0);
+	case 3:
+		return MNEMONIC_KEY(p[0], p[1], p[2]);
+	default:
+		return 0;
+	}
+}
+
 static enum asm_parse_error dest_from_substr(struct substring dest_substr, enum asm_c_dest *dest)
 {
-	if (substring_cmp(dest_substr, "M") == 0) {
-		*dest = ASM_C_DEST_M;
-	} else {
+	switch (mnemonic_key(dest_substr)) {
+	case MNEMONIC_KEY('M', 0, 0): *dest = ASM_C_DEST_M; break;
+	case MNEMONIC_KEY('D', 0, 0): *dest = ASM_C_DEST_D; break;
+	case MNEMONIC_KEY('M', 'D', 0): *dest = ASM_C_DEST_MD; break;
+	case MNEMONIC_KEY('A', 0, 0): *dest = ASM_C_DEST_A; break;
+	case MNEMONIC_KEY('A', 'M', 0): *dest = ASM_C_DEST_AM; break;
+	case MNEMONIC_KEY('A', 'D', 0): *dest = ASM_C_DEST_AD; break;
+	case MNEMONIC_KEY('A', 'M', 'D'): *dest = ASM_C_DEST_AMD; break;
+	default:
 		return ASM_PARSE_ERROR_C_DEST_MALFORMED;
 	}
 	return ASM_PARSE_ERROR_NO_ERROR;
@@ -203,9 +281,46 @@ static enum asm_parse_error dest_from_substr(struct substring dest_substr, enum
 
 static enum asm_parse_error comp_from_substr(struct substring comp_substr, enum asm_c_a_comp *comp)
 {
-	if (substring_cmp(comp_substr, "0") == 0) {
-		*comp = ASM_C_A_COMP_ZERO;
-	} else {
+	switch (mnemonic_key(comp_substr)) {
+	case MNEMONIC_KEY('0', 0, 0): *comp = ASM_C_A_COMP_ZERO; break;
+	case MNEMONIC_KEY('1', 0, 0): *comp = ASM_C_A_COMP_ONE; break;
+	case MNEMONIC_KEY('-', '1', 0): *comp = ASM_C_A_COMP_NEG_ONE; break;
+
+	case MNEMONIC_KEY('D', 0, 0): *comp = ASM_C_A_COMP_D; break;
+	case MNEMONIC_KEY('A', 0, 0): *comp = ASM_C_A_COMP_A; break;
+	case MNEMONIC_KEY('M', 0, 0): *comp = ASM_C_A_COMP_M; break;
+
+	case MNEMONIC_KEY('!', 'D', 0): *comp = ASM_C_A_COMP_NOT_D; break;
+	case MNEMONIC_KEY('!', 'A', 0): *comp = ASM_C_A_COMP_NOT_A; break;
+	case MNEMONIC_KEY('!', 'M', 0): *comp = ASM_C_A_COMP_NOT_M; break;
+
+	case MNEMONIC_KEY('-', 'D', 0): *comp = ASM_C_A_COMP_NEG_D; break;
+	case MNEMONIC_KEY('-', 'A', 0): *comp = ASM_C_A_COMP_NEG_A; break;
+	case MNEMONIC_KEY('-', 'M', 0): *comp = ASM_C_A_COMP_NEG_M; break;
+
+	case MNEMONIC_KEY('D', '+', '1'): *comp = ASM_C_A_COMP_D_PLUS_ONE; break;
+	case MNEMONIC_KEY('A', '+', '1'): *comp = ASM_C_A_COMP_A_PLUS_ONE; break;
+	case MNEMONIC_KEY('M', '+', '1'): *comp = ASM_C_A_COMP_M_PLUS_ONE; break;
+
+	case MNEMONIC_KEY('D', '-', '1'): *comp = ASM_C_A_COMP_D_MINUS_ONE; break;
+	case MNEMONIC_KEY('A', '-', '1'): *comp = ASM_C_A_COMP_A_MINUS_ONE; break;
+	case MNEMONIC_KEY('M', '-', '1'): *comp = ASM_C_A_COMP_M_MINUS_ONE; break;
+
+	case MNEMONIC_KEY('D', '+', 'A'): *comp = ASM_C_A_COMP_D_PLUS_A; break;
+	case MNEMONIC_KEY('D', '+', 'M'): *comp = ASM_C_A_COMP_D_PLUS_M; break;
+
+	case MNEMONIC_KEY('D', '-', 'A'): *comp = ASM_C_A_COMP_D_MINUS_A; break;
+	case MNEMONIC_KEY('D', '-', 'M'): *comp = ASM_C_A_COMP_D_MINUS_M; break;
+
+	case MNEMONIC_KEY('A', '-', 'D'): *comp = ASM_C_A_COMP_A_MINUS_D; break;
+	case MNEMONIC_KEY('M', '-', 'D'): *comp = ASM_C_A_COMP_M_MINUS_D; break;
+
+	case MNEMONIC_KEY('D', '&', 'A'): *comp = ASM_C_A_COMP_D_AND_A; break;
+	case MNEMONIC_KEY('D', '&', 'M'): *comp = ASM_C_A_COMP_D_AND_M; break;
+
+	case MNEMONIC_KEY('D', '|', 'A'): *comp = ASM_C_A_COMP_D_OR_A; break;
+	case MNEMONIC_KEY('D', '|', 'M'): *comp = ASM_C_A_COMP_D_OR_M; break;
+	default:
 		return ASM_PARSE_ERROR_C_A_COMP_MALFORMED;
 	}
 	return ASM_PARSE_ERROR_NO_ERROR;
@@ -213,9 +328,15 @@ static enum asm_parse_error comp_from_substr(struct substring comp_substr, enum
 
 static enum asm_parse_error jump_from_substr(struct substring jump_substr, enum asm_c_jump *jump)
 {
-	if (substring_cmp(jump_substr, "JGT") == 0) {
-		*jump = ASM_C_JUMP_JGT;
-	} else {
+	switch (mnemonic_key(jump_substr)) {
+	case MNEMONIC_KEY('J', 'G', 'T'): *jump = ASM_C_JUMP_JGT; break;
+	case MNEMONIC_KEY('J', 'E', 'Q'): *jump = ASM_C_JUMP_JEQ; break;
+	case MNEMONIC_KEY('J', 'G', 'E'): *jump = ASM_C_JUMP_JGE; break;
+	case MNEMONIC_KEY('J', 'L', 'T'): *jump = ASM_C_JUMP_JLT; break;
+	case MNEMONIC_KEY('J', 'N', 'E'): *jump = ASM_C_JUMP_JNE; break;
+	case MNEMONIC_KEY('J', 'L', 'E'): *jump = ASM_C_JUMP_JLE; break;
+	case MNEMONIC_KEY('J', 'M', 'P'): *jump = ASM_C_JUMP_JMP; break;
+	default:
 		return ASM_PARSE_ERROR_C_JUMP_MALFORMED;
 	}
 	return ASM_PARSE_ERROR_NO_ERROR;
@@ -245,7 +366,7 @@ static enum asm_parse_error parse_c_instruction(struct parser_state *state, stru
 	struct substring jump_substr;
 
 	char current_char;
-	while ((current_char = parser_state_current_char(state)) && current_char != ' ' && current_char != '\n') {
+	while ((current_char = parser_state_current_char(state)) && !is_line_space(current_char) && current_char != '\n') {
 		if (current_char == '=') {
 			if (found_dest || found_jump) {
 				return ASM_PARSE_ERROR_C_MALFORMED;
@@ -325,6 +446,7 @@ static enum asm_parse_error parse_declaration_line(struct parser_state *state, s
 	enum asm_parse_error err;
 	struct asm_a_instruction a_instruction = {0};
 	struct asm_c_instruction c_instruction = {0};
+	struct asm_symbol *label = NULL;
 
 	switch (parser_state_current_char(state)) {
 	case '\0':
@@ -343,8 +465,13 @@ static enum asm_parse_error parse_declaration_line(struct parser_state *state, s
 		 declaration->instruction.a_instruction = a_instruction;
 		 break;
         case '(':
-		fprintf(stderr, "TODO support labels %s at %s:%d\n", __func__, __FILE__, __LINE__);
-		exit(EXIT_FAILURE);
+		 err = parse_label(state, &label);
+		 if (err != ASM_PARSE_ERROR_NO_ERROR) {
+			 return err;
+		 }
+		 declaration->type = ASM_DECL_LABEL;
+		 declaration->label = label;
+		 break;
 	default:
 		 err = parse_c_instruction(state, &c_instruction);
 		 if (err != ASM_PARSE_ERROR_NO_ERROR) {
@@ -371,77 +498,81 @@ static enum asm_parse_error parse_declaration_line(struct parser_state *state, s
 	return ASM_PARSE_ERROR_NO_ERROR;
 }
 
-static void asm_a_instruction_destroy(struct asm_a_instruction instruction)
-{
-	switch (instruction.type) {
-	case ASM_A_INST_LABEL:
-		free(instruction.label);
-		break;
-	case ASM_A_INST_ADDRESS:
-		// No dynamic memory in address
-		break;
-	}
-}
-
-static void asm_instruction_destroy(struct asm_instruction instruction)
-{
-	switch (instruction.type) {
-	case ASM_INST_A:
-		asm_a_instruction_destroy(instruction.a_instruction);
-		break;
-	case ASM_INST_C:
-		// No dynamic memory in C instructions
-		break;
-	}
-}
+/*
+ * Rough lower bound on source bytes per declaration, used to turn an input
+ * length into a declaration count. Generated code is mostly short lines like
+ * "@SP" and "M=M+1", so this is on the small side; overestimating only costs
+ * untouched virtual memory.
+ */
+#define ASM_SOURCE_BYTES_PER_DECLARATION 6
 
-static void asm_declaration_destroy(struct asm_declaration declaration)
-{
-	switch (declaration.type) {
-	case ASM_DECL_LABEL:
-		free(declaration.label);
-		break;
-	case ASM_DECL_INSTRUCTION:
-		asm_instruction_destroy(declaration.instruction);
-		break;
-	}
-}
+/*
+ * Rough fraction of the source that ends up as interned symbols and symbol
+ * table slots.
+ */
+#define ASM_SOURCE_BYTES_PER_SYMBOL_BYTE 4
 
-asm_declarations asm_declarations_create()
+asm_declarations asm_declarations_create(size_t size_hint)
 {
 	asm_declarations decls = {.declarations = NULL, .len = 0, .capacity = 0};
+
+	size_t capacity = size_hint / ASM_SOURCE_BYTES_PER_DECLARATION;
+	size_t array_size = capacity * sizeof(struct asm_declaration);
+	arena_init(&decls.arena, array_size + size_hint / ASM_SOURCE_BYTES_PER_SYMBOL_BYTE);
+	asm_symbol_table_init(&decls.symbols);
+
+	if (capacity > 0) {
+		decls.declarations = arena_alloc(&decls.arena, array_size, alignof(struct asm_declaration));
+		decls.capacity = capacity;
+	}
 	return decls;
 }
 
 static void asm_declarations_append(asm_declarations *declarations, struct asm_declaration declaration)
 {
 	if (declarations->capacity == declarations->len) {
+		size_t old_size = declarations->capacity * sizeof(struct asm_declaration);
 		if (declarations->capacity == 0) {
-			declarations->capacity = 1;
+			declarations->capacity = 64;
 		} else {
 			declarations->capacity *= 2;
 		}
 		size_t new_size = declarations->capacity * sizeof(struct asm_declaration);
-		if ((declarations->declarations = realloc(declarations->declarations, new_size)) == NULL) {
-			fprintf(stderr, "strdup realloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
-			exit(EXIT_FAILURE);
-		}
+		declarations->declarations = arena_realloc(&declarations->arena, declarations->declarations,
+							   old_size, new_size, alignof(struct asm_declaration));
 	}
 
 	declarations->declarations[declarations->len] = declaration;
 	declarations->len += 1;
 }
 
-enum asm_parse_error parse_asm_declarations(char *source, asm_declarations *declarations)
+/*
+ * Number of lines taken from the scanner at a time. Small enough to live on
+ * the stack, large enough that the per call overhead disappears.
+ */
+#define ASM_PARSE_LINE_BATCH 256
+
+enum asm_parse_error parse_asm_declarations(const char *source, size_t len, asm_declarations *declarations)
 {
-	struct parser_state state = parser_state_create(source);
-	while (parser_state_current_char(&state)) {
-		struct asm_declaration declaration;
-		enum asm_parse_error err = parse_declaration_line(&state, &declaration);
-		if (err == ASM_PARSE_ERROR_NO_ERROR) {
-			asm_declarations_append(declarations, declaration);
-		} else if (err != ASM_PARSE_ERROR_NO_DECLARATION) {
-			return err;
+	// The scanner finds each declaration's extent a block at a time, so
+	// the line parser never walks blank lines or comments
+	struct asm_scanner scanner;
+	asm_scanner_init(&scanner, source, len, asm_scan_best_impl());
+
+	struct asm_line lines[ASM_PARSE_LINE_BATCH];
+	size_t num_lines;
+	while ((num_lines = asm_scan_lines(&scanner, lines, ASM_PARSE_LINE_BATCH)) > 0) {
+		for (size_t i = 0; i < num_lines; i++) {
+			struct parser_state state = parser_state_create(source, lines[i].end, declarations);
+			state.pos = lines[i].start;
+
+			struct asm_declaration declaration;
+			enum asm_parse_error err = parse_declaration_line(&state, &declaration);
+			if (err == ASM_PARSE_ERROR_NO_ERROR) {
+				asm_declarations_append(declarations, declaration);
+			} else if (err != ASM_PARSE_ERROR_NO_DECLARATION) {
+				return err;
+			}
 		}
 	}
 
@@ -450,8 +581,5 @@ enum asm_parse_error parse_asm_declarations(char *source, asm_declarations *decl
 
 void asm_declarations_destroy(asm_declarations declarations)
 {
-	for (size_t i = 0; i < declarations.len; i++) {
-		asm_declaration_destroy(declarations.declarations[i]);
-	}
-	free(declarations.declarations);
+	arena_destroy(&declarations.arena);
 }
@@ -7,7 +7,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "error.h"
+#include "symbol_table.h"
 
 /*
  * An ASM declaration is either a label like (MY_LABEL) or an instruction. This
@@ -29,7 +31,8 @@ enum asm_instruction_type {
 
 /*
  * An A instruction in ASM source code either points to a label (@hello) or an
- * address (@12345678901234).
+ * address (@12345678901234). Labels here also cover variables and predefined
+ * symbols; which one it is gets decided when symbols are resolved.
  */
 enum asm_a_instruction_type {
 	ASM_A_INST_LABEL,
@@ -40,7 +43,7 @@ enum asm_a_instruction_type {
 struct asm_a_instruction {
 	enum asm_a_instruction_type type;
 	union {
-		char *label;
+		struct asm_symbol *label;
 		uint16_t address;
 	};
 };
@@ -138,17 +141,35 @@ struct asm_instruction {
 struct asm_declaration {
 	enum asm_declaration_type type;
 	union {
-		char *label;
+		struct asm_symbol *label;
 		struct asm_instruction instruction;
 	};
 };
 
+/*
+ * Parsed declarations. The array, the symbol table and every symbol hanging off
+ * of them are allocated from `arena`, so destroying the whole thing is a
+ * handful of frees no matter how many declarations there are.
+ */
 typedef struct {
 	struct asm_declaration *declarations;
 	size_t len;
 	size_t capacity;
+	/** Every symbol referenced or declared in the source, interned */
+	struct asm_symbol_table symbols;
+	struct arena arena;
 } asm_declarations;
 
-asm_declarations asm_declarations_create();
-enum asm_parse_error parse_asm_declarations(char *, asm_declarations *);
+/*
+ * Creates an empty set of declarations. `size_hint` is the length of the
+ * source about to be parsed (or 0 if unknown) and is used to pre-size the
+ * declaration array and arena.
+ */
+asm_declarations asm_declarations_create(size_t size_hint);
+
+/*
+ * Parses `len` bytes of `source`. The source doesn't need to be NUL
+ * terminated, so it can point straight into an mmapped file.
+ */
+enum asm_parse_error parse_asm_declarations(const char *source, size_t len, asm_declarations *);
 void asm_declarations_destroy(asm_declarations);
@@ -7,42 +7,56 @@
 // N.B. Including whole source file to get at static functions
 #include "parser.c"
 
-void setUp (void) {} /* Is run before every test, put unit init calls here. */
-void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+// Symbols parsed by tests that don't go through parse_asm_declarations are
+// interned here
+static asm_declarations test_declarations;
+
+void setUp (void) { test_declarations = asm_declarations_create(0); } /* Is run before every test, put unit init calls here. */
+void tearDown (void) { asm_declarations_destroy(test_declarations); } /* Is run after every test, put unit clean-up calls here. */
+
+static struct parser_state parser_state_create_str(const char *source)
+{
+	return parser_state_create(source, strlen(source), &test_declarations);
+}
+
+static enum asm_parse_error parse_asm_declarations_str(const char *source, asm_declarations *declarations)
+{
+	return parse_asm_declarations(source, strlen(source), declarations);
+}
 
 void test_eat_line_space_comments()
 {
 	// Empty line
-	struct parser_state state = parser_state_create("");
+	struct parser_state state = parser_state_create_str("");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_size_t(state.pos, 0);
 
 	// Simple comment, no leading whitespace
-	state = parser_state_create("// blah");
+	state = parser_state_create_str("// blah");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_CHAR('\0', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(7, state.pos);
 
 	// Simple comment, leading whitespace
-	state = parser_state_create("   // blah");
+	state = parser_state_create_str("   // blah");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_CHAR('\0', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(10, state.pos);
 
 	// Just whitespace
-	state = parser_state_create("   ");
+	state = parser_state_create_str("   ");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_CHAR('\0', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(3, state.pos);
 
 	// Eat until next line
-	state = parser_state_create("   // hello\ngoodbye");
+	state = parser_state_create_str("   // hello\ngoodbye");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_CHAR('\n', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(11, state.pos);
 
 	// Eat whitespace until non whitespace
-	state = parser_state_create("   hello\ngoodbye");
+	state = parser_state_create_str("   hello\ngoodbye");
 	eat_line_space_comments(&state);
 	TEST_ASSERT_EQUAL_CHAR('h', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(3, state.pos);
@@ -52,95 +66,84 @@ void test_parse_a_instruction()
 {
 	// Missing @ symbol (empty string)
 	struct asm_a_instruction instruction = {0};
-	struct parser_state state = parser_state_create("");
+	struct parser_state state = parser_state_create_str("");
 	enum asm_parse_error err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_A_INSTRUCTION_MISSING_AT_SYMBOL, err);
-	asm_a_instruction_destroy(instruction);
 
 	// Doesn't start with @
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("not@");
+	state = parser_state_create_str("not@");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_A_INSTRUCTION_MISSING_AT_SYMBOL, err);
-	asm_a_instruction_destroy(instruction);
 
 	// Simple success
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@123");
+	state = parser_state_create_str("@123");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_ADDRESS, instruction.type);
 	TEST_ASSERT_EQUAL_UINT16(123, instruction.address);
-	asm_a_instruction_destroy(instruction);
 
 	// Bare @
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@");
+	state = parser_state_create_str("@");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_UNEXPECTED_EOF, err);
-	asm_a_instruction_destroy(instruction);
 
 	// Min allowed value
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@0");
+	state = parser_state_create_str("@0");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_ADDRESS, instruction.type);
 	TEST_ASSERT_EQUAL_UINT16(0, instruction.address);
-	asm_a_instruction_destroy(instruction);
 
 	// Max allowed value
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@32767");
+	state = parser_state_create_str("@32767");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_ADDRESS, instruction.type);
 	TEST_ASSERT_EQUAL_UINT16(32767, instruction.address);
-	asm_a_instruction_destroy(instruction);
 
 	// Logical overflow (fits in uint16_t, but is too large for address)
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@32768");
+	state = parser_state_create_str("@32768");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_A_INSTRUCTION_ADDRESS_TOO_LARGE, err);
-	asm_a_instruction_destroy(instruction);
 
 	// uint16_t overflow
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@32768231432848329789437289");
+	state = parser_state_create_str("@32768231432848329789437289");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_A_INSTRUCTION_ADDRESS_TOO_LARGE, err);
-	asm_a_instruction_destroy(instruction);
 
 	// Label
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@hello");
+	state = parser_state_create_str("@hello");
 	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_LABEL, instruction.type);
-	TEST_ASSERT_EQUAL_STRING("hello", instruction.label);
-	asm_a_instruction_destroy(instruction);
+	TEST_ASSERT_EQUAL_STRING("hello", instruction.label->name);
 
 	// Doesn't support negative addresses
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@-398");
+	state = parser_state_create_str("@-398");
  	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_INVALID_SYMBOL_START, err);
-	asm_a_instruction_destroy(instruction);
 
 	// Invalid symbol start char
 	memset(&instruction, 0, sizeof(struct asm_a_instruction));
-	state = parser_state_create("@ hello");
+	state = parser_state_create_str("@ hello");
  	err = parse_a_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_INVALID_SYMBOL_START, err);
-	asm_a_instruction_destroy(instruction);
 }
 
 void test_parse_c_instruction()
 {
 	// Dest and comp
 	struct asm_c_instruction instruction = {0};
-	struct parser_state state = parser_state_create("M=0");
+	struct parser_state state = parser_state_create_str("M=0");
 	enum asm_parse_error err = parse_c_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_C_DEST_M, instruction.dest);
@@ -149,13 +152,13 @@ void test_parse_c_instruction()
 
 	// Missing comp
 	memset(&instruction, 0, sizeof(struct asm_c_instruction));
-	state = parser_state_create("M=");
+	state = parser_state_create_str("M=");
 	err = parse_c_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_C_A_COMP_MALFORMED, err);
 
 	// Comp and jump
 	memset(&instruction, 0, sizeof(struct asm_c_instruction));
-	state = parser_state_create("0;JGT");
+	state = parser_state_create_str("0;JGT");
 	err = parse_c_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_C_DEST_NULL, instruction.dest);
@@ -164,7 +167,7 @@ void test_parse_c_instruction()
 
 	// Dest, comp, and jump
 	memset(&instruction, 0, sizeof(struct asm_c_instruction));
-	state = parser_state_create("M=0;JGT");
+	state = parser_state_create_str("M=0;JGT");
 	err = parse_c_instruction(&state, &instruction);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_C_DEST_M, instruction.dest);
@@ -176,100 +179,152 @@ void test_parse_declaration_line()
 {
 	// Successfully parse A instruction
 	struct asm_declaration declaration = {0};
-	struct parser_state state = parser_state_create("  @hello // abc123");
+	struct parser_state state = parser_state_create_str("  @hello // abc123");
 	enum asm_parse_error err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_INST_A, declaration.instruction.type);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_LABEL, declaration.instruction.a_instruction.type);
-	TEST_ASSERT_EQUAL_STRING("hello", declaration.instruction.a_instruction.label);
+	TEST_ASSERT_EQUAL_STRING("hello", declaration.instruction.a_instruction.label->name);
 	TEST_ASSERT_EQUAL_CHAR('\0', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(18, state.pos);
-	asm_declaration_destroy(declaration);
 
 	// Newline after with more instructions
 	memset(&declaration, 0, sizeof(struct asm_declaration));
-	state = parser_state_create("  @hello \n @more");
+	state = parser_state_create_str("  @hello \n @more");
 	err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_INT(ASM_INST_A, declaration.instruction.type);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_LABEL, declaration.instruction.a_instruction.type);
-	TEST_ASSERT_EQUAL_STRING("hello", declaration.instruction.a_instruction.label);
+	TEST_ASSERT_EQUAL_STRING("hello", declaration.instruction.a_instruction.label->name);
 	TEST_ASSERT_EQUAL_CHAR(' ', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(10, state.pos);
-	asm_declaration_destroy(declaration);
 
 	// Empty string
 	memset(&declaration, 0, sizeof(struct asm_declaration));
-	state = parser_state_create("");
+	state = parser_state_create_str("");
 	err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_DECLARATION, err);
-	asm_declaration_destroy(declaration);
 
 	// Empty line once whitespace eaten
 	memset(&declaration, 0, sizeof(struct asm_declaration));
-	state = parser_state_create("  // blah");
+	state = parser_state_create_str("  // blah");
 	err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_DECLARATION, err);
 	TEST_ASSERT_EQUAL_CHAR('\0', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(9, state.pos);
-	asm_declaration_destroy(declaration);
 
 	// Empty line once whitespace eaten, but more after
 	memset(&declaration, 0, sizeof(struct asm_declaration));
-	state = parser_state_create("  // blah\n@hello");
+	state = parser_state_create_str("  // blah\n@hello");
 	err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_DECLARATION, err);
 	TEST_ASSERT_EQUAL_CHAR('@', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(10, state.pos);
-	asm_declaration_destroy(declaration);
+
+	// Label
+	memset(&declaration, 0, sizeof(struct asm_declaration));
+	state = parser_state_create_str(" (LOOP) // top\n@LOOP");
+	err = parse_declaration_line(&state, &declaration);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	TEST_ASSERT_EQUAL_INT(ASM_DECL_LABEL, declaration.type);
+	TEST_ASSERT_EQUAL_STRING("LOOP", declaration.label->name);
+	TEST_ASSERT_EQUAL_CHAR('@', parser_state_current_char(&state));
+
+	// Label and reference are the same interned symbol
+	struct asm_declaration reference = {0};
+	err = parse_declaration_line(&state, &reference);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	TEST_ASSERT_EQUAL_PTR(declaration.label, reference.instruction.a_instruction.label);
+
+	// Label missing closing paren
+	memset(&declaration, 0, sizeof(struct asm_declaration));
+	state = parser_state_create_str("(LOOP");
+	err = parse_declaration_line(&state, &declaration);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_LABEL_MALFORMED, err);
+
+	// Label with invalid symbol
+	memset(&declaration, 0, sizeof(struct asm_declaration));
+	state = parser_state_create_str("(1LOOP)");
+	err = parse_declaration_line(&state, &declaration);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_INVALID_SYMBOL_START, err);
 
 	// Extra input that isn't whitespace or comment
 	memset(&declaration, 0, sizeof(struct asm_declaration));
-	state = parser_state_create("@hello bad");
+	state = parser_state_create_str("@hello bad");
 	err = parse_declaration_line(&state, &declaration);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_EXTRA_INPUT, err);
 	TEST_ASSERT_EQUAL_CHAR('b', parser_state_current_char(&state));
 	TEST_ASSERT_EQUAL_size_t(7, state.pos);
-	asm_declaration_destroy(declaration);
 }
 
 void test_parse_asm_declarations()
 {
 	// Empty input
-	asm_declarations declarations = asm_declarations_create();
-	enum asm_parse_error err = parse_asm_declarations("", &declarations);
+	asm_declarations declarations = asm_declarations_create(0);
+	enum asm_parse_error err = parse_asm_declarations_str("", &declarations);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	asm_declarations_destroy(declarations);
 
+	// Empty file, which has no data to point at
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations(NULL, 0, &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	TEST_ASSERT_EQUAL_size_t(0, declarations.len);
+	asm_declarations_destroy(declarations);
+
 	// Just space and comments
-	declarations = asm_declarations_create();
-	err = parse_asm_declarations("//my file\n\n  \n\n //", &declarations);
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations_str("//my file\n\n  \n\n //", &declarations);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	asm_declarations_destroy(declarations);
 
 	// Single A instruction
-	declarations = asm_declarations_create();
-	err = parse_asm_declarations("//my file\n@hello", &declarations);
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations_str("//my file\n@hello", &declarations);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_size_t(1, declarations.len);
 	TEST_ASSERT_EQUAL_INT(ASM_INST_A, declarations.declarations[0].instruction.type);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_LABEL, declarations.declarations[0].instruction.a_instruction.type);
-	TEST_ASSERT_EQUAL_STRING("hello", declarations.declarations[0].instruction.a_instruction.label);
+	TEST_ASSERT_EQUAL_STRING("hello", declarations.declarations[0].instruction.a_instruction.label->name);
 	asm_declarations_destroy(declarations);
 
 	// A and C instruction
-	declarations = asm_declarations_create();
-	err = parse_asm_declarations("//my file\n@hello\nM=0;JGT", &declarations);
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations_str("//my file\n@hello\nM=0;JGT", &declarations);
 	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
 	TEST_ASSERT_EQUAL_size_t(2, declarations.len);
 	TEST_ASSERT_EQUAL_INT(ASM_INST_A, declarations.declarations[0].instruction.type);
 	TEST_ASSERT_EQUAL_INT(ASM_A_INST_LABEL, declarations.declarations[0].instruction.a_instruction.type);
-	TEST_ASSERT_EQUAL_STRING("hello", declarations.declarations[0].instruction.a_instruction.label);
+	TEST_ASSERT_EQUAL_STRING("hello", declarations.declarations[0].instruction.a_instruction.label->name);
 	TEST_ASSERT_EQUAL_INT(ASM_INST_C, declarations.declarations[1].instruction.type);
 	TEST_ASSERT_EQUAL_INT(ASM_C_DEST_M, declarations.declarations[1].instruction.c_instruction.dest);
 	TEST_ASSERT_EQUAL_INT(ASM_C_A_COMP_ZERO, declarations.declarations[1].instruction.c_instruction.a_comp);
 	TEST_ASSERT_EQUAL_INT(ASM_C_JUMP_JGT, declarations.declarations[1].instruction.c_instruction.jump);
 	asm_declarations_destroy(declarations);
+
+	// Length-bounded view stops at len even without a NUL terminator
+	declarations = asm_declarations_create(0);
+	const char *source = "@hello\n@goodbye";
+	err = parse_asm_declarations(source, 6, &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	TEST_ASSERT_EQUAL_size_t(1, declarations.len);
+	TEST_ASSERT_EQUAL_STRING("hello", declarations.declarations[0].instruction.a_instruction.label->name);
+	asm_declarations_destroy(declarations);
+
+	// Comment straight after a C instruction
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations_str("D=M// no space\n\t0;JMP\t//tab", &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+	TEST_ASSERT_EQUAL_size_t(2, declarations.len);
+	TEST_ASSERT_EQUAL_INT(ASM_C_A_COMP_M, declarations.declarations[0].instruction.c_instruction.a_comp);
+	TEST_ASSERT_EQUAL_INT(ASM_C_JUMP_JMP, declarations.declarations[1].instruction.c_instruction.jump);
+	asm_declarations_destroy(declarations);
+
+	// Comment cut off right at the end of the view
+	declarations = asm_declarations_create(0);
+	err = parse_asm_declarations("M=0 /", 5, &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_EXTRA_INPUT, err);
+	asm_declarations_destroy(declarations);
 }
 
 
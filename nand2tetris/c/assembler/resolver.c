@@ -0,0 +1,52 @@
+#include <stdint.h>
+
+#include "error.h"
+#include "parser.h"
+#include "resolver.h"
+#include "symbol_table.h"
+
+enum asm_parse_error asm_resolve_symbols(asm_declarations *declarations)
+{
+	// First pass: labels
+	uint32_t rom_address = 0;
+	for (size_t i = 0; i < declarations->len; i++) {
+		struct asm_declaration *declaration = &declarations->declarations[i];
+		switch (declaration->type) {
+		case ASM_DECL_LABEL:
+			if (declaration->label->kind != ASM_SYMBOL_UNRESOLVED) {
+				return ASM_PARSE_ERROR_LABEL_REDEFINED;
+			}
+			declaration->label->kind = ASM_SYMBOL_LABEL;
+			declaration->label->value = rom_address;
+			break;
+		case ASM_DECL_INSTRUCTION:
+			rom_address++;
+			break;
+		}
+	}
+
+	// Second pass: variables
+	uint32_t next_variable = ASM_FIRST_VARIABLE_ADDRESS;
+	for (size_t i = 0; i < declarations->len; i++) {
+		struct asm_declaration *declaration = &declarations->declarations[i];
+		if (declaration->type != ASM_DECL_INSTRUCTION ||
+		    declaration->instruction.type != ASM_INST_A ||
+		    declaration->instruction.a_instruction.type != ASM_A_INST_LABEL) {
+			continue;
+		}
+
+		struct asm_symbol *symbol = declaration->instruction.a_instruction.label;
+		if (symbol->kind == ASM_SYMBOL_UNRESOLVED) {
+			symbol->kind = ASM_SYMBOL_VARIABLE;
+			symbol->value = next_variable++;
+		}
+
+		// Labels past the end of ROM are fine until someone references
+		// them.
+		if (symbol->value > ASM_MAX_ADDRESS) {
+			return ASM_PARSE_ERROR_A_INSTRUCTION_ADDRESS_TOO_LARGE;
+		}
+	}
+
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
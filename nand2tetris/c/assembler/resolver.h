@@ -0,0 +1,31 @@
+/*
+ * Resolves labels and variables in parsed declarations.
+ */
+
+#pragma once
+
+#include "error.h"
+#include "parser.h"
+
+/*
+ * First RAM address handed out to variables.
+ */
+#define ASM_FIRST_VARIABLE_ADDRESS 16
+
+/*
+ * Largest value that fits in an A instruction.
+ */
+#define ASM_MAX_ADDRESS 32767
+
+/*
+ * Resolves every symbol in `declarations` in two passes:
+ *
+ * 1. Walk declarations counting instructions, and bind each (LABEL) to the ROM
+ *    address of the instruction after it.
+ * 2. Walk A instructions, and bind each symbol that is still unresolved to the
+ *    next free RAM address starting at 16, in order of first use.
+ *
+ * Predefined symbols were already resolved when they were interned. Since
+ * symbols are interned, each pass is O(1) per declaration.
+ */
+enum asm_parse_error asm_resolve_symbols(asm_declarations *declarations);
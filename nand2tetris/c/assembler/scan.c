@@ -0,0 +1,283 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define ASM_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define ASM_SCAN_X86 0
+#endif
+
+#define ASM_SCAN_BLOCK 64
+
+/*
+ * Per byte classes computed for a block, one bit per byte.
+ */
+struct block_classes {
+	/** '\n' or NUL */
+	uint64_t newline;
+	/** ' ', '\t' or '\r' */
+	uint64_t blank;
+	/** '/' */
+	uint64_t slash;
+};
+
+/*
+ * Returns a word with the high bit of each byte of `x` set iff that byte
+ * equals `c`. Unlike the usual "has zero byte" trick this is exact for every
+ * byte, not just the lowest match.
+ */
+static uint64_t bytes_equal(uint64_t x, char c)
+{
+	const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+	uint64_t t = x ^ (0x0101010101010101ULL * (unsigned char) c);
+	return ~(((t & low7) + low7) | t) & ~low7;
+}
+
+/*
+ * Packs the high bit of each byte of `x` into 8 bits, lowest byte first.
+ */
+static uint64_t high_bits(uint64_t x)
+{
+	return ((x >> 7) * 0x0102040810204080ULL) >> 56;
+}
+
+/*
+ * Portable fallback that classifies 8 bytes at a time in ordinary registers.
+ */
+static void classify_scalar(const char *p, struct block_classes *classes)
+{
+	*classes = (struct block_classes) {0};
+	for (int i = 0; i < ASM_SCAN_BLOCK; i += 8) {
+		uint64_t x;
+		memcpy(&x, p + i, sizeof(x));
+		// The bit packing assumes the first byte is the lowest
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		x = __builtin_bswap64(x);
+#endif
+		classes->newline |= high_bits(bytes_equal(x, '\n') | bytes_equal(x, '\0')) << i;
+		classes->blank |= high_bits(bytes_equal(x, ' ') | bytes_equal(x, '\t') | bytes_equal(x, '\r')) << i;
+		classes->slash |= high_bits(bytes_equal(x, '/')) << i;
+	}
+}
+
+#if ASM_SCAN_X86
+static void classify_sse2(const char *p, struct block_classes *classes)
+{
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i tab = _mm_set1_epi8('\t');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i slash = _mm_set1_epi8('/');
+
+	*classes = (struct block_classes) {0};
+	for (int i = 0; i < ASM_SCAN_BLOCK; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+		__m128i is_nl = _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, nul));
+		__m128i is_blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+						_mm_cmpeq_epi8(v, cr));
+		__m128i is_slash = _mm_cmpeq_epi8(v, slash);
+		classes->newline |= (uint64_t) (uint16_t) _mm_movemask_epi8(is_nl) << i;
+		classes->blank |= (uint64_t) (uint16_t) _mm_movemask_epi8(is_blank) << i;
+		classes->slash |= (uint64_t) (uint16_t) _mm_movemask_epi8(is_slash) << i;
+	}
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *p, struct block_classes *classes)
+{
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i nul = _mm256_setzero_si256();
+	const __m256i space = _mm256_set1_epi8(' ');
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i slash = _mm256_set1_epi8('/');
+
+	*classes = (struct block_classes) {0};
+	for (int i = 0; i < ASM_SCAN_BLOCK; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+		__m256i is_nl = _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, nul));
+		__m256i is_blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+						   _mm256_cmpeq_epi8(v, cr));
+		__m256i is_slash = _mm256_cmpeq_epi8(v, slash);
+		classes->newline |= (uint64_t) (uint32_t) _mm256_movemask_epi8(is_nl) << i;
+		classes->blank |= (uint64_t) (uint32_t) _mm256_movemask_epi8(is_blank) << i;
+		classes->slash |= (uint64_t) (uint32_t) _mm256_movemask_epi8(is_slash) << i;
+	}
+}
+#endif
+
+bool asm_scan_impl_supported(enum asm_scan_impl impl)
+{
+	switch (impl) {
+	case ASM_SCAN_SCALAR:
+		return true;
+#if ASM_SCAN_X86
+	case ASM_SCAN_SSE2:
+		return true;
+	case ASM_SCAN_AVX2:
+		return __builtin_cpu_supports("avx2");
+#else
+	case ASM_SCAN_SSE2:
+	case ASM_SCAN_AVX2:
+		return false;
+#endif
+	}
+	return false;
+}
+
+static pthread_once_t best_impl_once = PTHREAD_ONCE_INIT;
+static enum asm_scan_impl best_impl;
+
+static void choose_best_impl(void)
+{
+	best_impl = ASM_SCAN_SCALAR;
+	if (asm_scan_impl_supported(ASM_SCAN_AVX2)) {
+		best_impl = ASM_SCAN_AVX2;
+	} else if (asm_scan_impl_supported(ASM_SCAN_SSE2)) {
+		best_impl = ASM_SCAN_SSE2;
+	}
+}
+
+enum asm_scan_impl asm_scan_best_impl(void)
+{
+	// Parallel assembly calls this from every shard thread at once
+	pthread_once(&best_impl_once, choose_best_impl);
+	return best_impl;
+}
+
+/*
+ * Computes the masks for the block containing `pos`. The last block is copied
+ * into a NUL padded buffer first, so reads never go past the end of the source
+ * and the end of input looks like any other terminator.
+ */
+static void load_block(struct asm_scanner *scanner, size_t pos)
+{
+	size_t block_start = pos - pos % ASM_SCAN_BLOCK;
+	const char *p;
+
+	// An empty file has no data at all, so the source may be NULL
+	char tail[ASM_SCAN_BLOCK];
+	if (scanner->len - block_start < ASM_SCAN_BLOCK) {
+		memset(tail, 0, sizeof(tail));
+		if (scanner->len > block_start) {
+			memcpy(tail, scanner->source + block_start, scanner->len - block_start);
+		}
+		p = tail;
+	} else {
+		p = scanner->source + block_start;
+	}
+
+	struct block_classes classes;
+	switch (scanner->impl) {
+#if ASM_SCAN_X86
+	case ASM_SCAN_AVX2:
+		classify_avx2(p, &classes);
+		break;
+	case ASM_SCAN_SSE2:
+		classify_sse2(p, &classes);
+		break;
+#endif
+	default:
+		classify_scalar(p, &classes);
+	}
+
+	// A comment starts at a slash followed by another slash, which for the
+	// last byte means peeking into the next block
+	size_t next = block_start + ASM_SCAN_BLOCK;
+	uint64_t next_slash = next < scanner->len && scanner->source[next] == '/';
+	uint64_t comment = classes.slash & (classes.slash >> 1 | next_slash << 63);
+
+	scanner->block_start = block_start;
+	scanner->masks[ASM_SCAN_NONBLANK] = ~classes.blank;
+	scanner->masks[ASM_SCAN_NEWLINE] = classes.newline;
+	scanner->masks[ASM_SCAN_DECLARATION_END] = classes.newline | comment;
+}
+
+/*
+ * Returns the first position at or after `pos` with its bit set in `mask`,
+ * loading blocks as needed. There always is one, since the end of input sets
+ * every mask.
+ */
+static size_t next_set_slow(struct asm_scanner *scanner, size_t pos, enum asm_scan_mask mask)
+{
+	while (true) {
+		if (pos < scanner->block_start || pos >= scanner->block_start + ASM_SCAN_BLOCK) {
+			load_block(scanner, pos);
+		}
+		uint64_t bits = scanner->masks[mask] >> (pos - scanner->block_start);
+		if (bits != 0) {
+			return pos + __builtin_ctzll(bits);
+		}
+		pos = scanner->block_start + ASM_SCAN_BLOCK;
+	}
+}
+
+/*
+ * `next_set_slow`, with the common case of the answer being in the current
+ * block inlined. Lines are short, so that's most of the time.
+ */
+static inline size_t next_set(struct asm_scanner *scanner, size_t pos, enum asm_scan_mask mask)
+{
+	// Wraps around (and so fails the check) if pos is before the block
+	size_t offset = pos - scanner->block_start;
+	if (offset < ASM_SCAN_BLOCK) {
+		uint64_t bits = scanner->masks[mask] >> offset;
+		if (bits != 0) {
+			return pos + __builtin_ctzll(bits);
+		}
+	}
+	return next_set_slow(scanner, pos, mask);
+}
+
+/*
+ * Generated code rarely indents, so checking the first byte of a line directly
+ * is cheaper than going through the masks.
+ */
+static bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+void asm_scanner_init(struct asm_scanner *scanner, const char *source, size_t len, enum asm_scan_impl impl)
+{
+	if (!asm_scan_impl_supported(impl)) {
+		impl = ASM_SCAN_SCALAR;
+	}
+	*scanner = (struct asm_scanner) {.source = source, .len = len, .pos = 0, .impl = impl};
+	load_block(scanner, 0);
+}
+
+size_t asm_scan_lines(struct asm_scanner *scanner, struct asm_line *lines, size_t max_lines)
+{
+	const char *source = scanner->source;
+	size_t num_lines = 0;
+	while (num_lines < max_lines && scanner->pos < scanner->len) {
+		size_t start = scanner->pos;
+		if (is_blank(source[start])) {
+			start = next_set(scanner, start, ASM_SCAN_NONBLANK);
+		}
+		size_t end = next_set(scanner, start, ASM_SCAN_DECLARATION_END);
+		size_t newline = end;
+		if (end < scanner->len && source[end] == '/') {
+			newline = next_set(scanner, end, ASM_SCAN_NEWLINE);
+		}
+
+		if (newline < scanner->len && source[newline] == '\0') {
+			// Nothing after a NUL counts
+			scanner->len = newline;
+		}
+		scanner->pos = newline < scanner->len ? newline + 1 : scanner->len;
+
+		// Blank and comment-only lines end where they start
+		if (start < end) {
+			lines[num_lines++] = (struct asm_line) {.start = start, .end = end};
+		}
+	}
+	return num_lines;
+}
@@ -0,0 +1,81 @@
+/*
+ * Vectorized pre-scan that splits source into the lines the parser actually
+ * has to look at.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Ways of classifying a 64 byte block. Every implementation gives identical
+ * results; the SIMD ones just do it 16 or 32 bytes at a time, and the scalar
+ * one 8 bytes at a time with bit tricks.
+ */
+enum asm_scan_impl {
+	ASM_SCAN_SCALAR,
+	ASM_SCAN_SSE2,
+	ASM_SCAN_AVX2,
+};
+
+/*
+ * The declaration on a line: `start` is the line's first non-blank byte and
+ * `end` is where a trailing comment starts, or else the newline ending the
+ * line (or the end of input). Lines that are blank or only hold a comment
+ * never show up.
+ */
+struct asm_line {
+	size_t start;
+	size_t end;
+};
+
+/*
+ * Masks the scanner keeps for the current block. Bit i describes byte
+ * `block_start + i`, and bytes past the end of input set every mask.
+ */
+enum asm_scan_mask {
+	/** Anything but ' ', '\t' and '\r' */
+	ASM_SCAN_NONBLANK,
+	/** '\n' or NUL */
+	ASM_SCAN_NEWLINE,
+	/** A newline, or the first '/' of "//" */
+	ASM_SCAN_DECLARATION_END,
+	ASM_SCAN_NUM_MASKS,
+};
+
+struct asm_scanner {
+	const char *source;
+	size_t len;
+	/** Start of the next line to scan */
+	size_t pos;
+	enum asm_scan_impl impl;
+
+	/** Offset of the 64 byte block the masks describe */
+	size_t block_start;
+	/** Indexed by `enum asm_scan_mask` */
+	uint64_t masks[ASM_SCAN_NUM_MASKS];
+};
+
+/*
+ * True if this CPU (and this build) can run `impl`.
+ */
+bool asm_scan_impl_supported(enum asm_scan_impl impl);
+
+/*
+ * The fastest supported implementation.
+ */
+enum asm_scan_impl asm_scan_best_impl(void);
+
+/*
+ * Starts scanning `len` bytes of `source`. Like the parser, a NUL byte ends
+ * the input early.
+ */
+void asm_scanner_init(struct asm_scanner *scanner, const char *source, size_t len, enum asm_scan_impl impl);
+
+/*
+ * Fills `lines` with up to `max_lines` of the next lines holding declarations.
+ * Returns how many were found, which is 0 only once the input is exhausted.
+ */
+size_t asm_scan_lines(struct asm_scanner *scanner, struct asm_line *lines, size_t max_lines);
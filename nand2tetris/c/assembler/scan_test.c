@@ -0,0 +1,145 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "scan.h"
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+
+#define MAX_LINES 64
+
+static const enum asm_scan_impl impls[] = {ASM_SCAN_SCALAR, ASM_SCAN_SSE2, ASM_SCAN_AVX2};
+
+/*
+ * Scans `len` bytes of `source` with `impl`, a few lines per call to exercise
+ * resuming, and returns the number of lines found.
+ */
+static size_t scan(const char *source, size_t len, enum asm_scan_impl impl, struct asm_line *lines)
+{
+	struct asm_scanner scanner;
+	asm_scanner_init(&scanner, source, len, impl);
+
+	size_t num_lines = 0, found;
+	while ((found = asm_scan_lines(&scanner, lines + num_lines, 3)) > 0) {
+		num_lines += found;
+		TEST_ASSERT_TRUE(num_lines <= MAX_LINES);
+	}
+	return num_lines;
+}
+
+/*
+ * Checks every supported implementation finds the lines starting with the
+ * characters in `starts` (in order), each of which ends at a comment or the
+ * next newline (or NUL).
+ */
+static void assert_lines(const char *source, size_t len, const char *starts)
+{
+	for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+		if (!asm_scan_impl_supported(impls[i])) {
+			continue;
+		}
+
+		struct asm_line lines[MAX_LINES];
+		size_t num_lines = scan(source, len, impls[i], lines);
+		TEST_ASSERT_EQUAL_size_t(strlen(starts), num_lines);
+		for (size_t j = 0; j < num_lines; j++) {
+			TEST_ASSERT_EQUAL_CHAR(starts[j], source[lines[j].start]);
+			size_t end = lines[j].start;
+			while (end < len && source[end] != '\n' && source[end] != '\0' &&
+			       !(source[end] == '/' && end + 1 < len && source[end + 1] == '/')) {
+				end++;
+			}
+			TEST_ASSERT_EQUAL_size_t(end, lines[j].end);
+		}
+	}
+}
+
+static void assert_lines_str(const char *source, const char *starts)
+{
+	assert_lines(source, strlen(source), starts);
+}
+
+void test_scan_lines()
+{
+	assert_lines_str("", "");
+	assert_lines_str("\n\n  \n\t\r\n", "");
+	assert_lines_str("@1", "@");
+	assert_lines_str("@1\nD=A\n(LOOP)\n", "@D(");
+	assert_lines_str("  @1  // trailing\n\t\tD=A\r\n", "@D");
+	assert_lines_str("D=M//no space\nM=D/ /\n", "DM");
+
+	// Comment only lines go, a lone slash stays for the parser to reject
+	assert_lines_str("// comment\n   // indented\n/\n/ /\n//", "//");
+
+	// Length bounded, not NUL terminated
+	assert_lines("@1\n@2\n@3", 5, "@@");
+}
+
+void test_scan_block_boundaries()
+{
+	// Lines and leading whitespace that straddle 64 byte blocks, including
+	// a line that is longer than a whole block
+	char source[1024];
+	size_t len = 0;
+	len += sprintf(source + len, "%62s@a\n", "");
+	len += sprintf(source + len, "%63sD=M\n", "");
+	len += sprintf(source + len, "%130s\n", "");
+	len += sprintf(source + len, "@%100s\n", "x");
+	len += sprintf(source + len, "%70s// comment %70s\n", "", "");
+	len += sprintf(source + len, "%60s@b /%60s\n", "", "/ comment across a block");
+	len += sprintf(source + len, "(END)");
+	assert_lines(source, len, "@D@@(");
+}
+
+void test_scan_nul_ends_input()
+{
+	const char source[] = "@1\n@2\0\n@3\n";
+	assert_lines(source, sizeof(source) - 1, "@@");
+
+	struct asm_line lines[MAX_LINES];
+	TEST_ASSERT_EQUAL_size_t(2, scan(source, sizeof(source) - 1, ASM_SCAN_SCALAR, lines));
+	TEST_ASSERT_EQUAL_size_t(5, lines[1].end);
+}
+
+void test_scan_impls_agree()
+{
+	// Pseudo random mix of the bytes the scanner cares about
+	static const char alphabet[] = "\n\n  \t\r//@(=;DM01";
+	char source[4096];
+	unsigned seed = 12345;
+	for (size_t i = 0; i < sizeof(source); i++) {
+		seed = seed * 1103515245 + 12345;
+		source[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+	}
+
+	for (size_t len = 0; len < sizeof(source); len += 97) {
+		struct asm_line expected[sizeof(source)];
+		struct asm_scanner scanner;
+		asm_scanner_init(&scanner, source, len, ASM_SCAN_SCALAR);
+		size_t num_expected = asm_scan_lines(&scanner, expected, sizeof(source));
+
+		for (size_t i = 1; i < sizeof(impls) / sizeof(impls[0]); i++) {
+			if (!asm_scan_impl_supported(impls[i])) {
+				continue;
+			}
+			struct asm_line lines[sizeof(source)];
+			asm_scanner_init(&scanner, source, len, impls[i]);
+			TEST_ASSERT_EQUAL_size_t(num_expected, asm_scan_lines(&scanner, lines, sizeof(source)));
+			if (num_expected > 0) {
+				TEST_ASSERT_EQUAL_MEMORY(expected, lines, num_expected * sizeof(struct asm_line));
+			}
+		}
+	}
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_scan_lines);
+	RUN_TEST(test_scan_block_boundaries);
+	RUN_TEST(test_scan_nul_ends_input);
+	RUN_TEST(test_scan_impls_agree);
+	return UNITY_END();
+}
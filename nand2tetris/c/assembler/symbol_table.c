@@ -0,0 +1,185 @@
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "arena.h"
+#include "symbol_table.h"
+
+#define ASM_SYMBOL_TABLE_MIN_CAPACITY 64
+
+struct asm_builtin_symbol {
+	const char *name;
+	size_t len;
+	uint16_t value;
+};
+
+/*
+ * Perfect hash over the predefined symbols. Every builtin is at least two
+ * characters long, and this combination of length, second and last character
+ * happens to give all 23 of them a distinct slot out of 64, so a lookup is one
+ * hash plus one memcmp. The slot indices below were computed offline from
+ * `asm_builtin_hash`; test_builtin_symbols checks they still agree.
+ */
+#define ASM_BUILTIN_TABLE_SIZE 64
+
+static size_t asm_builtin_hash(const char *name, size_t len)
+{
+	return (len + 6 * (unsigned char) name[1] + 15 * (unsigned char) name[len - 1]) & (ASM_BUILTIN_TABLE_SIZE - 1);
+}
+
+static const struct asm_builtin_symbol asm_builtin_table[ASM_BUILTIN_TABLE_SIZE] = {
+	[50] = {"R0", 2, 0},
+	[7] = {"R1", 2, 1},
+	[28] = {"R2", 2, 2},
+	[49] = {"R3", 2, 3},
+	[6] = {"R4", 2, 4},
+	[27] = {"R5", 2, 5},
+	[48] = {"R6", 2, 6},
+	[5] = {"R7", 2, 7},
+	[26] = {"R8", 2, 8},
+	[47] = {"R9", 2, 9},
+	[57] = {"R10", 3, 10},
+	[8] = {"R11", 3, 11},
+	[23] = {"R12", 3, 12},
+	[38] = {"R13", 3, 13},
+	[53] = {"R14", 3, 14},
+	[4] = {"R15", 3, 15},
+	[18] = {"SP", 2, 0},
+	[9] = {"LCL", 3, 1},
+	[24] = {"ARG", 3, 2},
+	[17] = {"THIS", 4, 3},
+	[32] = {"THAT", 4, 4},
+	[42] = {"SCREEN", 6, 16384},
+	[11] = {"KBD", 3, 24576},
+};
+
+bool asm_builtin_symbol_lookup(const char *name, size_t len, uint16_t *value)
+{
+	if (len < 2 || len > 6) {
+		return false;
+	}
+
+	const struct asm_builtin_symbol *builtin = &asm_builtin_table[asm_builtin_hash(name, len)];
+	if (builtin->len != len || memcmp(builtin->name, name, len) != 0) {
+		return false;
+	}
+
+	*value = builtin->value;
+	return true;
+}
+
+/*
+ * 32 bit FNV-1a. Symbols are short, so something fancier doesn't buy much.
+ */
+static uint32_t asm_symbol_hash(const char *name, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void asm_symbol_table_init(struct asm_symbol_table *table)
+{
+	table->slots = NULL;
+	table->capacity = 0;
+	table->len = 0;
+}
+
+static struct asm_symbol_slot *asm_symbol_table_find_slot(const struct asm_symbol_table *table, const char *name,
+							  size_t len, uint32_t hash)
+{
+	size_t mask = table->capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct asm_symbol_slot *slot = &table->slots[i];
+		if (slot->symbol == NULL) {
+			return slot;
+		}
+		if (slot->hash == hash && slot->symbol->len == len && memcmp(slot->symbol->name, name, len) == 0) {
+			return slot;
+		}
+	}
+}
+
+/*
+ * Doubles the slot array. The old array stays behind in the arena, which costs
+ * at most as much again as the final table.
+ */
+static void asm_symbol_table_grow(struct asm_symbol_table *table, struct arena *arena)
+{
+	size_t old_capacity = table->capacity;
+	struct asm_symbol_slot *old_slots = table->slots;
+
+	table->capacity = old_capacity == 0 ? ASM_SYMBOL_TABLE_MIN_CAPACITY : old_capacity * 2;
+	size_t size = table->capacity * sizeof(*table->slots);
+	table->slots = arena_alloc(arena, size, alignof(struct asm_symbol_slot));
+	memset(table->slots, 0, size);
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		struct asm_symbol_slot old = old_slots[i];
+		if (old.symbol == NULL) {
+			continue;
+		}
+		size_t mask = table->capacity - 1;
+		size_t j = old.hash & mask;
+		while (table->slots[j].symbol != NULL) {
+			j = (j + 1) & mask;
+		}
+		table->slots[j] = old;
+	}
+}
+
+struct asm_symbol *asm_symbol_table_intern(struct asm_symbol_table *table, struct arena *arena,
+					   const char *name, size_t len)
+{
+	// Keep the load factor at or under 1/2 so probe sequences stay short.
+	if ((table->len + 1) * 2 > table->capacity) {
+		asm_symbol_table_grow(table, arena);
+	}
+
+	uint32_t hash = asm_symbol_hash(name, len);
+	struct asm_symbol_slot *slot = asm_symbol_table_find_slot(table, name, len, hash);
+	if (slot->symbol != NULL) {
+		return slot->symbol;
+	}
+
+	struct asm_symbol *symbol = arena_alloc(arena, sizeof(*symbol), alignof(struct asm_symbol));
+	symbol->name = arena_strndup(arena, name, len);
+	symbol->len = len;
+	symbol->hash = hash;
+	symbol->kind = ASM_SYMBOL_UNRESOLVED;
+	symbol->value = 0;
+
+	uint16_t builtin_value;
+	if (asm_builtin_symbol_lookup(name, len, &builtin_value)) {
+		symbol->kind = ASM_SYMBOL_BUILTIN;
+		symbol->value = builtin_value;
+	}
+
+	slot->hash = hash;
+	slot->symbol = symbol;
+	table->len++;
+
+	return symbol;
+}
+
+struct asm_symbol *asm_symbol_table_lookup(const struct asm_symbol_table *table, const char *name, size_t len)
+{
+	if (table->capacity == 0) {
+		return NULL;
+	}
+	return asm_symbol_table_find_slot(table, name, len, asm_symbol_hash(name, len))->symbol;
+}
+
+size_t asm_symbol_table_index(const struct asm_symbol_table *table, const struct asm_symbol *symbol)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = symbol->hash & mask;
+	while (table->slots[i].symbol != symbol) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
@@ -0,0 +1,80 @@
+/*
+ * Interned symbol table for labels and variables.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+/*
+ * What a symbol currently resolves to.
+ */
+enum asm_symbol_kind {
+	ASM_SYMBOL_UNRESOLVED, ///< Referenced, but not resolved yet
+	ASM_SYMBOL_BUILTIN,    ///< Predefined symbol like R0, SP, or SCREEN
+	ASM_SYMBOL_LABEL,      ///< (LABEL) declaration, value is a ROM address
+	ASM_SYMBOL_VARIABLE,   ///< Variable, value is a RAM address from 16 up
+};
+
+/*
+ * An interned symbol. Every occurrence of a name in a program points at the
+ * same `asm_symbol`, so once it is resolved every reference sees the value
+ * without another lookup.
+ */
+struct asm_symbol {
+	/** NUL terminated name */
+	const char *name;
+	size_t len;
+	uint32_t hash;
+	enum asm_symbol_kind kind;
+	uint32_t value;
+};
+
+struct asm_symbol_slot {
+	uint32_t hash;
+	struct asm_symbol *symbol;
+};
+
+/*
+ * Open-addressing (linear probing) hash table from name to `asm_symbol`. The
+ * slots and the symbols themselves are allocated from an arena, which the
+ * caller passes in on every insert; nothing here needs to be freed.
+ */
+struct asm_symbol_table {
+	struct asm_symbol_slot *slots;
+	/** Always a power of two (or 0 before the first insert) */
+	size_t capacity;
+	size_t len;
+};
+
+void asm_symbol_table_init(struct asm_symbol_table *table);
+
+/*
+ * Returns the interned symbol for `name`, creating it (copied into `arena`) if
+ * this is the first time we've seen it. New symbols that name a predefined
+ * symbol come back already resolved as `ASM_SYMBOL_BUILTIN`.
+ */
+struct asm_symbol *asm_symbol_table_intern(struct asm_symbol_table *table, struct arena *arena,
+					   const char *name, size_t len);
+
+/*
+ * Returns the interned symbol for `name`, or NULL if it was never interned.
+ */
+struct asm_symbol *asm_symbol_table_lookup(const struct asm_symbol_table *table, const char *name, size_t len);
+
+/*
+ * Returns the slot `symbol` sits in, which is below `table->capacity`. The
+ * symbol must have been interned in `table`. Slots only move when the table
+ * grows, so while nothing is being inserted they can index a side array.
+ */
+size_t asm_symbol_table_index(const struct asm_symbol_table *table, const struct asm_symbol *symbol);
+
+/*
+ * Looks up a predefined symbol (R0-R15, SP, LCL, ARG, THIS, THAT, SCREEN, KBD)
+ * through a perfect hash. Returns false if `name` isn't predefined.
+ */
+bool asm_builtin_symbol_lookup(const char *name, size_t len, uint16_t *value);
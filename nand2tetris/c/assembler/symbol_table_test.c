@@ -0,0 +1,156 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "parser.h"
+#include "resolver.h"
+// N.B. Including whole source file to get at static functions
+#include "symbol_table.c"
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) {} /* Is run after every test, put unit clean-up calls here. */
+
+void test_builtin_symbols()
+{
+	const struct {
+		const char *name;
+		uint16_t value;
+	} builtins[] = {
+		{"R0", 0}, {"R1", 1}, {"R2", 2}, {"R3", 3}, {"R4", 4}, {"R5", 5},
+		{"R6", 6}, {"R7", 7}, {"R8", 8}, {"R9", 9}, {"R10", 10}, {"R11", 11},
+		{"R12", 12}, {"R13", 13}, {"R14", 14}, {"R15", 15},
+		{"SP", 0}, {"LCL", 1}, {"ARG", 2}, {"THIS", 3}, {"THAT", 4},
+		{"SCREEN", 16384}, {"KBD", 24576},
+	};
+
+	// Every builtin lives in the slot its hash points at
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); i++) {
+		uint16_t value = 0xFFFF;
+		TEST_ASSERT_TRUE_MESSAGE(asm_builtin_symbol_lookup(builtins[i].name, strlen(builtins[i].name), &value),
+					 builtins[i].name);
+		TEST_ASSERT_EQUAL_UINT16(builtins[i].value, value);
+	}
+
+	// Near misses
+	const char *not_builtins[] = {"", "R", "R16", "r0", "SPX", "S", "THESE", "SCREEN1", "KBD_", "LOOP"};
+	for (size_t i = 0; i < sizeof(not_builtins) / sizeof(not_builtins[0]); i++) {
+		uint16_t value;
+		TEST_ASSERT_FALSE_MESSAGE(asm_builtin_symbol_lookup(not_builtins[i], strlen(not_builtins[i]), &value),
+					  not_builtins[i]);
+	}
+}
+
+void test_symbol_table_intern()
+{
+	struct arena arena;
+	arena_init(&arena, 0);
+	struct asm_symbol_table table;
+	asm_symbol_table_init(&table);
+
+	TEST_ASSERT_NULL(asm_symbol_table_lookup(&table, "LOOP", 4));
+
+	// Interning the same name twice gives the same symbol, even from a
+	// different buffer
+	struct asm_symbol *loop = asm_symbol_table_intern(&table, &arena, "LOOP", 4);
+	char loop_copy[] = "LOOP_END";
+	TEST_ASSERT_EQUAL_PTR(loop, asm_symbol_table_intern(&table, &arena, loop_copy, 4));
+	TEST_ASSERT_EQUAL_PTR(loop, asm_symbol_table_lookup(&table, "LOOP", 4));
+	TEST_ASSERT_EQUAL_STRING("LOOP", loop->name);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_UNRESOLVED, loop->kind);
+
+	// Builtins come back resolved
+	struct asm_symbol *screen = asm_symbol_table_intern(&table, &arena, "SCREEN", 6);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_BUILTIN, screen->kind);
+	TEST_ASSERT_EQUAL_UINT32(16384, screen->value);
+
+	// Lots of symbols, forcing several grows
+	char name[32];
+	for (int i = 0; i < 100000; i++) {
+		int len = snprintf(name, sizeof(name), "label_%d", i);
+		struct asm_symbol *symbol = asm_symbol_table_intern(&table, &arena, name, len);
+		symbol->value = i;
+	}
+	TEST_ASSERT_EQUAL_size_t(100002, table.len);
+	for (int i = 0; i < 100000; i++) {
+		int len = snprintf(name, sizeof(name), "label_%d", i);
+		struct asm_symbol *symbol = asm_symbol_table_lookup(&table, name, len);
+		TEST_ASSERT_NOT_NULL(symbol);
+		TEST_ASSERT_EQUAL_UINT32(i, symbol->value);
+	}
+	TEST_ASSERT_EQUAL_PTR(loop, asm_symbol_table_lookup(&table, "LOOP", 4));
+
+	arena_destroy(&arena);
+}
+
+static enum asm_parse_error parse_and_resolve(const char *source, asm_declarations *declarations)
+{
+	enum asm_parse_error err = parse_asm_declarations(source, strlen(source), declarations);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		return err;
+	}
+	return asm_resolve_symbols(declarations);
+}
+
+void test_resolve_symbols()
+{
+	asm_declarations declarations = asm_declarations_create(0);
+	enum asm_parse_error err = parse_and_resolve("@i\n"
+						     "M=0\n"
+						     "(LOOP)\n"
+						     "@END\n"
+						     "0;JGT\n"
+						     "@sum\n"
+						     "M=0\n"
+						     "@i\n"
+						     "@LOOP\n"
+						     "0;JGT\n"
+						     "(END)\n"
+						     "@KBD\n",
+						     &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, err);
+
+	struct asm_symbol *i = asm_symbol_table_lookup(&declarations.symbols, "i", 1);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_VARIABLE, i->kind);
+	TEST_ASSERT_EQUAL_UINT32(16, i->value);
+
+	struct asm_symbol *sum = asm_symbol_table_lookup(&declarations.symbols, "sum", 3);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_VARIABLE, sum->kind);
+	TEST_ASSERT_EQUAL_UINT32(17, sum->value);
+
+	struct asm_symbol *loop = asm_symbol_table_lookup(&declarations.symbols, "LOOP", 4);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_LABEL, loop->kind);
+	TEST_ASSERT_EQUAL_UINT32(2, loop->value);
+
+	// Referenced before it was declared
+	struct asm_symbol *end = asm_symbol_table_lookup(&declarations.symbols, "END", 3);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_LABEL, end->kind);
+	TEST_ASSERT_EQUAL_UINT32(9, end->value);
+
+	struct asm_symbol *kbd = asm_symbol_table_lookup(&declarations.symbols, "KBD", 3);
+	TEST_ASSERT_EQUAL_INT(ASM_SYMBOL_BUILTIN, kbd->kind);
+	TEST_ASSERT_EQUAL_UINT32(24576, kbd->value);
+
+	asm_declarations_destroy(declarations);
+
+	// Duplicate label
+	declarations = asm_declarations_create(0);
+	err = parse_and_resolve("(LOOP)\n@LOOP\n(LOOP)\n", &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_LABEL_REDEFINED, err);
+	asm_declarations_destroy(declarations);
+
+	// Redefining a builtin
+	declarations = asm_declarations_create(0);
+	err = parse_and_resolve("(SP)\n@SP\n", &declarations);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_LABEL_REDEFINED, err);
+	asm_declarations_destroy(declarations);
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_builtin_symbols);
+	RUN_TEST(test_symbol_table_intern);
+	RUN_TEST(test_resolve_symbols);
+	return UNITY_END();
+}
@@ -0,0 +1,124 @@
+/*
+ * Counts heap allocations made while parsing a large synthetic program, and
+ * reports them per instruction along with parse and teardown time.
+ *
+ * malloc, calloc and realloc are interposed for the whole process (glibc routes
+ * its own internal calls, e.g. from strndup, through them too) and forwarded to
+ * the real implementations via dlsym(RTLD_NEXT).
+ *
+ * Usage: alloc_bench [num_lines]
+ */
+
+#define _GNU_SOURCE // RTLD_NEXT
+
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../assembler/input.h"
+#include "../assembler/parser.h"
+#include "bench_utils.h"
+
+static size_t num_allocations = 0;
+
+static void *(*real_malloc)(size_t) = NULL;
+static void *(*real_calloc)(size_t, size_t) = NULL;
+static void *(*real_realloc)(void *, size_t) = NULL;
+static void (*real_free)(void *) = NULL;
+
+/*
+ * dlsym can itself call calloc before we've resolved the real one, so hand it
+ * a bit of static memory (which is never freed) for that.
+ */
+static char bootstrap_heap[4096];
+static size_t bootstrap_used = 0;
+static bool resolving = false;
+
+static void resolve_real_allocators(void)
+{
+	if (real_malloc != NULL) {
+		return;
+	}
+	resolving = true;
+	*(void **) (&real_malloc) = dlsym(RTLD_NEXT, "malloc");
+	*(void **) (&real_calloc) = dlsym(RTLD_NEXT, "calloc");
+	*(void **) (&real_realloc) = dlsym(RTLD_NEXT, "realloc");
+	*(void **) (&real_free) = dlsym(RTLD_NEXT, "free");
+	resolving = false;
+}
+
+void *malloc(size_t size)
+{
+	resolve_real_allocators();
+	num_allocations++;
+	return real_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (resolving) {
+		void *p = bootstrap_heap + bootstrap_used;
+		bootstrap_used += (nmemb * size + 15) & ~(size_t) 15;
+		return p;
+	}
+	resolve_real_allocators();
+	num_allocations++;
+	return real_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	resolve_real_allocators();
+	num_allocations++;
+	return real_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if ((char *) ptr >= bootstrap_heap && (char *) ptr < bootstrap_heap + sizeof(bootstrap_heap)) {
+		return;
+	}
+	resolve_real_allocators();
+	real_free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 10000000);
+
+	size_t num_bytes;
+	char *path = bench_create_synthetic_asm_file(num_lines, &num_bytes);
+
+	struct asm_input input;
+	if (!asm_input_open(path, &input)) {
+		perror("failed to read input");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t allocations_before = num_allocations;
+	double start = bench_now_seconds();
+
+	asm_declarations declarations = asm_declarations_create(input.len);
+	enum asm_parse_error err = parse_asm_declarations(input.data, input.len, &declarations);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "parse error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+
+	double parsed = bench_now_seconds();
+	size_t allocations = num_allocations - allocations_before;
+	size_t num_declarations = declarations.len;
+
+	asm_declarations_destroy(declarations);
+	double destroyed = bench_now_seconds();
+
+	printf("allocations: %zu for %zu declarations (%.6f per instruction)\n",
+	       allocations, num_declarations, (double) allocations / num_declarations);
+	printf("parse: %.3f s  destroy: %.3f s\n", parsed - start, destroyed - parsed);
+
+	asm_input_close(&input);
+	unlink(path);
+	free(path);
+}
@@ -0,0 +1,117 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_utils.h"
+
+double bench_now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define JUMP_TARGETS 2048
+
+size_t bench_write_synthetic_module(FILE *fp, size_t num_lines, size_t module)
+{
+	// Roughly the shape of translated `push` / `add` sequences, with a
+	// sprinkling of comments, blank lines, variables and builtins. Each
+	// repetition n of the pattern defines label L<n> and jumps forward to
+	// L<n+1>. Jump targets wrap at JUMP_TARGETS so every referenced ROM
+	// address still fits in an A instruction however long the program is.
+	// Later modules prefix the labels they define, and keep jumping to
+	// module 0's, for the same reason.
+	static const struct {
+		const char *format;
+		bool is_jump;
+	} lines[] = {
+		{"// push constant\n", false},
+		{"@17\n", false},
+		{"D=A\n", false},
+		{"@SP\n", false},
+		{"AM=M+1\n", false},
+		{"A=A-1\n", false},
+		{"M=D\n", false},
+		{"(%sL%zu)\n", false},
+		{"   @counter // trailing comment\n", false},
+		{"AM=M-1\n", false},
+		{"D=M\n", false},
+		{"A=A-1\n", false},
+		{"M=D+M\n", false},
+		{"@L%zu\n", true},
+		{"D;JGT\n", false},
+		{"\n", false},
+	};
+	const size_t num_patterns = sizeof(lines) / sizeof(lines[0]);
+
+	char prefix[32] = "";
+	if (module > 0) {
+		snprintf(prefix, sizeof(prefix), "M%zu.", module);
+	}
+
+	size_t bytes = 0;
+	for (size_t i = 0; i < num_lines; i++) {
+		size_t pattern = i % num_patterns;
+		size_t label = i / num_patterns;
+		int len;
+		if (lines[pattern].is_jump) {
+			len = fprintf(fp, lines[pattern].format, (label + 1) % JUMP_TARGETS);
+		} else {
+			len = fprintf(fp, lines[pattern].format, prefix, label);
+		}
+		if (len < 0) {
+			perror("fprintf failed");
+			exit(EXIT_FAILURE);
+		}
+		bytes += len;
+	}
+	return bytes;
+}
+
+size_t bench_write_synthetic_asm(FILE *fp, size_t num_lines)
+{
+	return bench_write_synthetic_module(fp, num_lines, 0);
+}
+
+char *bench_create_synthetic_asm_file(size_t num_lines, size_t *num_bytes)
+{
+	const char *tmpdir = getenv("TMPDIR");
+	if (tmpdir == NULL) {
+		tmpdir = "/tmp";
+	}
+
+	size_t path_len = strlen(tmpdir) + sizeof("/hack-bench-XXXXXX.asm");
+	char *path = malloc(path_len);
+	if (path == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	snprintf(path, path_len, "%s/hack-bench-XXXXXX.asm", tmpdir);
+
+	int fd = mkstemps(path, strlen(".asm"));
+	if (fd < 0) {
+		perror("mkstemps failed");
+		exit(EXIT_FAILURE);
+	}
+	FILE *fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		perror("fdopen failed");
+		exit(EXIT_FAILURE);
+	}
+
+	*num_bytes = bench_write_synthetic_asm(fp, num_lines);
+	fclose(fp);
+	return path;
+}
+
+size_t bench_lines_arg(int argc, char **argv, size_t default_lines)
+{
+	if (argc > 1) {
+		return strtoull(argv[1], NULL, 10);
+	}
+	return default_lines;
+}
@@ -0,0 +1,41 @@
+/*
+ * Shared helpers for the assembler benchmarks.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Monotonic wall clock time in seconds.
+ */
+double bench_now_seconds(void);
+
+/*
+ * Writes a synthetic Hack assembly program with `num_lines` lines to `fp`. The
+ * program mixes A instructions, C instructions, comments and blank lines the
+ * way generated VM translator output does. Returns the number of bytes
+ * written.
+ */
+size_t bench_write_synthetic_asm(FILE *fp, size_t num_lines);
+
+/*
+ * Writes one module of a program split across files, as the VM translator
+ * would emit for one .vm file. Module 0 is exactly the synthetic program
+ * above; the others define differently named labels so any number of modules
+ * can be linked together. Returns the number of bytes written.
+ */
+size_t bench_write_synthetic_module(FILE *fp, size_t num_lines, size_t module);
+
+/*
+ * Creates a temporary file holding a synthetic program (see
+ * `bench_write_synthetic_asm`) and returns its path, which should be unlinked
+ * and freed by the caller.
+ */
+char *bench_create_synthetic_asm_file(size_t num_lines, size_t *num_bytes);
+
+/*
+ * Parses an optional line count from argv[1], falling back to `default_lines`.
+ */
+size_t bench_lines_arg(int argc, char **argv, size_t default_lines);
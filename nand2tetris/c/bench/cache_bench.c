@@ -0,0 +1,228 @@
+/*
+ * Measures rebuilding a program split across many files with the object
+ * cache: a cold build, a rebuild with nothing changed, and a rebuild after a
+ * one-line edit to one file, against assembling every file from scratch.
+ * Every build is checked against the uncached one.
+ *
+ * Usage: cache_bench [num_lines] [num_files]
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../assembler/cache.h"
+#include "../assembler/input.h"
+#include "../assembler/object.h"
+#include "bench_utils.h"
+
+#define ROUNDS 5
+
+struct build {
+	double seconds;
+	size_t hits;
+	uint16_t *words;
+	size_t num_words;
+};
+
+/*
+ * What the assembler does with several inputs: read each one, assemble it
+ * (through the cache if `cache_dir` isn't NULL) and link.
+ */
+static struct build run_build(char **paths, size_t num_files, const char *cache_dir)
+{
+	struct build build = {0};
+	struct asm_object *objects = malloc(num_files * sizeof(*objects));
+	if (objects == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	double start = bench_now_seconds();
+	for (size_t i = 0; i < num_files; i++) {
+		struct asm_input input;
+		if (!asm_input_open(paths[i], &input)) {
+			perror(paths[i]);
+			exit(EXIT_FAILURE);
+		}
+		enum asm_parse_error err;
+		if (cache_dir != NULL) {
+			bool hit;
+			err = asm_cache_assemble(cache_dir, input.data, input.len, &objects[i], &hit);
+			build.hits += hit;
+		} else {
+			err = asm_object_assemble(input.data, input.len, &objects[i]);
+		}
+		asm_input_close(&input);
+		if (err != ASM_PARSE_ERROR_NO_ERROR) {
+			fprintf(stderr, "%s: error %d\n", paths[i], err);
+			exit(EXIT_FAILURE);
+		}
+	}
+	enum asm_parse_error err = asm_objects_link(objects, num_files, &build.words, &build.num_words);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "link error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	build.seconds = bench_now_seconds() - start;
+
+	for (size_t i = 0; i < num_files; i++) {
+		asm_object_destroy(&objects[i]);
+	}
+	free(objects);
+	return build;
+}
+
+static void check_same(const struct build *expected, const struct build *build, const char *name)
+{
+	if (build->num_words != expected->num_words ||
+	    memcmp(build->words, expected->words, build->num_words * sizeof(uint16_t)) != 0) {
+		fprintf(stderr, "%s: output differs from the uncached build\n", name);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * Writes module `module`, with its first "@17" turned into "@<constant>" so
+ * every edit gives a source the cache hasn't seen.
+ */
+static void write_module(const char *path, size_t num_lines, size_t module, size_t constant)
+{
+	char *source;
+	size_t len;
+	FILE *fp = open_memstream(&source, &len);
+	if (fp == NULL) {
+		perror("open_memstream failed");
+		exit(EXIT_FAILURE);
+	}
+	bench_write_synthetic_module(fp, num_lines, module);
+	fclose(fp);
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	const char *edit = strstr(source, "@17\n");
+	if (edit == NULL) {
+		fputs(source, fp);
+	} else {
+		fwrite(source, 1, edit - source, fp);
+		fprintf(fp, "@%zu\n", constant);
+		fputs(edit + strlen("@17\n"), fp);
+	}
+	fclose(fp);
+	free(source);
+}
+
+static void remove_dir(const char *path)
+{
+	DIR *dir = opendir(path);
+	if (dir != NULL) {
+		struct dirent *entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+				char child[4096];
+				snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+				if (unlink(child) != 0) {
+					remove_dir(child);
+				}
+			}
+		}
+		closedir(dir);
+	}
+	rmdir(path);
+}
+
+static void print_build(const char *name, const struct build *build, double baseline)
+{
+	printf("%-24s %10.4f %8zu %8.1fx\n", name, build->seconds, build->hits, baseline / build->seconds);
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 2000000);
+	size_t num_files = argc > 2 ? strtoull(argv[2], NULL, 10) : 64;
+	if (num_files == 0) {
+		num_files = 1;
+	}
+	size_t lines_per_file = num_lines / num_files;
+
+	const char *tmpdir = getenv("TMPDIR");
+	char dir[4096];
+	snprintf(dir, sizeof(dir), "%s/hack-cache-bench-XXXXXX", tmpdir != NULL ? tmpdir : "/tmp");
+	if (mkdtemp(dir) == NULL) {
+		perror("mkdtemp failed");
+		exit(EXIT_FAILURE);
+	}
+	char cache_dir[4096 + 8];
+	snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+
+	char **paths = malloc(num_files * sizeof(*paths));
+	if (paths == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < num_files; i++) {
+		paths[i] = malloc(sizeof(dir) + 32);
+		if (paths[i] == NULL) {
+			fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+		snprintf(paths[i], sizeof(dir) + 32, "%s/Module%zu.asm", dir, i);
+		write_module(paths[i], lines_per_file, i, 17);
+	}
+
+	printf("%zu files of %zu lines\n", num_files, lines_per_file);
+	printf("%-24s %10s %8s %9s\n", "build", "seconds", "hits", "speedup");
+
+	struct build uncached = run_build(paths, num_files, NULL);
+	print_build("uncached", &uncached, uncached.seconds);
+
+	struct build cold = run_build(paths, num_files, cache_dir);
+	check_same(&uncached, &cold, "cold cache");
+	print_build("cold cache", &cold, uncached.seconds);
+	free(cold.words);
+
+	// Best of a few rounds, since a single rebuild is short
+	struct build unchanged = {.seconds = 1e9};
+	for (int round = 0; round < ROUNDS; round++) {
+		struct build build = run_build(paths, num_files, cache_dir);
+		check_same(&uncached, &build, "unchanged");
+		free(build.words);
+		if (build.seconds < unchanged.seconds) {
+			unchanged = build;
+		}
+	}
+	print_build("no change", &unchanged, uncached.seconds);
+	free(uncached.words);
+
+	// Each round edits one line of the middle file to something new
+	size_t edited = num_files / 2;
+	struct build best_uncached = {.seconds = 1e9}, best_edit = {.seconds = 1e9};
+	for (int round = 0; round < ROUNDS; round++) {
+		write_module(paths[edited], lines_per_file, edited, 100 + round);
+		struct build build = run_build(paths, num_files, cache_dir);
+		struct build reference = run_build(paths, num_files, NULL);
+		check_same(&reference, &build, "one-line edit");
+		if (build.seconds < best_edit.seconds) {
+			best_edit = build;
+		}
+		if (reference.seconds < best_uncached.seconds) {
+			best_uncached = reference;
+		}
+		free(build.words);
+		free(reference.words);
+	}
+	print_build("one-line edit, uncached", &best_uncached, best_uncached.seconds);
+	print_build("one-line edit, cached", &best_edit, best_uncached.seconds);
+
+	for (size_t i = 0; i < num_files; i++) {
+		free(paths[i]);
+	}
+	free(paths);
+	remove_dir(dir);
+}
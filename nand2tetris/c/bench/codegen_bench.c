@@ -0,0 +1,154 @@
+/*
+ * Measures the C instruction decoder and the encoder/writer.
+ *
+ * The decode section compares the packed-key switch the parser uses against
+ * the obvious chain of substring_cmp calls over every comp mnemonic. The
+ * end-to-end section times parse, resolve, encode and write of a large
+ * synthetic program in both output formats.
+ *
+ * Usage: codegen_bench [num_lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pull in the parser's static decoders
+#include "../assembler/parser.c"
+
+#include "../assembler/codegen.h"
+#include "../assembler/resolver.h"
+#include "bench_utils.h"
+
+#define DECODE_ROUNDS 2000000
+
+/*
+ * Comp mnemonics in `enum asm_c_a_comp` order.
+ */
+static const char *const comp_mnemonics[] = {
+	"0", "1", "-1",
+	"D", "A", "M",
+	"!D", "!A", "!M",
+	"-D", "-A", "-M",
+	"D+1", "A+1", "M+1",
+	"D-1", "A-1", "M-1",
+	"D+A", "D+M",
+	"D-A", "D-M",
+	"A-D", "M-D",
+	"D&A", "D&M",
+	"D|A", "D|M",
+};
+
+#define NUM_COMPS (sizeof(comp_mnemonics) / sizeof(comp_mnemonics[0]))
+
+static enum asm_parse_error comp_from_substr_chain(struct substring comp_substr, enum asm_c_a_comp *comp)
+{
+	for (size_t i = 0; i < NUM_COMPS; i++) {
+		if (substring_cmp(comp_substr, comp_mnemonics[i]) == 0) {
+			*comp = i;
+			return ASM_PARSE_ERROR_NO_ERROR;
+		}
+	}
+	return ASM_PARSE_ERROR_C_A_COMP_MALFORMED;
+}
+
+static double bench_decode(enum asm_parse_error (*decode)(struct substring, enum asm_c_a_comp *))
+{
+	struct substring substrs[NUM_COMPS];
+	for (size_t i = 0; i < NUM_COMPS; i++) {
+		substrs[i] = substring_create(comp_mnemonics[i], 0, strlen(comp_mnemonics[i]));
+	}
+
+	unsigned long checksum = 0;
+	double start = bench_now_seconds();
+	for (size_t round = 0; round < DECODE_ROUNDS; round++) {
+		// Step through the mnemonics out of order so the branch predictor
+		// can't just learn the sequence
+		struct substring s = substrs[(round * 11) % NUM_COMPS];
+		enum asm_c_a_comp comp;
+		if (decode(s, &comp) != ASM_PARSE_ERROR_NO_ERROR) {
+			fprintf(stderr, "decode failed\n");
+			exit(EXIT_FAILURE);
+		}
+		checksum += comp;
+	}
+	double elapsed = bench_now_seconds() - start;
+
+	// Both decoders agree, so this is the same for each; printing it keeps
+	// the loop from being optimized away.
+	fprintf(stderr, "checksum %lu\n", checksum);
+	return elapsed / DECODE_ROUNDS;
+}
+
+static void bench_end_to_end(size_t num_lines)
+{
+	char *buffer;
+	size_t num_bytes;
+	FILE *fp = open_memstream(&buffer, &num_bytes);
+	if (fp == NULL) {
+		perror("open_memstream failed");
+		exit(EXIT_FAILURE);
+	}
+	bench_write_synthetic_asm(fp, num_lines);
+	fclose(fp);
+
+	FILE *null = fopen("/dev/null", "w");
+	if (null == NULL) {
+		perror("fopen failed");
+		exit(EXIT_FAILURE);
+	}
+
+	double start = bench_now_seconds();
+	asm_declarations declarations = asm_declarations_create(num_bytes);
+	enum asm_parse_error err = parse_asm_declarations(buffer, num_bytes, &declarations);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_resolve_symbols(&declarations);
+	}
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	double parsed = bench_now_seconds();
+
+	uint16_t *words = malloc(declarations.len * sizeof(*words) + 1);
+	if (words == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	size_t num_words = asm_declarations_encode(&declarations, words);
+	double encoded = bench_now_seconds();
+
+	if (!hack_write(null, words, num_words, HACK_OUTPUT_TEXT)) {
+		perror("write failed");
+		exit(EXIT_FAILURE);
+	}
+	double text = bench_now_seconds();
+
+	if (!hack_write(null, words, num_words, HACK_OUTPUT_BINARY)) {
+		perror("write failed");
+		exit(EXIT_FAILURE);
+	}
+	double binary = bench_now_seconds();
+
+	double mb = num_bytes / 1e6;
+	printf("%zu instructions, %.1f MB of source\n", num_words, mb);
+	printf("  parse+resolve: %8.1f ns/instruction %8.1f MB/s\n", (parsed - start) * 1e9 / num_words, mb / (parsed - start));
+	printf("  encode:        %8.1f ns/instruction\n", (encoded - parsed) * 1e9 / num_words);
+	printf("  write text:    %8.1f ns/instruction\n", (text - encoded) * 1e9 / num_words);
+	printf("  write binary:  %8.1f ns/instruction\n", (binary - text) * 1e9 / num_words);
+	printf("  total (text):  %8.1f MB/s\n", mb / (text - start));
+
+	fclose(null);
+	free(words);
+	asm_declarations_destroy(declarations);
+	free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 10000000);
+
+	printf("comp decode: switch %.1f ns, substring_cmp chain %.1f ns\n",
+	       bench_decode(comp_from_substr) * 1e9, bench_decode(comp_from_substr_chain) * 1e9);
+	bench_end_to_end(num_lines);
+}
@@ -0,0 +1,225 @@
+/*
+ * Measures the emulator's predecoded computed goto loop, on its own and with
+ * hot code compiled into traces, against a plain interpreter that fetches,
+ * decodes and switches on every word as it runs, which is how a
+ * straightforward emulator (or the course's Java one) steps. All of them run
+ * the same programs for the same number of cycles and must leave identical
+ * state behind.
+ *
+ * Usage: emulator_bench [cycles] [program.asm...]
+ *
+ * The programs default to Pong, as built by the course's Jack compiler. They
+ * must run at least as long as the cycle count without halting, since the
+ * plain interpreter doesn't notice halts.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assembler/codegen.h"
+#include "../assembler/input.h"
+#include "../assembler/object.h"
+#include "../emulator/cpu.h"
+#include "bench_utils.h"
+
+#define ROUNDS 3
+
+/*
+ * Multiplies RAM[0] by RAM[1] into RAM[2] by repeated addition, forever.
+ */
+static const char *const MULT_LOOP = "(START)\n@R2\nM=0\n@R1\nD=M\n@R3\nM=D\n"
+				     "(LOOP)\n@R3\nD=M\n@START\nD;JEQ\n"
+				     "@R0\nD=M\n@R2\nM=D+M\n@R3\nM=M-1\n@LOOP\n0;JMP\n";
+
+static void assemble(const char *name, const char *source, size_t len, uint16_t **words, size_t *num_words)
+{
+	struct asm_object object;
+	enum asm_parse_error err = asm_object_assemble(source, len, &object);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_objects_link(&object, 1, words, num_words);
+		asm_object_destroy(&object);
+	}
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "%s: error %d\n", name, err);
+		exit(EXIT_FAILURE);
+	}
+}
+
+struct naive_cpu {
+	uint16_t a, d, pc;
+	uint64_t cycles;
+	uint16_t ram[HACK_RAM_SIZE];
+};
+
+static uint16_t naive_comp(const struct naive_cpu *cpu, uint16_t word)
+{
+	uint16_t a = cpu->a, d = cpu->d, m = cpu->ram[a & HACK_ADDRESS_MASK];
+	uint16_t y = (word & 0x1000) ? m : a;
+	switch ((word >> 6) & 0x3F) {
+	case 0x2A: return 0;
+	case 0x3F: return 1;
+	case 0x3A: return 0xFFFF;
+	case 0x0C: return d;
+	case 0x30: return y;
+	case 0x0D: return ~d;
+	case 0x31: return ~y;
+	case 0x0F: return -d;
+	case 0x33: return -y;
+	case 0x1F: return d + 1;
+	case 0x37: return y + 1;
+	case 0x0E: return d - 1;
+	case 0x32: return y - 1;
+	case 0x02: return d + y;
+	case 0x13: return d - y;
+	case 0x07: return y - d;
+	case 0x00: return d & y;
+	case 0x15: return d | y;
+	}
+	fprintf(stderr, "invalid instruction %04x\n", word);
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * Runs until at least `max_cycles` instructions have executed, stopping at a
+ * jump like the real loop does so both end up in the same state.
+ */
+static void naive_run(struct naive_cpu *cpu, const uint16_t *rom, size_t len, uint64_t max_cycles)
+{
+	while (cpu->pc < len) {
+		uint16_t word = rom[cpu->pc];
+		cpu->cycles++;
+		if (!(word & 0x8000)) {
+			cpu->a = word;
+			cpu->pc++;
+			continue;
+		}
+
+		uint16_t out = naive_comp(cpu, word);
+		uint16_t old_a = cpu->a;
+		if (word & 0x08) {
+			cpu->ram[old_a & HACK_ADDRESS_MASK] = out;
+		}
+		if (word & 0x10) {
+			cpu->d = out;
+		}
+		if (word & 0x20) {
+			cpu->a = out;
+		}
+		int16_t value = (int16_t) out;
+		if (((word & 4) && value < 0) || ((word & 2) && value == 0) || ((word & 1) && value > 0)) {
+			cpu->pc = old_a & HACK_ADDRESS_MASK;
+			if (cpu->cycles >= max_cycles) {
+				return;
+			}
+		} else {
+			cpu->pc++;
+		}
+	}
+}
+
+/*
+ * Best of a few runs of the real emulator, leaving the last one's state in
+ * `cpu`.
+ */
+static double run_cpu(struct hack_cpu *cpu, const char *name, const uint16_t *rom, size_t len, uint64_t cycles,
+		      uint32_t hot_threshold)
+{
+	double best = 1e9;
+	for (int round = 0; round < ROUNDS; round++) {
+		size_t bad_index;
+		if (round > 0) {
+			hack_cpu_destroy(cpu);
+		}
+		if (!hack_cpu_init(cpu, rom, len, &bad_index)) {
+			fprintf(stderr, "%s: invalid instruction at %zu\n", name, bad_index);
+			exit(EXIT_FAILURE);
+		}
+		cpu->hot_threshold = hot_threshold;
+		cpu->ram[0] = 123;
+		cpu->ram[1] = 4567;
+		double start = bench_now_seconds();
+		hack_cpu_run(cpu, cycles);
+		double seconds = bench_now_seconds() - start;
+		if (seconds < best) {
+			best = seconds;
+		}
+	}
+	return best;
+}
+
+static void check_same(const char *name, const struct hack_cpu *cpu, const struct naive_cpu *naive)
+{
+	if (cpu->cycles != naive->cycles || cpu->a != naive->a || cpu->d != naive->d || cpu->pc != naive->pc ||
+	    memcmp(cpu->ram, naive->ram, sizeof(cpu->ram)) != 0) {
+		fprintf(stderr, "%s: emulators disagree after %llu and %llu cycles\n", name,
+			(unsigned long long) cpu->cycles, (unsigned long long) naive->cycles);
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void bench_program(const char *name, const uint16_t *rom, size_t len, uint64_t cycles)
+{
+	static struct naive_cpu naive;
+	double naive_seconds = 1e9;
+	for (int round = 0; round < ROUNDS; round++) {
+		memset(&naive, 0, sizeof(naive));
+		naive.ram[0] = 123;
+		naive.ram[1] = 4567;
+		double start = bench_now_seconds();
+		naive_run(&naive, rom, len, cycles);
+		double seconds = bench_now_seconds() - start;
+		if (seconds < naive_seconds) {
+			naive_seconds = seconds;
+		}
+	}
+
+	static struct hack_cpu cpu;
+	double interpreted_seconds = run_cpu(&cpu, name, rom, len, cycles, 0);
+	check_same(name, &cpu, &naive);
+	hack_cpu_destroy(&cpu);
+
+	double traced_seconds = run_cpu(&cpu, name, rom, len, cycles, HACK_HOT_THRESHOLD);
+	check_same(name, &cpu, &naive);
+	size_t num_traces = cpu.num_traces;
+	hack_cpu_destroy(&cpu);
+
+	double mips = naive.cycles / 1e6;
+	printf("%-12s %10.1f %12.1f %10.1f %8.2fx %8.2fx %7zu\n", name, mips / naive_seconds, mips / interpreted_seconds,
+	       mips / traced_seconds, naive_seconds / interpreted_seconds, naive_seconds / traced_seconds, num_traces);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t cycles = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000000;
+
+	printf("%llu cycles, in MIPS\n", (unsigned long long) cycles);
+	printf("%-12s %10s %12s %10s %9s %9s %7s\n", "program", "naive", "interpreted", "traced", "speedup", "speedup",
+	       "traces");
+
+	uint16_t *words;
+	size_t num_words;
+	assemble("mult", MULT_LOOP, strlen(MULT_LOOP), &words, &num_words);
+	bench_program("mult", words, num_words, cycles);
+	free(words);
+
+	// Pong sits waiting for a key once it's drawn the screen, which is still
+	// a realistic mix of calls, returns and stack traffic
+	const char *pong_path = "../projects/06/pong/Pong.asm";
+	char **paths = argc > 2 ? argv + 2 : (char **) &pong_path;
+	int num_paths = argc > 2 ? argc - 2 : 1;
+	for (int i = 0; i < num_paths; i++) {
+		struct asm_input input;
+		if (!asm_input_open(paths[i], &input)) {
+			perror(paths[i]);
+			exit(EXIT_FAILURE);
+		}
+		assemble(paths[i], input.data, input.len, &words, &num_words);
+		asm_input_close(&input);
+
+		const char *name = strrchr(paths[i], '/') != NULL ? strrchr(paths[i], '/') + 1 : paths[i];
+		bench_program(name, words, num_words, cycles);
+		free(words);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Measures how fast the assembler front end loads and parses a large
+ * synthetic program, through both the mmap path and the streaming fallback.
+ *
+ * Usage: input_bench [num_lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../assembler/input.h"
+#include "../assembler/parser.h"
+#include "bench_utils.h"
+
+static void run(const char *name, const char *path, size_t num_bytes, bool stream)
+{
+	double start = bench_now_seconds();
+
+	struct asm_input input;
+	bool ok;
+	if (stream) {
+		FILE *fp = fopen(path, "r");
+		if (fp == NULL) {
+			perror("fopen failed");
+			exit(EXIT_FAILURE);
+		}
+		ok = asm_input_read_stream(fp, &input);
+		fclose(fp);
+	} else {
+		ok = asm_input_open(path, &input);
+	}
+	if (!ok) {
+		perror("failed to read input");
+		exit(EXIT_FAILURE);
+	}
+	double loaded = bench_now_seconds();
+
+	asm_declarations declarations = asm_declarations_create(input.len);
+	enum asm_parse_error err = parse_asm_declarations(input.data, input.len, &declarations);
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "parse error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	double parsed = bench_now_seconds();
+
+	size_t num_declarations = declarations.len;
+	asm_declarations_destroy(declarations);
+	asm_input_close(&input);
+
+	double mb = num_bytes / 1e6;
+	printf("%-8s load: %8.1f MB/s  load+parse: %8.1f MB/s  (%zu declarations)\n",
+	       name, mb / (loaded - start), mb / (parsed - start), num_declarations);
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 10000000);
+
+	size_t num_bytes;
+	char *path = bench_create_synthetic_asm_file(num_lines, &num_bytes);
+	printf("synthetic program: %zu lines, %.1f MB\n", num_lines, num_bytes / 1e6);
+
+	run("mmap", path, num_bytes, false);
+	run("stream", path, num_bytes, true);
+
+	unlink(path);
+	free(path);
+}
@@ -0,0 +1,85 @@
+/*
+ * Measures how sharded assembly scales with the number of threads, against
+ * the single threaded parse/resolve/encode path, and checks every run
+ * produces exactly the same words.
+ *
+ * Usage: parallel_bench [num_lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../assembler/codegen.h"
+#include "../assembler/parallel.h"
+#include "../assembler/parser.h"
+#include "../assembler/resolver.h"
+#include "bench_utils.h"
+
+static double run_single(const char *source, size_t len, uint16_t **words, size_t *num_words)
+{
+	double start = bench_now_seconds();
+	asm_declarations declarations = asm_declarations_create(len);
+	enum asm_parse_error err = parse_asm_declarations(source, len, &declarations);
+	if (err == ASM_PARSE_ERROR_NO_ERROR) {
+		err = asm_resolve_symbols(&declarations);
+	}
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	*words = malloc(declarations.len * sizeof(uint16_t) + 1);
+	if (*words == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	*num_words = asm_declarations_encode(&declarations, *words);
+	asm_declarations_destroy(declarations);
+	return bench_now_seconds() - start;
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 10000000);
+
+	char *source;
+	size_t len;
+	FILE *fp = open_memstream(&source, &len);
+	if (fp == NULL) {
+		perror("open_memstream failed");
+		exit(EXIT_FAILURE);
+	}
+	bench_write_synthetic_asm(fp, num_lines);
+	fclose(fp);
+
+	uint16_t *expected;
+	size_t num_expected;
+	double single = run_single(source, len, &expected, &num_expected);
+
+	double mb = len / 1e6;
+	printf("synthetic program: %zu lines, %.1f MB, %ld online CPUs\n", num_lines, mb, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%8s %10s %10s %8s\n", "threads", "seconds", "MB/s", "speedup");
+	printf("%8s %10.3f %10.1f %8s\n", "single", single, mb / single, "1.00");
+
+	for (size_t threads = 1; threads <= 8; threads *= 2) {
+		uint16_t *words;
+		size_t num_words;
+		double start = bench_now_seconds();
+		enum asm_parse_error err = asm_assemble_parallel(source, len, threads, &words, &num_words);
+		double elapsed = bench_now_seconds() - start;
+		if (err != ASM_PARSE_ERROR_NO_ERROR) {
+			fprintf(stderr, "error %d\n", err);
+			exit(EXIT_FAILURE);
+		}
+		if (num_words != num_expected || memcmp(words, expected, num_words * sizeof(uint16_t)) != 0) {
+			fprintf(stderr, "%zu threads: output differs from single threaded\n", threads);
+			exit(EXIT_FAILURE);
+		}
+		printf("%8zu %10.3f %10.1f %8.2f\n", threads, elapsed, mb / elapsed, single / elapsed);
+		free(words);
+	}
+
+	free(expected);
+	free(source);
+}
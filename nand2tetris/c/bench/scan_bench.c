@@ -0,0 +1,192 @@
+/*
+ * Compares the vectorized line pre-scan against the parser's original
+ * character at a time walk, first on its own and then as part of a full
+ * parse, on the synthetic program and on an indented, heavily commented
+ * version of it.
+ *
+ * Usage: scan_bench [num_lines]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pull in the parser's static line helpers
+#include "../assembler/parser.c"
+
+#include "../assembler/scan.h"
+#include "bench_utils.h"
+
+#define ROUNDS 9
+
+static const char *const impl_names[] = {
+	[ASM_SCAN_SCALAR] = "scalar",
+	[ASM_SCAN_SSE2] = "sse2",
+	[ASM_SCAN_AVX2] = "avx2",
+};
+
+/*
+ * Counts declaration lines the way the parser used to find them: one
+ * character at a time through the parser_state helpers.
+ */
+static size_t count_lines_char_at_a_time(const char *source, size_t len)
+{
+	struct parser_state state = parser_state_create(source, len, NULL);
+	size_t num_lines = 0;
+	while (parser_state_current_char(&state)) {
+		eat_line_space_comments(&state);
+		char c = parser_state_current_char(&state);
+		if (c && c != '\n') {
+			num_lines++;
+		}
+		while (parser_state_current_char(&state) && parser_state_current_char(&state) != '\n') {
+			parser_state_advance(&state);
+		}
+		parser_state_advance(&state);
+	}
+	return num_lines;
+}
+
+static size_t count_lines_scanner(const char *source, size_t len, enum asm_scan_impl impl)
+{
+	struct asm_scanner scanner;
+	asm_scanner_init(&scanner, source, len, impl);
+	struct asm_line lines[ASM_PARSE_LINE_BATCH];
+	size_t num_lines = 0, found;
+	while ((found = asm_scan_lines(&scanner, lines, ASM_PARSE_LINE_BATCH)) > 0) {
+		num_lines += found;
+	}
+	return num_lines;
+}
+
+/*
+ * The parser's main loop before the pre-scan.
+ */
+static enum asm_parse_error parse_char_at_a_time(const char *source, size_t len, asm_declarations *declarations)
+{
+	struct parser_state state = parser_state_create(source, len, declarations);
+	while (parser_state_current_char(&state)) {
+		struct asm_declaration declaration;
+		enum asm_parse_error err = parse_declaration_line(&state, &declaration);
+		if (err == ASM_PARSE_ERROR_NO_ERROR) {
+			asm_declarations_append(declarations, declaration);
+		} else if (err != ASM_PARSE_ERROR_NO_DECLARATION) {
+			return err;
+		}
+	}
+	return ASM_PARSE_ERROR_NO_ERROR;
+}
+
+static double time_parse(const char *source, size_t len,
+			 enum asm_parse_error (*parse)(const char *, size_t, asm_declarations *))
+{
+	asm_declarations declarations = asm_declarations_create(len);
+	double start = bench_now_seconds();
+	enum asm_parse_error err = parse(source, len, &declarations);
+	double elapsed = bench_now_seconds() - start;
+	if (err != ASM_PARSE_ERROR_NO_ERROR) {
+		fprintf(stderr, "parse error %d\n", err);
+		exit(EXIT_FAILURE);
+	}
+	asm_declarations_destroy(declarations);
+	return elapsed;
+}
+
+static void run(const char *name, const char *source, size_t len)
+{
+	double mb = len / 1e6;
+	printf("%s: %.1f MB\n", name, mb);
+
+	size_t expected = 0;
+	double best = 1e9;
+	for (int round = 0; round < ROUNDS; round++) {
+		double start = bench_now_seconds();
+		expected = count_lines_char_at_a_time(source, len);
+		double elapsed = bench_now_seconds() - start;
+		best = elapsed < best ? elapsed : best;
+	}
+	printf("  line walk %-14s %8.1f MB/s\n", "char at a time", mb / best);
+
+	for (enum asm_scan_impl impl = ASM_SCAN_SCALAR; impl <= ASM_SCAN_AVX2; impl++) {
+		if (!asm_scan_impl_supported(impl)) {
+			printf("  line walk %-14s %8s\n", impl_names[impl], "n/a");
+			continue;
+		}
+		best = 1e9;
+		for (int round = 0; round < ROUNDS; round++) {
+			double start = bench_now_seconds();
+			size_t num_lines = count_lines_scanner(source, len, impl);
+			double elapsed = bench_now_seconds() - start;
+			best = elapsed < best ? elapsed : best;
+			if (num_lines != expected) {
+				fprintf(stderr, "%s found %zu lines, expected %zu\n", impl_names[impl], num_lines, expected);
+				exit(EXIT_FAILURE);
+			}
+		}
+		printf("  line walk %-14s %8.1f MB/s\n", impl_names[impl], mb / best);
+	}
+
+	// Alternate the two so drift in machine load hits both equally
+	double before = 1e9, after = 1e9;
+	for (int round = 0; round < ROUNDS; round++) {
+		double elapsed = time_parse(source, len, parse_char_at_a_time);
+		before = elapsed < before ? elapsed : before;
+		elapsed = time_parse(source, len, parse_asm_declarations);
+		after = elapsed < after ? elapsed : after;
+	}
+	printf("  full parse %-13s %8.1f MB/s\n", "char at a time", mb / before);
+	printf("  full parse %-13s %8.1f MB/s (%.2fx)\n", impl_names[asm_scan_best_impl()], mb / after, before / after);
+}
+
+/*
+ * Indents every line of `source` and gives it a trailing comment, like
+ * annotated compiler output.
+ */
+static char *annotate(const char *source, size_t len, size_t *annotated_len)
+{
+	char *buffer;
+	FILE *fp = open_memstream(&buffer, annotated_len);
+	if (fp == NULL) {
+		perror("open_memstream failed");
+		exit(EXIT_FAILURE);
+	}
+
+	size_t lineno = 0;
+	const char *line = source;
+	const char *end = source + len;
+	while (line < end) {
+		const char *newline = memchr(line, '\n', end - line);
+		size_t line_len = (newline != NULL ? newline : end) - line;
+		fprintf(fp, "        %.*s", (int) line_len, line);
+		if (line_len > 0 && line[0] != '(') {
+			fprintf(fp, "    // generated from Main.vm line %zu", ++lineno);
+		}
+		fputc('\n', fp);
+		line += line_len + 1;
+	}
+	fclose(fp);
+	return buffer;
+}
+
+int main(int argc, char **argv)
+{
+	size_t num_lines = bench_lines_arg(argc, argv, 4000000);
+
+	char *source;
+	size_t len;
+	FILE *fp = open_memstream(&source, &len);
+	if (fp == NULL) {
+		perror("open_memstream failed");
+		exit(EXIT_FAILURE);
+	}
+	bench_write_synthetic_asm(fp, num_lines);
+	fclose(fp);
+	run("synthetic", source, len);
+
+	size_t annotated_len;
+	char *annotated = annotate(source, len, &annotated_len);
+	run("annotated", annotated, annotated_len);
+
+	free(annotated);
+	free(source);
+}
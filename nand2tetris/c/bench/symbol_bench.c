@@ -0,0 +1,100 @@
+/*
+ * Compares symbol lookup cost in the interned hash table against a linear
+ * strcmp scan (what a naive label list does) as the number of distinct labels
+ * grows.
+ *
+ * Usage: symbol_bench [max_labels]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../assembler/arena.h"
+#include "../assembler/symbol_table.h"
+#include "bench_utils.h"
+
+#define NAME_SIZE 48
+
+/*
+ * Only time this many lookups for the linear scan so large tables still
+ * finish.
+ */
+#define LINEAR_LOOKUPS 2000
+
+static char *make_names(size_t n)
+{
+	char *names = malloc(n * NAME_SIZE);
+	if (names == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < n; i++) {
+		snprintf(names + i * NAME_SIZE, NAME_SIZE, "Main.loop$label_%zu", i);
+	}
+	return names;
+}
+
+static double bench_hash(const char *names, size_t n)
+{
+	struct arena arena;
+	arena_init(&arena, 0);
+	struct asm_symbol_table table;
+	asm_symbol_table_init(&table);
+
+	for (size_t i = 0; i < n; i++) {
+		const char *name = names + i * NAME_SIZE;
+		asm_symbol_table_intern(&table, &arena, name, strlen(name));
+	}
+
+	// Look every symbol up again in a scattered order
+	size_t found = 0;
+	double start = bench_now_seconds();
+	for (size_t i = 0; i < n; i++) {
+		const char *name = names + ((i * 7919) % n) * NAME_SIZE;
+		found += asm_symbol_table_intern(&table, &arena, name, strlen(name)) != NULL;
+	}
+	double elapsed = bench_now_seconds() - start;
+
+	if (found != n) {
+		fprintf(stderr, "lost symbols\n");
+		exit(EXIT_FAILURE);
+	}
+	arena_destroy(&arena);
+	return elapsed / n;
+}
+
+static double bench_linear(const char *names, size_t n)
+{
+	size_t lookups = n < LINEAR_LOOKUPS ? n : LINEAR_LOOKUPS;
+	size_t found = 0;
+	double start = bench_now_seconds();
+	for (size_t i = 0; i < lookups; i++) {
+		const char *name = names + ((i * 7919) % n) * NAME_SIZE;
+		for (size_t j = 0; j < n; j++) {
+			if (strcmp(names + j * NAME_SIZE, name) == 0) {
+				found++;
+				break;
+			}
+		}
+	}
+	double elapsed = bench_now_seconds() - start;
+
+	if (found != lookups) {
+		fprintf(stderr, "lost symbols\n");
+		exit(EXIT_FAILURE);
+	}
+	return elapsed / lookups;
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_labels = bench_lines_arg(argc, argv, 1000000);
+
+	printf("%10s %16s %16s\n", "labels", "hash ns/lookup", "linear ns/lookup");
+	for (size_t n = 1000; n <= max_labels; n *= 10) {
+		char *names = make_names(n);
+		printf("%10zu %16.1f %16.1f\n", n, bench_hash(names, n) * 1e9, bench_linear(names, n) * 1e9);
+		free(names);
+	}
+}
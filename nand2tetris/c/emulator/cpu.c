@@ -0,0 +1,471 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../assembler/codegen.h"
+#include "../assembler/parser.h"
+#include "cpu.h"
+
+/*
+ * Every comp, as an expression over the registers and memory of the dispatch
+ * loop. The names match `enum asm_c_a_comp`.
+ */
+#define HACK_COMPS(X) \
+	X(ZERO, 0) \
+	X(ONE, 1) \
+	X(NEG_ONE, 0xFFFF) \
+	X(D, d) \
+	X(A, a) \
+	X(M, MEM) \
+	X(NOT_D, ~d) \
+	X(NOT_A, ~a) \
+	X(NOT_M, ~MEM) \
+	X(NEG_D, -d) \
+	X(NEG_A, -a) \
+	X(NEG_M, -MEM) \
+	X(D_PLUS_ONE, d + 1) \
+	X(A_PLUS_ONE, a + 1) \
+	X(M_PLUS_ONE, MEM + 1) \
+	X(D_MINUS_ONE, d - 1) \
+	X(A_MINUS_ONE, a - 1) \
+	X(M_MINUS_ONE, MEM - 1) \
+	X(D_PLUS_A, d + a) \
+	X(D_PLUS_M, d + MEM) \
+	X(D_MINUS_A, d - a) \
+	X(D_MINUS_M, d - MEM) \
+	X(A_MINUS_D, a - d) \
+	X(M_MINUS_D, MEM - d) \
+	X(D_AND_A, d & a) \
+	X(D_AND_M, d & MEM) \
+	X(D_OR_A, d | a) \
+	X(D_OR_M, d | MEM)
+
+#define HACK_NUM_COMPS 28
+
+/*
+ * Micro-op kinds. Each C instruction is specialized on its comp and on either
+ * its dest or its jump, which covers nearly everything compilers emit; the
+ * rare instruction with both goes through a generic variant per comp.
+ */
+enum uop_kind {
+	UOP_A,
+	UOP_NOP,
+	UOP_HALT,
+	UOP_END,
+	/** Traces only: the VM translator's push of D, `@SP A=M M=D @SP M=M+1` */
+	UOP_PUSH_D,
+	/** Traces only: its pop into D, `@SP AM=M-1 D=M` */
+	UOP_POP_D,
+	/** Traces only: carry on from `pc` wherever a jump there would go */
+	UOP_CONTINUE,
+	UOP_C_BASE,
+};
+
+/*
+ * Variants of each comp, after UOP_C_BASE + comp * UOP_C_VARIANTS: dest M to
+ * AMD (1 to 7) at dest - 1, jumps JGT to JMP (1 to 7) at jump + 6, and then
+ * the generic one.
+ */
+#define UOP_C_VARIANTS 15
+#define UOP_C_GENERIC 14
+#define UOP_C(comp, variant) (UOP_C_BASE + (comp) * UOP_C_VARIANTS + (variant))
+
+/*
+ * Every C kind again, fused with the A instruction before it, whose value is
+ * in `imm`. Traces only.
+ */
+#define UOP_A_FUSED (HACK_NUM_COMPS * UOP_C_VARIANTS)
+#define UOP_NUM_KINDS (UOP_C(HACK_NUM_COMPS, 0) + UOP_A_FUSED)
+
+/*
+ * Trace length limit, and room for traces: enough for every instruction of a
+ * large program to be compiled twice over. Once it's full, whatever isn't
+ * compiled stays interpreted.
+ */
+#define TRACE_MAX_UOPS 128
+#define TRACES_SIZE (2 * HACK_ROM_SIZE)
+
+struct hack_uop {
+	/** Label in the dispatch loop, once threaded */
+	const void *handler;
+	uint16_t kind;
+	/** Value loaded by an A instruction */
+	uint16_t imm;
+	/** Address of the (first) instruction this stands for */
+	uint16_t pc;
+	/** For generic C micro-ops */
+	uint8_t dest;
+	uint8_t jump;
+};
+
+/*
+ * True for `@i` at address i followed by an unconditional jump with no dest,
+ * the idiom programs end with.
+ */
+static bool is_halt_loop(const uint16_t *rom, size_t len, size_t i)
+{
+	struct asm_instruction next;
+	return rom[i] == i && i + 1 < len && asm_instruction_decode(rom[i + 1], &next) &&
+		next.type == ASM_INST_C && next.c_instruction.jump == ASM_C_JUMP_JMP &&
+		next.c_instruction.dest == ASM_C_DEST_NULL;
+}
+
+static struct hack_uop predecode(const struct asm_instruction *instruction)
+{
+	if (instruction->type == ASM_INST_A) {
+		return (struct hack_uop) {.kind = UOP_A, .imm = instruction->a_instruction.address};
+	}
+
+	const struct asm_c_instruction *c = &instruction->c_instruction;
+	struct hack_uop uop = {.dest = c->dest, .jump = c->jump};
+	if (c->jump == ASM_C_JUMP_NULL) {
+		// A computation that goes nowhere doesn't need computing
+		uop.kind = c->dest == ASM_C_DEST_NULL ? UOP_NOP : UOP_C(c->a_comp, c->dest - 1);
+	} else if (c->dest == ASM_C_DEST_NULL) {
+		uop.kind = UOP_C(c->a_comp, c->jump + 6);
+	} else {
+		uop.kind = UOP_C(c->a_comp, UOP_C_GENERIC);
+	}
+	return uop;
+}
+
+bool hack_cpu_init(struct hack_cpu *cpu, const uint16_t *rom, size_t len, size_t *bad_index)
+{
+	if (len > HACK_ROM_SIZE) {
+		*bad_index = HACK_ROM_SIZE;
+		return false;
+	}
+
+	// One extra so falling off the very end of a full ROM also halts
+	struct hack_uop *code = malloc((HACK_ROM_SIZE + 1) * sizeof(*code));
+	if (code == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < len; i++) {
+		struct asm_instruction instruction;
+		if (!asm_instruction_decode(rom[i], &instruction)) {
+			free(code);
+			*bad_index = i;
+			return false;
+		}
+		code[i] = predecode(&instruction);
+		code[i].pc = i;
+		if (is_halt_loop(rom, len, i)) {
+			code[i].kind = UOP_HALT;
+		}
+	}
+	for (size_t i = len; i <= HACK_ROM_SIZE; i++) {
+		code[i] = (struct hack_uop) {.kind = UOP_END, .pc = i};
+	}
+
+	struct hack_uop **entries = malloc((HACK_ROM_SIZE + 1) * sizeof(*entries));
+	uint32_t *heat = malloc(HACK_ROM_SIZE * sizeof(*heat));
+	if (entries == NULL || heat == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i <= HACK_ROM_SIZE; i++) {
+		entries[i] = &code[i];
+	}
+
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->hot_threshold = HACK_HOT_THRESHOLD;
+	cpu->code = code;
+	cpu->rom_len = len;
+	cpu->entries = entries;
+	cpu->heat = heat;
+	return true;
+}
+
+void hack_cpu_destroy(struct hack_cpu *cpu)
+{
+	free(cpu->code);
+	free(cpu->entries);
+	free(cpu->heat);
+	free(cpu->traces);
+	cpu->code = NULL;
+	cpu->entries = NULL;
+	cpu->heat = NULL;
+	cpu->traces = NULL;
+}
+
+static bool is_uop(const struct hack_uop *uop, enum asm_c_a_comp comp, enum asm_c_dest dest)
+{
+	return uop->kind == UOP_C(comp, dest - 1);
+}
+
+static bool is_sp_load(const struct hack_uop *uop)
+{
+	return uop->kind == UOP_A && uop->imm == 0;
+}
+
+static bool is_push_d(const struct hack_uop *code)
+{
+	return is_sp_load(&code[0]) && is_uop(&code[1], ASM_C_A_COMP_M, ASM_C_DEST_A) &&
+		is_uop(&code[2], ASM_C_A_COMP_D, ASM_C_DEST_M) && is_sp_load(&code[3]) &&
+		is_uop(&code[4], ASM_C_A_COMP_M_PLUS_ONE, ASM_C_DEST_M);
+}
+
+static bool is_pop_d(const struct hack_uop *code)
+{
+	return is_sp_load(&code[0]) && is_uop(&code[1], ASM_C_A_COMP_M_MINUS_ONE, ASM_C_DEST_AM) &&
+		is_uop(&code[2], ASM_C_A_COMP_M, ASM_C_DEST_D);
+}
+
+static bool is_unconditional_jump(const struct hack_uop *uop)
+{
+	return uop->kind >= UOP_C_BASE && uop->jump == ASM_C_JUMP_JMP;
+}
+
+/*
+ * Compiles a trace starting at `start` and points jumps there at it. A trace
+ * runs straight through conditional jumps, which leave it when taken, and
+ * ends at an unconditional one, or else with a UOP_CONTINUE back to wherever
+ * the next address goes. Jumps into the middle of a trace land in the plain
+ * micro-ops, which are never changed, so they're always safe to fall back on.
+ */
+static void compile_trace(struct hack_cpu *cpu, uint16_t start, const void *const *handlers)
+{
+	if (cpu->traces == NULL) {
+		cpu->traces = malloc(TRACES_SIZE * sizeof(*cpu->traces));
+		if (cpu->traces == NULL) {
+			fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+	}
+	// Halting is already as fast as it gets, and a trace there would be
+	// nothing but a UOP_CONTINUE back to itself
+	if (cpu->traces_len + TRACE_MAX_UOPS + 1 > TRACES_SIZE || cpu->code[start].kind == UOP_HALT ||
+	    cpu->code[start].kind == UOP_END) {
+		return;
+	}
+
+	const struct hack_uop *code = cpu->code;
+	struct hack_uop *trace = &cpu->traces[cpu->traces_len];
+	size_t len = 0;
+	size_t pc = start;
+	bool ended = false;
+	// code[] has a UOP_END after the program, which stops every match short
+	while (len < TRACE_MAX_UOPS && !ended && code[pc].kind != UOP_HALT && code[pc].kind != UOP_END) {
+		struct hack_uop uop = code[pc];
+		if (pc + 5 <= cpu->rom_len && is_push_d(&code[pc])) {
+			uop.kind = UOP_PUSH_D;
+			pc += 5;
+		} else if (pc + 3 <= cpu->rom_len && is_pop_d(&code[pc])) {
+			uop.kind = UOP_POP_D;
+			pc += 3;
+		} else if (uop.kind == UOP_A && code[pc + 1].kind >= UOP_C_BASE) {
+			uop = code[pc + 1];
+			uop.kind += UOP_A_FUSED;
+			uop.imm = code[pc].imm;
+			uop.pc = pc;
+			pc += 2;
+		} else {
+			pc++;
+		}
+		ended = is_unconditional_jump(&uop);
+		uop.handler = handlers[uop.kind];
+		trace[len++] = uop;
+	}
+	if (!ended) {
+		trace[len++] = (struct hack_uop) {.handler = handlers[UOP_CONTINUE], .kind = UOP_CONTINUE, .pc = pc};
+	}
+
+	cpu->traces_len += len;
+	cpu->num_traces++;
+	cpu->entries[start] = trace;
+}
+
+static bool jump_taken(uint8_t jump, uint16_t out)
+{
+	int16_t value = (int16_t) out;
+	return ((jump & 4) && value < 0) || ((jump & 2) && value == 0) || ((jump & 1) && value > 0);
+}
+
+// Labels as values are a GNU extension, and the whole point of this loop
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+enum hack_halt hack_cpu_run(struct hack_cpu *cpu, uint64_t max_cycles)
+{
+#define C_LABELS_FOR(name, fused, suffix) \
+	[UOP_C(ASM_C_A_COMP_##name, 0) + (fused)] = &&name##_M##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 1) + (fused)] = &&name##_D##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 2) + (fused)] = &&name##_MD##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 3) + (fused)] = &&name##_A##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 4) + (fused)] = &&name##_AM##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 5) + (fused)] = &&name##_AD##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 6) + (fused)] = &&name##_AMD##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 7) + (fused)] = &&name##_JGT##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 8) + (fused)] = &&name##_JEQ##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 9) + (fused)] = &&name##_JGE##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 10) + (fused)] = &&name##_JLT##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 11) + (fused)] = &&name##_JNE##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 12) + (fused)] = &&name##_JLE##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, 13) + (fused)] = &&name##_JMP##suffix, \
+	[UOP_C(ASM_C_A_COMP_##name, UOP_C_GENERIC) + (fused)] = &&name##_GENERIC##suffix,
+#define C_LABELS(name, expr) C_LABELS_FOR(name, 0, ) C_LABELS_FOR(name, UOP_A_FUSED, _FUSED)
+
+	static const void *const handlers[UOP_NUM_KINDS] = {
+		[UOP_A] = &&op_a,
+		[UOP_NOP] = &&op_nop,
+		[UOP_HALT] = &&op_halt,
+		[UOP_END] = &&op_end,
+		[UOP_PUSH_D] = &&op_push_d,
+		[UOP_POP_D] = &&op_pop_d,
+		[UOP_CONTINUE] = &&op_continue,
+		HACK_COMPS(C_LABELS)
+	};
+#undef C_LABELS
+#undef C_LABELS_FOR
+
+	struct hack_uop *code = cpu->code;
+	struct hack_uop **entries = cpu->entries;
+	uint32_t *heat = cpu->heat;
+	if (!cpu->threaded) {
+		for (size_t i = 0; i <= HACK_ROM_SIZE; i++) {
+			code[i].handler = handlers[code[i].kind];
+		}
+		for (size_t i = 0; i < HACK_ROM_SIZE; i++) {
+			heat[i] = cpu->hot_threshold;
+		}
+		cpu->threaded = true;
+	}
+
+	// Registers live in locals so the compiler can keep them in machine
+	// registers across the whole loop
+	uint16_t a = cpu->a;
+	uint16_t d = cpu->d;
+	uint16_t *ram = cpu->ram;
+	uint64_t cycles = cpu->cycles;
+	uint64_t limit = cycles + max_cycles < cycles ? UINT64_MAX : cycles + max_cycles;
+	struct hack_uop *op = entries[cpu->pc];
+	enum hack_halt halt;
+
+#define MEM ram[a & HACK_ADDRESS_MASK]
+#define DISPATCH() goto *op->handler
+#define NEXT(n) \
+	do { \
+		cycles += (n); \
+		op++; \
+		DISPATCH(); \
+	} while (0)
+	// Taken jumps are where time is checked and heat is counted
+#define JUMP_IF(cond, target, n) \
+	do { \
+		cycles += (n); \
+		if (cond) { \
+			uint16_t to = (target) & HACK_ADDRESS_MASK; \
+			op = entries[to]; \
+			if (cycles >= limit) { \
+				goto out_of_cycles; \
+			} \
+			if (heat[to] != 0 && --heat[to] == 0) { \
+				compile_trace(cpu, to, handlers); \
+				op = entries[to]; \
+			} \
+		} else { \
+			op++; \
+		} \
+		DISPATCH(); \
+	} while (0)
+
+	// dest=comp stores happen at the end of the cycle, so M is written at
+	// the address A had going in. Fused variants load A first, and count as
+	// two instructions.
+#define C_HANDLERS_FOR(name, expr, suffix, load, n) \
+	name##_M##suffix: { load; uint16_t out = (expr); MEM = out; NEXT(n); } \
+	name##_D##suffix: { load; d = (expr); NEXT(n); } \
+	name##_MD##suffix: { load; uint16_t out = (expr); MEM = out; d = out; NEXT(n); } \
+	name##_A##suffix: { load; a = (expr); NEXT(n); } \
+	name##_AM##suffix: { load; uint16_t out = (expr); MEM = out; a = out; NEXT(n); } \
+	name##_AD##suffix: { load; uint16_t out = (expr); a = out; d = out; NEXT(n); } \
+	name##_AMD##suffix: { load; uint16_t out = (expr); MEM = out; a = out; d = out; NEXT(n); } \
+	name##_JGT##suffix: { load; uint16_t out = (expr); JUMP_IF((int16_t) out > 0, a, n); } \
+	name##_JEQ##suffix: { load; uint16_t out = (expr); JUMP_IF(out == 0, a, n); } \
+	name##_JGE##suffix: { load; uint16_t out = (expr); JUMP_IF((int16_t) out >= 0, a, n); } \
+	name##_JLT##suffix: { load; uint16_t out = (expr); JUMP_IF((int16_t) out < 0, a, n); } \
+	name##_JNE##suffix: { load; uint16_t out = (expr); JUMP_IF(out != 0, a, n); } \
+	name##_JLE##suffix: { load; uint16_t out = (expr); JUMP_IF((int16_t) out <= 0, a, n); } \
+	name##_JMP##suffix: { load; JUMP_IF(true, a, n); } \
+	name##_GENERIC##suffix: { \
+		load; \
+		uint16_t out = (expr); \
+		uint16_t old_a = a; \
+		if (op->dest & ASM_C_DEST_M) { \
+			MEM = out; \
+		} \
+		if (op->dest & ASM_C_DEST_D) { \
+			d = out; \
+		} \
+		if (op->dest & ASM_C_DEST_A) { \
+			a = out; \
+		} \
+		JUMP_IF(jump_taken(op->jump, out), old_a, n); \
+	}
+#define C_HANDLERS(name, expr) \
+	C_HANDLERS_FOR(name, expr, , (void) 0, 1) \
+	C_HANDLERS_FOR(name, expr, _FUSED, a = op->imm, 2)
+
+	DISPATCH();
+
+op_a:
+	a = op->imm;
+	NEXT(1);
+op_nop:
+	NEXT(1);
+op_push_d:
+	a = ram[0];
+	MEM = d;
+	ram[0]++;
+	a = 0;
+	NEXT(5);
+op_pop_d:
+	a = --ram[0];
+	d = MEM;
+	NEXT(3);
+op_continue:
+	op = entries[op->pc];
+	DISPATCH();
+
+	HACK_COMPS(C_HANDLERS)
+
+op_halt:
+	halt = HACK_HALT_LOOP;
+	goto done;
+op_end:
+	halt = HACK_HALT_END_OF_ROM;
+	goto done;
+out_of_cycles:
+	halt = HACK_HALT_CYCLE_LIMIT;
+done:
+	cpu->a = a;
+	cpu->d = d;
+	cpu->cycles = cycles;
+	cpu->pc = op->pc;
+	return halt;
+
+#undef C_HANDLERS
+#undef C_HANDLERS_FOR
+#undef JUMP_IF
+#undef NEXT
+#undef DISPATCH
+#undef MEM
+}
+
+#pragma GCC diagnostic pop
+
+const char *hack_halt_name(enum hack_halt halt)
+{
+	switch (halt) {
+	case HACK_HALT_LOOP:
+		return "halted in a loop";
+	case HACK_HALT_END_OF_ROM:
+		return "ran off the end of the program";
+	case HACK_HALT_CYCLE_LIMIT:
+		return "hit the cycle limit";
+	}
+	return "unknown";
+}
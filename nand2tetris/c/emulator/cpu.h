@@ -0,0 +1,92 @@
+/*
+ * Hack CPU emulator. ROM is decoded once up front into micro-ops, which are
+ * then run by a computed goto dispatch loop. Jump targets that get hot are
+ * compiled into traces of superinstructions, each covering several Hack
+ * instructions, which the same loop runs.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * A instructions load 15 bits, so that's all the ROM and RAM addresses there
+ * are. RAM beyond the keyboard isn't wired to anything on the real machine,
+ * but having all of it means no access ever needs a bounds check.
+ */
+#define HACK_ROM_SIZE 32768
+#define HACK_RAM_SIZE 32768
+#define HACK_ADDRESS_MASK 0x7FFF
+
+/*
+ * Taken jumps to an address before the code from there is compiled.
+ */
+#define HACK_HOT_THRESHOLD 32
+
+#define HACK_SCREEN 16384
+#define HACK_KBD 24576
+
+/*
+ * Why `hack_cpu_run` returned.
+ */
+enum hack_halt {
+	/** Reached the usual `(END) @END 0;JMP` infinite loop */
+	HACK_HALT_LOOP,
+	/** Ran past the last instruction of the program */
+	HACK_HALT_END_OF_ROM,
+	/** Used up its cycle budget */
+	HACK_HALT_CYCLE_LIMIT,
+};
+
+struct hack_uop;
+
+struct hack_cpu {
+	uint16_t a;
+	uint16_t d;
+	uint16_t pc;
+	/** Instructions executed so far */
+	uint64_t cycles;
+	uint16_t ram[HACK_RAM_SIZE];
+
+	/**
+	 * Taken jumps to an address before compiling a trace from it, or 0 to
+	 * only ever interpret. Defaults to HACK_HOT_THRESHOLD; changes after
+	 * the first `hack_cpu_run` are ignored.
+	 */
+	uint32_t hot_threshold;
+	/** Traces compiled so far */
+	size_t num_traces;
+
+	/** HACK_ROM_SIZE micro-ops: the program, then halts */
+	struct hack_uop *code;
+	size_t rom_len;
+	/** Whether `code` points at the dispatch loop's labels yet */
+	bool threaded;
+	/** Where a jump to each address goes: into `code` or a trace */
+	struct hack_uop **entries;
+	/** Taken jumps left before each address gets compiled; 0 once it has */
+	uint32_t *heat;
+	/** Every trace, end to end */
+	struct hack_uop *traces;
+	size_t traces_len;
+};
+
+/*
+ * Decodes `len` words of ROM and resets the CPU, with RAM all zeros. Returns
+ * false, setting `*bad_index` to the first offending word, if the program is
+ * too large or holds an instruction with invalid comp bits.
+ */
+bool hack_cpu_init(struct hack_cpu *cpu, const uint16_t *rom, size_t len, size_t *bad_index);
+
+void hack_cpu_destroy(struct hack_cpu *cpu);
+
+/*
+ * Runs from the current state for at most about `max_cycles` more
+ * instructions. The budget is only checked on jumps, so straight-line code
+ * can overshoot it by up to its length. Can be called again to carry on.
+ */
+enum hack_halt hack_cpu_run(struct hack_cpu *cpu, uint64_t max_cycles);
+
+const char *hack_halt_name(enum hack_halt halt);
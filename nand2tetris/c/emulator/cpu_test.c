@@ -0,0 +1,210 @@
+#include "unity.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../assembler/codegen.h"
+#include "../assembler/parser.h"
+#include "../assembler/resolver.h"
+#include "cpu.h"
+
+static struct hack_cpu cpu;
+
+void setUp (void) {} /* Is run before every test, put unit init calls here. */
+void tearDown (void) { hack_cpu_destroy(&cpu); } /* Is run after every test, put unit clean-up calls here. */
+
+/*
+ * Assembles `source` and loads it into `cpu`.
+ */
+static void load(const char *source)
+{
+	asm_declarations declarations = asm_declarations_create(0);
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, parse_asm_declarations(source, strlen(source), &declarations));
+	TEST_ASSERT_EQUAL_INT(ASM_PARSE_ERROR_NO_ERROR, asm_resolve_symbols(&declarations));
+	uint16_t words[256];
+	TEST_ASSERT_LESS_OR_EQUAL_size_t(256, declarations.len);
+	size_t len = asm_declarations_encode(&declarations, words);
+	asm_declarations_destroy(declarations);
+
+	size_t bad_index;
+	TEST_ASSERT_TRUE(hack_cpu_init(&cpu, words, len, &bad_index));
+}
+
+void test_cpu_add()
+{
+	// projects/06/add/Add.asm
+	load("@2\nD=A\n@3\nD=D+A\n@0\nM=D\n");
+	TEST_ASSERT_EQUAL_INT(HACK_HALT_END_OF_ROM, hack_cpu_run(&cpu, 1000));
+	TEST_ASSERT_EQUAL_UINT16(5, cpu.ram[0]);
+	TEST_ASSERT_EQUAL_UINT64(6, cpu.cycles);
+	TEST_ASSERT_EQUAL_UINT16(6, cpu.pc);
+}
+
+void test_cpu_max()
+{
+	// projects/06/max/Max.asm
+	const char *max = "@R0\nD=M\n@R1\nD=D-M\n@OUTPUT_FIRST\nD;JGT\n"
+			  "@R1\nD=M\n@OUTPUT_D\n0;JMP\n"
+			  "(OUTPUT_FIRST)\n@R0\nD=M\n"
+			  "(OUTPUT_D)\n@R2\nM=D\n"
+			  "(INFINITE_LOOP)\n@INFINITE_LOOP\n0;JMP\n";
+	const int16_t cases[][3] = {{3, 5, 5}, {5, 3, 5}, {-1, -7, -1}, {-32768, -32767, -32767}, {4, 4, 4}};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		load(max);
+		cpu.ram[0] = cases[i][0];
+		cpu.ram[1] = cases[i][1];
+		TEST_ASSERT_EQUAL_INT(HACK_HALT_LOOP, hack_cpu_run(&cpu, 1000));
+		TEST_ASSERT_EQUAL_INT16(cases[i][2], (int16_t) cpu.ram[2]);
+		TEST_ASSERT_EQUAL_UINT16(14, cpu.pc);
+		// Halting again straight away
+		TEST_ASSERT_EQUAL_INT(HACK_HALT_LOOP, hack_cpu_run(&cpu, 1000));
+		hack_cpu_destroy(&cpu);
+	}
+}
+
+void test_cpu_loop()
+{
+	// Sums 1 to 100 into RAM[17]
+	load("@i\nM=1\n@sum\nM=0\n"
+	     "(LOOP)\n@i\nD=M\n@100\nD=D-A\n@END\nD;JGT\n"
+	     "@i\nD=M\n@sum\nM=D+M\n@i\nM=M+1\n@LOOP\n0;JMP\n"
+	     "(END)\n@END\n0;JMP\n");
+	TEST_ASSERT_EQUAL_INT(HACK_HALT_LOOP, hack_cpu_run(&cpu, 100000));
+	TEST_ASSERT_EQUAL_UINT16(5050, cpu.ram[17]);
+	TEST_ASSERT_EQUAL_UINT64(4 + 100 * 14 + 6, cpu.cycles);
+}
+
+void test_cpu_all_comps()
+{
+	// With D = 7, A = 100 and M = 9
+	const struct {
+		const char *comp;
+		int16_t value;
+	} comps[] = {
+		{"0", 0}, {"1", 1}, {"-1", -1},
+		{"D", 7}, {"A", 100}, {"M", 9},
+		{"!D", ~7}, {"!A", ~100}, {"!M", ~9},
+		{"-D", -7}, {"-A", -100}, {"-M", -9},
+		{"D+1", 8}, {"A+1", 101}, {"M+1", 10},
+		{"D-1", 6}, {"A-1", 99}, {"M-1", 8},
+		{"D+A", 107}, {"D+M", 16},
+		{"D-A", -93}, {"D-M", -2},
+		{"A-D", 93}, {"M-D", 2},
+		{"D&A", 7 & 100}, {"D&M", 7 & 9},
+		{"D|A", 7 | 100}, {"D|M", 7 | 9},
+	};
+
+	const char *dests[] = {"D", "MD", "AD", "AMD"};
+	for (size_t i = 0; i < sizeof(comps) / sizeof(comps[0]); i++) {
+		for (size_t j = 0; j < sizeof(dests) / sizeof(dests[0]); j++) {
+			char source[64];
+			snprintf(source, sizeof(source), "@7\nD=A\n@100\n%s=%s\n@0\nM=D\n", dests[j], comps[i].comp);
+			load(source);
+			cpu.ram[100] = 9;
+			hack_cpu_run(&cpu, 1000);
+			TEST_ASSERT_EQUAL_INT16_MESSAGE(comps[i].value, (int16_t) cpu.ram[0], comps[i].comp);
+			if (strchr(dests[j], 'M') != NULL) {
+				// Stored where A pointed before the instruction
+				TEST_ASSERT_EQUAL_INT16_MESSAGE(comps[i].value, (int16_t) cpu.ram[100], comps[i].comp);
+			}
+			hack_cpu_destroy(&cpu);
+		}
+	}
+}
+
+void test_cpu_jumps()
+{
+	// Each jump against a negative, zero and positive comp, with whether it's
+	// taken for each
+	const char *jumps[] = {"JGT", "JEQ", "JGE", "JLT", "JNE", "JLE", "JMP"};
+	const char *taken[] = {"001", "010", "011", "100", "101", "110", "111"};
+	const char *values[] = {"-1", "0", "1"};
+	for (size_t i = 0; i < sizeof(jumps) / sizeof(jumps[0]); i++) {
+		for (size_t j = 0; j < 3; j++) {
+			char source[128];
+			snprintf(source, sizeof(source), "@YES\n%s;%s\n@END\n0;JMP\n(YES)\n@R5\nM=1\n(END)\n@END\n0;JMP\n",
+				 values[j], jumps[i]);
+			load(source);
+			// Jumping to END then compiles a trace at the halt, which
+			// must still halt
+			cpu.hot_threshold = 1;
+			TEST_ASSERT_EQUAL_INT(HACK_HALT_LOOP, hack_cpu_run(&cpu, 1000));
+			TEST_ASSERT_EQUAL_UINT16_MESSAGE(taken[i][j] - '0', cpu.ram[5], jumps[i]);
+			hack_cpu_destroy(&cpu);
+		}
+	}
+
+	// A dest and a jump together: the jump goes where A was, not where the
+	// new A points
+	load("@10\nD=A\n@6\nAD=D-1;JGT\n@R1\nM=1\n@R2\nM=D\n");
+	TEST_ASSERT_EQUAL_INT(HACK_HALT_END_OF_ROM, hack_cpu_run(&cpu, 1000));
+	TEST_ASSERT_EQUAL_UINT16(0, cpu.ram[1]);
+	TEST_ASSERT_EQUAL_UINT16(9, cpu.ram[2]);
+}
+
+void test_cpu_cycle_limit()
+{
+	load("(LOOP)\n@R0\nM=M+1\n@LOOP\n0;JMP\n");
+	TEST_ASSERT_EQUAL_INT(HACK_HALT_CYCLE_LIMIT, hack_cpu_run(&cpu, 400));
+	TEST_ASSERT_EQUAL_UINT64(400, cpu.cycles);
+	TEST_ASSERT_EQUAL_UINT16(100, cpu.ram[0]);
+	TEST_ASSERT_EQUAL_UINT16(0, cpu.pc);
+
+	// Carrying on where it left off
+	TEST_ASSERT_EQUAL_INT(HACK_HALT_CYCLE_LIMIT, hack_cpu_run(&cpu, 400));
+	TEST_ASSERT_EQUAL_UINT64(800, cpu.cycles);
+	TEST_ASSERT_EQUAL_UINT16(200, cpu.ram[0]);
+}
+
+void test_cpu_traces_match_interpreter()
+{
+	// Pushes and pops through the stack like VM code, with a conditional
+	// jump through the middle of the loop's trace into SKIP
+	const char *source = "@256\nD=A\n@SP\nM=D\n"
+			     "(LOOP)\n@R13\nM=M+1\nD=M\n@7\nD=D&A\n@SKIP\nD;JEQ\n"
+			     "@R13\nD=M\n@SP\nA=M\nM=D\n@SP\nM=M+1\n@SP\nAM=M-1\nD=M\n"
+			     "(SKIP)\n@R14\nM=D+M\n@LOOP\n0;JMP\n";
+	static struct hack_cpu interpreted;
+	load(source);
+	interpreted = cpu;
+	interpreted.hot_threshold = 0;
+	load(source);
+	cpu.hot_threshold = 1;
+
+	// Stopping at odd points catches any trace that gets the cycle count or
+	// pc wrong
+	for (int slice = 0; slice < 500; slice++) {
+		TEST_ASSERT_EQUAL_INT(HACK_HALT_CYCLE_LIMIT, hack_cpu_run(&interpreted, 37));
+		TEST_ASSERT_EQUAL_INT(HACK_HALT_CYCLE_LIMIT, hack_cpu_run(&cpu, 37));
+		TEST_ASSERT_EQUAL_UINT64(interpreted.cycles, cpu.cycles);
+		TEST_ASSERT_EQUAL_UINT16(interpreted.pc, cpu.pc);
+		TEST_ASSERT_EQUAL_UINT16(interpreted.a, cpu.a);
+		TEST_ASSERT_EQUAL_UINT16(interpreted.d, cpu.d);
+		TEST_ASSERT_EQUAL_UINT16_ARRAY(interpreted.ram, cpu.ram, 300);
+	}
+	TEST_ASSERT_EQUAL_size_t(0, interpreted.num_traces);
+	TEST_ASSERT_EQUAL_size_t(2, cpu.num_traces);
+	hack_cpu_destroy(&interpreted);
+}
+
+void test_cpu_invalid_instruction()
+{
+	const uint16_t rom[] = {0x0002, 0xEC10, 0xFFC0};
+	size_t bad_index;
+	TEST_ASSERT_FALSE(hack_cpu_init(&cpu, rom, 3, &bad_index));
+	TEST_ASSERT_EQUAL_size_t(2, bad_index);
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_cpu_add);
+	RUN_TEST(test_cpu_max);
+	RUN_TEST(test_cpu_loop);
+	RUN_TEST(test_cpu_all_comps);
+	RUN_TEST(test_cpu_jumps);
+	RUN_TEST(test_cpu_cycle_limit);
+	RUN_TEST(test_cpu_traces_match_interpreter);
+	RUN_TEST(test_cpu_invalid_instruction);
+	return UNITY_END();
+}
@@ -0,0 +1,226 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../assembler/codegen.h"
+#include "../assembler/input.h"
+#include "../assembler/object.h"
+#include "cpu.h"
+
+#define MAX_RAM_INITS 256
+
+struct ram_init {
+	uint16_t address;
+	uint16_t value;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-bv] [-n max_cycles] [-t hot] [-r addr=value]... [-d start:end] [-D dump] program\n", prog);
+	fprintf(stderr, "  -b  the program is raw big endian 16 bit words instead of .hack text\n");
+	fprintf(stderr, "  -v  report cycles, time and the reason for stopping on stderr\n");
+	fprintf(stderr, "  -n  stop after about this many instructions (default 1000000000)\n");
+	fprintf(stderr, "  -t  compile code jumped to this many times (default %d, 0 never)\n", HACK_HOT_THRESHOLD);
+	fprintf(stderr, "  -r  set RAM[addr] to value before running; may be repeated\n");
+	fprintf(stderr, "  -d  print RAM[start] to RAM[end], inclusive, as \"addr value\" lines\n");
+	fprintf(stderr, "  -D  write all of RAM to dump as raw big endian 16 bit words\n");
+	fprintf(stderr, "A program ending in .asm is assembled first.\n");
+	exit(EXIT_FAILURE);
+}
+
+static bool ends_with(const char *s, const char *suffix)
+{
+	size_t len = strlen(s);
+	size_t suffix_len = strlen(suffix);
+	return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+static bool parse_address(const char *s, char **end, uint16_t *address)
+{
+	unsigned long value = strtoul(s, end, 0);
+	if (*end == s || value >= HACK_RAM_SIZE) {
+		return false;
+	}
+	*address = value;
+	return true;
+}
+
+/*
+ * Parses all of `s` as a decimal count no larger than `max`. strtoull alone
+ * would take "" or "foo" as 0, "10k" as 10, and "-1" as a huge number.
+ */
+static bool parse_count(const char *s, uint64_t max, uint64_t *count)
+{
+	if (!isdigit((unsigned char) *s)) {
+		return false;
+	}
+	char *end;
+	errno = 0;
+	unsigned long long value = strtoull(s, &end, 10);
+	if (*end != '\0' || errno == ERANGE || value > max) {
+		return false;
+	}
+	*count = value;
+	return true;
+}
+
+/*
+ * Reads the program at `path`, assembling it if it's a .asm file.
+ */
+static void load_program(const char *path, enum hack_output_format format, uint16_t **words, size_t *num_words)
+{
+	struct asm_input input;
+	if (!asm_input_open(path, &input)) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+
+	if (ends_with(path, ".asm")) {
+		struct asm_object object;
+		enum asm_parse_error err = asm_object_assemble(input.data, input.len, &object);
+		if (err == ASM_PARSE_ERROR_NO_ERROR) {
+			err = asm_objects_link(&object, 1, words, num_words);
+			asm_object_destroy(&object);
+		}
+		if (err != ASM_PARSE_ERROR_NO_ERROR) {
+			fprintf(stderr, "%s: error: %d\n", path, err);
+			exit(EXIT_FAILURE);
+		}
+	} else if (!hack_read(input.data, input.len, format, words, num_words)) {
+		fprintf(stderr, "%s: not a valid %s program\n", path, format == HACK_OUTPUT_TEXT ? ".hack" : "binary");
+		exit(EXIT_FAILURE);
+	}
+	asm_input_close(&input);
+}
+
+static void write_dump(const char *path, const uint16_t *ram)
+{
+	FILE *fp = fopen(path, "wb");
+	if (fp == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	if (!hack_write(fp, ram, HACK_RAM_SIZE, HACK_OUTPUT_BINARY) || fclose(fp) != 0) {
+		perror("failed to write dump");
+		exit(EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	enum hack_output_format format = HACK_OUTPUT_TEXT;
+	uint64_t max_cycles = 1000000000;
+	uint32_t hot_threshold = HACK_HOT_THRESHOLD;
+	struct ram_init inits[MAX_RAM_INITS];
+	size_t num_inits = 0;
+	bool dump_range = false;
+	uint16_t dump_start = 0, dump_end = 0;
+	const char *dump_path = NULL;
+	bool verbose = false;
+
+	int c;
+	char *end;
+	while ((c = getopt(argc, argv, "bd:D:n:r:t:v")) != -1) {
+		switch (c) {
+		case 'b':
+			format = HACK_OUTPUT_BINARY;
+			break;
+		case 'd':
+			if (!parse_address(optarg, &end, &dump_start) || *end != ':' ||
+			    !parse_address(end + 1, &end, &dump_end) || *end != '\0' || dump_end < dump_start) {
+				usage(argv[0]);
+			}
+			dump_range = true;
+			break;
+		case 'D':
+			dump_path = optarg;
+			break;
+		case 'n':
+			if (!parse_count(optarg, UINT64_MAX, &max_cycles)) {
+				usage(argv[0]);
+			}
+			break;
+		case 'r': {
+			if (num_inits == MAX_RAM_INITS) {
+				usage(argv[0]);
+			}
+			struct ram_init *init = &inits[num_inits++];
+			if (!parse_address(optarg, &end, &init->address) || *end != '=') {
+				usage(argv[0]);
+			}
+			// Negative values are welcome, as the test scripts use them
+			long value = strtol(end + 1, &end, 0);
+			if (*end != '\0' || value < -32768 || value > 65535) {
+				usage(argv[0]);
+			}
+			init->value = (uint16_t) value;
+			break;
+		}
+		case 't': {
+			uint64_t threshold;
+			if (!parse_count(optarg, UINT32_MAX, &threshold)) {
+				usage(argv[0]);
+			}
+			hot_threshold = threshold;
+			break;
+		}
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+	}
+
+	uint16_t *words;
+	size_t num_words;
+	load_program(argv[optind], format, &words, &num_words);
+
+	struct hack_cpu *cpu = malloc(sizeof(*cpu));
+	if (cpu == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	size_t bad_index;
+	if (!hack_cpu_init(cpu, words, num_words, &bad_index)) {
+		fprintf(stderr, "%s: invalid instruction at ROM[%zu]\n", argv[optind], bad_index);
+		exit(EXIT_FAILURE);
+	}
+	free(words);
+	cpu->hot_threshold = hot_threshold;
+	for (size_t i = 0; i < num_inits; i++) {
+		cpu->ram[inits[i].address] = inits[i].value;
+	}
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	enum hack_halt halt = hack_cpu_run(cpu, max_cycles);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	if (verbose) {
+		double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+		fprintf(stderr, "%s at pc %u after %llu cycles in %.3f s (%.1f MIPS, %zu traces)\n",
+			hack_halt_name(halt), cpu->pc, (unsigned long long) cpu->cycles, seconds,
+			seconds > 0 ? cpu->cycles / seconds / 1e6 : 0.0, cpu->num_traces);
+	}
+	if (dump_range) {
+		for (size_t address = dump_start; address <= dump_end; address++) {
+			printf("%zu %d\n", address, (int16_t) cpu->ram[address]);
+		}
+	}
+	if (dump_path != NULL) {
+		write_dump(dump_path, cpu->ram);
+	}
+
+	hack_cpu_destroy(cpu);
+	free(cpu);
+	// Hitting the cycle limit is a failure for CI; halting either way isn't
+	return halt == HACK_HALT_CYCLE_LIMIT ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+//! Times the assembler on a large generated program, Criterion style: a few
+//! warm up runs, then a number of samples reported as median, mean and
+//! standard deviation.
+//!
+//! Usage: cargo run --release --example hack_assemble_bench [instructions] [samples]
+//!
+//! The program defaults to a million instructions, using every comp, dest and
+//! jump, a few hundred variables and labels throughout the first 32K words,
+//! where A instructions can still reach them.
+
+use std::env;
+use std::fmt::Write;
+use std::time::Instant;
+
+use nand2tetris::hack;
+
+const WARM_UP: usize = 3;
+
+const COMPS: [&str; 28] = [
+    "0", "1", "-1", "D", "A", "M", "!D", "!A", "!M", "-D", "-A", "-M", "D+1", "A+1", "M+1", "D-1",
+    "A-1", "M-1", "D+A", "D+M", "D-A", "D-M", "A-D", "M-D", "D&A", "D&M", "D|A", "D|M",
+];
+const DESTS: [&str; 8] = ["", "M=", "D=", "MD=", "A=", "AM=", "AD=", "AMD="];
+const JUMPS: [&str; 8] = ["", ";JGT", ";JEQ", ";JGE", ";JLT", ";JNE", ";JLE", ";JMP"];
+
+fn generate(num_instructions: usize) -> String {
+    let mut source = String::new();
+    for i in 0..num_instructions {
+        if i % 64 == 0 && i < 0x7FFF {
+            writeln!(source, "(LABEL{})", i / 64).unwrap();
+        }
+        match i % 4 {
+            0 => writeln!(source, "@var{}", i % 300).unwrap(),
+            1 => writeln!(source, "@{}", i % 0x8000).unwrap(),
+            2 => writeln!(source, "@LABEL{}", i % 500).unwrap(),
+            _ => writeln!(
+                source,
+                "{}{}{} // comment",
+                DESTS[i / 4 % 8],
+                COMPS[i / 32 % 28],
+                JUMPS[i / 7 % 8],
+            )
+            .unwrap(),
+        }
+    }
+    source
+}
+
+/// Runs `f`, which returns the size of its output, and reports how long it
+/// took over `bytes` of input.
+fn bench<F: FnMut() -> usize>(name: &str, bytes: usize, samples: usize, mut f: F) {
+    for _ in 0..WARM_UP {
+        f();
+    }
+
+    let mut times: Vec<f64> = (0..samples)
+        .map(|_| {
+            let start = Instant::now();
+            f();
+            start.elapsed().as_secs_f64()
+        })
+        .collect();
+    times.sort_by(|a, b| a.partial_cmp(b).unwrap());
+
+    let mean = times.iter().sum::<f64>() / samples as f64;
+    let variance = times.iter().map(|t| (t - mean).powi(2)).sum::<f64>() / samples as f64;
+    let median = times[samples / 2];
+    println!(
+        "{name:<22} median {:8.2} ms  mean {:8.2} ms  +/- {:6.2} ms  {:7.1} MB/s",
+        median * 1e3,
+        mean * 1e3,
+        variance.sqrt() * 1e3,
+        bytes as f64 / median / 1e6,
+    );
+}
+
+fn main() {
+    let args: Vec<String> = env::args().skip(1).collect();
+    let num_instructions = args
+        .first()
+        .map_or(1_000_000, |arg| arg.parse().expect("bad size"));
+    let samples = args
+        .get(1)
+        .map_or(20, |arg| arg.parse().expect("bad sample count"));
+
+    let source = generate(num_instructions);
+    println!(
+        "{num_instructions} instructions, {:.1} MB of source, {samples} samples",
+        source.len() as f64 / 1e6
+    );
+
+    // Everything must agree before it's worth timing
+    let lines = hack::assemble(&source).expect("failed to assemble");
+    let words = hack::assemble_words(&source).expect("failed to assemble");
+    let text = hack::write_hack(&words, hack::HackFormat::Text);
+    assert_eq!(text, (lines.join("\n") + "\n").into_bytes());
+
+    bench("lines of strings", source.len(), samples, || {
+        hack::assemble(&source).unwrap().len()
+    });
+    bench("words", source.len(), samples, || {
+        hack::assemble_words(&source).unwrap().len()
+    });
+    bench("words + text buffer", source.len(), samples, || {
+        let words = hack::assemble_words(&source).unwrap();
+        hack::write_hack(&words, hack::HackFormat::Text).len()
+    });
+    bench("words + binary buffer", source.len(), samples, || {
+        let words = hack::assemble_words(&source).unwrap();
+        hack::write_hack(&words, hack::HackFormat::Binary).len()
+    });
+    bench("text buffer alone", source.len(), samples, || {
+        hack::write_hack(&words, hack::HackFormat::Text).len()
+    });
+}
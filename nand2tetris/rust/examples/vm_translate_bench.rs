@@ -0,0 +1,111 @@
+//! Compares translating VM code by collecting every line of assembly into a
+//! `Vec<String>` against streaming it a line at a time into a writer.
+//!
+//! Usage: cargo run --release --example vm_translate_bench [megabytes] [file.vm...]
+//!
+//! The files default to the OS in tools/OS, repeated until the corpus is at
+//! least the given size (default 16 MB).
+
+use std::env;
+use std::fs;
+use std::io::{self, BufWriter, Write};
+use std::time::{Duration, Instant};
+
+use nand2tetris::vm;
+
+const ROUNDS: usize = 3;
+
+/// Best time of a few rounds of `f`, which returns the number of bytes of
+/// assembly it produced.
+fn best_of<F: FnMut() -> usize>(mut f: F) -> (Duration, usize) {
+    let mut best = Duration::MAX;
+    let mut bytes = 0;
+    for _ in 0..ROUNDS {
+        let start = Instant::now();
+        bytes = f();
+        best = best.min(start.elapsed());
+    }
+    (best, bytes)
+}
+
+/// Counts what's written to it, and throws it away.
+struct CountingSink(usize);
+
+impl Write for CountingSink {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0 += buf.len();
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+fn main() {
+    let args: Vec<String> = env::args().skip(1).collect();
+    let megabytes: usize = args
+        .first()
+        .map_or(16, |arg| arg.parse().expect("bad size"));
+    let paths: Vec<String> = if args.len() > 1 {
+        args[1..].to_vec()
+    } else {
+        let mut paths: Vec<String> = fs::read_dir("../tools/OS")
+            .expect("couldn't read tools/OS")
+            .map(|entry| entry.expect("couldn't read tools/OS").path())
+            .filter(|path| path.extension().map_or(false, |ext| ext == "vm"))
+            .map(|path| path.to_string_lossy().into_owned())
+            .collect();
+        paths.sort();
+        paths
+    };
+
+    let mut corpus = String::new();
+    let mut files = 0;
+    while corpus.len() < megabytes << 20 {
+        for path in &paths {
+            corpus.push_str(&fs::read_to_string(path).expect("couldn't read source file"));
+            files += 1;
+        }
+    }
+    let mb = corpus.len() as f64 / (1 << 20) as f64;
+    println!("{mb:.1} MB of VM code from {files} files, best of {ROUNDS}");
+
+    for call_mode in [vm::CallMode::Inline, vm::CallMode::Trampoline] {
+        let (collected, collected_bytes) = best_of(|| {
+            let commands = vm::parse_vm_source(&corpus).expect("failed to parse source");
+            let asm = vm::vm_to_asm(&"Corpus".to_string(), commands, call_mode)
+                .expect("failed to compile source to ASM");
+            let mut out = BufWriter::new(CountingSink(0));
+            for line in asm {
+                writeln!(out, "{}", line).unwrap();
+            }
+            out.into_inner().map_err(|_| ()).unwrap().0
+        });
+
+        let (streamed, streamed_bytes) = best_of(|| {
+            let mut out = BufWriter::new(CountingSink(0));
+            vm::translate_vm_stream(
+                "Corpus",
+                corpus.as_bytes(),
+                &mut out,
+                call_mode,
+                vm::StackMode::Memory,
+            )
+            .expect("failed to compile source to ASM");
+            out.into_inner().map_err(|_| ()).unwrap().0
+        });
+
+        assert_eq!(
+            collected_bytes, streamed_bytes,
+            "translations differ in length"
+        );
+        println!(
+            "{call_mode:?}: {:.1} MB of assembly, collected {:.1} MB/s, streamed {:.1} MB/s ({:.2}x)",
+            streamed_bytes as f64 / (1 << 20) as f64,
+            mb / collected.as_secs_f64(),
+            mb / streamed.as_secs_f64(),
+            collected.as_secs_f64() / streamed.as_secs_f64(),
+        );
+    }
+}
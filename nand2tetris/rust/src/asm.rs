@@ -36,17 +36,17 @@ pub struct SourceCInstruction {
 }
 
 /// A `SourceCDest` is the `dest` part of a C instruction represented in
-/// assembler source code.
-#[derive(Debug, PartialEq, Clone)]
+/// assembler source code. Each variant's value is its `ddd` bits.
+#[derive(Debug, PartialEq, Clone, Copy)]
 pub enum SourceCDest {
-    Null,
-    M,
-    D,
-    MD,
-    A,
-    AM,
-    AD,
-    AMD,
+    Null = 0b000,
+    M = 0b001,
+    D = 0b010,
+    MD = 0b011,
+    A = 0b100,
+    AM = 0b101,
+    AD = 0b110,
+    AMD = 0b111,
 }
 
 impl FromStr for SourceCDest {
@@ -68,75 +68,75 @@ impl FromStr for SourceCDest {
 }
 
 /// A `SourceCComp` is the textual representation of the `a` and `cccccc` parts
-/// of a C instruction.
-#[derive(Debug, PartialEq, Clone)]
+/// of a C instruction. Each variant's value is its `acccccc` bits.
+#[derive(Debug, PartialEq, Clone, Copy)]
 pub enum SourceCComp {
     /// 0
-    Zero,
+    Zero = 0b0101010,
     /// 1
-    One,
+    One = 0b0111111,
     /// -1
-    NegOne,
+    NegOne = 0b0111010,
 
     /// D
-    D,
+    D = 0b0001100,
     /// A
-    A,
+    A = 0b0110000,
     /// M
-    M,
+    M = 0b1110000,
 
     /// !D
-    NotD,
+    NotD = 0b0001101,
     /// !A
-    NotA,
+    NotA = 0b0110001,
     /// !M
-    NotM,
+    NotM = 0b1110001,
 
     /// -D
-    NegD,
+    NegD = 0b0001111,
     /// -A
-    NegA,
+    NegA = 0b0110011,
     /// -M
-    NegM,
+    NegM = 0b1110011,
 
     /// D+1
-    DPlusOne,
+    DPlusOne = 0b0011111,
     /// A+1
-    APlusOne,
+    APlusOne = 0b0110111,
     /// M+1
-    MPlusOne,
+    MPlusOne = 0b1110111,
 
     /// D-1
-    DMinusOne,
+    DMinusOne = 0b0001110,
     /// A-1
-    AMinusOne,
+    AMinusOne = 0b0110010,
     /// M-1
-    MMinusOne,
+    MMinusOne = 0b1110010,
 
     /// D+A
-    DPlusA,
+    DPlusA = 0b0000010,
     /// D+M
-    DPlusM,
+    DPlusM = 0b1000010,
 
     /// D-A
-    DMinusA,
+    DMinusA = 0b0010011,
     /// D-M
-    DMinusM,
+    DMinusM = 0b1010011,
 
     /// A-D
-    AMinusD,
+    AMinusD = 0b0000111,
     /// M-D
-    MMinusD,
+    MMinusD = 0b1000111,
 
     /// D&A
-    DAndA,
+    DAndA = 0b0000000,
     /// D&M
-    DAndM,
+    DAndM = 0b1000000,
 
     /// D|A
-    DOrA,
+    DOrA = 0b0010101,
     /// D|M
-    DOrM,
+    DOrM = 0b1010101,
 }
 
 impl FromStr for SourceCComp {
@@ -190,25 +190,25 @@ impl FromStr for SourceCComp {
 }
 
 /// A `SourceCJump` is the `jump` part of a C instruction represented in
-/// assembler source code.
-#[derive(Debug, PartialEq, Clone)]
+/// assembler source code. Each variant's value is its `jjj` bits.
+#[derive(Debug, PartialEq, Clone, Copy)]
 pub enum SourceCJump {
     /// No jump
-    Null,
+    Null = 0b000,
     /// if comp > 0 jump
-    JGT,
+    JGT = 0b001,
     /// if comp == 0 jump
-    JEQ,
+    JEQ = 0b010,
     /// if comp >= 0 jump
-    JGE,
+    JGE = 0b011,
     /// if comp < 0 jump
-    JLT,
+    JLT = 0b100,
     /// if comp != 0 jump
-    JNE,
+    JNE = 0b101,
     /// if comp <= 0 jump
-    JLE,
+    JLE = 0b110,
     /// unconditional jump
-    JMP,
+    JMP = 0b111,
 }
 
 impl FromStr for SourceCJump {
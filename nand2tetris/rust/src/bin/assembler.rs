@@ -1,15 +1,18 @@
 use std::env;
 use std::fs;
+use std::io::{self, Write};
 use std::process;
 
 // use nand2tetris::asm;
 use nand2tetris::hack;
 
 fn main() {
-    let source_path: String = match env::args().collect::<Vec<String>>().as_slice() {
-        [_, path] => path.to_string(),
+    let (format, source_path) = match env::args().collect::<Vec<String>>().as_slice() {
+        [_, path] => (hack::HackFormat::Text, path.to_string()),
+        [_, flag, path] if flag == "-b" => (hack::HackFormat::Binary, path.to_string()),
         _ => {
-            eprintln!("Usage: assembler <filename>");
+            eprintln!("Usage: assembler [-b] <filename>");
+            eprintln!("  -b  write raw big endian 16 bit words instead of .hack text");
             process::exit(1);
         }
     };
@@ -20,9 +23,10 @@ fn main() {
     // let parsed = asm::parse_assembly_source(&source_string).expect("failed to parse source");
     // println!("{:#?}", parsed);
 
-    let assembled = hack::assemble(&source_string).expect("failed to assemble source");
+    let assembled = hack::assemble_words(&source_string).expect("failed to assemble source");
     // println!("{:#?}", assembled);
-    for line in &assembled {
-        println!("{}", line)
-    }
+    io::stdout()
+        .lock()
+        .write_all(&hack::write_hack(&assembled, format))
+        .expect("failed to write output");
 }
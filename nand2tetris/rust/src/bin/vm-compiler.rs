@@ -1,51 +1,149 @@
+use std::collections::BTreeMap;
 use std::env;
-use std::fs;
+use std::fs::File;
+use std::io::{self, BufReader, BufWriter, Write};
 use std::path::Path;
 use std::process;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::mpsc;
+use std::thread;
 
 use nand2tetris::vm;
 
-fn main() {
-    if env::args().len() <= 1 {
-        eprintln!("Usage: assembler <file1> [file2] ...");
-        process::exit(1);
-    }
+/// Translates the file at `path` into `out`, under a header naming it. Its
+/// statics and comparison labels are named after the file, and its label
+/// counter starts from zero, so files can be translated in any order.
+fn translate_file<W: Write>(
+    path_str: &str,
+    out: &mut W,
+    call_mode: vm::CallMode,
+    stack_mode: vm::StackMode,
+) -> Result<(), String> {
+    let path = Path::new(path_str);
+    let file_basename: &str = path
+        .file_stem()
+        .expect("couldn't get file basename")
+        .to_str()
+        .expect("couldn't convert file basename to &str");
 
-    // TODO: The bootstrap code and footer should be in the vm module. This
-    // function should just read .vm files (perhaps also parsing them), and then
-    // feed them into the translator as a stream.
+    let source = File::open(path).map_err(|err| format!("{path_str}: {err}"))?;
 
-    for line in vm::vm_asm_bootstrap_code() {
-        println!("{}", line);
-    }
+    let write_err = |err: io::Error| format!("error writing output: {err}");
+    writeln!(out, "// SOURCE: {file_basename}").map_err(write_err)?;
+    vm::translate_vm_stream(
+        file_basename,
+        BufReader::new(source),
+        out,
+        call_mode,
+        stack_mode,
+    )
+    .map_err(|err| format!("{path_str}: {err}"))?;
+    writeln!(out).map_err(write_err)
+}
 
-    for path_str in env::args().skip(1) {
-        let path = Path::new(&path_str);
-        let file_basename: &str = path
-            .file_stem()
-            .expect("couldn't get file basename")
-            .to_str()
-            .expect("couldn't convert file basename to &str");
+/// Translates the files on `jobs` threads, each taking the next file not yet
+/// started, and writes them to `out` in argument order as soon as all the
+/// files before them are done. The output is the same as translating them one
+/// after another, but each file's asm is held in memory until its turn, so a
+/// file that's slow to translate can leave everything after it buffered.
+fn translate_files_parallel<W: Write>(
+    paths: &[String],
+    out: &mut W,
+    call_mode: vm::CallMode,
+    stack_mode: vm::StackMode,
+    jobs: usize,
+) -> Result<(), String> {
+    let next_path = AtomicUsize::new(0);
+    let (sender, receiver) = mpsc::channel();
 
-        let source_string =
-            fs::read_to_string(path.clone()).expect("Something went wrong reading the source file");
+    thread::scope(|scope| {
+        for _ in 0..jobs.min(paths.len()) {
+            let sender = sender.clone();
+            let next_path = &next_path;
+            scope.spawn(move || loop {
+                let index = next_path.fetch_add(1, Ordering::Relaxed);
+                if index >= paths.len() {
+                    break;
+                }
+                let mut asm = Vec::new();
+                let result =
+                    translate_file(&paths[index], &mut asm, call_mode, stack_mode).map(|_| asm);
+                if sender.send((index, result)).is_err() {
+                    // The main thread stopped at an earlier error
+                    break;
+                }
+            });
+        }
+        drop(sender);
 
-        let parsed = vm::parse_vm_source(&source_string).expect("failed to parse source");
-        // println!("{:#?}", parsed);
+        // Hold on to files finished early until it's their turn
+        let mut finished = BTreeMap::new();
+        let mut next_out = 0;
+        for (index, result) in receiver {
+            finished.insert(index, result);
+            while let Some(result) = finished.remove(&next_out) {
+                out.write_all(&result?)
+                    .map_err(|err| format!("error writing output: {err}"))?;
+                next_out += 1;
+            }
+        }
+        Ok(())
+    })
+}
 
-        let asm = vm::vm_to_asm(&file_basename.to_string(), parsed)
-            .expect("failed to compile source to ASM");
+fn usage() -> ! {
+    eprintln!("Usage: vm-compiler [--inline-calls] [--cache-top] [-j jobs] <file1> [file2] ...");
+    eprintln!();
+    eprintln!("  -j jobs  translate files on this many threads (default 1). With 1, output is");
+    eprintln!("           streamed a line at a time; with more, each file's asm is held in");
+    eprintln!("           memory until the files before it are written, trading memory for speed.");
+    process::exit(1);
+}
 
-        println!("// SOURCE: {file_basename}");
-        for line in asm {
-            println!("{}", line);
+fn main() {
+    // Calls go through the shared trampolines unless --inline-calls is given
+    let mut call_mode = vm::CallMode::Trampoline;
+    // The top of the stack is kept in RAM unless --cache-top is given
+    let mut stack_mode = vm::StackMode::Memory;
+    // Files are translated one at a time, streaming, unless -j says otherwise
+    let mut jobs = 1;
+    let mut paths: Vec<String> = Vec::new();
+    let mut args = env::args().skip(1);
+    while let Some(arg) = args.next() {
+        match arg.as_str() {
+            "--inline-calls" => call_mode = vm::CallMode::Inline,
+            "--cache-top" => stack_mode = vm::StackMode::CacheTop,
+            "-j" => match args.next().and_then(|n| n.parse().ok()) {
+                Some(n) if n > 0 => jobs = n,
+                _ => usage(),
+            },
+            _ => paths.push(arg),
         }
-        println!("");
+    }
+
+    if paths.is_empty() {
+        usage();
+    }
+
+    let stdout = io::stdout();
+    let mut out = BufWriter::new(stdout.lock());
+
+    vm::write_vm_asm_bootstrap(&mut out, call_mode).expect("failed to write bootstrap code");
+
+    if jobs == 1 || paths.len() == 1 {
+        // Each file is translated a line at a time straight into stdout, so
+        // nothing is held in memory but the current line
+        for path_str in &paths {
+            translate_file(path_str, &mut out, call_mode, stack_mode)
+                .expect("failed to compile source to ASM");
+        }
+    } else {
+        translate_files_parallel(&paths, &mut out, call_mode, stack_mode, jobs)
+            .expect("failed to compile source to ASM");
     }
 
     // Add footer that ends program with infinite loop
     // TODO: I think the thing that produces VM files does this for us
-    println!("(_vm_END)");
-    println!("@_vm_END");
-    println!("0;JMP");
+    writeln!(out, "(_vm_END)\n@_vm_END\n0;JMP").expect("failed to write output");
+    out.flush().expect("failed to write output");
 }
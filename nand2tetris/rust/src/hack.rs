@@ -3,241 +3,164 @@ use std::collections::HashMap;
 use super::asm;
 use super::misc::{SourceLine, Symbol};
 
-pub enum HackInstruction {
-    AInstruction(AInstruction),
-    CInstruction(CInstruction),
+/// How assembled instructions are written out.
+#[derive(Debug, PartialEq, Clone, Copy)]
+pub enum HackFormat {
+    /// A line of 16 `0` and `1` characters per instruction, like the course's
+    /// tools read and write.
+    Text,
+    /// Raw big endian 16 bit words.
+    Binary,
 }
 
-/// A `AInstruction` is:
-///     0 vvvvvvvvvvvvvvv
-#[derive(Debug, PartialEq, Clone)]
-pub struct AInstruction {
-    v: [bool; 15],
+/// Variables are given RAM addresses from here on, in the order they first
+/// appear.
+const FIRST_VARIABLE_ADDRESS: usize = 16;
+
+/// A instructions can only load 15 bits.
+const MAX_ADDRESS: usize = 0x7FFF;
+
+/// The symbols every program starts with.
+fn predefined_symbol(name: &str) -> Option<usize> {
+    match name {
+        "R0" | "SP" => Some(0),
+        "R1" | "LCL" => Some(1),
+        "R2" | "ARG" => Some(2),
+        "R3" | "THIS" => Some(3),
+        "R4" | "THAT" => Some(4),
+        "R5" => Some(5),
+        "R6" => Some(6),
+        "R7" => Some(7),
+        "R8" => Some(8),
+        "R9" => Some(9),
+        "R10" => Some(10),
+        "R11" => Some(11),
+        "R12" => Some(12),
+        "R13" => Some(13),
+        "R14" => Some(14),
+        "R15" => Some(15),
+        "SCREEN" => Some(16384),
+        "KBD" => Some(24576),
+        _ => None,
+    }
 }
 
-/// A `CInstruction` is:
-///     111 a cccccc ddd jjj
-#[derive(Debug, PartialEq, Clone)]
-pub struct CInstruction {
-    ac: [bool; 7],
-    d: [bool; 3],
-    j: [bool; 3],
+/// Assembles `source` into lines of a .hack file.
+pub fn assemble(source: &String) -> Result<Vec<String>, String> {
+    let words = assemble_words(source)?;
+    Ok(words.iter().map(|word| format!("{word:016b}")).collect())
 }
 
-pub fn assemble(source: &String) -> Result<Vec<String>, String> {
-    let mut symbols: HashMap<Symbol, u16> = HashMap::from([
-        (Symbol("R0".to_string()), 0),
-        (Symbol("R1".to_string()), 1),
-        (Symbol("R2".to_string()), 2),
-        (Symbol("R3".to_string()), 3),
-        (Symbol("R4".to_string()), 4),
-        (Symbol("R5".to_string()), 5),
-        (Symbol("R6".to_string()), 6),
-        (Symbol("R7".to_string()), 7),
-        (Symbol("R8".to_string()), 8),
-        (Symbol("R9".to_string()), 9),
-        (Symbol("R10".to_string()), 10),
-        (Symbol("R11".to_string()), 11),
-        (Symbol("R12".to_string()), 12),
-        (Symbol("R13".to_string()), 13),
-        (Symbol("R14".to_string()), 14),
-        (Symbol("R15".to_string()), 15),
-        (Symbol("SP".to_string()), 0),
-        (Symbol("LCL".to_string()), 1),
-        (Symbol("ARG".to_string()), 2),
-        (Symbol("THIS".to_string()), 3),
-        (Symbol("THAT".to_string()), 4),
-        (Symbol("SCREEN".to_string()), 16384),
-        (Symbol("KBD".to_string()), 24576),
-    ]);
+/// Assembles `source` into Hack machine instructions.
+pub fn assemble_words(source: &String) -> Result<Vec<u16>, String> {
     let parsed = asm::parse_assembly_source(source)?;
 
-    // First pass: define labels and filter them out
-    let mut instructions: Vec<SourceLine<asm::AssemblyInstruction>> = Vec::new();
+    // First pass: define labels, as the address of the instruction after them
+    let mut labels: HashMap<&str, usize> = HashMap::new();
+    let mut num_instructions = 0;
     for inst in parsed.iter() {
         match &inst.item {
-            asm::AssemblyElement::Label(sym) => {
+            asm::AssemblyElement::Label(Symbol(name)) => {
                 // TODO: Check if label already exists and fail
-                symbols.insert(
-                    sym.clone(),
-                    instructions
-                        .len()
-                        .try_into()
-                        .expect("couldn't downcast usize"),
-                );
-            }
-            asm::AssemblyElement::AInstruction(a_inst) => {
-                instructions.push(SourceLine {
-                    lineno: inst.lineno,
-                    item: asm::AssemblyInstruction::AInstruction(a_inst.clone()),
-                });
-            }
-            asm::AssemblyElement::CInstruction(c_inst) => {
-                instructions.push(SourceLine {
-                    lineno: inst.lineno,
-                    item: asm::AssemblyInstruction::CInstruction(c_inst.clone()),
-                });
+                labels.insert(name, num_instructions);
             }
+            _ => num_instructions += 1,
         }
     }
 
-    // Second pass: define other variables
-    for inst in instructions.iter() {
-        match &inst.item {
-            asm::AssemblyInstruction::AInstruction(asm::SourceAInstruction::Symbol(sym)) => {
-                // N.B. Symbols start at memory address 16
-                let current_length: u16 = symbols
-                    .len()
-                    .try_into()
-                    .expect("couldn't downcast to usize");
-                let next_address: u16 = current_length + 16;
-                symbols.entry(sym.clone()).or_insert(next_address);
+    // Second pass: encode instructions, defining variables as they're found
+    let mut variables: HashMap<&str, usize> = HashMap::new();
+    let mut words = Vec::with_capacity(num_instructions);
+    for SourceLine { lineno, item } in parsed.iter() {
+        let word = match item {
+            asm::AssemblyElement::Label(_) => continue,
+
+            asm::AssemblyElement::AInstruction(asm::SourceAInstruction::Number(num)) => *num,
+            asm::AssemblyElement::AInstruction(asm::SourceAInstruction::Symbol(Symbol(name))) => {
+                let next_address = FIRST_VARIABLE_ADDRESS + variables.len();
+                let address = match labels.get(name.as_str()) {
+                    Some(address) => *address,
+                    None => match predefined_symbol(name) {
+                        Some(address) => address,
+                        None => *variables.entry(name).or_insert(next_address),
+                    },
+                };
+                if address > MAX_ADDRESS {
+                    return Err(format!(
+                        "line {lineno}: address {address} of {name} doesn't fit in an A instruction"
+                    ));
+                }
+                address as u16
             }
-            _ => (),
-        }
-    }
 
-    // Third pass: use defined variables
-    instructions
-        .iter()
-        .map(|inst| {
-            assembly_instruction_to_hack(inst, &symbols)
-                .map(|inst| hack_instruction_to_string(&inst))
-        })
-        .collect()
-}
-
-fn hack_instruction_to_string(inst: &HackInstruction) -> String {
-    match inst {
-        HackInstruction::AInstruction(a_inst) => a_to_string(a_inst),
-        HackInstruction::CInstruction(c_inst) => c_to_string(c_inst),
+            asm::AssemblyElement::CInstruction(c_inst) => encode_c_instruction(c_inst),
+        };
+        words.push(word);
     }
+    Ok(words)
 }
 
-fn a_to_string(inst: &AInstruction) -> String {
-    bool_arrays_to_string(&[&[false], &inst.v])
-}
-
-fn c_to_string(inst: &CInstruction) -> String {
-    bool_arrays_to_string(&[&[true, true, true], &inst.ac, &inst.d, &inst.j])
+/// A C instruction is:
+///     111 a cccccc ddd jjj
+/// where the source enums' values are the bits of each part.
+fn encode_c_instruction(inst: &asm::SourceCInstruction) -> u16 {
+    let asm::SourceCInstruction { dest, comp, jump } = *inst;
+    0b111 << 13 | (comp as u16) << 6 | (dest as u16) << 3 | jump as u16
 }
 
-fn bool_arrays_to_string(bools: &[&[bool]]) -> String {
-    let mut chars: Vec<char> = vec![];
-    for &inner in bools {
-        for b in inner {
-            match b {
-                false => chars.push('0'),
-                true => chars.push('1'),
+/// Writes `words` out in `format`, into a buffer allocated once up front.
+pub fn write_hack(words: &[u16], format: HackFormat) -> Vec<u8> {
+    match format {
+        HackFormat::Text => {
+            let mut buf = Vec::with_capacity(words.len() * 17);
+            for word in words {
+                for bit in (0..16).rev() {
+                    buf.push(b'0' + (word >> bit & 1) as u8);
+                }
+                buf.push(b'\n');
             }
+            buf
         }
-    }
-    chars.iter().collect()
-}
-
-fn assembly_instruction_to_hack(
-    inst: &SourceLine<asm::AssemblyInstruction>,
-    symbols: &HashMap<Symbol, u16>,
-) -> Result<HackInstruction, String> {
-    let SourceLine { lineno, item } = inst;
-    match item {
-        asm::AssemblyInstruction::AInstruction(asm::SourceAInstruction::Number(num)) => {
-            Ok(HackInstruction::AInstruction(AInstruction {
-                v: a_num_to_binary(*num),
-            }))
-        }
-        asm::AssemblyInstruction::AInstruction(asm::SourceAInstruction::Symbol(sym)) => {
-            match symbols.get(sym) {
-                Some(loc) => Ok(HackInstruction::AInstruction(AInstruction {
-                    v: a_num_to_binary(*loc),
-                })),
-                None => Err(format!(
-                    "line {lineno}: Don't support symbols yet ({})",
-                    sym.0
-                )),
+        HackFormat::Binary => {
+            let mut buf = Vec::with_capacity(words.len() * 2);
+            for word in words {
+                buf.extend_from_slice(&word.to_be_bytes());
             }
+            buf
         }
-
-        asm::AssemblyInstruction::CInstruction(asm::SourceCInstruction { dest, comp, jump }) => {
-            Ok(HackInstruction::CInstruction(CInstruction {
-                ac: c_comp_to_binary(comp),
-                d: c_dest_to_binary(dest),
-                j: c_jump_to_binary(jump),
-            }))
-        }
-    }
-}
-
-/// Converts a decimal number from an A instruction into a binary array
-fn a_num_to_binary(i: u16) -> [bool; 15] {
-    let mut digits = [false; 15];
-    let binary_str = format!("{i:15b}");
-
-    if binary_str.len() != 15 {
-        panic!("converting num {i} to binary produced result with len() != 15");
-    }
-
-    for (i, d) in binary_str.chars().enumerate() {
-        digits[i] = d == '1';
-    }
-    digits
-}
-
-fn c_dest_to_binary(dest: &asm::SourceCDest) -> [bool; 3] {
-    match dest {
-        asm::SourceCDest::Null => [false, false, false],
-        asm::SourceCDest::M => [false, false, true],
-        asm::SourceCDest::D => [false, true, false],
-        asm::SourceCDest::MD => [false, true, true],
-        asm::SourceCDest::A => [true, false, false],
-        asm::SourceCDest::AM => [true, false, true],
-        asm::SourceCDest::AD => [true, true, false],
-        asm::SourceCDest::AMD => [true, true, true],
     }
 }
 
-fn c_comp_to_binary(comp: &asm::SourceCComp) -> [bool; 7] {
-    match comp {
-        asm::SourceCComp::Zero => [false, true, false, true, false, true, false],
-        asm::SourceCComp::One => [false, true, true, true, true, true, true],
-        asm::SourceCComp::NegOne => [false, true, true, true, false, true, false],
-        asm::SourceCComp::D => [false, false, false, true, true, false, false],
-        asm::SourceCComp::A => [false, true, true, false, false, false, false],
-        asm::SourceCComp::M => [true, true, true, false, false, false, false],
-        asm::SourceCComp::NotD => [false, false, false, true, true, false, true],
-        asm::SourceCComp::NotA => [false, true, true, false, false, false, true],
-        asm::SourceCComp::NotM => [true, true, true, false, false, false, true],
-        asm::SourceCComp::NegD => [false, false, false, true, true, true, true],
-        asm::SourceCComp::NegA => [false, true, true, false, false, true, true],
-        asm::SourceCComp::NegM => [true, true, true, false, false, true, true],
-        asm::SourceCComp::DPlusOne => [false, false, true, true, true, true, true],
-        asm::SourceCComp::APlusOne => [false, true, true, false, true, true, true],
-        asm::SourceCComp::MPlusOne => [true, true, true, false, true, true, true],
-        asm::SourceCComp::DMinusOne => [false, false, false, true, true, true, false],
-        asm::SourceCComp::AMinusOne => [false, true, true, false, false, true, false],
-        asm::SourceCComp::MMinusOne => [true, true, true, false, false, true, false],
-        asm::SourceCComp::DPlusA => [false, false, false, false, false, true, false],
-        asm::SourceCComp::DPlusM => [true, false, false, false, false, true, false],
-        asm::SourceCComp::DMinusA => [false, false, true, false, false, true, true],
-        asm::SourceCComp::DMinusM => [true, false, true, false, false, true, true],
-        asm::SourceCComp::AMinusD => [false, false, false, false, true, true, true],
-        asm::SourceCComp::MMinusD => [true, false, false, false, true, true, true],
-        asm::SourceCComp::DAndA => [false, false, false, false, false, false, false],
-        asm::SourceCComp::DAndM => [true, false, false, false, false, false, false],
-        asm::SourceCComp::DOrA => [false, false, true, false, true, false, true],
-        asm::SourceCComp::DOrM => [true, false, true, false, true, false, true],
-    }
-}
-
-fn c_jump_to_binary(jump: &asm::SourceCJump) -> [bool; 3] {
-    match jump {
-        asm::SourceCJump::Null => [false, false, false],
-        asm::SourceCJump::JGT => [false, false, true],
-        asm::SourceCJump::JEQ => [false, true, false],
-        asm::SourceCJump::JGE => [false, true, true],
-        asm::SourceCJump::JLT => [true, false, false],
-        asm::SourceCJump::JNE => [true, false, true],
-        asm::SourceCJump::JLE => [true, true, false],
-        asm::SourceCJump::JMP => [true, true, true],
-    }
+#[test]
+fn test_assemble_words() {
+    let source =
+        "@R2\nM=0\n(LOOP)\n@i\nD=M\n@LOOP\nD;JGT\n@j\nAM=M-1\n@i\n0;JMP\n@SCREEN\n".to_string();
+    assert_eq!(
+        assemble_words(&source),
+        Ok(vec![
+            2,
+            0b1110101010001000,
+            // Variables are numbered from 16 as they first appear
+            16,
+            0b1111110000010000,
+            2,
+            0b1110001100000001,
+            17,
+            0b1111110010101000,
+            16,
+            0b1110101010000111,
+            16384,
+        ])
+    );
+
+    let words = [5, 0b1110101010001000];
+    assert_eq!(
+        write_hack(&words, HackFormat::Text),
+        b"0000000000000101\n1110101010001000\n"
+    );
+    assert_eq!(write_hack(&words, HackFormat::Binary), [0, 5, 0xEA, 0x88]);
+
+    // Labels past the 15 bits an A instruction holds can't be loaded
+    let source = "0;JMP\n".repeat(0x8000) + "(FAR)\n@FAR\n";
+    assert!(assemble_words(&source).is_err());
 }
@@ -1,3 +1,4 @@
+use std::io::{self, BufRead, Write};
 use std::str::FromStr;
 use std::string::ToString;
 
@@ -75,21 +76,28 @@ impl FromStr for Segment {
     }
 }
 
-impl ToString for Segment {
-    fn to_string(&self) -> String {
+impl Segment {
+    /// The segment's name in VM source.
+    pub fn name(&self) -> &'static str {
         match self {
-            Segment::Argument => "argument".to_string(),
-            Segment::Local => "local".to_string(),
-            Segment::Static => "static".to_string(),
-            Segment::Constant => "constant".to_string(),
-            Segment::This => "this".to_string(),
-            Segment::That => "that".to_string(),
-            Segment::Pointer => "pointer".to_string(),
-            Segment::Temp => "temp".to_string(),
+            Segment::Argument => "argument",
+            Segment::Local => "local",
+            Segment::Static => "static",
+            Segment::Constant => "constant",
+            Segment::This => "this",
+            Segment::That => "that",
+            Segment::Pointer => "pointer",
+            Segment::Temp => "temp",
         }
     }
 }
 
+impl ToString for Segment {
+    fn to_string(&self) -> String {
+        self.name().to_string()
+    }
+}
+
 /// Define a function with a given label and number of local vars.
 #[derive(Debug, PartialEq, Clone)]
 pub struct FunctionCommand {
@@ -287,299 +295,852 @@ fn test_parse_vm_line() {
     );
 }
 
+/// How `call` and `return` are translated.
+#[derive(Debug, PartialEq, Clone, Copy)]
+pub enum CallMode {
+    /// Every call site and every return carries the whole frame save or
+    /// restore sequence, about 45 instructions each. Fastest, but OS-heavy
+    /// programs don't fit in 32K of ROM this way.
+    Inline,
+    /// Call sites load their arguments and jump into one shared call
+    /// trampoline, and every return jumps into one shared return trampoline.
+    /// Each call costs a few extra cycles, in exchange for a fraction of the
+    /// code.
+    Trampoline,
+}
+
+/// Label of the shared call trampoline. Expects D = return address, R13 = 5 +
+/// nargs and R14 = address of the function to call.
+const CALL_TRAMPOLINE: &str = "_vm_call";
+
+/// Label of the shared return trampoline.
+const RETURN_TRAMPOLINE: &str = "_vm_return";
+
+/// Where the top of the stack is kept between VM commands.
+#[derive(Debug, PartialEq, Clone, Copy)]
+pub enum StackMode {
+    /// Every command reads its operands from and pushes its result to RAM.
+    Memory,
+    /// The top of the stack stays in D from one command to the next, so
+    /// straight-line arithmetic never touches RAM for it. It's written back
+    /// before labels, gotos, calls and returns, where other code expects the
+    /// whole stack in RAM.
+    CacheTop,
+}
+
+/// Writes each line, a format string that may capture variables like
+/// `"@{label}"`, followed by a newline. Returns early on a write error.
+macro_rules! asm {
+    ($out:expr, $($line:literal),+ $(,)?) => {
+        {
+            $(writeln!($out, $line)?;)+
+        }
+    };
+}
+
 /// The VM translator is responsible for setting SP = 256, and for calling
-/// Sys.init
-pub fn vm_asm_bootstrap_code() -> Vec<String> {
+/// Sys.init. With `CallMode::Trampoline` this also holds the trampolines,
+/// which are never reached by falling through since Sys.init never returns.
+pub fn write_vm_asm_bootstrap<W: Write>(out: &mut W, call_mode: CallMode) -> io::Result<()> {
     // Set SP = 256
-    let mut lines = vec![
-        "@256".to_string(),
-        "D=A".to_string(),
-        "@SP".to_string(),
-        "M=D".to_string(),
-    ];
+    asm!(out, "@256", "D=A", "@SP", "M=D");
 
     // Call Sys.init
-    let bootstrap_psuedo_filename = "_vm_bootstrap".to_string();
-    let sys_init_call = SourceLine {
-        lineno: 0,
-        item: VMCommand::Call(CallCommand {
-            name: Symbol("Sys.init".to_string()),
-            nargs: 0,
-        }),
-    };
-    let bootstrap_call_commands = vm_command_to_asm(
-        &bootstrap_psuedo_filename,
+    let sys_init_call = VMCommand::Call(CallCommand {
+        name: Symbol("Sys.init".to_string()),
+        nargs: 0,
+    });
+    write_vm_command_asm(
+        out,
+        "_vm_bootstrap",
         &sys_init_call,
         &mut "".to_string(),
         &mut 0,
-    )
-    .expect("failed to build bootstrap Sys.init call");
-    lines.extend(bootstrap_call_commands);
-    lines
+        call_mode,
+    )?;
+
+    if call_mode == CallMode::Trampoline {
+        asm!(out, "({CALL_TRAMPOLINE})");
+        write_call_frame_asm(out, None)?;
+        asm!(out, "@R14", "A=M", "0;JMP");
+
+        asm!(out, "({RETURN_TRAMPOLINE})");
+        write_return_asm(out)?;
+    }
+    Ok(())
+}
+
+/// Like `write_vm_asm_bootstrap`, but collects the lines.
+pub fn vm_asm_bootstrap_code(call_mode: CallMode) -> Vec<String> {
+    collect_lines(|out| write_vm_asm_bootstrap(out, call_mode).map_err(|err| err.to_string()))
+        .expect("failed to build bootstrap code")
+}
+
+/// Translates VM source straight from `input` to `out`, a line at a time, so
+/// memory use doesn't grow with the size of the program. Errors reading,
+/// parsing or writing stop the translation, with output up to that point
+/// already written.
+pub fn translate_vm_stream<R: BufRead, W: Write>(
+    filename: &str,
+    mut input: R,
+    out: &mut W,
+    call_mode: CallMode,
+    stack_mode: StackMode,
+) -> Result<(), String> {
+    // Used to prefix labels
+    let mut current_function_name: String = "".to_string();
+
+    // Counter used for jump labels for comparison operations
+    let mut label_counter = 0;
+
+    // Whether the top of the stack is in D, with StackMode::CacheTop
+    let mut top_in_d = false;
+
+    let mut line = String::new();
+    let mut lineno = 0;
+    loop {
+        line.clear();
+        let len = input
+            .read_line(&mut line)
+            .map_err(|err| format!("error reading line {lineno}: {err}"))?;
+        if len == 0 {
+            // Code that runs off the end of a file, like the project 07
+            // tests, leaves its results on the stack
+            return write_spill_top(out, &mut top_in_d)
+                .map_err(|err| format!("error writing line {lineno}: {err}"));
+        }
+
+        // Same as str::lines, which parse_vm_source uses
+        let source_line = line.strip_suffix('\n').unwrap_or(&line);
+        let source_line = source_line.strip_suffix('\r').unwrap_or(source_line);
+        match parse_vm_line(source_line) {
+            Err(err) => return Err(format!("error on line {lineno}: {err}")),
+            Ok(Some(command)) => match stack_mode {
+                StackMode::Memory => write_vm_command_asm(
+                    out,
+                    filename,
+                    &command,
+                    &mut current_function_name,
+                    &mut label_counter,
+                    call_mode,
+                ),
+                StackMode::CacheTop => write_vm_command_asm_cached(
+                    out,
+                    filename,
+                    &command,
+                    &mut current_function_name,
+                    &mut label_counter,
+                    call_mode,
+                    &mut top_in_d,
+                ),
+            }
+            .map_err(|err| format!("error writing line {lineno}: {err}"))?,
+            Ok(None) => {}
+        }
+        lineno += 1;
+    }
 }
 
 /// Compiles VM commands to assembly source code.
 pub fn vm_to_asm(
     filename: &String,
     commands: Vec<SourceLine<VMCommand>>,
+    call_mode: CallMode,
 ) -> Result<Vec<String>, String> {
-    // Used to prefix labels
     let mut current_function_name: String = "".to_string();
-
-    // Counter used for jump labels for comparison operations
     let mut label_counter = 0;
 
-    commands
-        .iter()
-        .map(|cmd| {
-            vm_command_to_asm(
+    collect_lines(|out| {
+        commands.iter().try_for_each(|cmd| {
+            write_vm_command_asm(
+                out,
                 filename,
-                cmd,
+                &cmd.item,
                 &mut current_function_name,
                 &mut label_counter,
+                call_mode,
             )
+            .map_err(|err| err.to_string())
         })
-        .collect::<Result<Vec<Vec<String>>, String>>()
-        .map(|vecs| vecs.into_iter().flatten().collect())
+    })
+}
+
+/// Runs a translation into memory and splits what it wrote into lines, for the
+/// functions that hand back a `Vec<String>`.
+fn collect_lines<F: FnOnce(&mut Vec<u8>) -> Result<(), String>>(
+    write: F,
+) -> Result<Vec<String>, String> {
+    let mut buf = Vec::new();
+    write(&mut buf)?;
+    let text = String::from_utf8(buf).map_err(|err| err.to_string())?;
+    Ok(text.lines().map(str::to_string).collect())
 }
 
+#[test]
+fn test_call_modes() {
+    let filename = "Main".to_string();
+    let call = SourceLine {
+        lineno: 0,
+        item: VMCommand::Call(CallCommand {
+            name: Symbol("Math.multiply".to_string()),
+            nargs: 2,
+        }),
+    };
+    let instructions = |lines: Vec<String>| {
+        lines
+            .into_iter()
+            .filter(|line| !line.starts_with("//") && !line.starts_with("("))
+            .collect::<Vec<String>>()
+    };
+    let translate = |command: &SourceLine<VMCommand>, call_mode: CallMode| {
+        instructions(
+            vm_command_to_asm(
+                &filename,
+                command,
+                &mut "Main.main".to_string(),
+                &mut 0,
+                call_mode,
+            )
+            .unwrap(),
+        )
+    };
+
+    assert_eq!(
+        translate(&call, CallMode::Trampoline),
+        vec![
+            "@7",
+            "D=A",
+            "@R13",
+            "M=D",
+            "@Math.multiply",
+            "D=A",
+            "@R14",
+            "M=D",
+            "@Main.main$ret.0",
+            "D=A",
+            "@_vm_call",
+            "0;JMP",
+        ]
+    );
+    assert_eq!(translate(&call, CallMode::Inline).len(), 47);
+
+    let ret = SourceLine {
+        lineno: 0,
+        item: VMCommand::Return,
+    };
+    assert_eq!(
+        translate(&ret, CallMode::Trampoline),
+        vec!["@_vm_return", "0;JMP"]
+    );
+    assert_eq!(translate(&ret, CallMode::Inline).len(), 49);
+
+    // Only the trampoline mode needs the trampolines
+    let bootstrap = vm_asm_bootstrap_code(CallMode::Trampoline);
+    assert!(bootstrap.contains(&"(_vm_call)".to_string()));
+    assert!(bootstrap.contains(&"(_vm_return)".to_string()));
+    assert!(!vm_asm_bootstrap_code(CallMode::Inline).contains(&"(_vm_call)".to_string()));
+}
+
+/// Like `write_vm_command_asm`, but returns the lines.
 pub fn vm_command_to_asm(
     filename: &String,
     command: &SourceLine<VMCommand>,
     current_function_name: &mut String,
     label_counter: &mut usize,
+    call_mode: CallMode,
 ) -> Result<Vec<String>, String> {
-    match &command.item {
-        VMCommand::Push(cmd) => push_to_asm(filename, &cmd),
-        VMCommand::Pop(cmd) => pop_to_asm(filename, &cmd),
-
-        VMCommand::Add => binary_op_asm("add", vec!["D=D+M".to_string()]),
-        VMCommand::Subtract => binary_op_asm("sub", vec!["D=D-M".to_string()]),
-        VMCommand::Negate => unary_op_asm("neg", "M=-M".to_string()),
-
-        VMCommand::Equal => binary_op_asm("eq", comparison_op_asm("JEQ", label_counter)),
-        VMCommand::GreaterThan => binary_op_asm("lt", comparison_op_asm("JGT", label_counter)),
-        VMCommand::LessThan => binary_op_asm("gt", comparison_op_asm("JLT", label_counter)),
-
-        VMCommand::And => binary_op_asm("and", vec!["D=D&M".to_string()]),
-        VMCommand::Or => binary_op_asm("or", vec!["D=D|M".to_string()]),
-        VMCommand::Not => unary_op_asm("not", "M=!M".to_string()),
-
-        VMCommand::Label(Symbol(sym)) => Ok(vec![format!("({current_function_name}${sym})")]),
-        VMCommand::Goto(Symbol(sym)) => Ok(vec![
-            format!("@{current_function_name}${sym}"),
-            "0;JMP".to_string(),
-        ]),
-        VMCommand::IfGoto(Symbol(sym)) => Ok(vec![
-            format!("// if-goto {sym}"),
-            // Pop stack: Point A at SP-1 and decrement SP
-            "@SP".to_string(),
-            "AM=M-1".to_string(),
-            // Store M into D and do comparison
-            "D=M".to_string(),
-            format!("@{current_function_name}${sym}"),
-            "D;JNE".to_string(),
-        ]),
+    collect_lines(|out| {
+        write_vm_command_asm(
+            out,
+            filename,
+            &command.item,
+            current_function_name,
+            label_counter,
+            call_mode,
+        )
+        .map_err(|err| err.to_string())
+    })
+}
+
+/// Writes the assembly for one VM command.
+pub fn write_vm_command_asm<W: Write>(
+    out: &mut W,
+    filename: &str,
+    command: &VMCommand,
+    current_function_name: &mut String,
+    label_counter: &mut usize,
+    call_mode: CallMode,
+) -> io::Result<()> {
+    match command {
+        VMCommand::Push(cmd) => write_push_asm(out, filename, cmd),
+        VMCommand::Pop(cmd) => write_pop_asm(out, filename, cmd),
+
+        VMCommand::Add => write_binary_op_asm(out, "add", |out| writeln!(out, "D=D+M")),
+        VMCommand::Subtract => write_binary_op_asm(out, "sub", |out| writeln!(out, "D=D-M")),
+        VMCommand::Negate => write_unary_op_asm(out, "neg", "M=-M"),
+
+        VMCommand::Equal => write_binary_op_asm(out, "eq", |out| {
+            write_comparison_op_asm(out, filename, "JEQ", label_counter)
+        }),
+        VMCommand::GreaterThan => write_binary_op_asm(out, "lt", |out| {
+            write_comparison_op_asm(out, filename, "JGT", label_counter)
+        }),
+        VMCommand::LessThan => write_binary_op_asm(out, "gt", |out| {
+            write_comparison_op_asm(out, filename, "JLT", label_counter)
+        }),
+
+        VMCommand::And => write_binary_op_asm(out, "and", |out| writeln!(out, "D=D&M")),
+        VMCommand::Or => write_binary_op_asm(out, "or", |out| writeln!(out, "D=D|M")),
+        VMCommand::Not => write_unary_op_asm(out, "not", "M=!M"),
+
+        VMCommand::Label(Symbol(sym)) => {
+            asm!(out, "({current_function_name}${sym})");
+            Ok(())
+        }
+        VMCommand::Goto(Symbol(sym)) => {
+            asm!(out, "@{current_function_name}${sym}", "0;JMP");
+            Ok(())
+        }
+        VMCommand::IfGoto(Symbol(sym)) => {
+            asm!(
+                out,
+                "// if-goto {sym}",
+                // Pop stack: Point A at SP-1 and decrement SP
+                "@SP",
+                "AM=M-1",
+                // Store M into D and do comparison
+                "D=M",
+                "@{current_function_name}${sym}",
+                "D;JNE",
+            );
+            Ok(())
+        }
 
         VMCommand::Function(FunctionCommand { name, nvars }) => {
             // Change the current function name
             let Symbol(name_str) = name;
-            *current_function_name = name_str.clone();
+            current_function_name.clone_from(name_str);
 
             // Add label for function. N.B. It appears the convention is for
             // function names to already include the file name, at least
             // according to the example VM commands I see.
-            let mut lines = vec![
-                format!("// function {name_str} {nvars}"),
-                format!("({name_str})"),
-            ];
+            asm!(out, "// function {name_str} {nvars}", "({name_str})");
+
             // Initialize local variables to zero. `call` sets LCL = SP, so we
             // just need to `push constant 0` nargs times
-            lines.extend((0..*nvars).flat_map(|_| {
-                vec![
-                    format!("// Zero out locals: push constant 0"),
+            for _ in 0..*nvars {
+                asm!(
+                    out,
+                    "// Zero out locals: push constant 0",
                     // Store constant in A
-                    "@0".to_string(),
-                    "D=A".to_string(),
+                    "@0",
+                    "D=A",
                     // Add to top of stack
-                    "@SP".to_string(),
-                    "A=M".to_string(),
-                    "M=D".to_string(),
+                    "@SP",
+                    "A=M",
+                    "M=D",
                     // Increment SP
-                    "@SP".to_string(),
-                    "M=M+1".to_string(),
-                ]
-            }));
-
-            Ok(lines)
+                    "@SP",
+                    "M=M+1",
+                );
+            }
+            Ok(())
         }
         VMCommand::Call(CallCommand { name, nargs }) => {
             let Symbol(name_str) = name;
             // TODO: This uses the global label counter, but the spec says each
             // function should have its own label counter.
-            let return_label = format!("{current_function_name}$ret.{label_counter}");
-
-            // Reusable code for pushing A to the stack
-            let push_d_to_stack = vec![
-                "@SP".to_string(),
-                "A=M".to_string(),
-                "M=D".to_string(),
-                "@SP".to_string(),
-                "M=M+1".to_string(),
-            ];
-
-            let mut lines = vec![format!("// call {name_str} {nargs}")];
-
-            // push returnAddress, generate a label and push it to the stack
-            lines.push(format!("@{return_label}"));
-            lines.push("D=A".to_string());
-            lines.extend(push_d_to_stack.clone());
-
-            // push LCL, save LCL of caller
-            lines.push("@LCL".to_string());
-            lines.push("D=M".to_string());
-            lines.extend(push_d_to_stack.clone());
-
-            // push ARG, save ARG of caller
-            lines.push("@ARG".to_string());
-            lines.push("D=M".to_string());
-            lines.extend(push_d_to_stack.clone());
-
-            // push THIS, save THIS of caller
-            lines.push("@THIS".to_string());
-            lines.push("D=M".to_string());
-            lines.extend(push_d_to_stack.clone());
-
-            // push THAT, save THAT of caller
-            lines.push("@THAT".to_string());
-            lines.push("D=M".to_string());
-            lines.extend(push_d_to_stack.clone());
-
-            // ARG = SP - 5 - nargs, reposition ARG
-            lines.push("@SP".to_string());
-            lines.push("D=M".to_string());
-            lines.push(format!("@{}", 5 + nargs));
-            lines.push("D=D-A".to_string());
-            lines.push("@ARG".to_string());
-            lines.push("M=D".to_string());
-
-            // LCL = SP, reposition LCL
-            lines.push("@SP".to_string());
-            lines.push("D=M".to_string());
-            lines.push("@LCL".to_string());
-            lines.push("M=D".to_string());
-
-            // goto f
-            lines.push(format!("@{name_str}"));
-            lines.push("0;JMP".to_string());
+            let return_label = format_args!("{current_function_name}$ret.{label_counter}");
+
+            asm!(out, "// call {name_str} {nargs}");
+
+            match call_mode {
+                CallMode::Inline => {
+                    // push returnAddress, generate a label and push it to the stack
+                    asm!(out, "@{return_label}", "D=A");
+                    write_call_frame_asm(out, Some(*nargs))?;
+
+                    // goto f
+                    asm!(out, "@{name_str}", "0;JMP");
+                }
+                CallMode::Trampoline => {
+                    // R13 = 5 + nargs, R14 = f, D = returnAddress, and let the
+                    // trampoline do the rest
+                    let nargs_plus_5 = 5 + nargs;
+                    asm!(
+                        out,
+                        "@{nargs_plus_5}",
+                        "D=A",
+                        "@R13",
+                        "M=D",
+                        "@{name_str}",
+                        "D=A",
+                        "@R14",
+                        "M=D",
+                        "@{return_label}",
+                        "D=A",
+                        "@{CALL_TRAMPOLINE}",
+                        "0;JMP",
+                    );
+                }
+            }
 
             // Record the return address label
-            lines.push(format!("({return_label})"));
+            asm!(out, "({return_label})");
 
             *label_counter += 1;
 
-            Ok(lines)
-        }
-        VMCommand::Return => Ok(vec![
-            "// return".to_string(),
-            // frame = LCL, store frame as temporary variable in R13
-            "@LCL".to_string(),
-            "D=M".to_string(),
-            "@R13".to_string(),
-            "M=D".to_string(),
-            // retAddr = *(frame - 5), store return address in R14
-            "@5".to_string(),
-            "A=D-A".to_string(), // D still points to frame
-            "D=M".to_string(),
-            "@R14".to_string(),
-            "M=D".to_string(),
-            // *ARG = pop(), reposition return value for caller
-            "@SP".to_string(), // First store top of stack in D
-            "A=M-1".to_string(),
-            "D=M".to_string(),
-            "@ARG".to_string(), // Then store D in *ARG
-            "A=M".to_string(),
-            "M=D".to_string(),
-            // SP = ARG + 1, reposition SP for caller
-            "D=A+1".to_string(), // A is still pointing to ARG
-            "@SP".to_string(),
-            "M=D".to_string(),
-            // THAT = *(frame - 1), restores THAT for caller
-            "@R13".to_string(),
-            "D=M".to_string(), // D = frame
-            "@1".to_string(),
-            "A=D-A".to_string(),
-            "D=M".to_string(), // D = *(frame - 1)
-            "@THAT".to_string(),
-            "M=D".to_string(),
-            // THIS = *(frame - 2), restores THIS for caller
-            "@R13".to_string(),
-            "D=M".to_string(), // D = frame
-            "@2".to_string(),
-            "A=D-A".to_string(),
-            "D=M".to_string(), // D = *(frame - 2)
-            "@THIS".to_string(),
-            "M=D".to_string(),
-            // ARG = *(frame - 3), restores ARG for caller
-            "@R13".to_string(),
-            "D=M".to_string(), // D = frame
-            "@3".to_string(),
-            "A=D-A".to_string(),
-            "D=M".to_string(), // D = *(frame - 3)
-            "@ARG".to_string(),
-            "M=D".to_string(),
-            // LCL = *(frame - 4), restores LCL for caller
-            "@R13".to_string(),
-            "D=M".to_string(), // D = frame
-            "@4".to_string(),
-            "A=D-A".to_string(),
-            "D=M".to_string(), // D = *(frame - 4)
-            "@LCL".to_string(),
-            "M=D".to_string(),
-            // goto retAddr
-            "@R14".to_string(),
-            "A=M".to_string(),
-            "0;JMP".to_string(),
-        ]),
+            Ok(())
+        }
+        VMCommand::Return => match call_mode {
+            CallMode::Inline => {
+                asm!(out, "// return");
+                write_return_asm(out)
+            }
+            CallMode::Trampoline => {
+                asm!(out, "// return", "@{RETURN_TRAMPOLINE}", "0;JMP");
+                Ok(())
+            }
+        },
+    }
+}
+
+/// Writes the assembly for one VM command with `StackMode::CacheTop`.
+/// `top_in_d` says whether the top of the stack is in D rather than RAM, in
+/// which case SP points where it would go. Commands that other code can jump
+/// into or out of write it back first, and go through `write_vm_command_asm`.
+pub fn write_vm_command_asm_cached<W: Write>(
+    out: &mut W,
+    filename: &str,
+    command: &VMCommand,
+    current_function_name: &mut String,
+    label_counter: &mut usize,
+    call_mode: CallMode,
+    top_in_d: &mut bool,
+) -> io::Result<()> {
+    match command {
+        VMCommand::Push(PushCommand { segment, index }) => {
+            let segment_str = segment.name();
+            asm!(out, "// push {segment_str} {index}");
+            write_spill_top(out, top_in_d)?;
+            write_cached_push_asm(out, filename, segment, *index, top_in_d)
+        }
+        VMCommand::Pop(PopCommand { segment, index }) => {
+            let segment_str = segment.name();
+            asm!(out, "// pop {segment_str} {index}");
+            write_load_top(out, top_in_d)?;
+            write_store_d(out, filename, segment, *index)?;
+            *top_in_d = false;
+            Ok(())
+        }
+
+        VMCommand::Add => write_cached_binary_op_asm(out, "add", "D=D+M", top_in_d),
+        VMCommand::Subtract => write_cached_binary_op_asm(out, "sub", "D=M-D", top_in_d),
+        VMCommand::Negate => write_cached_unary_op_asm(out, "neg", "D=-D", top_in_d),
+
+        VMCommand::Equal => {
+            write_cached_comparison_op_asm(out, filename, "eq", "JEQ", label_counter, top_in_d)
+        }
+        VMCommand::GreaterThan => {
+            write_cached_comparison_op_asm(out, filename, "gt", "JGT", label_counter, top_in_d)
+        }
+        VMCommand::LessThan => {
+            write_cached_comparison_op_asm(out, filename, "lt", "JLT", label_counter, top_in_d)
+        }
+
+        VMCommand::And => write_cached_binary_op_asm(out, "and", "D=D&M", top_in_d),
+        VMCommand::Or => write_cached_binary_op_asm(out, "or", "D=D|M", top_in_d),
+        VMCommand::Not => write_cached_unary_op_asm(out, "not", "D=!D", top_in_d),
+
+        VMCommand::IfGoto(Symbol(sym)) => {
+            // The condition is popped into D anyway, so it needn't be written
+            // back, and after a comparison it's already there
+            asm!(out, "// if-goto {sym}");
+            write_load_top(out, top_in_d)?;
+            asm!(out, "@{current_function_name}${sym}", "D;JNE");
+            *top_in_d = false;
+            Ok(())
+        }
+
+        VMCommand::Function(FunctionCommand { name, nvars }) => {
+            // Nothing falls through into a function, but write back anyway in
+            // case something does
+            write_spill_top(out, top_in_d)?;
+
+            let Symbol(name_str) = name;
+            current_function_name.clone_from(name_str);
+            asm!(out, "// function {name_str} {nvars}", "({name_str})");
+
+            // Zeroed locals are pushes like any other, so the last one stays
+            // in D
+            for _ in 0..*nvars {
+                write_spill_top(out, top_in_d)?;
+                write_cached_push_asm(out, filename, &Segment::Constant, 0, top_in_d)?;
+            }
+            Ok(())
+        }
+
+        VMCommand::Label(_) | VMCommand::Goto(_) | VMCommand::Call(_) | VMCommand::Return => {
+            write_spill_top(out, top_in_d)?;
+            write_vm_command_asm(
+                out,
+                filename,
+                command,
+                current_function_name,
+                label_counter,
+                call_mode,
+            )
+        }
+    }
+}
+
+/// Pushes D onto the stack in RAM if the top of the stack is held there.
+fn write_spill_top<W: Write>(out: &mut W, top_in_d: &mut bool) -> io::Result<()> {
+    if *top_in_d {
+        asm!(out, "@SP", "M=M+1", "A=M-1", "M=D");
+        *top_in_d = false;
+    }
+    Ok(())
+}
+
+/// Pops the top of the stack into D, unless it's already there.
+fn write_load_top<W: Write>(out: &mut W, top_in_d: &mut bool) -> io::Result<()> {
+    if !*top_in_d {
+        asm!(out, "@SP", "AM=M-1", "D=M");
+        *top_in_d = true;
     }
+    Ok(())
 }
 
-fn push_to_asm(filename: &String, command: &PushCommand) -> Result<Vec<String>, String> {
+/// Loads *(segment + index) into D as the new top of the stack. The old top
+/// must already have been written back.
+fn write_cached_push_asm<W: Write>(
+    out: &mut W,
+    filename: &str,
+    segment: &Segment,
+    index: u16,
+    top_in_d: &mut bool,
+) -> io::Result<()> {
+    match (segment, index) {
+        (Segment::Constant, 0) => asm!(out, "D=0"),
+        (Segment::Constant, 1) => asm!(out, "D=1"),
+        (Segment::Constant, _) => {
+            write_fetch_segment(out, filename, segment, index)?;
+            asm!(out, "D=A");
+        }
+        _ => {
+            write_fetch_segment(out, filename, segment, index)?;
+            asm!(out, "D=M");
+        }
+    }
+    *top_in_d = true;
+    Ok(())
+}
+
+/// Stores D at *(segment + index), without going through R13 where it can.
+fn write_store_d<W: Write>(
+    out: &mut W,
+    filename: &str,
+    segment: &Segment,
+    index: u16,
+) -> io::Result<()> {
+    let base = match segment {
+        Segment::Argument => "@ARG",
+        Segment::Local => "@LCL",
+        Segment::This => "@THIS",
+        Segment::That => "@THAT",
+        // These have fixed addresses that don't need D to compute
+        _ => {
+            write_fetch_segment(out, filename, segment, index)?;
+            asm!(out, "M=D");
+            return Ok(());
+        }
+    };
+
+    if index < 7 {
+        // Step A up to the address, which is no longer than the sequence below
+        asm!(out, "{base}", "A=M");
+        for _ in 0..index {
+            asm!(out, "A=A+1");
+        }
+        asm!(out, "M=D");
+    } else {
+        // Keep the value in R13 and add it to the address, so the address and
+        // then the value can be had back by subtracting
+        asm!(
+            out, "@R13", "M=D", "{base}", "D=M", "@{index}", "D=D+A", // D = address
+            "@R13", "D=D+M", // D = address + value
+            "A=D-M", // A = address
+            "M=D-A", // *address = value
+        );
+    }
+    Ok(())
+}
+
+/// Applies `op_code` to the top of the stack in D.
+fn write_cached_unary_op_asm<W: Write>(
+    out: &mut W,
+    op_name: &str,
+    op_code: &str,
+    top_in_d: &mut bool,
+) -> io::Result<()> {
+    asm!(out, "// {op_name}");
+    write_load_top(out, top_in_d)?;
+    asm!(out, "{op_code}");
+    Ok(())
+}
+
+/// Pops the second item on the stack and applies `op_code` to it and the top
+/// of the stack, leaving the result in D. When the operation is applied, D
+/// holds the top of the stack and M the item below it, so for example
+/// subtraction is D=M-D.
+fn write_cached_binary_op_asm<W: Write>(
+    out: &mut W,
+    op_name: &str,
+    op_code: &str,
+    top_in_d: &mut bool,
+) -> io::Result<()> {
+    asm!(out, "// {op_name}");
+    write_load_top(out, top_in_d)?;
+    asm!(out, "@SP", "AM=M-1", "{op_code}");
+    Ok(())
+}
+
+/// Like `write_comparison_op_asm`, but the result is left in D and there's no
+/// need for a separate failure branch.
+fn write_cached_comparison_op_asm<W: Write>(
+    out: &mut W,
+    filename: &str,
+    op_name: &str,
+    jump_op: &str,
+    label_counter: &mut usize,
+    top_in_d: &mut bool,
+) -> io::Result<()> {
+    asm!(out, "// {op_name}");
+    write_load_top(out, top_in_d)?;
+
+    let suffix = format_args!("{filename}_{label_counter}");
+    asm!(
+        out,
+        "@SP",
+        "AM=M-1",
+        "D=M-D",
+        "@_vm_comp_success_{suffix}",
+        "D;{jump_op}",
+        "D=0",
+        "@_vm_comp_end_{suffix}",
+        "0;JMP",
+        "(_vm_comp_success_{suffix})",
+        "D=-1",
+        "(_vm_comp_end_{suffix})",
+    );
+
+    *label_counter += 1;
+
+    Ok(())
+}
+
+#[test]
+fn test_stack_modes() {
+    let translate = |source: &str, stack_mode: StackMode| {
+        let mut out = Vec::new();
+        translate_vm_stream(
+            "Main",
+            source.as_bytes(),
+            &mut out,
+            CallMode::Trampoline,
+            stack_mode,
+        )
+        .unwrap();
+        String::from_utf8(out)
+            .unwrap()
+            .lines()
+            .map(str::to_string)
+            .collect::<Vec<String>>()
+    };
+
+    // Nothing is pushed to RAM until the end, where the result is left on the
+    // stack
+    let source = "push local 0\npush constant 3\nadd\nneg\npop static 2\npush argument 9\n";
+    assert_eq!(
+        translate(source, StackMode::CacheTop),
+        vec![
+            "// push local 0",
+            "@LCL",
+            "A=M",
+            "D=M",
+            "// push constant 3",
+            "@SP",
+            "M=M+1",
+            "A=M-1",
+            "M=D",
+            "@3",
+            "D=A",
+            "// add",
+            "@SP",
+            "AM=M-1",
+            "D=D+M",
+            "// neg",
+            "D=-D",
+            "// pop static 2",
+            "@Main.2",
+            "M=D",
+            "// push argument 9",
+            "@ARG",
+            "D=M",
+            "@9",
+            "A=D+A",
+            "D=M",
+            "@SP",
+            "M=M+1",
+            "A=M-1",
+            "M=D",
+        ]
+    );
+    let memory = translate(source, StackMode::Memory);
+    assert_eq!(
+        memory.iter().filter(|line| !line.starts_with("//")).count(),
+        47
+    );
+
+    // The comparison's result is tested straight from D, and the stack is in
+    // RAM at the label
+    let source = "label LOOP\npush local 0\npush constant 1\nlt\nif-goto LOOP\n";
+    assert_eq!(
+        translate(source, StackMode::CacheTop),
+        vec![
+            "($LOOP)",
+            "// push local 0",
+            "@LCL",
+            "A=M",
+            "D=M",
+            "// push constant 1",
+            "@SP",
+            "M=M+1",
+            "A=M-1",
+            "M=D",
+            "D=1",
+            "// lt",
+            "@SP",
+            "AM=M-1",
+            "D=M-D",
+            "@_vm_comp_success_Main_0",
+            "D;JLT",
+            "D=0",
+            "@_vm_comp_end_Main_0",
+            "0;JMP",
+            "(_vm_comp_success_Main_0)",
+            "D=-1",
+            "(_vm_comp_end_Main_0)",
+            "// if-goto LOOP",
+            "@$LOOP",
+            "D;JNE",
+        ]
+    );
+}
+
+/// Saves the caller's frame and sets up the callee's, for `call`. Expects the
+/// return address in D. `nargs` is known at an inline call site; the call
+/// trampoline is passed 5 + nargs in R13 instead.
+fn write_call_frame_asm<W: Write>(out: &mut W, nargs: Option<u16>) -> io::Result<()> {
+    // push returnAddress, then LCL, ARG, THIS and THAT of the caller
+    for saved in ["", "@LCL", "@ARG", "@THIS", "@THAT"] {
+        if !saved.is_empty() {
+            asm!(out, "{saved}", "D=M");
+        }
+        asm!(out, "@SP", "A=M", "M=D", "@SP", "M=M+1");
+    }
+
+    // ARG = SP - 5 - nargs, reposition ARG
+    match nargs {
+        Some(nargs) => {
+            let nargs_plus_5 = 5 + nargs;
+            asm!(out, "@{nargs_plus_5}", "D=A");
+        }
+        None => asm!(out, "@R13", "D=M"),
+    }
+    asm!(out, "@SP", "D=M-D", "@ARG", "M=D");
+
+    // LCL = SP, reposition LCL
+    asm!(out, "@SP", "D=M", "@LCL", "M=D");
+
+    Ok(())
+}
+
+/// Restores the caller's frame and jumps back to it, for `return`.
+fn write_return_asm<W: Write>(out: &mut W) -> io::Result<()> {
+    // frame = LCL, store frame as temporary variable in R13
+    asm!(out, "@LCL", "D=M", "@R13", "M=D");
+
+    // retAddr = *(frame - 5), store return address in R14. D still points to
+    // frame
+    asm!(out, "@5", "A=D-A", "D=M", "@R14", "M=D");
+
+    // *ARG = pop(), reposition return value for caller. First store top of
+    // stack in D, then store D in *ARG
+    asm!(out, "@SP", "A=M-1", "D=M", "@ARG", "A=M", "M=D");
+
+    // SP = ARG + 1, reposition SP for caller. A is still pointing to ARG
+    asm!(out, "D=A+1", "@SP", "M=D");
+
+    // THAT, THIS, ARG and LCL = *(frame - 1) to *(frame - 4), restores them
+    // for caller
+    for (offset, saved) in [(1, "@THAT"), (2, "@THIS"), (3, "@ARG"), (4, "@LCL")] {
+        asm!(
+            out,
+            "@R13",
+            "D=M", // D = frame
+            "@{offset}",
+            "A=D-A",
+            "D=M", // D = *(frame - offset)
+            "{saved}",
+            "M=D",
+        );
+    }
+
+    // goto retAddr
+    asm!(out, "@R14", "A=M", "0;JMP");
+    Ok(())
+}
+
+fn write_push_asm<W: Write>(out: &mut W, filename: &str, command: &PushCommand) -> io::Result<()> {
     let PushCommand { segment, index } = command;
-    let segment_str = segment.to_string();
+    let segment_str = segment.name();
 
-    let mut lines = vec![format!("// push {segment_str} {index}")];
+    asm!(out, "// push {segment_str} {index}");
 
     // Compute *(segment + index) and store in A
-    lines.append(&mut asm_fetch_segment(filename, segment, *index));
+    write_fetch_segment(out, filename, segment, *index)?;
 
     if *segment == Segment::Constant {
-        lines.push("D=A".to_string());
+        asm!(out, "D=A");
     } else {
         // Follow the pointer by reading M into D
-        lines.push("D=M".to_string());
+        asm!(out, "D=M");
     }
 
-    // Store D onto the stack
-    lines.push("@SP".to_string()); // Set A to SP (RAM[0])
-    lines.push("A=M".to_string()); // Follow pointer
-    lines.push("M=D".to_string()); // Store D in pointer location
+    // Store D onto the stack: set A to SP (RAM[0]), follow the pointer and
+    // store D there
+    asm!(out, "@SP", "A=M", "M=D");
 
     // Increment SP
-    lines.push("@SP".to_string());
-    lines.push("M=M+1".to_string());
-
-    Ok(lines)
+    asm!(out, "@SP", "M=M+1");
+    Ok(())
 }
 
 /// ASM code to compute location of given memory segment and index and store
 /// result in A.
-fn asm_fetch_segment(filename: &String, segment: &Segment, index: u16) -> Vec<String> {
+fn write_fetch_segment<W: Write>(
+    out: &mut W,
+    filename: &str,
+    segment: &Segment,
+    index: u16,
+) -> io::Result<()> {
     match segment {
-        Segment::Argument => asm_fetch_memory_offset("@ARG".to_string(), index),
-        Segment::Local => asm_fetch_memory_offset("@LCL".to_string(), index),
-        Segment::This => asm_fetch_memory_offset("@THIS".to_string(), index),
-        Segment::That => asm_fetch_memory_offset("@THAT".to_string(), index),
+        Segment::Argument => write_fetch_memory_offset(out, "@ARG", index),
+        Segment::Local => write_fetch_memory_offset(out, "@LCL", index),
+        Segment::This => write_fetch_memory_offset(out, "@THIS", index),
+        Segment::That => write_fetch_memory_offset(out, "@THAT", index),
 
         // Static variables are mapped on addresses 16 to 255 of the host RAM.
         // The book says each reference to static i in a VM program stored in
@@ -592,137 +1153,148 @@ fn asm_fetch_segment(filename: &String, segment: &Segment, index: u16) -> Vec<St
         // 100, push constant 200, pop static 5, pop static 2. The translation
         // scheme described above will cause static 5 and static 2 to be mapped
         // on RAM addresses 16 and 17, respectively.
-        Segment::Static => vec![format!("@{filename}.{index}")],
+        Segment::Static => {
+            asm!(out, "@{filename}.{index}");
+            Ok(())
+        }
 
         // pointer is RAM[3-4]
         Segment::Pointer => {
             let location = 3 + index;
-            vec![format!("@{location}").to_string()]
+            asm!(out, "@{location}");
+            Ok(())
         }
 
         // temp is always RAM[5-12]
         Segment::Temp => {
             let location = 5 + index;
-            vec![format!("@{location}").to_string()]
+            asm!(out, "@{location}");
+            Ok(())
         }
 
         // Constant is a virtual segment, used to fetch constant values
-        Segment::Constant => vec![format!("@{index}").to_string()],
+        Segment::Constant => {
+            asm!(out, "@{index}");
+            Ok(())
+        }
     }
 }
 
 /// ASM code to compute memory segment with offset and store in D
-fn asm_fetch_memory_offset(base: String, offset: u16) -> Vec<String> {
+fn write_fetch_memory_offset<W: Write>(out: &mut W, base: &str, offset: u16) -> io::Result<()> {
     // Set A to base
-    let mut lines = vec![base];
+    asm!(out, "{base}");
     if offset == 0 {
         // Follow pointer, store in A
-        lines.push("A=M".to_string());
+        asm!(out, "A=M");
     } else {
-        // Set D to point to base memory location so we can add to it
-        lines.push("D=M".to_string());
-        // Load offset into A and add to base from D
-        lines.push(format!("@{offset}"));
-        lines.push("A=D+A".to_string());
+        asm!(
+            out,
+            // Set D to point to base memory location so we can add to it
+            "D=M",
+            // Load offset into A and add to base from D
+            "@{offset}",
+            "A=D+A",
+        );
     }
-    lines
+    Ok(())
 }
 
-fn pop_to_asm(filename: &String, command: &PopCommand) -> Result<Vec<String>, String> {
+fn write_pop_asm<W: Write>(out: &mut W, filename: &str, command: &PopCommand) -> io::Result<()> {
     let PopCommand { segment, index } = command;
-    let segment_str = segment.to_string();
+    let segment_str = segment.name();
 
-    let mut lines = vec![format!("// pop {segment_str} {index}")];
+    asm!(out, "// pop {segment_str} {index}");
 
     // Compute *(segment + index) and store in A
-    lines.append(&mut asm_fetch_segment(filename, segment, *index));
+    write_fetch_segment(out, filename, segment, *index)?;
 
     // Store segment target in R13 for now
-    lines.push("D=A".to_string());
-    lines.push("@R13".to_string());
-    lines.push("M=D".to_string());
+    asm!(out, "D=A", "@R13", "M=D");
 
     // Decrement SP and point A there
-    lines.push("@SP".to_string());
-    lines.push("AM=M-1".to_string());
+    asm!(out, "@SP", "AM=M-1");
 
     // Store the popped value in D, and then R13
-    lines.push("D=M".to_string());
-    lines.push("@R13".to_string());
-    lines.push("A=M".to_string());
-    lines.push("M=D".to_string());
-
-    Ok(lines)
+    asm!(out, "D=M", "@R13", "A=M", "M=D");
+    Ok(())
 }
 
 /// Updates the top of the stack in-place with the given operation. When the
 /// operation is applied, A is pointing at SP-1, so you can do the op on M.
-fn unary_op_asm(op_name: &str, op_code: String) -> Result<Vec<String>, String> {
-    Ok(vec![
-        format!("// {op_name}"),
+fn write_unary_op_asm<W: Write>(out: &mut W, op_name: &str, op_code: &str) -> io::Result<()> {
+    asm!(
+        out,
+        "// {op_name}",
         // Point A at SP-1
-        "@SP".to_string(),
-        "A=M-1".to_string(),
-        op_code,
-    ])
+        "@SP",
+        "A=M-1",
+        "{op_code}",
+    );
+    Ok(())
 }
 
 /// Pops two items off the stack, applies the given operation, and pushes the
 /// result back onto the stack. When the operation is applied, D contains the
 /// value at *(SP-2) and A is at SP-1, so for example addition would be D=D+M.
-fn binary_op_asm(op_name: &str, op_code: Vec<String>) -> Result<Vec<String>, String> {
-    // Decrement SP by 1
-    let mut lines = vec![
-        format!("// {op_name}"),
-        "@SP".to_string(),
-        "M=M-1".to_string(),
-    ];
-
-    // First arg for operation is now at SP-1. Fetch that and put into D.
-    lines.push("A=M-1".to_string());
-    lines.push("D=M".to_string());
-
-    // Get second arg at SP and perform op, storing result in D
-    lines.push("A=A+1".to_string());
-    lines.extend(op_code);
+fn write_binary_op_asm<W: Write, F: FnOnce(&mut W) -> io::Result<()>>(
+    out: &mut W,
+    op_name: &str,
+    write_op: F,
+) -> io::Result<()> {
+    asm!(
+        out,
+        // Decrement SP by 1
+        "// {op_name}",
+        "@SP",
+        "M=M-1",
+        // First arg for operation is now at SP-1. Fetch that and put into D.
+        "A=M-1",
+        "D=M",
+        // Get second arg at SP and perform op, storing result in D
+        "A=A+1",
+    );
+    write_op(out)?;
 
     // Store result in SP-1
-    lines.push("@SP".to_string());
-    lines.push("A=M-1".to_string());
-    lines.push("M=D".to_string());
-
-    Ok(lines)
+    asm!(out, "@SP", "A=M-1", "M=D");
+    Ok(())
 }
 
 /// Implements necessary ASM to compute jump results and stores value in D.
 /// Assumes that before this ASM is entered, D contains the value at *(SP-2) and
-/// A is at SP-1, like inside `binary_op_asm`.
-fn comparison_op_asm(jump_op: &str, label_counter: &mut usize) -> Vec<String> {
-    let success_label = format!("_vm_comp_success_{label_counter}");
-    let fail_label = format!("_vm_comp_fail_{label_counter}");
-    let end_label = format!("_vm_comp_end_{label_counter}");
-    let lines = vec![
+/// A is at SP-1, like inside `write_binary_op_asm`. Labels include the file
+/// name, since every file's label counter starts from 0.
+fn write_comparison_op_asm<W: Write>(
+    out: &mut W,
+    filename: &str,
+    jump_op: &str,
+    label_counter: &mut usize,
+) -> io::Result<()> {
+    let suffix = format_args!("{filename}_{label_counter}");
+    asm!(
+        out,
         // Run comparison operation on D and M and jump to appropriate location
-        "D=D-M".to_string(),
-        format!("@{success_label}"),
-        format!("D;{jump_op}"),
-        format!("@{fail_label}"),
-        "0;JMP".to_string(),
+        "D=D-M",
+        "@_vm_comp_success_{suffix}",
+        "D;{jump_op}",
+        "@_vm_comp_fail_{suffix}",
+        "0;JMP",
         // If the comparison operation succeeds, then jump here and we will set
         // *(SP-1) to 0b1111... (which is -1 in decimal).
-        format!("({success_label})"),
-        "D=-1".to_string(),
-        format!("@{end_label}"),
-        "0;JMP".to_string(),
+        "(_vm_comp_success_{suffix})",
+        "D=-1",
+        "@_vm_comp_end_{suffix}",
+        "0;JMP",
         // If the comparison operation fails, then jump here and we will set
         // *(SP-1) to 0.
-        format!("({fail_label})"),
-        "D=0".to_string(),
+        "(_vm_comp_fail_{suffix})",
+        "D=0",
         // End label, just to continue execution
-        format!("({end_label})"),
-    ];
+        "(_vm_comp_end_{suffix})",
+    );
 
     *label_counter += 1;
 
-    lines
+    Ok(())
 }
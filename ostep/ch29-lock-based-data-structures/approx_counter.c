@@ -1,75 +1,170 @@
 #include "approx_counter.h"
 
-#include "mutex_utils.h"
+#include "lock.h"
 
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 struct approx_counter {
-	pthread_mutex_t global_mutex;
-	uint64_t global_counter;
+	struct lock global_lock;
+	_Atomic uint64_t global_counter;
+	// Odd while a sync is moving a CPU count into the global counter. Only
+	// changed with global_lock held.
+	_Atomic uint64_t sync_seq;
 
 	int num_cpus;
-	pthread_mutex_t *cpu_mutexes;
-	uint64_t *cpu_counters;
+	struct lock *cpu_locks;
+	// Only changed with the CPU's lock held, but atomic so get can read them
+	// without it
+	_Atomic uint64_t *cpu_counters;
 
 	uint64_t sync_threshold;
+
+	bool has_flusher;
+	atomic_bool stop_flusher;
+	pthread_t flusher;
+	uint64_t flush_interval_us;
 };
 
-struct approx_counter *approx_counter_create(int num_cpus, uint64_t sync_threshold)
+struct approx_counter *approx_counter_create(int num_cpus, uint64_t sync_threshold, enum lock_kind lock_kind)
 {
 	struct approx_counter *counter = malloc(sizeof(*counter));
 
-	pthread_mutex_init_or_fail(&counter->global_mutex);
-	counter->global_counter = 0;
+	lock_init(&counter->global_lock, lock_kind);
+	atomic_init(&counter->global_counter, 0);
+	atomic_init(&counter->sync_seq, 0);
 
 	counter->num_cpus = num_cpus;
-	counter->cpu_mutexes = malloc(sizeof(*counter->cpu_mutexes) * counter->num_cpus);
+	counter->cpu_locks = malloc(sizeof(*counter->cpu_locks) * counter->num_cpus);
 	counter->cpu_counters = malloc(sizeof(*counter->cpu_counters) * counter->num_cpus);
 
 	for (int i = 0; i < counter->num_cpus; i++) {
-		pthread_mutex_init_or_fail(&counter->cpu_mutexes[i]);
-		counter->cpu_counters[i] = 0;
+		lock_init(&counter->cpu_locks[i], lock_kind);
+		atomic_init(&counter->cpu_counters[i], 0);
 	}
 
 	counter->sync_threshold = sync_threshold;
 
+	counter->has_flusher = false;
+	atomic_init(&counter->stop_flusher, false);
+
 	return counter;
 }
 
+/*
+ * Moves the count of CPU core_id into the global counter. Must hold that
+ * CPU's lock. Bumps sync_seq either side, like a seqlock, so get can tell
+ * the count was in neither place, or both, while it looked.
+ */
+static void sync_cpu_counter(struct approx_counter *counter, int core_id, uint64_t count)
+{
+	lock_acquire(&counter->global_lock);
+	uint64_t seq = atomic_load_explicit(&counter->sync_seq, memory_order_relaxed);
+	atomic_store_explicit(&counter->sync_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	uint64_t global = atomic_load_explicit(&counter->global_counter, memory_order_relaxed);
+	atomic_store_explicit(&counter->global_counter, global + count, memory_order_relaxed);
+	atomic_store_explicit(&counter->cpu_counters[core_id], 0, memory_order_relaxed);
+
+	atomic_store_explicit(&counter->sync_seq, seq + 2, memory_order_release);
+	lock_release(&counter->global_lock);
+}
+
 void approx_counter_increment(struct approx_counter *counter, int core_id)
 {
-	pthread_mutex_t *mutex = &counter->cpu_mutexes[core_id];
-	pthread_mutex_lock_or_fail(mutex);
-	counter->cpu_counters[core_id] += 1;
+	struct lock *lock = &counter->cpu_locks[core_id];
+	lock_acquire(lock);
+	// Only this thread writes it while holding the lock, so no need for an
+	// atomic add
+	_Atomic uint64_t *cpu_counter = &counter->cpu_counters[core_id];
+	uint64_t count = atomic_load_explicit(cpu_counter, memory_order_relaxed) + 1;
+	atomic_store_explicit(cpu_counter, count, memory_order_relaxed);
 
 	// Sync to global counter
-	if (counter->cpu_counters[core_id] >= counter->sync_threshold) {
-		pthread_mutex_lock_or_fail(&counter->global_mutex);
-		counter->global_counter += counter->cpu_counters[core_id];
-		pthread_mutex_unlock_or_fail(&counter->global_mutex);
-		counter->cpu_counters[core_id] = 0;
-	}
+	if (count >= counter->sync_threshold)
+		sync_cpu_counter(counter, core_id, count);
 
-	pthread_mutex_unlock_or_fail(mutex);
+	lock_release(lock);
 }
 
 uint64_t approx_counter_get(struct approx_counter *counter)
 {
-	uint64_t count = counter->global_counter;
-	for (int i = 0; i < counter->num_cpus; i++)
-		count += counter->cpu_counters[i];
-	return count;
+	for (;;) {
+		uint64_t seq = atomic_load_explicit(&counter->sync_seq, memory_order_acquire);
+		if (seq % 2 == 1)
+			continue;
+
+		uint64_t count = atomic_load_explicit(&counter->global_counter, memory_order_relaxed);
+		for (int i = 0; i < counter->num_cpus; i++)
+			count += atomic_load_explicit(&counter->cpu_counters[i], memory_order_relaxed);
+
+		// No counts moved while we added them up, and each one only grew, so
+		// the total is somewhere between what it was when we started and
+		// finished
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&counter->sync_seq, memory_order_relaxed) == seq)
+			return count;
+	}
+}
+
+uint64_t approx_counter_get_fast(struct approx_counter *counter)
+{
+	return atomic_load_explicit(&counter->global_counter, memory_order_relaxed);
+}
+
+static void *flusher_thread(void *arg)
+{
+	struct approx_counter *counter = arg;
+	struct timespec interval = {
+		.tv_sec = counter->flush_interval_us / 1000000,
+		.tv_nsec = counter->flush_interval_us % 1000000 * 1000,
+	};
+
+	while (!atomic_load_explicit(&counter->stop_flusher, memory_order_relaxed)) {
+		nanosleep(&interval, NULL);
+		for (int i = 0; i < counter->num_cpus; i++) {
+			lock_acquire(&counter->cpu_locks[i]);
+			uint64_t count = atomic_load_explicit(&counter->cpu_counters[i], memory_order_relaxed);
+			if (count > 0)
+				sync_cpu_counter(counter, i, count);
+			lock_release(&counter->cpu_locks[i]);
+		}
+	}
+	return NULL;
+}
+
+void approx_counter_start_flusher(struct approx_counter *counter, uint64_t interval_us)
+{
+	if (counter->has_flusher) {
+		fprintf(stderr, "flusher already started in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	counter->flush_interval_us = interval_us;
+	if (pthread_create(&counter->flusher, NULL, flusher_thread, counter)) {
+		fprintf(stderr, "pthread_create failed in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	counter->has_flusher = true;
 }
 
 void approx_counter_destroy(struct approx_counter *counter)
 {
-	pthread_mutex_destroy(&counter->global_mutex);
+	if (counter->has_flusher) {
+		atomic_store_explicit(&counter->stop_flusher, true, memory_order_relaxed);
+		pthread_join(counter->flusher, NULL);
+	}
+
+	lock_destroy(&counter->global_lock);
 	for (int i = 0; i < counter->num_cpus; i++)
-		pthread_mutex_destroy(&counter->cpu_mutexes[i]);
-	free(counter->cpu_mutexes);
+		lock_destroy(&counter->cpu_locks[i]);
+	free(counter->cpu_locks);
 	free(counter->cpu_counters);
 	free(counter);
 }
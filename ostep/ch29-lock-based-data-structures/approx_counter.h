@@ -1,20 +1,38 @@
 #pragma once
 
+#include "lock.h"
+
 #include <stdint.h>
 
 /**
  * An approx_counter is an approximate counter that had an atomic_counter per
  * CPU thread, and syncs these counters into a global counter after reaching a
- * certain threshold.
+ * certain threshold. Its locks are of the given kind.
  */
 struct approx_counter;
 
-struct approx_counter *approx_counter_create(int num_cpus, uint64_t sync_threshold);
+struct approx_counter *approx_counter_create(int num_cpus, uint64_t sync_threshold, enum lock_kind lock_kind);
 void approx_counter_increment(struct approx_counter *counter, int core_id);
 
 /**
- * Gets value of global counter and all CPU counters.
+ * Gets value of global counter and all CPU counters, as it was at some point
+ * during the call. Never takes a lock, so never holds up incrementers; it
+ * retries if a sync moves counts while it's adding them up. Successive calls
+ * never go down.
  */
 uint64_t approx_counter_get(struct approx_counter *counter);
 
+/**
+ * Gets value of global counter alone, in O(1). Never goes down, and is behind
+ * by less than num_cpus * sync_threshold; with a flusher running, counts
+ * don't sit in the CPU counters for much longer than its interval either.
+ */
+uint64_t approx_counter_get_fast(struct approx_counter *counter);
+
+/**
+ * Starts a thread that syncs every CPU counter into the global counter every
+ * interval_us microseconds, until the counter is destroyed.
+ */
+void approx_counter_start_flusher(struct approx_counter *counter, uint64_t interval_us);
+
 void approx_counter_destroy(struct approx_counter *counter);
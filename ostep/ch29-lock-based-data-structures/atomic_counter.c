@@ -1,30 +1,29 @@
 #include "atomic_counter.h"
 
-#include "mutex_utils.h"
+#include "lock.h"
 
-#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 struct atomic_counter {
 	uint64_t count;
-	pthread_mutex_t mutex;
+	struct lock lock;
 };
 
-struct atomic_counter *atomic_counter_create()
+struct atomic_counter *atomic_counter_create(enum lock_kind lock_kind)
 {
 	struct atomic_counter *counter = malloc(sizeof(*counter));
 	counter->count = 0;
-	pthread_mutex_init_or_fail(&counter->mutex);
+	lock_init(&counter->lock, lock_kind);
 	return counter;
 }
 
 void atomic_counter_increment(struct atomic_counter *counter)
 {
-	pthread_mutex_lock_or_fail(&counter->mutex);
+	lock_acquire(&counter->lock);
 	counter->count += 1;
-	pthread_mutex_unlock_or_fail(&counter->mutex);
+	lock_release(&counter->lock);
 }
 
 uint64_t atomic_counter_get(struct atomic_counter *counter)
@@ -34,6 +33,6 @@ uint64_t atomic_counter_get(struct atomic_counter *counter)
 
 void atomic_counter_destroy(struct atomic_counter *counter)
 {
-	pthread_mutex_destroy(&counter->mutex);
+	lock_destroy(&counter->lock);
 	free(counter);
 }
@@ -1,13 +1,16 @@
 #pragma once
 
+#include "lock.h"
+
 #include <stdint.h>
 
 /**
- * A atomic_counter is a counter that is threadsafe thanks to mutexes.
+ * A atomic_counter is a counter that is threadsafe thanks to a lock of the given
+ * kind.
  */
 struct atomic_counter;
 
-struct atomic_counter *atomic_counter_create();
+struct atomic_counter *atomic_counter_create(enum lock_kind lock_kind);
 void atomic_counter_increment(struct atomic_counter *counter);
 uint64_t atomic_counter_get(struct atomic_counter *counter);
 void atomic_counter_destroy(struct atomic_counter *counter);
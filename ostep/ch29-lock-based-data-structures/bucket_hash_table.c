@@ -0,0 +1,67 @@
+#include "bucket_hash_table.h"
+
+#include "hash.h"
+#include "locked_list.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct bucket_hash_table {
+	uint64_t num_buckets;
+	struct locked_list **buckets;
+};
+
+struct bucket_hash_table *bucket_hash_table_create(uint64_t num_buckets)
+{
+	struct bucket_hash_table *table = malloc(sizeof(*table));
+	struct locked_list **buckets = malloc(sizeof(*buckets) * num_buckets);
+	if (table == NULL || buckets == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	table->num_buckets = num_buckets;
+	table->buckets = buckets;
+	for (uint64_t i = 0; i < num_buckets; i++)
+		table->buckets[i] = locked_list_create();
+
+	return table;
+}
+
+static struct locked_list *bucket(struct bucket_hash_table *table, uint64_t key)
+{
+	return table->buckets[hash_key(key) % table->num_buckets];
+}
+
+bool bucket_hash_table_insert(struct bucket_hash_table *table, uint64_t key)
+{
+	return locked_list_insert(bucket(table, key), key);
+}
+
+bool bucket_hash_table_lookup(struct bucket_hash_table *table, uint64_t key)
+{
+	return locked_list_lookup(bucket(table, key), key);
+}
+
+bool bucket_hash_table_remove(struct bucket_hash_table *table, uint64_t key)
+{
+	return locked_list_remove(bucket(table, key), key);
+}
+
+uint64_t bucket_hash_table_size(struct bucket_hash_table *table)
+{
+	uint64_t size = 0;
+	for (uint64_t i = 0; i < table->num_buckets; i++)
+		size += locked_list_size(table->buckets[i]);
+	return size;
+}
+
+void bucket_hash_table_destroy(struct bucket_hash_table *table)
+{
+	for (uint64_t i = 0; i < table->num_buckets; i++)
+		locked_list_destroy(table->buckets[i]);
+	free(table->buckets);
+	free(table);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A bucket_hash_table is OSTEP's concurrent hash table: a fixed number of
+ * buckets, each a locked_list with its own mutex, so operations on different
+ * buckets never contend.
+ */
+struct bucket_hash_table;
+
+struct bucket_hash_table *bucket_hash_table_create(uint64_t num_buckets);
+
+/**
+ * Adds key, returning false if it was already there.
+ */
+bool bucket_hash_table_insert(struct bucket_hash_table *table, uint64_t key);
+
+bool bucket_hash_table_lookup(struct bucket_hash_table *table, uint64_t key);
+
+/**
+ * Removes key, returning false if it wasn't there.
+ */
+bool bucket_hash_table_remove(struct bucket_hash_table *table, uint64_t key);
+
+/**
+ * Counts the keys. Only exact if nothing is changing the table.
+ */
+uint64_t bucket_hash_table_size(struct bucket_hash_table *table);
+
+void bucket_hash_table_destroy(struct bucket_hash_table *table);
@@ -0,0 +1,13 @@
+#pragma once
+
+/**
+ * Size of a cache line on the x86-64 and ARM cores these run on.
+ */
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Alignment for per-CPU state that other CPUs shouldn't touch. Two lines,
+ * because Intel's spatial prefetcher pulls in pairs of lines, so neighbors
+ * on adjacent lines still interfere.
+ */
+#define SHARD_ALIGNMENT (2 * CACHE_LINE_SIZE)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Mixes key so that every bit of it affects every bit of the hash (the
+ * splitmix64 finalizer). It's a bijection, so distinct keys never collide
+ * before being reduced to a bucket.
+ */
+static inline uint64_t hash_key(uint64_t key)
+{
+	key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+	key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+	return key ^ (key >> 31);
+}
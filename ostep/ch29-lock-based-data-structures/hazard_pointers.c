@@ -0,0 +1,159 @@
+#include "hazard_pointers.h"
+
+#include "cache_line.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct hazard_pointers_thread {
+	// Read by every thread scanning, so kept off other threads' lines
+	_Alignas(SHARD_ALIGNMENT) _Atomic(void *) slots[HAZARD_POINTERS_PER_THREAD];
+
+	// Only touched by the owning thread
+	void **retired;
+	size_t num_retired;
+};
+
+struct hazard_pointers {
+	int num_threads;
+	struct hazard_pointers_thread *threads;
+	void (*free_node)(void *node);
+
+	// Scan once a thread has retired this many nodes. Being a multiple of
+	// the number of slots means each scan frees a good share of them.
+	size_t scan_threshold;
+	// Scratch space for the published pointers during a scan, per thread
+	void **scan_buffers;
+	// Backing for every thread's retired list
+	void **retired;
+};
+
+static void *malloc_or_fail(size_t size)
+{
+	void *ptr = malloc(size);
+	if (ptr == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+struct hazard_pointers *hazard_pointers_create(int num_threads, void (*free_node)(void *node))
+{
+	size_t scan_threshold = 2 * (size_t) num_threads * HAZARD_POINTERS_PER_THREAD;
+	size_t num_slots = (size_t) num_threads * HAZARD_POINTERS_PER_THREAD;
+
+	// Allocate everything before filling anything in, with every thread's
+	// retired list in one block
+	struct hazard_pointers *hp = malloc_or_fail(sizeof(*hp));
+	struct hazard_pointers_thread *threads = aligned_alloc(SHARD_ALIGNMENT, sizeof(*threads) * num_threads);
+	if (threads == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	void **scan_buffers = malloc_or_fail(sizeof(*scan_buffers) * num_slots * num_threads);
+	void **retired = malloc_or_fail(sizeof(*retired) * scan_threshold * num_threads);
+
+	hp->num_threads = num_threads;
+	hp->free_node = free_node;
+	hp->scan_threshold = scan_threshold;
+	hp->threads = threads;
+	hp->scan_buffers = scan_buffers;
+	hp->retired = retired;
+
+	for (int i = 0; i < num_threads; i++) {
+		struct hazard_pointers_thread *thread = &threads[i];
+		for (int slot = 0; slot < HAZARD_POINTERS_PER_THREAD; slot++)
+			atomic_init(&thread->slots[slot], NULL);
+		thread->num_retired = 0;
+		thread->retired = &retired[i * scan_threshold];
+	}
+
+	return hp;
+}
+
+void *hazard_pointers_protect(struct hazard_pointers *hp, int thread_id, int slot, _Atomic(void *) *src,
+			      uintptr_t mask)
+{
+	_Atomic(void *) *published = &hp->threads[thread_id].slots[slot];
+	void *ptr = atomic_load(src);
+	for (;;) {
+		// Both sequentially consistent, so a scan that starts after the
+		// node is unlinked is sure to see it published
+		atomic_store(published, (void *) ((uintptr_t) ptr & ~mask));
+		void *again = atomic_load(src);
+		if (again == ptr)
+			return ptr;
+		ptr = again;
+	}
+}
+
+void hazard_pointers_set(struct hazard_pointers *hp, int thread_id, int slot, void *ptr)
+{
+	atomic_store(&hp->threads[thread_id].slots[slot], ptr);
+}
+
+void hazard_pointers_clear(struct hazard_pointers *hp, int thread_id)
+{
+	for (int slot = 0; slot < HAZARD_POINTERS_PER_THREAD; slot++)
+		atomic_store_explicit(&hp->threads[thread_id].slots[slot], NULL, memory_order_release);
+}
+
+static int compare_pointers(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t) * (void *const *) a, y = (uintptr_t) * (void *const *) b;
+	return (x > y) - (x < y);
+}
+
+/*
+ * Frees whichever of the thread's retired nodes no thread has published,
+ * keeping the rest for next time.
+ */
+static void scan(struct hazard_pointers *hp, int thread_id)
+{
+	size_t num_slots = (size_t) hp->num_threads * HAZARD_POINTERS_PER_THREAD;
+	void **published = &hp->scan_buffers[thread_id * num_slots];
+	size_t num_published = 0;
+	for (int i = 0; i < hp->num_threads; i++) {
+		for (int slot = 0; slot < HAZARD_POINTERS_PER_THREAD; slot++) {
+			void *ptr = atomic_load(&hp->threads[i].slots[slot]);
+			if (ptr != NULL)
+				published[num_published++] = ptr;
+		}
+	}
+	qsort(published, num_published, sizeof(*published), compare_pointers);
+
+	struct hazard_pointers_thread *thread = &hp->threads[thread_id];
+	size_t kept = 0;
+	for (size_t i = 0; i < thread->num_retired; i++) {
+		void *node = thread->retired[i];
+		if (bsearch(&node, published, num_published, sizeof(*published), compare_pointers))
+			thread->retired[kept++] = node;
+		else
+			hp->free_node(node);
+	}
+	thread->num_retired = kept;
+}
+
+void hazard_pointers_retire(struct hazard_pointers *hp, int thread_id, void *node)
+{
+	struct hazard_pointers_thread *thread = &hp->threads[thread_id];
+	thread->retired[thread->num_retired++] = node;
+	// At most num_slots nodes can be kept, so there's always room
+	if (thread->num_retired == hp->scan_threshold)
+		scan(hp, thread_id);
+}
+
+void hazard_pointers_destroy(struct hazard_pointers *hp)
+{
+	for (int i = 0; i < hp->num_threads; i++) {
+		for (size_t j = 0; j < hp->threads[i].num_retired; j++)
+			hp->free_node(hp->threads[i].retired[j]);
+	}
+	free(hp->retired);
+	free(hp->scan_buffers);
+	free(hp->threads);
+	free(hp);
+}
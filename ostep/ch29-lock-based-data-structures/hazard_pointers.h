@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * The most pointers one thread can protect at once.
+ */
+#define HAZARD_POINTERS_PER_THREAD 3
+
+/**
+ * Hazard pointers let lock-free structures free nodes that other threads may
+ * still be reading (Michael, "Hazard Pointers: Safe Memory Reclamation for
+ * Lock-Free Objects"). Before dereferencing a shared node, a thread publishes
+ * it in one of its slots; removed nodes are retired rather than freed, and
+ * only freed once no slot holds them.
+ *
+ * Each thread passes its own thread_id, from 0 up to num_threads.
+ */
+struct hazard_pointers;
+
+/**
+ * free_node is called on each retired node once it's safe to free.
+ */
+struct hazard_pointers *hazard_pointers_create(int num_threads, void (*free_node)(void *node));
+
+/**
+ * Reads the pointer in src and protects it in the given slot, retrying until
+ * src still holds it after it was published, so it can't have been retired
+ * in between. `mask` is cleared from the pointer before it's published, for
+ * structures that keep flags in the low bits; the pointer is returned as
+ * read, flags and all.
+ */
+void *hazard_pointers_protect(struct hazard_pointers *hp, int thread_id, int slot, _Atomic(void *) *src,
+			      uintptr_t mask);
+
+/**
+ * Publishes ptr in the given slot. Only safe if ptr is known to be reachable
+ * still, e.g. it's already protected in another slot.
+ */
+void hazard_pointers_set(struct hazard_pointers *hp, int thread_id, int slot, void *ptr);
+
+/**
+ * Clears all of the thread's slots.
+ */
+void hazard_pointers_clear(struct hazard_pointers *hp, int thread_id);
+
+/**
+ * Hands over a node that's no longer reachable from the structure, to be
+ * freed once no thread has it protected.
+ */
+void hazard_pointers_retire(struct hazard_pointers *hp, int thread_id, void *node);
+
+/**
+ * Frees every retired node. No thread may be using the structure.
+ */
+void hazard_pointers_destroy(struct hazard_pointers *hp);
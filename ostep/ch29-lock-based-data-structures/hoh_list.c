@@ -0,0 +1,131 @@
+#include "hoh_list.h"
+
+#include "mutex_utils.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct hoh_list_node {
+	pthread_mutex_t mutex;
+	uint64_t key;
+	struct hoh_list_node *next;
+};
+
+struct hoh_list {
+	// A sentinel whose lock guards the first link, so inserting or removing
+	// at the front works like anywhere else
+	struct hoh_list_node head;
+};
+
+static struct hoh_list_node *node_create(uint64_t key)
+{
+	struct hoh_list_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init_or_fail(&node->mutex);
+	node->key = key;
+	node->next = NULL;
+	return node;
+}
+
+static void node_destroy(struct hoh_list_node *node)
+{
+	pthread_mutex_destroy(&node->mutex);
+	free(node);
+}
+
+struct hoh_list *hoh_list_create()
+{
+	struct hoh_list *list = malloc(sizeof(*list));
+	if (list == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	pthread_mutex_init_or_fail(&list->head.mutex);
+	list->head.next = NULL;
+	return list;
+}
+
+/*
+ * Walks the list hand over hand to the last node with a key less than `key`,
+ * and returns it locked. Its next node, if any, is where `key` is or would
+ * go.
+ */
+static struct hoh_list_node *find_prev(struct hoh_list *list, uint64_t key)
+{
+	struct hoh_list_node *prev = &list->head;
+	pthread_mutex_lock_or_fail(&prev->mutex);
+	for (;;) {
+		struct hoh_list_node *node = prev->next;
+		if (node == NULL || node->key >= key)
+			return prev;
+		pthread_mutex_lock_or_fail(&node->mutex);
+		pthread_mutex_unlock_or_fail(&prev->mutex);
+		prev = node;
+	}
+}
+
+bool hoh_list_insert(struct hoh_list *list, uint64_t key)
+{
+	struct hoh_list_node *prev = find_prev(list, key);
+	bool inserted = prev->next == NULL || prev->next->key != key;
+	if (inserted) {
+		struct hoh_list_node *node = node_create(key);
+		node->next = prev->next;
+		prev->next = node;
+	}
+	pthread_mutex_unlock_or_fail(&prev->mutex);
+	return inserted;
+}
+
+bool hoh_list_lookup(struct hoh_list *list, uint64_t key)
+{
+	struct hoh_list_node *prev = find_prev(list, key);
+	bool found = prev->next != NULL && prev->next->key == key;
+	pthread_mutex_unlock_or_fail(&prev->mutex);
+	return found;
+}
+
+bool hoh_list_remove(struct hoh_list *list, uint64_t key)
+{
+	struct hoh_list_node *prev = find_prev(list, key);
+	struct hoh_list_node *node = prev->next;
+	if (node == NULL || node->key != key) {
+		pthread_mutex_unlock_or_fail(&prev->mutex);
+		return false;
+	}
+
+	// Anyone else on their way to the node is waiting on prev's lock, and
+	// will find it gone. Wait out anyone already holding it.
+	pthread_mutex_lock_or_fail(&node->mutex);
+	prev->next = node->next;
+	pthread_mutex_unlock_or_fail(&node->mutex);
+	pthread_mutex_unlock_or_fail(&prev->mutex);
+	node_destroy(node);
+	return true;
+}
+
+uint64_t hoh_list_size(struct hoh_list *list)
+{
+	uint64_t size = 0;
+	for (struct hoh_list_node *node = list->head.next; node != NULL; node = node->next)
+		size++;
+	return size;
+}
+
+void hoh_list_destroy(struct hoh_list *list)
+{
+	struct hoh_list_node *node = list->head.next;
+	while (node != NULL) {
+		struct hoh_list_node *next = node->next;
+		node_destroy(node);
+		node = next;
+	}
+	pthread_mutex_destroy(&list->head.mutex);
+	free(list);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A hoh_list is a set of keys in a sorted linked list with a mutex per node,
+ * traversed with hand-over-hand locking: take the next node's lock before
+ * letting go of the current one. Threads can work on different parts of the
+ * list at once, at the price of a lock and unlock per node passed.
+ */
+struct hoh_list;
+
+struct hoh_list *hoh_list_create();
+
+/**
+ * Adds key, returning false if it was already there.
+ */
+bool hoh_list_insert(struct hoh_list *list, uint64_t key);
+
+bool hoh_list_lookup(struct hoh_list *list, uint64_t key);
+
+/**
+ * Removes key, returning false if it wasn't there.
+ */
+bool hoh_list_remove(struct hoh_list *list, uint64_t key);
+
+/**
+ * Counts the keys. Only exact if nothing is changing the list.
+ */
+uint64_t hoh_list_size(struct hoh_list *list);
+
+void hoh_list_destroy(struct hoh_list *list);
@@ -0,0 +1,255 @@
+#include "lock.h"
+
+#include "mutex_utils.h"
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Spins before a spinning waiter yields its core. The spinlocks are meant to
+// spin, but with more threads than cores the holder may need our core to
+// finish, and pure spinning would burn whole timeslices.
+#define SPINS_BEFORE_YIELD 1024
+
+// Spins before the futex lock goes to sleep
+#define FUTEX_SPINS 100
+
+// Most MCS locks one thread can hold at once
+#define MCS_MAX_HELD 8
+
+const char *const LOCK_KIND_NAMES[NUM_LOCK_KINDS] = {
+	[LOCK_PTHREAD] = "pthread",
+	[LOCK_TTAS] = "ttas",
+	[LOCK_TICKET] = "ticket",
+	[LOCK_MCS] = "mcs",
+	[LOCK_FUTEX] = "futex",
+};
+
+struct lock_mcs_node {
+	_Atomic(struct lock_mcs_node *) next;
+	atomic_bool locked;
+	bool in_use;
+};
+
+// Each thread queues on MCS locks with its own nodes
+static _Thread_local struct lock_mcs_node mcs_nodes[MCS_MAX_HELD];
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Called on each turn around a spin loop.
+ */
+static inline void spin_wait(unsigned *spins)
+{
+	if (++*spins % SPINS_BEFORE_YIELD == 0)
+		sched_yield();
+	else
+		cpu_relax();
+}
+
+void lock_init(struct lock *lock, enum lock_kind kind)
+{
+	lock->kind = kind;
+	switch (kind) {
+	case LOCK_PTHREAD:
+		pthread_mutex_init_or_fail(&lock->mutex);
+		break;
+	case LOCK_TTAS:
+		atomic_init(&lock->ttas, false);
+		break;
+	case LOCK_TICKET:
+		atomic_init(&lock->ticket.next_ticket, 0);
+		atomic_init(&lock->ticket.now_serving, 0);
+		break;
+	case LOCK_MCS:
+		atomic_init(&lock->mcs.tail, NULL);
+		lock->mcs.holder = NULL;
+		break;
+	case LOCK_FUTEX:
+		atomic_init(&lock->futex, 0);
+		break;
+	}
+}
+
+static void ttas_acquire(struct lock *lock)
+{
+	unsigned spins = 0;
+	for (;;) {
+		while (atomic_load_explicit(&lock->ttas, memory_order_relaxed))
+			spin_wait(&spins);
+		if (!atomic_exchange_explicit(&lock->ttas, true, memory_order_acquire))
+			return;
+	}
+}
+
+static void ticket_acquire(struct lock *lock)
+{
+	uint32_t ticket = atomic_fetch_add_explicit(&lock->ticket.next_ticket, 1, memory_order_relaxed);
+	unsigned spins = 0;
+	while (atomic_load_explicit(&lock->ticket.now_serving, memory_order_acquire) != ticket)
+		spin_wait(&spins);
+}
+
+static void ticket_release(struct lock *lock)
+{
+	// Only the holder changes now_serving, so no need for an atomic add
+	uint32_t serving = atomic_load_explicit(&lock->ticket.now_serving, memory_order_relaxed);
+	atomic_store_explicit(&lock->ticket.now_serving, serving + 1, memory_order_release);
+}
+
+static void mcs_acquire(struct lock *lock)
+{
+	struct lock_mcs_node *node = NULL;
+	for (int i = 0; i < MCS_MAX_HELD && node == NULL; i++) {
+		if (!mcs_nodes[i].in_use)
+			node = &mcs_nodes[i];
+	}
+	if (node == NULL) {
+		fprintf(stderr, "more than %d MCS locks held in %s at %s:%d\n", MCS_MAX_HELD, __func__, __FILE__,
+			__LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->in_use = true;
+	atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+	atomic_store_explicit(&node->locked, true, memory_order_relaxed);
+
+	struct lock_mcs_node *prev = atomic_exchange_explicit(&lock->mcs.tail, node, memory_order_acq_rel);
+	if (prev != NULL) {
+		atomic_store_explicit(&prev->next, node, memory_order_release);
+		unsigned spins = 0;
+		while (atomic_load_explicit(&node->locked, memory_order_acquire))
+			spin_wait(&spins);
+	}
+	lock->mcs.holder = node;
+}
+
+static void mcs_release(struct lock *lock)
+{
+	struct lock_mcs_node *node = lock->mcs.holder;
+	struct lock_mcs_node *next = atomic_load_explicit(&node->next, memory_order_acquire);
+	if (next == NULL) {
+		// No one queued behind us, unless they've swapped themselves in as
+		// the tail but not linked on to us yet
+		struct lock_mcs_node *expected = node;
+		if (atomic_compare_exchange_strong_explicit(&lock->mcs.tail, &expected, NULL, memory_order_acq_rel,
+							    memory_order_relaxed)) {
+			node->in_use = false;
+			return;
+		}
+		unsigned spins = 0;
+		while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+			spin_wait(&spins);
+	}
+	atomic_store_explicit(&next->locked, false, memory_order_release);
+	node->in_use = false;
+}
+
+static long futex(_Atomic uint32_t *addr, int op, uint32_t val)
+{
+	return syscall(SYS_futex, (uint32_t *) addr, op, val, NULL, NULL, 0);
+}
+
+/*
+ * Drepper's mutex from "Futexes Are Tricky", with a spinning first phase.
+ */
+static void futex_acquire(struct lock *lock)
+{
+	// Phase one: spin, in case the holder is about to let go
+	for (int i = 0; i < FUTEX_SPINS; i++) {
+		uint32_t expected = 0;
+		if (atomic_compare_exchange_weak_explicit(&lock->futex, &expected, 1, memory_order_acquire,
+							  memory_order_relaxed))
+			return;
+		cpu_relax();
+	}
+
+	// Phase two: mark the lock as having sleepers and sleep until it's free.
+	// Taking it as 2 is pessimistic, since others may have left, but only
+	// costs a spare wake.
+	uint32_t state = atomic_exchange_explicit(&lock->futex, 2, memory_order_acquire);
+	while (state != 0) {
+		futex(&lock->futex, FUTEX_WAIT_PRIVATE, 2);
+		state = atomic_exchange_explicit(&lock->futex, 2, memory_order_acquire);
+	}
+}
+
+static void futex_release(struct lock *lock)
+{
+	// Only make the system call if someone may be asleep
+	if (atomic_exchange_explicit(&lock->futex, 0, memory_order_release) == 2)
+		futex(&lock->futex, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void lock_acquire(struct lock *lock)
+{
+	switch (lock->kind) {
+	case LOCK_PTHREAD:
+		pthread_mutex_lock_or_fail(&lock->mutex);
+		break;
+	case LOCK_TTAS:
+		ttas_acquire(lock);
+		break;
+	case LOCK_TICKET:
+		ticket_acquire(lock);
+		break;
+	case LOCK_MCS:
+		mcs_acquire(lock);
+		break;
+	case LOCK_FUTEX:
+		futex_acquire(lock);
+		break;
+	}
+}
+
+void lock_release(struct lock *lock)
+{
+	switch (lock->kind) {
+	case LOCK_PTHREAD:
+		pthread_mutex_unlock_or_fail(&lock->mutex);
+		break;
+	case LOCK_TTAS:
+		atomic_store_explicit(&lock->ttas, false, memory_order_release);
+		break;
+	case LOCK_TICKET:
+		ticket_release(lock);
+		break;
+	case LOCK_MCS:
+		mcs_release(lock);
+		break;
+	case LOCK_FUTEX:
+		futex_release(lock);
+		break;
+	}
+}
+
+void lock_destroy(struct lock *lock)
+{
+	if (lock->kind == LOCK_PTHREAD)
+		pthread_mutex_destroy(&lock->mutex);
+}
+
+bool lock_kind_from_name(const char *name, enum lock_kind *kind)
+{
+	for (int i = 0; i < NUM_LOCK_KINDS; i++) {
+		if (strcmp(name, LOCK_KIND_NAMES[i]) == 0) {
+			*kind = i;
+			return true;
+		}
+	}
+	return false;
+}
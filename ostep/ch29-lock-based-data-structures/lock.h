@@ -0,0 +1,66 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The kinds of lock a struct lock can be, picked when it's initialized.
+ */
+enum lock_kind {
+	// pthread_mutex_t, through mutex_utils
+	LOCK_PTHREAD,
+	// Test-and-test-and-set spinlock: spin reading the lock, which stays in
+	// cache, and only try the atomic exchange once it looks free
+	LOCK_TTAS,
+	// Ticket lock: take a number with fetch-and-add and wait until it's
+	// served, so waiters get the lock in the order they arrived
+	LOCK_TICKET,
+	// MCS queue lock: waiters queue up in a linked list and each spins on
+	// its own node, so a release only touches the next waiter's cache line
+	LOCK_MCS,
+	// Two-phase futex lock: spin briefly, then sleep in the kernel
+	LOCK_FUTEX,
+};
+
+#define NUM_LOCK_KINDS (LOCK_FUTEX + 1)
+
+/**
+ * Names of the lock kinds, as given on the command line.
+ */
+extern const char *const LOCK_KIND_NAMES[NUM_LOCK_KINDS];
+
+struct lock_mcs_node;
+
+/**
+ * A lock of any of the kinds. Embed it like a pthread_mutex_t.
+ */
+struct lock {
+	enum lock_kind kind;
+	union {
+		pthread_mutex_t mutex;
+		atomic_bool ttas;
+		struct {
+			_Atomic uint32_t next_ticket;
+			_Atomic uint32_t now_serving;
+		} ticket;
+		struct {
+			_Atomic(struct lock_mcs_node *) tail;
+			// The holder's queue node, which only the holder touches
+			struct lock_mcs_node *holder;
+		} mcs;
+		// 0 unlocked, 1 locked, 2 locked with sleepers to wake
+		_Atomic uint32_t futex;
+	};
+};
+
+void lock_init(struct lock *lock, enum lock_kind kind);
+void lock_acquire(struct lock *lock);
+void lock_release(struct lock *lock);
+void lock_destroy(struct lock *lock);
+
+/**
+ * Looks up a lock kind by name, returning false if there's no such kind.
+ */
+bool lock_kind_from_name(const char *name, enum lock_kind *kind);
@@ -0,0 +1,114 @@
+#include "locked_list.h"
+
+#include "mutex_utils.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct locked_list_node {
+	uint64_t key;
+	struct locked_list_node *next;
+};
+
+struct locked_list {
+	pthread_mutex_t mutex;
+	struct locked_list_node *head;
+	uint64_t size;
+};
+
+struct locked_list *locked_list_create()
+{
+	struct locked_list *list = malloc(sizeof(*list));
+	if (list == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	pthread_mutex_init_or_fail(&list->mutex);
+	list->head = NULL;
+	list->size = 0;
+
+	return list;
+}
+
+/*
+ * Finds the link pointing at key's node, or the NULL at the end of the list.
+ * Must hold the mutex.
+ */
+static struct locked_list_node **find(struct locked_list *list, uint64_t key)
+{
+	struct locked_list_node **link = &list->head;
+	while (*link != NULL && (*link)->key != key)
+		link = &(*link)->next;
+	return link;
+}
+
+bool locked_list_insert(struct locked_list *list, uint64_t key)
+{
+	// Allocate outside the critical section, as OSTEP suggests, and throw it
+	// away if the key turns out to be there already
+	struct locked_list_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->key = key;
+
+	pthread_mutex_lock_or_fail(&list->mutex);
+	if (*find(list, key) != NULL) {
+		pthread_mutex_unlock_or_fail(&list->mutex);
+		free(node);
+		return false;
+	}
+	node->next = list->head;
+	list->head = node;
+	list->size++;
+	pthread_mutex_unlock_or_fail(&list->mutex);
+	return true;
+}
+
+bool locked_list_lookup(struct locked_list *list, uint64_t key)
+{
+	pthread_mutex_lock_or_fail(&list->mutex);
+	bool found = *find(list, key) != NULL;
+	pthread_mutex_unlock_or_fail(&list->mutex);
+	return found;
+}
+
+bool locked_list_remove(struct locked_list *list, uint64_t key)
+{
+	pthread_mutex_lock_or_fail(&list->mutex);
+	struct locked_list_node **link = find(list, key);
+	struct locked_list_node *node = *link;
+	if (node != NULL) {
+		*link = node->next;
+		list->size--;
+	}
+	pthread_mutex_unlock_or_fail(&list->mutex);
+
+	free(node);
+	return node != NULL;
+}
+
+uint64_t locked_list_size(struct locked_list *list)
+{
+	pthread_mutex_lock_or_fail(&list->mutex);
+	uint64_t size = list->size;
+	pthread_mutex_unlock_or_fail(&list->mutex);
+	return size;
+}
+
+void locked_list_destroy(struct locked_list *list)
+{
+	struct locked_list_node *node = list->head;
+	while (node != NULL) {
+		struct locked_list_node *next = node->next;
+		free(node);
+		node = next;
+	}
+	pthread_mutex_destroy(&list->mutex);
+	free(list);
+}
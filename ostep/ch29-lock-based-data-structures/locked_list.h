@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A locked_list is a set of keys in a linked list, made threadsafe by a
+ * single mutex around every operation, like OSTEP's concurrent linked list.
+ */
+struct locked_list;
+
+struct locked_list *locked_list_create();
+
+/**
+ * Adds key, returning false if it was already there.
+ */
+bool locked_list_insert(struct locked_list *list, uint64_t key);
+
+bool locked_list_lookup(struct locked_list *list, uint64_t key);
+
+/**
+ * Removes key, returning false if it wasn't there.
+ */
+bool locked_list_remove(struct locked_list *list, uint64_t key);
+
+uint64_t locked_list_size(struct locked_list *list);
+void locked_list_destroy(struct locked_list *list);
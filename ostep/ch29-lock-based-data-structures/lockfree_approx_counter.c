@@ -0,0 +1,73 @@
+#include "lockfree_approx_counter.h"
+
+#include "cache_line.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct lockfree_approx_counter_shard {
+	_Alignas(SHARD_ALIGNMENT) _Atomic uint64_t count;
+};
+
+struct lockfree_approx_counter {
+	_Alignas(SHARD_ALIGNMENT) _Atomic uint64_t global_counter;
+
+	int num_cpus;
+	struct lockfree_approx_counter_shard *shards;
+
+	uint64_t sync_threshold;
+};
+
+struct lockfree_approx_counter *lockfree_approx_counter_create(int num_cpus, uint64_t sync_threshold)
+{
+	struct lockfree_approx_counter *counter = aligned_alloc(SHARD_ALIGNMENT, sizeof(*counter));
+	struct lockfree_approx_counter_shard *shards = aligned_alloc(SHARD_ALIGNMENT, sizeof(*shards) * num_cpus);
+	if (counter == NULL || shards == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	atomic_init(&counter->global_counter, 0);
+
+	counter->num_cpus = num_cpus;
+	counter->shards = shards;
+	for (int i = 0; i < counter->num_cpus; i++)
+		atomic_init(&counter->shards[i].count, 0);
+
+	counter->sync_threshold = sync_threshold;
+
+	return counter;
+}
+
+void lockfree_approx_counter_increment(struct lockfree_approx_counter *counter, int core_id)
+{
+	// Nothing else is published through the counts, so relaxed ordering is
+	// enough; the thread joins at the end give the final count.
+	_Atomic uint64_t *count = &counter->shards[core_id].count;
+	uint64_t local = atomic_fetch_add_explicit(count, 1, memory_order_relaxed) + 1;
+	if (local < counter->sync_threshold)
+		return;
+
+	// Sync to global counter. Only take what we saw, so that if another
+	// thread on the same shard got in first, whoever wins the exchange moves
+	// the count and the other leaves the shard alone. Anything added since
+	// stays for the next sync.
+	if (atomic_compare_exchange_strong_explicit(count, &local, 0, memory_order_relaxed, memory_order_relaxed))
+		atomic_fetch_add_explicit(&counter->global_counter, local, memory_order_relaxed);
+}
+
+uint64_t lockfree_approx_counter_get(struct lockfree_approx_counter *counter)
+{
+	uint64_t count = atomic_load_explicit(&counter->global_counter, memory_order_relaxed);
+	for (int i = 0; i < counter->num_cpus; i++)
+		count += atomic_load_explicit(&counter->shards[i].count, memory_order_relaxed);
+	return count;
+}
+
+void lockfree_approx_counter_destroy(struct lockfree_approx_counter *counter)
+{
+	free(counter->shards);
+	free(counter);
+}
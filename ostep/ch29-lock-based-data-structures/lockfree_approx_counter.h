@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * A lockfree_approx_counter is a padded_approx_counter without the mutexes.
+ * Each CPU bumps its own count with a relaxed atomic add, and moves it into
+ * the global count with atomic operations once it reaches the threshold.
+ * Increments are never lost, even if threads share a core_id.
+ */
+struct lockfree_approx_counter;
+
+struct lockfree_approx_counter *lockfree_approx_counter_create(int num_cpus, uint64_t sync_threshold);
+void lockfree_approx_counter_increment(struct lockfree_approx_counter *counter, int core_id);
+
+/**
+ * Gets value of global counter and all CPU counters. Counts that are being
+ * moved to the global counter at the time may be missed.
+ */
+uint64_t lockfree_approx_counter_get(struct lockfree_approx_counter *counter);
+
+void lockfree_approx_counter_destroy(struct lockfree_approx_counter *counter);
@@ -0,0 +1,143 @@
+#include "lockfree_queue.h"
+
+#include "cache_line.h"
+#include "hazard_pointers.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Hazard pointer slots
+#define HP_NODE 0
+#define HP_NEXT 1
+
+struct lockfree_queue_node {
+	uint64_t value;
+	_Atomic(void *) next;
+};
+
+struct lockfree_queue {
+	_Alignas(SHARD_ALIGNMENT) _Atomic(void *) head;
+	_Alignas(SHARD_ALIGNMENT) _Atomic(void *) tail;
+
+	struct hazard_pointers *hp;
+};
+
+static struct lockfree_queue_node *node_create(uint64_t value)
+{
+	struct lockfree_queue_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->value = value;
+	atomic_init(&node->next, NULL);
+	return node;
+}
+
+struct lockfree_queue *lockfree_queue_create(int num_threads)
+{
+	struct lockfree_queue *queue = aligned_alloc(SHARD_ALIGNMENT, sizeof(*queue));
+	if (queue == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	// Like the two-lock queue, head always points at a dummy node
+	struct lockfree_queue_node *dummy = node_create(0);
+	atomic_init(&queue->head, dummy);
+	atomic_init(&queue->tail, dummy);
+	queue->hp = hazard_pointers_create(num_threads, free);
+
+	return queue;
+}
+
+void lockfree_queue_enqueue(struct lockfree_queue *queue, uint64_t value, int thread_id)
+{
+	struct lockfree_queue_node *node = node_create(value);
+
+	for (;;) {
+		struct lockfree_queue_node *tail = hazard_pointers_protect(queue->hp, thread_id, HP_NODE, &queue->tail, 0);
+		void *next = atomic_load(&tail->next);
+		if (next != NULL) {
+			// Someone linked a node on but hasn't moved the tail yet
+			void *expected_tail = tail;
+			atomic_compare_exchange_strong(&queue->tail, &expected_tail, next);
+			continue;
+		}
+
+		void *expected = NULL;
+		if (atomic_compare_exchange_strong(&tail->next, &expected, node)) {
+			// If this fails, someone else already helped
+			void *expected_tail = tail;
+			atomic_compare_exchange_strong(&queue->tail, &expected_tail, node);
+			break;
+		}
+	}
+
+	hazard_pointers_clear(queue->hp, thread_id);
+}
+
+bool lockfree_queue_dequeue(struct lockfree_queue *queue, uint64_t *value, int thread_id)
+{
+	// The old dummy, once we've swung head past it. Written as one loop
+	// with no continues, which keeps -fanalyzer under ASan from tripping
+	// over the atomics' temporaries.
+	struct lockfree_queue_node *old_head = NULL;
+	bool done = false;
+	while (!done) {
+		struct lockfree_queue_node *head = hazard_pointers_protect(queue->hp, thread_id, HP_NODE, &queue->head, 0);
+		void *tail = atomic_load(&queue->tail);
+		struct lockfree_queue_node *next = hazard_pointers_protect(queue->hp, thread_id, HP_NEXT, &head->next, 0);
+		void *current_head = atomic_load(&queue->head);
+
+		if (current_head != head) {
+			// head moved on while we protected next, so next may already
+			// be retired; go round again
+		} else if (next == NULL) {
+			done = true;
+		} else if (head == tail) {
+			// The tail is lagging behind a node that's been linked on
+			atomic_compare_exchange_strong(&queue->tail, &tail, next);
+		} else {
+			// Read before the swap, after which next is the dummy and
+			// another dequeuer could free it
+			uint64_t next_value = next->value;
+			void *expected_head = head;
+			if (atomic_compare_exchange_strong(&queue->head, &expected_head, next)) {
+				*value = next_value;
+				old_head = head;
+				done = true;
+			}
+		}
+	}
+
+	hazard_pointers_clear(queue->hp, thread_id);
+	if (old_head == NULL)
+		return false;
+	hazard_pointers_retire(queue->hp, thread_id, old_head);
+	return true;
+}
+
+uint64_t lockfree_queue_size(struct lockfree_queue *queue)
+{
+	uint64_t size = 0;
+	struct lockfree_queue_node *head = atomic_load(&queue->head);
+	for (struct lockfree_queue_node *node = atomic_load(&head->next); node != NULL; node = atomic_load(&node->next))
+		size++;
+	return size;
+}
+
+void lockfree_queue_destroy(struct lockfree_queue *queue)
+{
+	struct lockfree_queue_node *node = atomic_load(&queue->head);
+	while (node != NULL) {
+		struct lockfree_queue_node *next = atomic_load(&node->next);
+		free(node);
+		node = next;
+	}
+	hazard_pointers_destroy(queue->hp);
+	free(queue);
+}
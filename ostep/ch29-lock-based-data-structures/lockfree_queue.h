@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A lockfree_queue is Michael and Scott's lock-free FIFO queue: enqueuers
+ * link nodes on with a compare-and-swap of the last node's next pointer, and
+ * dequeuers swing the head along with another. A thread that finds the tail
+ * lagging behind helps move it along rather than waiting. Dequeued nodes are
+ * freed through hazard pointers.
+ *
+ * Each thread passes its own thread_id, from 0 up to num_threads.
+ */
+struct lockfree_queue;
+
+struct lockfree_queue *lockfree_queue_create(int num_threads);
+void lockfree_queue_enqueue(struct lockfree_queue *queue, uint64_t value, int thread_id);
+
+/**
+ * Takes the value at the front of the queue, returning false if it's empty.
+ */
+bool lockfree_queue_dequeue(struct lockfree_queue *queue, uint64_t *value, int thread_id);
+
+/**
+ * Counts the values. Only exact if nothing is changing the queue.
+ */
+uint64_t lockfree_queue_size(struct lockfree_queue *queue);
+
+void lockfree_queue_destroy(struct lockfree_queue *queue);
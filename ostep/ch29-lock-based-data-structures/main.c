@@ -2,26 +2,73 @@
 
 #include "approx_counter.h"
 #include "atomic_counter.h"
+#include "bucket_hash_table.h"
+#include "hoh_list.h"
+#include "lock.h"
+#include "locked_list.h"
+#include "lockfree_approx_counter.h"
+#include "lockfree_queue.h"
 #include "nonatomic_counter.h"
+#include "padded_approx_counter.h"
+#include "split_ordered_hash_table.h"
+#include "striped_hash_table.h"
+#include "two_lock_queue.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/sysinfo.h>
 #include <time.h>
+#include <unistd.h>
+
+// Every this many ops, one is timed on its own for the latency
+// percentiles. Timing all of them would mostly measure clock_gettime.
+#define LATENCY_SAMPLE_INTERVAL 256
+
+#define MAX_LIST_LEN 64
+
+// How often approx_flushed's flusher thread syncs the CPU counters
+#define FLUSH_INTERVAL_US 1000
+
+// Sizes of the hash tables with a fixed number of buckets
+#define HASH_TABLE_BUCKETS 1024
+#define HASH_TABLE_STRIPES 64
+
+/**
+ * How threads are placed on cores.
+ */
+enum pinning {
+	// Left to the scheduler
+	PINNING_NONE,
+	// Thread i on core i, wrapping around
+	PINNING_COMPACT,
+	// Threads spaced evenly across all the cores
+	PINNING_SPREAD,
+};
+
+static const char *const PINNING_NAMES[] = {
+	[PINNING_NONE] = "none",
+	[PINNING_COMPACT] = "compact",
+	[PINNING_SPREAD] = "spread",
+};
 
 void stick_this_thread_to_core(int core_id) {
-	int num_cores = get_nprocs();
-	if (core_id < 0 || core_id >= num_cores) {
-		fprintf(stderr, "core_id %d exceeds num_cores %d in %s at %s:%d\n", core_id, num_cores, __func__, __FILE__, __LINE__);
+	if (core_id < 0) {
+		fprintf(stderr, "negative core_id %d in %s at %s:%d\n", core_id, __func__, __FILE__, __LINE__);
 		exit(EXIT_FAILURE);
 	}
 
+	// With more threads than cores, they double up
+	int num_cores = get_nprocs();
 	cpu_set_t cpuset;
 	CPU_ZERO(&cpuset);
-	CPU_SET(core_id, &cpuset);
+	CPU_SET(core_id % num_cores, &cpuset);
 
 	pthread_t current_thread = pthread_self();
 	if (pthread_setaffinity_np(current_thread, sizeof(cpu_set_t), &cpuset)) {
@@ -30,151 +77,748 @@ void stick_this_thread_to_core(int core_id) {
 	}
 }
 
-struct nonatomic_thread_args {
-	int core_id;
-	struct nonatomic_counter *counter;
-	uint64_t count_max;
+/**
+ * What an operation does to a structure. Counters increment on either kind of
+ * write, and get on reads; sets insert or remove the key, and look it up on
+ * reads; queues enqueue the key on writes, and dequeue on reads.
+ */
+enum op {
+	OP_READ,
+	OP_INSERT,
+	OP_REMOVE,
+};
+
+enum structure_kind {
+	KIND_COUNTER,
+	KIND_SET,
+	KIND_QUEUE,
 };
 
-static void *nonatomic_thread_handler(void *arg)
+struct structure_params {
+	int num_threads;
+	// For the sharded counters
+	uint64_t sync_threshold;
+	// For the structures built on struct lock
+	enum lock_kind lock_kind;
+};
+
+struct workload {
+	// How many in every 100 ops are reads
+	unsigned read_pct;
+	// Keys are drawn uniformly from 0 up to this
+	uint64_t key_range;
+};
+
+/*
+ * Each structure behind the same interface: create, an op returning how much
+ * it changed the structure's value (its count, or how many keys or values it
+ * holds), get for that value, and destroy. Structures ignore whichever of
+ * the params, thread_id and key they've no use for.
+ */
+
+// Counters
+
+static void *bench_nonatomic_create(const struct structure_params *params)
 {
-	struct nonatomic_thread_args *thread_args = (struct nonatomic_thread_args *) arg;
-	stick_this_thread_to_core(thread_args->core_id);
-	for (uint64_t i = 0; i < thread_args->count_max; i++)
-		nonatomic_counter_increment(thread_args->counter);
-	return NULL;
+	(void) params;
+	return nonatomic_counter_create();
 }
 
-struct atomic_thread_args {
-	int core_id;
-	struct atomic_counter *counter;
-	uint64_t count_max;
-};
+static inline void bench_nonatomic_increment(void *counter, int thread_id)
+{
+	(void) thread_id;
+	nonatomic_counter_increment(counter);
+}
+
+static uint64_t bench_nonatomic_get(void *counter) { return nonatomic_counter_get(counter); }
+static void bench_nonatomic_destroy(void *counter) { nonatomic_counter_destroy(counter); }
 
-static void *atomic_thread_handler(void *arg)
+static void *bench_atomic_create(const struct structure_params *params)
 {
-	struct atomic_thread_args *thread_args = (struct atomic_thread_args *) arg;
-	stick_this_thread_to_core(thread_args->core_id);
-	for (uint64_t i = 0; i < thread_args->count_max; i++)
-		atomic_counter_increment(thread_args->counter);
-	return NULL;
+	return atomic_counter_create(params->lock_kind);
+}
+
+static inline void bench_atomic_increment(void *counter, int thread_id)
+{
+	(void) thread_id;
+	atomic_counter_increment(counter);
+}
+
+static uint64_t bench_atomic_get(void *counter) { return atomic_counter_get(counter); }
+static void bench_atomic_destroy(void *counter) { atomic_counter_destroy(counter); }
+
+static void *bench_approx_create(const struct structure_params *params)
+{
+	return approx_counter_create(params->num_threads, params->sync_threshold, params->lock_kind);
+}
+static inline void bench_approx_increment(void *counter, int thread_id) { approx_counter_increment(counter, thread_id); }
+static uint64_t bench_approx_get(void *counter) { return approx_counter_get(counter); }
+static void bench_approx_destroy(void *counter) { approx_counter_destroy(counter); }
+
+// An approx_counter with a flusher thread, read in O(1) from the global count
+static void *bench_approx_flushed_create(const struct structure_params *params)
+{
+	struct approx_counter *counter = approx_counter_create(params->num_threads, params->sync_threshold, params->lock_kind);
+	approx_counter_start_flusher(counter, FLUSH_INTERVAL_US);
+	return counter;
+}
+
+static inline void bench_approx_flushed_increment(void *counter, int thread_id) { approx_counter_increment(counter, thread_id); }
+static uint64_t bench_approx_flushed_get(void *counter) { return approx_counter_get_fast(counter); }
+static void bench_approx_flushed_destroy(void *counter) { approx_counter_destroy(counter); }
+
+static void *bench_padded_approx_create(const struct structure_params *params)
+{
+	return padded_approx_counter_create(params->num_threads, params->sync_threshold, params->lock_kind);
+}
+
+static inline void bench_padded_approx_increment(void *counter, int thread_id)
+{
+	padded_approx_counter_increment(counter, thread_id);
+}
+
+static uint64_t bench_padded_approx_get(void *counter) { return padded_approx_counter_get(counter); }
+static void bench_padded_approx_destroy(void *counter) { padded_approx_counter_destroy(counter); }
+
+static void *bench_lockfree_approx_create(const struct structure_params *params)
+{
+	return lockfree_approx_counter_create(params->num_threads, params->sync_threshold);
+}
+
+static inline void bench_lockfree_approx_increment(void *counter, int thread_id)
+{
+	lockfree_approx_counter_increment(counter, thread_id);
 }
 
-struct approx_thread_args {
-	int core_id;
-	struct approx_counter *counter;
+static uint64_t bench_lockfree_approx_get(void *counter) { return lockfree_approx_counter_get(counter); }
+static void bench_lockfree_approx_destroy(void *counter) { lockfree_approx_counter_destroy(counter); }
+
+
+#define DEFINE_COUNTER_OP(name)                                                                      \
+	static inline int bench_##name##_op(void *counter, int thread_id, enum op op, uint64_t key)  \
+	{                                                                                            \
+		(void) key;                                                                          \
+		if (op == OP_READ) {                                                                 \
+			bench_##name##_get(counter);                                                 \
+			return 0;                                                                    \
+		}                                                                                    \
+		bench_##name##_increment(counter, thread_id);                                        \
+		return 1;                                                                            \
+	}
+
+DEFINE_COUNTER_OP(nonatomic)
+DEFINE_COUNTER_OP(atomic)
+DEFINE_COUNTER_OP(approx)
+DEFINE_COUNTER_OP(approx_flushed)
+DEFINE_COUNTER_OP(padded_approx)
+DEFINE_COUNTER_OP(lockfree_approx)
+
+// Sets
+
+static void *bench_locked_list_create(const struct structure_params *params)
+{
+	(void) params;
+	return locked_list_create();
+}
+
+static inline bool bench_locked_list_insert(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return locked_list_insert(set, key);
+}
+
+static inline bool bench_locked_list_lookup(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return locked_list_lookup(set, key);
+}
+
+static inline bool bench_locked_list_remove(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return locked_list_remove(set, key);
+}
+
+static uint64_t bench_locked_list_get(void *set) { return locked_list_size(set); }
+static void bench_locked_list_destroy(void *set) { locked_list_destroy(set); }
+
+static void *bench_hoh_list_create(const struct structure_params *params)
+{
+	(void) params;
+	return hoh_list_create();
+}
+
+static inline bool bench_hoh_list_insert(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return hoh_list_insert(set, key);
+}
+
+static inline bool bench_hoh_list_lookup(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return hoh_list_lookup(set, key);
+}
+
+static inline bool bench_hoh_list_remove(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return hoh_list_remove(set, key);
+}
+
+static uint64_t bench_hoh_list_get(void *set) { return hoh_list_size(set); }
+static void bench_hoh_list_destroy(void *set) { hoh_list_destroy(set); }
+
+static void *bench_bucket_hash_create(const struct structure_params *params)
+{
+	(void) params;
+	return bucket_hash_table_create(HASH_TABLE_BUCKETS);
+}
+
+static inline bool bench_bucket_hash_insert(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return bucket_hash_table_insert(set, key);
+}
+
+static inline bool bench_bucket_hash_lookup(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return bucket_hash_table_lookup(set, key);
+}
+
+static inline bool bench_bucket_hash_remove(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return bucket_hash_table_remove(set, key);
+}
+
+static uint64_t bench_bucket_hash_get(void *set) { return bucket_hash_table_size(set); }
+static void bench_bucket_hash_destroy(void *set) { bucket_hash_table_destroy(set); }
+
+static void *bench_striped_hash_create(const struct structure_params *params)
+{
+	(void) params;
+	return striped_hash_table_create(HASH_TABLE_BUCKETS, HASH_TABLE_STRIPES);
+}
+
+static inline bool bench_striped_hash_insert(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return striped_hash_table_insert(set, key);
+}
+
+static inline bool bench_striped_hash_lookup(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return striped_hash_table_lookup(set, key);
+}
+
+static inline bool bench_striped_hash_remove(void *set, int thread_id, uint64_t key)
+{
+	(void) thread_id;
+	return striped_hash_table_remove(set, key);
+}
+
+static uint64_t bench_striped_hash_get(void *set) { return striped_hash_table_size(set); }
+static void bench_striped_hash_destroy(void *set) { striped_hash_table_destroy(set); }
+
+static void *bench_split_ordered_hash_create(const struct structure_params *params)
+{
+	return split_ordered_hash_table_create(params->num_threads);
+}
+
+static inline bool bench_split_ordered_hash_insert(void *set, int thread_id, uint64_t key)
+{
+	return split_ordered_hash_table_insert(set, key, thread_id);
+}
+
+static inline bool bench_split_ordered_hash_lookup(void *set, int thread_id, uint64_t key)
+{
+	return split_ordered_hash_table_lookup(set, key, thread_id);
+}
+
+static inline bool bench_split_ordered_hash_remove(void *set, int thread_id, uint64_t key)
+{
+	return split_ordered_hash_table_remove(set, key, thread_id);
+}
+
+static uint64_t bench_split_ordered_hash_get(void *set) { return split_ordered_hash_table_size(set); }
+static void bench_split_ordered_hash_destroy(void *set) { split_ordered_hash_table_destroy(set); }
+
+/*
+ * Sets start with every other key in the key range, so lookups hit about
+ * half the time and inserts and removes keep the size steady.
+ */
+#define DEFINE_SET_OP(name)                                                                          \
+	static inline int bench_##name##_op(void *set, int thread_id, enum op op, uint64_t key)      \
+	{                                                                                            \
+		switch (op) {                                                                        \
+		case OP_READ:                                                                        \
+			bench_##name##_lookup(set, thread_id, key);                                  \
+			return 0;                                                                    \
+		case OP_INSERT:                                                                      \
+			return bench_##name##_insert(set, thread_id, key);                           \
+		case OP_REMOVE:                                                                      \
+			return -bench_##name##_remove(set, thread_id, key);                          \
+		}                                                                                    \
+		return 0;                                                                            \
+	}                                                                                            \
+                                                                                                     \
+	static void bench_##name##_prefill(void *set, uint64_t key_range)                            \
+	{                                                                                            \
+		for (uint64_t key = 0; key < key_range; key += 2)                                    \
+			bench_##name##_insert(set, 0, key);                                          \
+	}
+
+DEFINE_SET_OP(locked_list)
+DEFINE_SET_OP(hoh_list)
+DEFINE_SET_OP(bucket_hash)
+DEFINE_SET_OP(striped_hash)
+DEFINE_SET_OP(split_ordered_hash)
+
+// Queues
+
+static void *bench_two_lock_queue_create(const struct structure_params *params)
+{
+	(void) params;
+	return two_lock_queue_create();
+}
+
+static inline void bench_two_lock_queue_enqueue(void *queue, int thread_id, uint64_t value)
+{
+	(void) thread_id;
+	two_lock_queue_enqueue(queue, value);
+}
+
+static inline bool bench_two_lock_queue_dequeue(void *queue, int thread_id)
+{
+	(void) thread_id;
+	uint64_t value;
+	return two_lock_queue_dequeue(queue, &value);
+}
+
+static uint64_t bench_two_lock_queue_get(void *queue) { return two_lock_queue_size(queue); }
+static void bench_two_lock_queue_destroy(void *queue) { two_lock_queue_destroy(queue); }
+
+static void *bench_lockfree_queue_create(const struct structure_params *params)
+{
+	return lockfree_queue_create(params->num_threads);
+}
+
+static inline void bench_lockfree_queue_enqueue(void *queue, int thread_id, uint64_t value)
+{
+	lockfree_queue_enqueue(queue, value, thread_id);
+}
+
+static inline bool bench_lockfree_queue_dequeue(void *queue, int thread_id)
+{
+	uint64_t value;
+	return lockfree_queue_dequeue(queue, &value, thread_id);
+}
+
+static uint64_t bench_lockfree_queue_get(void *queue) { return lockfree_queue_size(queue); }
+static void bench_lockfree_queue_destroy(void *queue) { lockfree_queue_destroy(queue); }
+
+#define DEFINE_QUEUE_OP(name)                                                                        \
+	static inline int bench_##name##_op(void *queue, int thread_id, enum op op, uint64_t key)    \
+	{                                                                                            \
+		if (op == OP_READ)                                                                   \
+			return -bench_##name##_dequeue(queue, thread_id);                            \
+		bench_##name##_enqueue(queue, thread_id, key);                                       \
+		return 1;                                                                            \
+	}
+
+DEFINE_QUEUE_OP(two_lock_queue)
+DEFINE_QUEUE_OP(lockfree_queue)
+
+/*
+ * Does `count` ops on `structure`, read_pct in every 100 of them reads and the
+ * rest split randomly between inserts and removes, timing every
+ * LATENCY_SAMPLE_INTERVAL'th one into `samples`. Adds up how much the ops
+ * changed the structure's value into `delta`. Stamped out per structure so
+ * the ops are direct calls rather than through function pointers.
+ */
+#define DEFINE_OP_LOOP(name)                                                                         \
+	static void bench_##name##_loop(void *structure, int thread_id, uint64_t count,              \
+					const struct workload *workload, uint32_t *samples,          \
+					int64_t *delta)                                              \
+	{                                                                                            \
+		struct timespec before, after;                                                       \
+		/* Each thread draws its own keys, with xorshift64 */                                \
+		uint64_t random = 0x9e3779b97f4a7c15 * (thread_id + 1);                              \
+		int64_t change = 0;                                                                  \
+		for (uint64_t i = 0; i < count; i++) {                                               \
+			random ^= random << 13;                                                      \
+			random ^= random >> 7;                                                       \
+			random ^= random << 17;                                                      \
+			enum op op = i % 100 < workload->read_pct ? OP_READ                          \
+				     : random & 1                 ? OP_INSERT                        \
+								  : OP_REMOVE;                       \
+			/* Scales the top 32 bits into the key range without dividing */            \
+			uint64_t key = (random >> 32) * workload->key_range >> 32;                   \
+                                                                                                     \
+			if (i % LATENCY_SAMPLE_INTERVAL != 0) {                                      \
+				change += bench_##name##_op(structure, thread_id, op, key);          \
+				continue;                                                            \
+			}                                                                            \
+			clock_gettime(CLOCK_MONOTONIC, &before);                                     \
+			change += bench_##name##_op(structure, thread_id, op, key);                  \
+			clock_gettime(CLOCK_MONOTONIC, &after);                                      \
+			*samples++ = (after.tv_sec - before.tv_sec) * 1000000000 +                   \
+				     (after.tv_nsec - before.tv_nsec);                               \
+		}                                                                                    \
+		*delta = change;                                                                     \
+	}
+
+DEFINE_OP_LOOP(nonatomic)
+DEFINE_OP_LOOP(atomic)
+DEFINE_OP_LOOP(approx)
+DEFINE_OP_LOOP(approx_flushed)
+DEFINE_OP_LOOP(padded_approx)
+DEFINE_OP_LOOP(lockfree_approx)
+DEFINE_OP_LOOP(locked_list)
+DEFINE_OP_LOOP(hoh_list)
+DEFINE_OP_LOOP(bucket_hash)
+DEFINE_OP_LOOP(striped_hash)
+DEFINE_OP_LOOP(split_ordered_hash)
+DEFINE_OP_LOOP(two_lock_queue)
+DEFINE_OP_LOOP(lockfree_queue)
+
+struct structure_impl {
+	const char *name;
+	enum structure_kind kind;
+	// Whether the structure uses sync_threshold, so is run for each one
+	bool sharded;
+	// Whether the structure uses lock_kind, so is run with each one
+	bool lockable;
+	void *(*create)(const struct structure_params *params);
+	// Fills the structure before a run, or NULL to start it empty
+	void (*prefill)(void *structure, uint64_t key_range);
+	void (*loop)(void *structure, int thread_id, uint64_t count, const struct workload *workload,
+		     uint32_t *samples, int64_t *delta);
+	uint64_t (*get)(void *structure);
+	void (*destroy)(void *structure);
+};
+
+#define COUNTER_IMPL(name, sharded, lockable)                                                        \
+	{#name, KIND_COUNTER, sharded, lockable, bench_##name##_create, NULL, bench_##name##_loop,   \
+	 bench_##name##_get, bench_##name##_destroy}
+#define SET_IMPL(name)                                                                               \
+	{#name, KIND_SET, false, false, bench_##name##_create, bench_##name##_prefill,               \
+	 bench_##name##_loop, bench_##name##_get, bench_##name##_destroy}
+#define QUEUE_IMPL(name)                                                                             \
+	{#name, KIND_QUEUE, false, false, bench_##name##_create, NULL, bench_##name##_loop,          \
+	 bench_##name##_get, bench_##name##_destroy}
+
+static const struct structure_impl IMPLS[] = {
+	// Here just to show that without locks the threads step on one another
+	// and we get an inaccurate count
+	COUNTER_IMPL(nonatomic, false, false),
+	COUNTER_IMPL(atomic, false, true),
+	COUNTER_IMPL(approx, true, true),
+	COUNTER_IMPL(approx_flushed, true, true),
+	COUNTER_IMPL(padded_approx, true, true),
+	COUNTER_IMPL(lockfree_approx, true, false),
+	SET_IMPL(locked_list),
+	SET_IMPL(hoh_list),
+	SET_IMPL(bucket_hash),
+	SET_IMPL(striped_hash),
+	SET_IMPL(split_ordered_hash),
+	QUEUE_IMPL(two_lock_queue),
+	QUEUE_IMPL(lockfree_queue),
+};
+
+#define NUM_IMPLS (sizeof(IMPLS) / sizeof(IMPLS[0]))
+
+struct thread_args {
+	const struct structure_impl *impl;
+	void *structure;
+	int thread_id;
+	int pin_core;
 	uint64_t count_max;
+	const struct workload *workload;
+	uint32_t *samples;
+	int64_t delta;
+	pthread_barrier_t *start_barrier;
+	struct timespec start, finish;
 };
 
-static void *approx_thread_handler(void *arg)
+static void *thread_handler(void *arg)
 {
-	struct approx_thread_args *thread_args = (struct approx_thread_args *) arg;
-	stick_this_thread_to_core(thread_args->core_id);
-	for (uint64_t i = 0; i < thread_args->count_max; i++)
-		approx_counter_increment(thread_args->counter, thread_args->core_id);
+	struct thread_args *thread_args = (struct thread_args *) arg;
+	if (thread_args->pin_core >= 0)
+		stick_this_thread_to_core(thread_args->pin_core);
+	pthread_barrier_wait(thread_args->start_barrier);
+	clock_gettime(CLOCK_MONOTONIC, &thread_args->start);
+	thread_args->impl->loop(thread_args->structure, thread_args->thread_id, thread_args->count_max,
+				thread_args->workload, thread_args->samples, &thread_args->delta);
+	clock_gettime(CLOCK_MONOTONIC, &thread_args->finish);
 	return NULL;
 }
 
-int main()
+static int compare_uint32(const void *a, const void *b)
 {
-	// TODO: Have command line args to run a given type of counter with
-	// different parameters, and then orchestrate all of this with a
-	// top-level bash script.
+	uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+	return (x > y) - (x < y);
+}
 
-	uint16_t num_threads = 8;
-	uint64_t count_max = 100000000;
+static void *calloc_or_fail(size_t count, size_t size)
+{
+	void *ptr = calloc(count, size);
+	if (ptr == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
 
-	struct timespec start, finish;
-	double elapsed_millis;
-
-	// Set up threads
-	pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
-
-	// Non-atomic counter. This is here just to show that without locks the
-	// threads step on one another and we get an inaccurate count.
-	struct nonatomic_counter *nonatomic_counter = nonatomic_counter_create();
-	struct nonatomic_thread_args *nonatomic_args = malloc(sizeof(*nonatomic_args) * num_threads);
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	for (size_t i = 0; i < num_threads; i++) {
-		nonatomic_args[i].core_id = i;
-		nonatomic_args[i].counter = nonatomic_counter;
-		nonatomic_args[i].count_max = count_max / num_threads;
-
-		if (pthread_create(&threads[i], NULL, nonatomic_thread_handler, &nonatomic_args[i])) {
-			fprintf(stderr, "error creating nonatomic counter pthread\n");
-			exit(EXIT_FAILURE);
+/**
+ * Runs one benchmark and prints its CSV row.
+ */
+static void run_benchmark(const struct structure_impl *impl, const struct structure_params *params,
+			  enum pinning pinning, const struct workload *workload, int rep, uint64_t count_max)
+{
+	int num_threads = params->num_threads;
+	int num_cores = get_nprocs();
+	uint64_t per_thread = count_max / num_threads;
+	uint64_t ops = per_thread * num_threads;
+	uint64_t samples_per_thread = (per_thread + LATENCY_SAMPLE_INTERVAL - 1) / LATENCY_SAMPLE_INTERVAL;
+
+	pthread_t *threads = calloc_or_fail(num_threads, sizeof(*threads));
+	struct thread_args *args = calloc_or_fail(num_threads, sizeof(*args));
+	uint32_t *samples = calloc_or_fail(samples_per_thread * num_threads, sizeof(*samples));
+	pthread_barrier_t start_barrier;
+	pthread_barrier_init(&start_barrier, NULL, num_threads + 1);
+
+	void *structure = impl->create(params);
+	if (impl->prefill != NULL)
+		impl->prefill(structure, workload->key_range);
+	uint64_t initial_value = impl->get(structure);
+
+	for (int i = 0; i < num_threads; i++) {
+		args[i].impl = impl;
+		args[i].structure = structure;
+		args[i].thread_id = i;
+		switch (pinning) {
+		case PINNING_NONE:
+			args[i].pin_core = -1;
+			break;
+		case PINNING_COMPACT:
+			args[i].pin_core = i;
+			break;
+		case PINNING_SPREAD:
+			args[i].pin_core = num_threads >= num_cores ? i : i * num_cores / num_threads;
+			break;
 		}
-	}
-	for (size_t i = 0; i < num_threads; i++)
-		pthread_join(threads[i], NULL);
-	clock_gettime(CLOCK_MONOTONIC, &finish);
-	elapsed_millis = (finish.tv_sec - start.tv_sec) * 1000.0;
-	elapsed_millis += (finish.tv_nsec - start.tv_nsec) / 1000000.0;
-
-	printf("nonatomic_counter time spent (ms): %f\n", elapsed_millis);
-	printf("nonatomic counter final value, expected: %" PRIu64
-	       ", got: %" PRIu64 "\n",
-	       count_max, nonatomic_counter_get(nonatomic_counter));
-
-	nonatomic_counter_destroy(nonatomic_counter);
-	free(nonatomic_args);
-
-	// Atomic counter
-	struct atomic_counter *atomic_counter = atomic_counter_create();
-	struct atomic_thread_args *atomic_args = malloc(sizeof(*atomic_args) * num_threads);
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	for (size_t i = 0; i < num_threads; i++) {
-		atomic_args[i].core_id = i;
-		atomic_args[i].counter = atomic_counter;
-		atomic_args[i].count_max = count_max / num_threads;
-
-		if (pthread_create(&threads[i], NULL, atomic_thread_handler, &atomic_args[i])) {
-			fprintf(stderr, "error creating atomic counter pthread\n");
+		args[i].count_max = per_thread;
+		args[i].workload = workload;
+		args[i].samples = samples + i * samples_per_thread;
+		args[i].start_barrier = &start_barrier;
+
+		if (pthread_create(&threads[i], NULL, thread_handler, &args[i])) {
+			fprintf(stderr, "error creating %s pthread\n", impl->name);
 			exit(EXIT_FAILURE);
 		}
 	}
-	for (size_t i = 0; i < num_threads; i++)
+
+	// Threads time themselves, as with fewer cores than threads they can be
+	// done before this one gets going again. The run is from the first to
+	// start to the last to finish.
+	pthread_barrier_wait(&start_barrier);
+	uint64_t start = UINT64_MAX, finish = 0;
+	uint64_t expected = initial_value;
+	for (int i = 0; i < num_threads; i++) {
 		pthread_join(threads[i], NULL);
-	clock_gettime(CLOCK_MONOTONIC, &finish);
-	elapsed_millis = (finish.tv_sec - start.tv_sec) * 1000.0;
-	elapsed_millis += (finish.tv_nsec - start.tv_nsec) / 1000000.0;
-
-	printf("atomic_counter time spent (ms): %f\n", elapsed_millis);
-	printf("atomic counter final value, expected: %" PRIu64
-	       ", got: %" PRIu64 "\n",
-	       count_max, atomic_counter_get(atomic_counter));
-
-	atomic_counter_destroy(atomic_counter);
-	free(atomic_args);
-
-	// Approx counter
-	uint64_t sync_threshold = 1024;
-	struct approx_counter *approx_counter = approx_counter_create(num_threads, sync_threshold);
-	struct approx_thread_args *approx_args = malloc(sizeof(*approx_args) * num_threads);
-	clock_gettime(CLOCK_MONOTONIC, &start);
-	for (size_t i = 0; i < num_threads; i++) {
-		approx_args[i].core_id = i;
-		approx_args[i].counter = approx_counter;
-		approx_args[i].count_max = count_max / num_threads;
-
-		if (pthread_create(&threads[i], NULL, approx_thread_handler, &approx_args[i])) {
-			fprintf(stderr, "error creating approx counter pthread\n");
-			exit(EXIT_FAILURE);
-		}
+		expected += args[i].delta;
+		uint64_t thread_start = args[i].start.tv_sec * 1000000000ull + args[i].start.tv_nsec;
+		uint64_t thread_finish = args[i].finish.tv_sec * 1000000000ull + args[i].finish.tv_nsec;
+		start = thread_start < start ? thread_start : start;
+		finish = thread_finish > finish ? thread_finish : finish;
 	}
-	for (size_t i = 0; i < num_threads; i++)
-		pthread_join(threads[i], NULL);
-	clock_gettime(CLOCK_MONOTONIC, &finish);
-	elapsed_millis = (finish.tv_sec - start.tv_sec) * 1000.0;
-	elapsed_millis += (finish.tv_nsec - start.tv_nsec) / 1000000.0;
+	double seconds = (finish - start) / 1e9;
 
-	printf("approx_counter time spent (ms): %f\n", elapsed_millis);
-	printf("approx counter final value, expected: %" PRIu64
-	       ", got: %" PRIu64 "\n",
-	       count_max, approx_counter_get(approx_counter));
+	uint64_t num_samples = samples_per_thread * num_threads;
+	qsort(samples, num_samples, sizeof(*samples), compare_uint32);
+	uint32_t p50 = num_samples > 0 ? samples[num_samples / 2] : 0;
+	uint32_t p99 = num_samples > 0 ? samples[num_samples * 99 / 100] : 0;
+	// A run too short for the clock to see counts as no throughput, not
+	// infinite throughput
+	double ops_per_sec = seconds > 0 ? ops / seconds : 0;
+	uint64_t final_value = impl->get(structure);
 
-	approx_counter_destroy(approx_counter);
-	free(approx_args);
+	printf("%s,%s,%d,%" PRIu64 ",%s,%u,%" PRIu64 ",%d,%" PRIu64 ",%.6f,%.0f,%" PRIu32 ",%" PRIu32 ",%" PRIu64
+	       ",%" PRId64 "\n",
+	       impl->name, impl->lockable ? LOCK_KIND_NAMES[params->lock_kind] : "", num_threads,
+	       impl->sharded ? params->sync_threshold : 0, PINNING_NAMES[pinning], workload->read_pct,
+	       impl->kind == KIND_SET ? workload->key_range : 0, rep, ops, seconds, ops_per_sec, p50, p99, final_value,
+	       (int64_t) (final_value - expected));
+	fflush(stdout);
 
+	impl->destroy(structure);
+	pthread_barrier_destroy(&start_barrier);
+	free(samples);
+	free(args);
 	free(threads);
 }
+
+/**
+ * Parses a comma separated list of numbers from min to max into `values`,
+ * returning how many there were, or 0 if it's malformed.
+ */
+static size_t parse_list(char *arg, uint64_t *values, uint64_t min, uint64_t max)
+{
+	size_t len = 0;
+	for (char *item = strtok(arg, ","); item != NULL; item = strtok(NULL, ",")) {
+		char *end;
+		errno = 0;
+		unsigned long long value = strtoull(item, &end, 10);
+		if (len == MAX_LIST_LEN || *end != '\0' || end == item || errno != 0 || value < min ||
+		    value > max)
+			return 0;
+		values[len++] = value;
+	}
+	return len;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-c structure,...] [-t threads,...] [-s threshold,...] [-n count] [-r reps] [-p pinning]"
+		" [-m read%%,...] [-k keys,...] [-l lock,...]\n",
+		prog);
+	fprintf(stderr, "  -c  structures to run (default all):");
+	for (size_t i = 0; i < NUM_IMPLS; i++)
+		fprintf(stderr, " %s", IMPLS[i].name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -t  thread counts to run each with (default 1,2,4,8)\n");
+	fprintf(stderr, "  -s  sync thresholds for the approx counters (default 1024)\n");
+	fprintf(stderr, "  -n  ops in total, split between the threads (default 10000000)\n");
+	fprintf(stderr, "  -r  repetitions of each run (default 3)\n");
+	fprintf(stderr, "  -p  none, compact (thread i on core i) or spread (evenly over cores); default compact\n");
+	fprintf(stderr, "  -m  percentages of ops that are reads: counter gets, set lookups or dequeues (default 0)\n");
+	fprintf(stderr, "  -k  key ranges for the sets, which start with every other key in it (default 1024)\n");
+	fprintf(stderr, "  -l  locks for the counters that take them (default pthread):");
+	for (int i = 0; i < NUM_LOCK_KINDS; i++)
+		fprintf(stderr, " %s", LOCK_KIND_NAMES[i]);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Writes a CSV row per run to stdout. Latencies are of one op in every %d, in ns. The error\n",
+		LATENCY_SAMPLE_INTERVAL);
+	fprintf(stderr, "is how far the final count or size is from what the threads' ops added up to.\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	bool selected[NUM_IMPLS];
+	for (size_t i = 0; i < NUM_IMPLS; i++)
+		selected[i] = true;
+	uint64_t thread_counts[MAX_LIST_LEN] = {1, 2, 4, 8};
+	size_t num_thread_counts = 4;
+	uint64_t thresholds[MAX_LIST_LEN] = {1024};
+	size_t num_thresholds = 1;
+	uint64_t count_max = 10000000;
+	int reps = 3;
+	enum pinning pinning = PINNING_COMPACT;
+	uint64_t read_pcts[MAX_LIST_LEN] = {0};
+	size_t num_read_pcts = 1;
+	uint64_t key_ranges[MAX_LIST_LEN] = {1024};
+	size_t num_key_ranges = 1;
+	enum lock_kind lock_kinds[NUM_LOCK_KINDS] = {LOCK_PTHREAD};
+	size_t num_lock_kinds = 1;
+
+	int c;
+	while ((c = getopt(argc, argv, "c:k:l:m:n:p:r:s:t:")) != -1) {
+		switch (c) {
+		case 'c':
+			for (size_t i = 0; i < NUM_IMPLS; i++)
+				selected[i] = false;
+			for (char *name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ",")) {
+				size_t i = 0;
+				while (i < NUM_IMPLS && strcmp(name, IMPLS[i].name) != 0)
+					i++;
+				if (i == NUM_IMPLS)
+					usage(argv[0]);
+				selected[i] = true;
+			}
+			break;
+		case 'k':
+			// Keys are scaled from 32 random bits
+			num_key_ranges = parse_list(optarg, key_ranges, 1, UINT32_MAX);
+			break;
+		case 'l':
+			num_lock_kinds = 0;
+			for (char *name = strtok(optarg, ","); name != NULL; name = strtok(NULL, ",")) {
+				if (num_lock_kinds == NUM_LOCK_KINDS ||
+				    !lock_kind_from_name(name, &lock_kinds[num_lock_kinds++]))
+					usage(argv[0]);
+			}
+			break;
+		case 'm':
+			num_read_pcts = parse_list(optarg, read_pcts, 0, 100);
+			break;
+		case 'n':
+			count_max = strtoull(optarg, NULL, 10);
+			break;
+		case 'p': {
+			size_t i = 0;
+			while (i < sizeof(PINNING_NAMES) / sizeof(PINNING_NAMES[0]) && strcmp(optarg, PINNING_NAMES[i]) != 0)
+				i++;
+			if (i == sizeof(PINNING_NAMES) / sizeof(PINNING_NAMES[0]))
+				usage(argv[0]);
+			pinning = i;
+			break;
+		}
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 's':
+			num_thresholds = parse_list(optarg, thresholds, 1, UINT64_MAX);
+			break;
+		case 't':
+			num_thread_counts = parse_list(optarg, thread_counts, 1, INT_MAX);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || num_thread_counts == 0 || num_thresholds == 0 || num_read_pcts == 0 ||
+	    num_key_ranges == 0 || num_lock_kinds == 0 || count_max == 0 || reps <= 0)
+		usage(argv[0]);
+	for (size_t t = 0; t < num_thread_counts; t++) {
+		// Otherwise some threads would have nothing to do
+		if (count_max < thread_counts[t]) {
+			fprintf(stderr, "%s: -n %" PRIu64 " is less than -t %" PRIu64 "\n", argv[0], count_max,
+				thread_counts[t]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	printf("structure,lock,threads,sync_threshold,pinning,read_pct,keys,rep,ops,seconds,ops_per_sec,p50_ns,p99_ns,"
+	       "final_value,error\n");
+	for (size_t i = 0; i < NUM_IMPLS; i++) {
+		if (!selected[i])
+			continue;
+		const struct structure_impl *impl = &IMPLS[i];
+		// Thresholds only mean anything to the sharded counters, locks to
+		// the counters with locks, and key ranges to the sets
+		size_t num_impl_thresholds = impl->sharded ? num_thresholds : 1;
+		size_t num_impl_lock_kinds = impl->lockable ? num_lock_kinds : 1;
+		size_t num_impl_key_ranges = impl->kind == KIND_SET ? num_key_ranges : 1;
+		for (size_t l = 0; l < num_impl_lock_kinds; l++) {
+			for (size_t t = 0; t < num_thread_counts; t++) {
+				for (size_t s = 0; s < num_impl_thresholds; s++) {
+					struct structure_params params = {thread_counts[t], thresholds[s], lock_kinds[l]};
+					for (size_t m = 0; m < num_read_pcts; m++) {
+						for (size_t k = 0; k < num_impl_key_ranges; k++) {
+							struct workload workload = {read_pcts[m], key_ranges[k]};
+							for (int rep = 0; rep < reps; rep++)
+								run_benchmark(impl, &params, pinning, &workload, rep,
+									      count_max);
+						}
+					}
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#include "padded_approx_counter.h"
+
+#include "cache_line.h"
+#include "lock.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct padded_approx_counter_shard {
+	_Alignas(SHARD_ALIGNMENT) struct lock lock;
+	uint64_t count;
+};
+
+struct padded_approx_counter {
+	// The global count is only touched on syncs, but keep it off the shards'
+	// lines anyway
+	_Alignas(SHARD_ALIGNMENT) struct lock global_lock;
+	uint64_t global_counter;
+
+	int num_cpus;
+	struct padded_approx_counter_shard *shards;
+
+	uint64_t sync_threshold;
+};
+
+struct padded_approx_counter *padded_approx_counter_create(int num_cpus, uint64_t sync_threshold,
+							   enum lock_kind lock_kind)
+{
+	struct padded_approx_counter *counter = aligned_alloc(SHARD_ALIGNMENT, sizeof(*counter));
+	struct padded_approx_counter_shard *shards = aligned_alloc(SHARD_ALIGNMENT, sizeof(*shards) * num_cpus);
+	if (counter == NULL || shards == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	lock_init(&counter->global_lock, lock_kind);
+	counter->global_counter = 0;
+
+	counter->num_cpus = num_cpus;
+	counter->shards = shards;
+	for (int i = 0; i < counter->num_cpus; i++) {
+		lock_init(&counter->shards[i].lock, lock_kind);
+		counter->shards[i].count = 0;
+	}
+
+	counter->sync_threshold = sync_threshold;
+
+	return counter;
+}
+
+void padded_approx_counter_increment(struct padded_approx_counter *counter, int core_id)
+{
+	struct padded_approx_counter_shard *shard = &counter->shards[core_id];
+	lock_acquire(&shard->lock);
+	shard->count += 1;
+
+	// Sync to global counter
+	if (shard->count >= counter->sync_threshold) {
+		lock_acquire(&counter->global_lock);
+		counter->global_counter += shard->count;
+		lock_release(&counter->global_lock);
+		shard->count = 0;
+	}
+
+	lock_release(&shard->lock);
+}
+
+uint64_t padded_approx_counter_get(struct padded_approx_counter *counter)
+{
+	uint64_t count = counter->global_counter;
+	for (int i = 0; i < counter->num_cpus; i++)
+		count += counter->shards[i].count;
+	return count;
+}
+
+void padded_approx_counter_destroy(struct padded_approx_counter *counter)
+{
+	lock_destroy(&counter->global_lock);
+	for (int i = 0; i < counter->num_cpus; i++)
+		lock_destroy(&counter->shards[i].lock);
+	free(counter->shards);
+	free(counter);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "lock.h"
+
+#include <stdint.h>
+
+/**
+ * A padded_approx_counter is an approx_counter whose per-CPU count and lock
+ * sit together on their own cache lines, so CPUs incrementing their own
+ * counts don't invalidate each other's lines (false sharing).
+ */
+struct padded_approx_counter;
+
+struct padded_approx_counter *padded_approx_counter_create(int num_cpus, uint64_t sync_threshold,
+							   enum lock_kind lock_kind);
+void padded_approx_counter_increment(struct padded_approx_counter *counter, int core_id);
+
+/**
+ * Gets value of global counter and all CPU counters.
+ */
+uint64_t padded_approx_counter_get(struct padded_approx_counter *counter);
+
+void padded_approx_counter_destroy(struct padded_approx_counter *counter);
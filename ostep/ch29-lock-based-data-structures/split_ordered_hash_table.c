@@ -0,0 +1,322 @@
+#include "split_ordered_hash_table.h"
+
+#include "cache_line.h"
+#include "hash.h"
+#include "hazard_pointers.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Hazard pointer slots
+#define HP_NEXT 0
+#define HP_CUR 1
+#define HP_PREV 2
+
+// Set in a node's next pointer once it's been logically removed
+#define MARK ((uintptr_t) 1)
+
+// Average keys per bucket before the number of buckets doubles
+#define LOAD_FACTOR 2
+
+// Bucket 0 is in segment 0, and segment s > 0 holds buckets 2^(s-1) up to
+// 2^s, so the bucket array can grow without being copied
+#define NUM_SEGMENTS 64
+
+struct split_ordered_hash_table_node {
+	// Bit-reversed hash, whose low bit is set for keys and clear for dummy
+	// nodes, which start each bucket
+	uint64_t so_key;
+	uint64_t key;
+	_Atomic(void *) next;
+};
+
+struct split_ordered_hash_table {
+	// Each segment is an array of pointers to buckets' dummy nodes, NULL
+	// until the bucket is first used
+	_Atomic(_Atomic(void *) *) segments[NUM_SEGMENTS];
+
+	// Number of buckets in use, a power of 2
+	_Alignas(SHARD_ALIGNMENT) _Atomic uint64_t num_buckets;
+	_Alignas(SHARD_ALIGNMENT) _Atomic uint64_t count;
+
+	struct hazard_pointers *hp;
+};
+
+static bool is_marked(void *ptr) { return (uintptr_t) ptr & MARK; }
+static void *marked(void *ptr) { return (void *) ((uintptr_t) ptr | MARK); }
+static void *unmarked(void *ptr) { return (void *) ((uintptr_t) ptr & ~MARK); }
+
+static uint64_t reverse_bits(uint64_t x)
+{
+	x = ((x >> 1) & 0x5555555555555555) | ((x & 0x5555555555555555) << 1);
+	x = ((x >> 2) & 0x3333333333333333) | ((x & 0x3333333333333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f0f0f0f0f) | ((x & 0x0f0f0f0f0f0f0f0f) << 4);
+	return __builtin_bswap64(x);
+}
+
+static uint64_t so_regular_key(uint64_t hash) { return reverse_bits(hash | (UINT64_C(1) << 63)); }
+static uint64_t so_dummy_key(uint64_t bucket) { return reverse_bits(bucket); }
+
+static struct split_ordered_hash_table_node *node_create(uint64_t so_key, uint64_t key)
+{
+	struct split_ordered_hash_table_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->so_key = so_key;
+	node->key = key;
+	atomic_init(&node->next, NULL);
+	return node;
+}
+
+struct split_ordered_hash_table *split_ordered_hash_table_create(int num_threads)
+{
+	struct split_ordered_hash_table *table = aligned_alloc(SHARD_ALIGNMENT, sizeof(*table));
+	_Atomic(void *) *first_segment = malloc(sizeof(*first_segment));
+	if (table == NULL || first_segment == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	// Bucket 0's dummy node is the head of the whole list
+	atomic_init(first_segment, node_create(so_dummy_key(0), 0));
+	atomic_init(&table->segments[0], first_segment);
+	for (int i = 1; i < NUM_SEGMENTS; i++)
+		atomic_init(&table->segments[i], NULL);
+
+	atomic_init(&table->num_buckets, 2);
+	atomic_init(&table->count, 0);
+	table->hp = hazard_pointers_create(num_threads, free);
+
+	return table;
+}
+
+/*
+ * Orders nodes by so_key, then by key, for keys whose hashes only differ in
+ * the top bit, which so_key loses.
+ */
+static int compare(struct split_ordered_hash_table_node *node, uint64_t so_key, uint64_t key)
+{
+	if (node->so_key != so_key)
+		return node->so_key < so_key ? -1 : 1;
+	return (node->key > key) - (node->key < key);
+}
+
+/*
+ * Michael's list search: finds the first node from *head on that's not less
+ * than (so_key, key), unlinking any removed nodes it passes. Returns whether
+ * it's an exact match, with *prev_out the link pointing at it and *cur_out
+ * the node (or NULL at the end of the list), both protected by hazard
+ * pointers.
+ */
+static bool list_find(struct split_ordered_hash_table *table, _Atomic(void *) *head, uint64_t so_key,
+		      uint64_t key, int thread_id, _Atomic(void *) **prev_out,
+		      struct split_ordered_hash_table_node **cur_out)
+{
+	struct hazard_pointers *hp = table->hp;
+
+try_again:;
+	// head is in a dummy node, which are never removed, so never marked
+	_Atomic(void *) *prev = head;
+	struct split_ordered_hash_table_node *cur = hazard_pointers_protect(hp, thread_id, HP_CUR, prev, 0);
+	for (;;) {
+		if (cur == NULL) {
+			*prev_out = prev;
+			*cur_out = NULL;
+			return false;
+		}
+
+		void *next = hazard_pointers_protect(hp, thread_id, HP_NEXT, &cur->next, MARK);
+		// If cur was unlinked since we got to it, next may be retired
+		if (atomic_load(prev) != cur)
+			goto try_again;
+
+		if (!is_marked(next)) {
+			int cmp = compare(cur, so_key, key);
+			if (cmp >= 0) {
+				*prev_out = prev;
+				*cur_out = cur;
+				return cmp == 0;
+			}
+			prev = &cur->next;
+			hazard_pointers_set(hp, thread_id, HP_PREV, cur);
+		} else {
+			// Finish removing it for whoever marked it
+			void *expected = cur;
+			if (!atomic_compare_exchange_strong(prev, &expected, unmarked(next)))
+				goto try_again;
+			hazard_pointers_retire(hp, thread_id, cur);
+		}
+
+		cur = unmarked(next);
+		hazard_pointers_set(hp, thread_id, HP_CUR, cur);
+	}
+}
+
+/*
+ * Links node into the list after *head, returning it, or if there's already
+ * a node with its key, returns that one instead and leaves node alone. The
+ * returned pointer is only safe to dereference for dummy nodes.
+ */
+static struct split_ordered_hash_table_node *list_insert(struct split_ordered_hash_table *table,
+							 _Atomic(void *) *head,
+							 struct split_ordered_hash_table_node *node, int thread_id)
+{
+	for (;;) {
+		_Atomic(void *) *prev;
+		struct split_ordered_hash_table_node *cur;
+		if (list_find(table, head, node->so_key, node->key, thread_id, &prev, &cur))
+			return cur;
+
+		atomic_store_explicit(&node->next, cur, memory_order_relaxed);
+		void *expected = cur;
+		if (atomic_compare_exchange_strong(prev, &expected, node))
+			return node;
+	}
+}
+
+/*
+ * The slot holding bucket's dummy node, allocating its segment if need be.
+ */
+static _Atomic(void *) *bucket_slot(struct split_ordered_hash_table *table, uint64_t bucket)
+{
+	int segment = bucket == 0 ? 0 : 64 - __builtin_clzll(bucket);
+	uint64_t first_bucket = segment == 0 ? 0 : UINT64_C(1) << (segment - 1);
+
+	_Atomic(void *) *slots = atomic_load(&table->segments[segment]);
+	if (slots == NULL) {
+		// calloc's zeroes are NULL pointers on every platform this runs on
+		_Atomic(void *) *new_slots = calloc(first_bucket, sizeof(*new_slots));
+		if (new_slots == NULL) {
+			fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+			exit(EXIT_FAILURE);
+		}
+		if (atomic_compare_exchange_strong(&table->segments[segment], &slots, new_slots))
+			slots = new_slots;
+		else
+			free(new_slots);
+	}
+	return &slots[bucket - first_bucket];
+}
+
+/*
+ * Gets bucket's dummy node, adding it to the list if this is the bucket's
+ * first use. Clears the thread's hazard pointers.
+ */
+static struct split_ordered_hash_table_node *get_bucket(struct split_ordered_hash_table *table, uint64_t bucket,
+							int thread_id)
+{
+	_Atomic(void *) *slot = bucket_slot(table, bucket);
+	struct split_ordered_hash_table_node *dummy = atomic_load(slot);
+	if (dummy != NULL)
+		return dummy;
+
+	// The bucket this one was split from, i.e. without its top bit, comes
+	// right before it in split order
+	uint64_t parent = bucket & ~(UINT64_C(1) << (63 - __builtin_clzll(bucket)));
+	struct split_ordered_hash_table_node *parent_dummy = get_bucket(table, parent, thread_id);
+
+	struct split_ordered_hash_table_node *new_dummy = node_create(so_dummy_key(bucket), 0);
+	dummy = list_insert(table, &parent_dummy->next, new_dummy, thread_id);
+	hazard_pointers_clear(table->hp, thread_id);
+	if (dummy != new_dummy)
+		free(new_dummy);
+
+	// Anyone racing to set it found the same node
+	atomic_store(slot, dummy);
+	return dummy;
+}
+
+bool split_ordered_hash_table_insert(struct split_ordered_hash_table *table, uint64_t key, int thread_id)
+{
+	uint64_t hash = hash_key(key);
+	uint64_t num_buckets = atomic_load(&table->num_buckets);
+	struct split_ordered_hash_table_node *dummy = get_bucket(table, hash & (num_buckets - 1), thread_id);
+
+	struct split_ordered_hash_table_node *node = node_create(so_regular_key(hash), key);
+	bool inserted = list_insert(table, &dummy->next, node, thread_id) == node;
+	hazard_pointers_clear(table->hp, thread_id);
+	if (!inserted) {
+		free(node);
+		return false;
+	}
+
+	// Double the buckets once they're too full. New buckets are split off
+	// lazily as they're used.
+	uint64_t count = atomic_fetch_add(&table->count, 1) + 1;
+	if (count / num_buckets > LOAD_FACTOR)
+		atomic_compare_exchange_strong(&table->num_buckets, &num_buckets, num_buckets * 2);
+	return true;
+}
+
+bool split_ordered_hash_table_lookup(struct split_ordered_hash_table *table, uint64_t key, int thread_id)
+{
+	uint64_t hash = hash_key(key);
+	uint64_t num_buckets = atomic_load(&table->num_buckets);
+	struct split_ordered_hash_table_node *dummy = get_bucket(table, hash & (num_buckets - 1), thread_id);
+
+	_Atomic(void *) *prev;
+	struct split_ordered_hash_table_node *cur;
+	bool found = list_find(table, &dummy->next, so_regular_key(hash), key, thread_id, &prev, &cur);
+	hazard_pointers_clear(table->hp, thread_id);
+	return found;
+}
+
+bool split_ordered_hash_table_remove(struct split_ordered_hash_table *table, uint64_t key, int thread_id)
+{
+	uint64_t hash = hash_key(key);
+	uint64_t so_key = so_regular_key(hash);
+	uint64_t num_buckets = atomic_load(&table->num_buckets);
+	struct split_ordered_hash_table_node *dummy = get_bucket(table, hash & (num_buckets - 1), thread_id);
+
+	for (;;) {
+		_Atomic(void *) *prev;
+		struct split_ordered_hash_table_node *cur;
+		if (!list_find(table, &dummy->next, so_key, key, thread_id, &prev, &cur)) {
+			hazard_pointers_clear(table->hp, thread_id);
+			return false;
+		}
+
+		// Marking it is what removes it; whoever marks it first wins
+		void *next = atomic_load(&cur->next);
+		if (is_marked(next) || !atomic_compare_exchange_strong(&cur->next, &next, marked(next)))
+			continue;
+
+		// Then unlink it, or leave that to the next search through here
+		void *expected = cur;
+		if (atomic_compare_exchange_strong(prev, &expected, next))
+			hazard_pointers_retire(table->hp, thread_id, cur);
+		else
+			list_find(table, &dummy->next, so_key, key, thread_id, &prev, &cur);
+		hazard_pointers_clear(table->hp, thread_id);
+
+		atomic_fetch_sub(&table->count, 1);
+		return true;
+	}
+}
+
+uint64_t split_ordered_hash_table_size(struct split_ordered_hash_table *table)
+{
+	return atomic_load(&table->count);
+}
+
+void split_ordered_hash_table_destroy(struct split_ordered_hash_table *table)
+{
+	// Everything still linked in, removed or not, hangs off bucket 0's dummy.
+	// Anything unlinked was retired and is freed with the hazard pointers.
+	struct split_ordered_hash_table_node *node = atomic_load(&table->segments[0])[0];
+	while (node != NULL) {
+		struct split_ordered_hash_table_node *next = unmarked(atomic_load(&node->next));
+		free(node);
+		node = next;
+	}
+	hazard_pointers_destroy(table->hp);
+
+	for (int i = 0; i < NUM_SEGMENTS; i++)
+		free(atomic_load(&table->segments[i]));
+	free(table);
+}
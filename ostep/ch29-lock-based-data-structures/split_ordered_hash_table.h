@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A split_ordered_hash_table is Shalev and Shavit's lock-free hash table.
+ * Every key lives in a single lock-free sorted linked list (Michael's, with
+ * hazard pointers), ordered by the bit-reversal of its hash. In that order
+ * each bucket's keys are contiguous, and splitting a bucket in two when the
+ * table doubles just means adding a dummy node partway along it, so the table
+ * grows without moving any keys or stopping anyone.
+ *
+ * Each thread passes its own thread_id, from 0 up to num_threads.
+ */
+struct split_ordered_hash_table;
+
+struct split_ordered_hash_table *split_ordered_hash_table_create(int num_threads);
+
+/**
+ * Adds key, returning false if it was already there.
+ */
+bool split_ordered_hash_table_insert(struct split_ordered_hash_table *table, uint64_t key, int thread_id);
+
+bool split_ordered_hash_table_lookup(struct split_ordered_hash_table *table, uint64_t key, int thread_id);
+
+/**
+ * Removes key, returning false if it wasn't there.
+ */
+bool split_ordered_hash_table_remove(struct split_ordered_hash_table *table, uint64_t key, int thread_id);
+
+uint64_t split_ordered_hash_table_size(struct split_ordered_hash_table *table);
+void split_ordered_hash_table_destroy(struct split_ordered_hash_table *table);
@@ -0,0 +1,135 @@
+#include "striped_hash_table.h"
+
+#include "cache_line.h"
+#include "hash.h"
+#include "mutex_utils.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct striped_hash_table_node {
+	uint64_t key;
+	struct striped_hash_table_node *next;
+};
+
+struct striped_hash_table_stripe {
+	_Alignas(SHARD_ALIGNMENT) pthread_mutex_t mutex;
+};
+
+struct striped_hash_table {
+	uint64_t num_buckets;
+	struct striped_hash_table_node **buckets;
+
+	int num_stripes;
+	struct striped_hash_table_stripe *stripes;
+};
+
+struct striped_hash_table *striped_hash_table_create(uint64_t num_buckets, int num_stripes)
+{
+	struct striped_hash_table *table = malloc(sizeof(*table));
+	struct striped_hash_table_node **buckets = calloc(num_buckets, sizeof(*buckets));
+	struct striped_hash_table_stripe *stripes = aligned_alloc(SHARD_ALIGNMENT, sizeof(*stripes) * num_stripes);
+	if (table == NULL || buckets == NULL || stripes == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	table->num_buckets = num_buckets;
+	table->buckets = buckets;
+	table->num_stripes = num_stripes;
+	table->stripes = stripes;
+	for (int i = 0; i < num_stripes; i++)
+		pthread_mutex_init_or_fail(&table->stripes[i].mutex);
+
+	return table;
+}
+
+/*
+ * Locks key's stripe, returning the link to key's node in its bucket, or the
+ * NULL at the end of the bucket.
+ */
+static struct striped_hash_table_node **lock_and_find(struct striped_hash_table *table, uint64_t key,
+						       pthread_mutex_t **mutex)
+{
+	uint64_t bucket = hash_key(key) % table->num_buckets;
+	*mutex = &table->stripes[bucket % table->num_stripes].mutex;
+	pthread_mutex_lock_or_fail(*mutex);
+
+	struct striped_hash_table_node **link = &table->buckets[bucket];
+	while (*link != NULL && (*link)->key != key)
+		link = &(*link)->next;
+	return link;
+}
+
+bool striped_hash_table_insert(struct striped_hash_table *table, uint64_t key)
+{
+	struct striped_hash_table_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->key = key;
+	node->next = NULL;
+
+	pthread_mutex_t *mutex;
+	struct striped_hash_table_node **link = lock_and_find(table, key, &mutex);
+	bool inserted = *link == NULL;
+	if (inserted)
+		*link = node;
+	pthread_mutex_unlock_or_fail(mutex);
+
+	if (!inserted)
+		free(node);
+	return inserted;
+}
+
+bool striped_hash_table_lookup(struct striped_hash_table *table, uint64_t key)
+{
+	pthread_mutex_t *mutex;
+	bool found = *lock_and_find(table, key, &mutex) != NULL;
+	pthread_mutex_unlock_or_fail(mutex);
+	return found;
+}
+
+bool striped_hash_table_remove(struct striped_hash_table *table, uint64_t key)
+{
+	pthread_mutex_t *mutex;
+	struct striped_hash_table_node **link = lock_and_find(table, key, &mutex);
+	struct striped_hash_table_node *node = *link;
+	if (node != NULL)
+		*link = node->next;
+	pthread_mutex_unlock_or_fail(mutex);
+
+	free(node);
+	return node != NULL;
+}
+
+uint64_t striped_hash_table_size(struct striped_hash_table *table)
+{
+	uint64_t size = 0;
+	for (uint64_t i = 0; i < table->num_buckets; i++) {
+		for (struct striped_hash_table_node *node = table->buckets[i]; node != NULL; node = node->next)
+			size++;
+	}
+	return size;
+}
+
+void striped_hash_table_destroy(struct striped_hash_table *table)
+{
+	for (uint64_t i = 0; i < table->num_buckets; i++) {
+		struct striped_hash_table_node *node = table->buckets[i];
+		while (node != NULL) {
+			struct striped_hash_table_node *next = node->next;
+			free(node);
+			node = next;
+		}
+	}
+	for (int i = 0; i < table->num_stripes; i++)
+		pthread_mutex_destroy(&table->stripes[i].mutex);
+	free(table->stripes);
+	free(table->buckets);
+	free(table);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A striped_hash_table shares a smaller, fixed set of mutexes (stripes)
+ * between its buckets: bucket i is guarded by stripe i % num_stripes. That
+ * keeps the locks' memory independent of the table size, and each stripe on
+ * its own cache lines, in exchange for some buckets contending that wouldn't
+ * with a lock per bucket.
+ */
+struct striped_hash_table;
+
+struct striped_hash_table *striped_hash_table_create(uint64_t num_buckets, int num_stripes);
+
+/**
+ * Adds key, returning false if it was already there.
+ */
+bool striped_hash_table_insert(struct striped_hash_table *table, uint64_t key);
+
+bool striped_hash_table_lookup(struct striped_hash_table *table, uint64_t key);
+
+/**
+ * Removes key, returning false if it wasn't there.
+ */
+bool striped_hash_table_remove(struct striped_hash_table *table, uint64_t key);
+
+/**
+ * Counts the keys. Only exact if nothing is changing the table.
+ */
+uint64_t striped_hash_table_size(struct striped_hash_table *table);
+
+void striped_hash_table_destroy(struct striped_hash_table *table);
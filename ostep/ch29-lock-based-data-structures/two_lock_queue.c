@@ -0,0 +1,109 @@
+#include "two_lock_queue.h"
+
+#include "cache_line.h"
+#include "mutex_utils.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct two_lock_queue_node {
+	uint64_t value;
+	// The one thing both ends touch: an enqueuer sets the last node's next
+	// while a dequeuer may be checking it to see if the queue is empty
+	_Atomic(struct two_lock_queue_node *) next;
+};
+
+struct two_lock_queue {
+	// Enqueuers and dequeuers each keep to their own end, so keep the ends
+	// on their own lines too
+	_Alignas(SHARD_ALIGNMENT) pthread_mutex_t head_mutex;
+	struct two_lock_queue_node *head;
+
+	_Alignas(SHARD_ALIGNMENT) pthread_mutex_t tail_mutex;
+	struct two_lock_queue_node *tail;
+};
+
+static struct two_lock_queue_node *node_create(uint64_t value)
+{
+	struct two_lock_queue_node *node = malloc(sizeof(*node));
+	if (node == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+	node->value = value;
+	atomic_init(&node->next, NULL);
+	return node;
+}
+
+struct two_lock_queue *two_lock_queue_create()
+{
+	struct two_lock_queue *queue = aligned_alloc(SHARD_ALIGNMENT, sizeof(*queue));
+	if (queue == NULL) {
+		fprintf(stderr, "malloc error in %s at %s:%d\n", __func__, __FILE__, __LINE__);
+		exit(EXIT_FAILURE);
+	}
+
+	struct two_lock_queue_node *dummy = node_create(0);
+	pthread_mutex_init_or_fail(&queue->head_mutex);
+	pthread_mutex_init_or_fail(&queue->tail_mutex);
+	queue->head = dummy;
+	queue->tail = dummy;
+
+	return queue;
+}
+
+void two_lock_queue_enqueue(struct two_lock_queue *queue, uint64_t value)
+{
+	struct two_lock_queue_node *node = node_create(value);
+
+	pthread_mutex_lock_or_fail(&queue->tail_mutex);
+	// Release, so a dequeuer that sees the node sees its value
+	atomic_store_explicit(&queue->tail->next, node, memory_order_release);
+	queue->tail = node;
+	pthread_mutex_unlock_or_fail(&queue->tail_mutex);
+}
+
+bool two_lock_queue_dequeue(struct two_lock_queue *queue, uint64_t *value)
+{
+	pthread_mutex_lock_or_fail(&queue->head_mutex);
+	struct two_lock_queue_node *dummy = queue->head;
+	struct two_lock_queue_node *first = atomic_load_explicit(&dummy->next, memory_order_acquire);
+	if (first == NULL) {
+		pthread_mutex_unlock_or_fail(&queue->head_mutex);
+		return false;
+	}
+
+	// The first node becomes the new dummy
+	*value = first->value;
+	queue->head = first;
+	pthread_mutex_unlock_or_fail(&queue->head_mutex);
+
+	free(dummy);
+	return true;
+}
+
+uint64_t two_lock_queue_size(struct two_lock_queue *queue)
+{
+	uint64_t size = 0;
+	for (struct two_lock_queue_node *node = atomic_load(&queue->head->next); node != NULL;
+	     node = atomic_load(&node->next))
+		size++;
+	return size;
+}
+
+void two_lock_queue_destroy(struct two_lock_queue *queue)
+{
+	struct two_lock_queue_node *node = queue->head;
+	while (node != NULL) {
+		struct two_lock_queue_node *next = atomic_load(&node->next);
+		free(node);
+		node = next;
+	}
+	pthread_mutex_destroy(&queue->head_mutex);
+	pthread_mutex_destroy(&queue->tail_mutex);
+	free(queue);
+}
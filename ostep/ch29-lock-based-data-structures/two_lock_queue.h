@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A two_lock_queue is Michael and Scott's two-lock FIFO queue, as in OSTEP:
+ * a dummy node keeps the head and tail apart, so enqueuers only take the tail
+ * lock and dequeuers only the head lock.
+ */
+struct two_lock_queue;
+
+struct two_lock_queue *two_lock_queue_create();
+void two_lock_queue_enqueue(struct two_lock_queue *queue, uint64_t value);
+
+/**
+ * Takes the value at the front of the queue, returning false if it's empty.
+ */
+bool two_lock_queue_dequeue(struct two_lock_queue *queue, uint64_t *value);
+
+/**
+ * Counts the values. Only exact if nothing is changing the queue.
+ */
+uint64_t two_lock_queue_size(struct two_lock_queue *queue);
+
+void two_lock_queue_destroy(struct two_lock_queue *queue);
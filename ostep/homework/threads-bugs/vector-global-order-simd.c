@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "common.h"
+#include "common_threads.h"
+
+// give each vector its own cache lines, so taking one vector's lock doesn't
+// steal the line holding a neighbour's lock or values
+#define VECTOR_ALIGNMENT (64)
+
+#include "main-header.h"
+#include "vector-header.h"
+
+// The adds themselves: eight ints at a time with AVX2 if the CPU has it,
+// four with SSE2 if not, and one at a time on anything else. Loads and stores
+// are unaligned, since values sits just after the lock.
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+void add_values_avx2(int *dst, int *src) {
+    int i;
+    for (i = 0; i + 8 <= VECTOR_SIZE; i += 8) {
+	__m256i d = _mm256_loadu_si256((__m256i *) &dst[i]);
+	__m256i s = _mm256_loadu_si256((__m256i *) &src[i]);
+	_mm256_storeu_si256((__m256i *) &dst[i], _mm256_add_epi32(d, s));
+    }
+    for (; i < VECTOR_SIZE; i++) {
+	dst[i] = dst[i] + src[i];
+    }
+}
+
+__attribute__((target("sse2")))
+void add_values_sse2(int *dst, int *src) {
+    int i;
+    for (i = 0; i + 4 <= VECTOR_SIZE; i += 4) {
+	__m128i d = _mm_loadu_si128((__m128i *) &dst[i]);
+	__m128i s = _mm_loadu_si128((__m128i *) &src[i]);
+	_mm_storeu_si128((__m128i *) &dst[i], _mm_add_epi32(d, s));
+    }
+    for (; i < VECTOR_SIZE; i++) {
+	dst[i] = dst[i] + src[i];
+    }
+}
+#endif
+
+void add_values_scalar(int *dst, int *src) {
+    int i;
+    for (i = 0; i < VECTOR_SIZE; i++) {
+	dst[i] = dst[i] + src[i];
+    }
+}
+
+void add_values(int *dst, int *src) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+	add_values_avx2(dst, src);
+    else if (__builtin_cpu_supports("sse2"))
+	add_values_sse2(dst, src);
+    else
+	add_values_scalar(dst, src);
+#else
+    add_values_scalar(dst, src);
+#endif
+}
+
+// same lock ordering as vector-global-order.c, by address; only the add
+// inside the critical section is different
+void vector_add(vector_t *v_dst, vector_t *v_src) {
+    if (v_dst < v_src) {
+	Pthread_mutex_lock(&v_dst->lock);
+	Pthread_mutex_lock(&v_src->lock);
+    } else if (v_dst > v_src) {
+	Pthread_mutex_lock(&v_src->lock);
+	Pthread_mutex_lock(&v_dst->lock);
+    } else {
+	// special case: src and dst are the same
+	Pthread_mutex_lock(&v_src->lock);
+    }
+    add_values(v_dst->values, v_src->values);
+    Pthread_mutex_unlock(&v_src->lock);
+    if (v_dst != v_src)
+	Pthread_mutex_unlock(&v_dst->lock);
+}
+
+void fini() {}
+
+
+#include "main-common.c"
+
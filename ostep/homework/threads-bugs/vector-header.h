@@ -3,10 +3,21 @@
 
 #define VECTOR_SIZE (100)
 
+// a variant can define VECTOR_ALIGNMENT to start each vector on a boundary
+// of that many bytes (and pad it out to one)
+#ifdef VECTOR_ALIGNMENT
+#define VECTOR_ALIGN __attribute__((aligned(VECTOR_ALIGNMENT)))
+#else
+#define VECTOR_ALIGN
+#endif
+
 typedef struct __vector {
     pthread_mutex_t lock;
+#ifdef VECTOR_SEQLOCK
+    _Atomic unsigned seq;   // for variants that define VECTOR_SEQLOCK
+#endif
     int values[VECTOR_SIZE];
-} vector_t;
+} VECTOR_ALIGN vector_t;
 
 
 #endif // __vector_header_h__
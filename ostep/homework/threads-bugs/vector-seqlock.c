@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include "common.h"
+#include "common_threads.h"
+
+// each vector gets a sequence number, which doubles as its spinlock: odd
+// while someone is writing the vector, bumped to even again when they're done
+#define VECTOR_SEQLOCK
+
+#include "main-header.h"
+#include "vector-header.h"
+
+atomic_int retry = 0;
+
+// spins before a waiting thread gives up its CPU, in case it's waiting on a
+// thread that isn't running (there are more threads than CPUs)
+#define SPINS_BEFORE_YIELD (100)
+
+void spin_wait(int *spins) {
+    if (++*spins % SPINS_BEFORE_YIELD == 0) {
+	sched_yield();
+    } else {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#endif
+    }
+}
+
+void seq_lock(vector_t *v) {
+    int spins = 0;
+    while (1) {
+	unsigned seq = atomic_load_explicit(&v->seq, memory_order_relaxed);
+	if (seq % 2 == 0 &&
+	    atomic_compare_exchange_weak_explicit(&v->seq, &seq, seq + 1,
+						  memory_order_acquire, memory_order_relaxed)) {
+	    // readers must see the odd sequence number before any new values
+	    atomic_thread_fence(memory_order_release);
+	    return;
+	}
+	spin_wait(&spins);
+    }
+}
+
+void seq_unlock(vector_t *v) {
+    unsigned seq = atomic_load_explicit(&v->seq, memory_order_relaxed);
+    atomic_store_explicit(&v->seq, seq + 1, memory_order_release);
+}
+
+// copies v's values without locking it; returns 0 if a writer had it, or
+// got to it while copying, in which case the copy is no good
+int seq_read(vector_t *v, int *values) {
+    unsigned seq = atomic_load_explicit(&v->seq, memory_order_acquire);
+    if (seq % 2 == 1)
+	return 0;
+    memcpy(values, v->values, sizeof(v->values));
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&v->seq, memory_order_relaxed) == seq;
+}
+
+// Writers lock v_dst; v_src is only read, optimistically. Nobody ever waits
+// on a lock while holding one: if v_src is being written, let go of v_dst
+// and try again once it's free. That rules out deadlock, even with -d. The
+// add still acts as if both were locked at once, at the moment of the copy.
+void vector_add(vector_t *v_dst, vector_t *v_src) {
+    int i;
+    if (v_dst == v_src) {
+	// special case: src and dst are the same
+	seq_lock(v_dst);
+	for (i = 0; i < VECTOR_SIZE; i++) {
+	    v_dst->values[i] = v_dst->values[i] + v_dst->values[i];
+	}
+	seq_unlock(v_dst);
+	return;
+    }
+
+    int src_values[VECTOR_SIZE];
+    seq_lock(v_dst);
+    while (seq_read(v_src, src_values) == 0) {
+	atomic_fetch_add_explicit(&retry, 1, memory_order_relaxed);
+	seq_unlock(v_dst);
+	int spins = 0;
+	while (atomic_load_explicit(&v_src->seq, memory_order_relaxed) % 2 == 1)
+	    spin_wait(&spins);
+	seq_lock(v_dst);
+    }
+    for (i = 0; i < VECTOR_SIZE; i++) {
+	v_dst->values[i] = v_dst->values[i] + src_values[i];
+    }
+    seq_unlock(v_dst);
+}
+
+void fini() {
+    printf("Retries: %d\n", atomic_load(&retry));
+}
+
+#include "main-common.c"
+
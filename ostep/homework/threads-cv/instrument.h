@@ -0,0 +1,212 @@
+#ifndef __instrument_h__
+#define __instrument_h__
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// all this is for -i: how long each item sits in the buffer, and how long
+// each thread spends blocked, in histograms per thread
+
+int do_instrument = 0;
+
+// Histograms are log-linear, like HdrHistogram: values below 2^HIST_SUB_BITS
+// get a bucket each, and every power of two above that is split into
+// 2^HIST_SUB_BITS buckets, so a bucket is never more than ~3% wide
+#define HIST_SUB_BITS (5)
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS];
+    unsigned long long total;   // how many values
+    unsigned long long sum;     // of all the values
+} histogram_t;
+
+int hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT)
+	return (int) value;
+    int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int) (value >> shift) - HIST_SUB_COUNT;
+}
+
+// the highest value that lands in bucket index
+uint64_t hist_highest(int index) {
+    if (index < HIST_SUB_COUNT)
+	return index;
+    int shift = index / HIST_SUB_COUNT - 1;
+    uint64_t sub = index % HIST_SUB_COUNT;
+    return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+void hist_record(histogram_t *h, uint64_t value) {
+    h->counts[hist_index(value)]++;
+    h->total++;
+    h->sum += value;
+}
+
+void hist_add(histogram_t *to, histogram_t *from) {
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++)
+	to->counts[i] += from->counts[i];
+    to->total += from->total;
+    to->sum += from->sum;
+}
+
+// value at or below which fraction of them lie (to within a bucket)
+uint64_t hist_percentile(histogram_t *h, double fraction) {
+    unsigned long long rank = (unsigned long long) (fraction * h->total + 0.5);
+    if (rank == 0)
+	rank = 1;
+    unsigned long long seen = 0;
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank)
+	    return hist_highest(i);
+    }
+    return 0;
+}
+
+// Timestamps are in ticks: the TSC where there is one, since it's much cheaper
+// than a clock_gettime() per item, and CLOCK_MONOTONIC nanoseconds otherwise.
+// Ticks are turned into time by seeing how many of them a CLOCK_MONOTONIC
+// interval took.
+unsigned long long monotonic_ns() {
+    struct timespec ts;
+    int rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(rc == 0);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+unsigned long long ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return monotonic_ns();
+#endif
+}
+
+typedef struct {
+    histogram_t latency;        // fill to get of each item this thread got
+    histogram_t blocked;        // each wait for the buffer to change
+} thread_stats_t;
+
+thread_stats_t *stats;          // one per thread: malloc in instrument_init()
+__thread thread_stats_t *my_stats;  // NULL in main(), which isn't counted
+unsigned long long *fill_ticks; // when each buffer slot was filled
+
+unsigned long long start_ns, start_ticks;
+
+void instrument_init(int slots, int threads) {
+    if (do_instrument == 0)
+	return;
+    stats = (thread_stats_t *) calloc(threads, sizeof(thread_stats_t));
+    fill_ticks = (unsigned long long *) calloc(slots, sizeof(unsigned long long));
+    assert(stats != NULL && fill_ticks != NULL);
+    start_ns = monotonic_ns();
+    start_ticks = ticks();
+}
+
+// call when slot is filled, before anyone can get it
+void note_fill(int slot) {
+    if (do_instrument)
+	fill_ticks[slot] = ticks();
+}
+
+// call when value is got out of slot
+void note_get(int slot, int value) {
+    if (do_instrument && my_stats != NULL && value != END_OF_STREAM)
+	hist_record(&my_stats->latency, ticks() - fill_ticks[slot]);
+}
+
+unsigned long long block_start() {
+    return do_instrument ? ticks() : 0;
+}
+
+void note_blocked(unsigned long long start) {
+    if (do_instrument && my_stats != NULL)
+	hist_record(&my_stats->blocked, ticks() - start);
+}
+
+// every Cond_wait() in the programs gets timed
+void timed_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    unsigned long long start = block_start();
+    int rc = pthread_cond_wait(cond, mutex);
+    assert(rc == 0);
+    note_blocked(start);
+}
+
+#undef Cond_wait
+#define Cond_wait(cond, mutex) timed_cond_wait(cond, mutex)
+
+// threads start here, so they can find their own stats
+typedef struct {
+    void *(*routine)(void *);
+    long long id;
+} thread_start_t;
+
+thread_start_t thread_starts[2 * MAX_THREADS];
+
+void *thread_trampoline(void *arg) {
+    thread_start_t *start = (thread_start_t *) arg;
+    if (do_instrument)
+	my_stats = &stats[start->id];
+    return start->routine((void *) start->id);
+}
+
+void start_thread(pthread_t *thread, void *(*routine)(void *), int id) {
+    thread_starts[id].routine = routine;
+    thread_starts[id].id = id;
+    Pthread_create(thread, NULL, thread_trampoline, &thread_starts[id]);
+}
+
+void print_percentiles(histogram_t *h, double us_per_tick) {
+    if (h->total == 0) {
+	printf(" %8s %8s %8s", "-", "-", "-");
+	return;
+    }
+    printf(" %8.1f %8.1f %8.1f",
+	   hist_percentile(h, 0.50) * us_per_tick,
+	   hist_percentile(h, 0.99) * us_per_tick,
+	   hist_percentile(h, 0.999) * us_per_tick);
+}
+
+void instrument_report(int items) {
+    if (do_instrument == 0)
+	return;
+    unsigned long long elapsed_ns = monotonic_ns() - start_ns;
+    unsigned long long elapsed_ticks = ticks() - start_ticks;
+    double us_per_tick = elapsed_ticks ? (elapsed_ns / 1000.0) / elapsed_ticks : 0;
+
+    printf("\n%-6s %8s %8s %8s %8s %8s %8s %8s %8s %10s\n", "thread", "items",
+	   "lat p50", "p99", "p999", "waits", "blk p50", "p99", "p999", "blocked ms");
+    histogram_t latency = { { 0 } }, blocked = { { 0 } };
+    int i;
+    for (i = 0; i < producers + consumers; i++) {
+	thread_stats_t *s = &stats[i];
+	char name[16];
+	if (i < producers)
+	    snprintf(name, sizeof(name), "P%d", i);
+	else
+	    snprintf(name, sizeof(name), "C%d", i - producers);
+	printf("%-6s %8llu", name, s->latency.total);
+	print_percentiles(&s->latency, us_per_tick);
+	printf(" %8llu", s->blocked.total);
+	print_percentiles(&s->blocked, us_per_tick);
+	printf(" %10.1f\n", s->blocked.sum * us_per_tick / 1000.0);
+	hist_add(&latency, &s->latency);
+	hist_add(&blocked, &s->blocked);
+    }
+    printf("%-6s %8llu", "all", latency.total);
+    print_percentiles(&latency, us_per_tick);
+    printf(" %8llu", blocked.total);
+    print_percentiles(&blocked, us_per_tick);
+    printf(" %10.1f\n", blocked.sum * us_per_tick / 1000.0);
+    printf("(latencies in us, from fill to get; blocked is time waiting for the buffer)\n");
+    printf("Throughput: %.0f items/sec\n", items / (elapsed_ns / 1e9));
+}
+
+#endif // __instrument_h__
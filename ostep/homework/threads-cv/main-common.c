@@ -5,10 +5,12 @@ void usage() {
     fprintf(stderr, "  -m <size of the shared producer/consumer buffer>\n");
     fprintf(stderr, "  -p <number of producers>\n");
     fprintf(stderr, "  -c <number of consumers>\n");
+    fprintf(stderr, "  -b <most items moved per lock acquisition (or ring access)>\n");
     fprintf(stderr, "  -P <sleep string: how each producer should sleep at various points in execution>\n");
     fprintf(stderr, "  -C <sleep string: how each consumer should sleep at various points in execution>\n");
     fprintf(stderr, "  -v [ verbose flag: trace what is happening and print it ]\n");
     fprintf(stderr, "  -t [ timing flag: time entire execution and print total time ]\n");
+    fprintf(stderr, "  -i [ instrument flag: print latency and blocking percentiles per thread, and throughput ]\n");
     exit(1);
 }
 
@@ -29,7 +31,7 @@ int main(int argc, char *argv[]) {
 
     opterr = 0;
     int c;
-    while ((c = getopt (argc, argv, "l:m:p:c:P:C:vt")) != -1) {
+    while ((c = getopt (argc, argv, "l:m:p:c:b:P:C:vti")) != -1) {
 	switch (c) {
 	case 'l':
 	    loops = atoi(optarg);
@@ -43,6 +45,9 @@ int main(int argc, char *argv[]) {
 	case 'c':
 	    consumers = atoi(optarg);
 	    break;
+	case 'b':
+	    batch = atoi(optarg);
+	    break;
 	case 'P':
 	    producer_pause_string = optarg;
 	    break;
@@ -55,6 +60,9 @@ int main(int argc, char *argv[]) {
 	case 't':
 	    do_timing = 1;
 	    break;
+	case 'i':
+	    do_instrument = 1;
+	    break;
 	default:
 	    usage();
 	}
@@ -62,6 +70,10 @@ int main(int argc, char *argv[]) {
 
     assert(loops > 0);
     assert(max > 0);
+    assert(batch > 0);
+#ifndef HAS_BATCHES
+    ensure(batch == 1, "error: this version doesn't do batches (-b)");
+#endif
     assert(producers <= MAX_THREADS);
     assert(consumers <= MAX_THREADS);
 
@@ -76,7 +88,11 @@ int main(int argc, char *argv[]) {
     for (i = 0; i < max; i++) {
 	buffer[i] = EMPTY;
     }
+#ifdef LOCK_FREE_BUFFER
+    init_ring();
+#endif
 
+    instrument_init(max, producers + consumers);
     do_print_headers();
 
     double t1 = Time_GetSeconds();
@@ -85,11 +101,11 @@ int main(int argc, char *argv[]) {
     pthread_t pid[MAX_THREADS], cid[MAX_THREADS];
     int thread_id = 0;
     for (i = 0; i < producers; i++) {
-	Pthread_create(&pid[i], NULL, producer, (void *) (long long) thread_id); 
+	start_thread(&pid[i], producer, thread_id);
 	thread_id++;
     }
     for (i = 0; i < consumers; i++) {
-	Pthread_create(&cid[i], NULL, consumer, (void *) (long long) thread_id); 
+	start_thread(&cid[i], consumer, thread_id);
 	thread_id++;
     }
 
@@ -102,6 +118,11 @@ int main(int argc, char *argv[]) {
     // - put "consumers" number of END_OF_STREAM's in queue
     // - when consumer sees -1, it exits
     for (i = 0; i < consumers; i++) {
+#ifdef LOCK_FREE_BUFFER
+	// do_fill() waits for room itself
+	do_fill(END_OF_STREAM);
+	do_eos();
+#else
 	Mutex_lock(&m);
 	while (num_full == max) 
 	    Cond_wait(empty_cv, &m);
@@ -109,6 +130,7 @@ int main(int argc, char *argv[]) {
 	do_eos();
 	Cond_signal(fill_cv);
 	Mutex_unlock(&m);
+#endif
     }
 
     // now OK to wait for all consumers
@@ -131,6 +153,8 @@ int main(int argc, char *argv[]) {
 	printf("Total time: %.2f seconds\n", t2-t1);
     }
 
+    instrument_report(producers * loops);
+
     return 0;
 }
 
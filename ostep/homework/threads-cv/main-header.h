@@ -167,5 +167,7 @@ void parse_pause_string(char *str, char *name, int expected_pieces,
     }
 }
 
+#include "instrument.h"
+
 
 #endif // __main_header_h__
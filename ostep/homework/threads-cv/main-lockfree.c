@@ -0,0 +1,297 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "common.h"
+#include "common_threads.h"
+
+#include "pc-header.h"
+
+// No mutex or condition variables around the buffer here: it's a bounded
+// multi-producer multi-consumer ring in the style of Dmitry Vyukov's, where
+// each slot has a sequence number saying whose turn it is. Producers and
+// consumers claim positions with a compare-and-swap and then only touch their
+// own slot. Threads only go to sleep, on a futex, when the ring is full or
+// empty. Linux only, because of the futexes.
+
+// Each slot's sequence number goes 2*turn (free for the turn'th fill of the
+// slot), 2*turn+1 (full, for the turn'th get), 2*turn+2 (free for the next
+// turn). Vyukov's ring uses pos and pos+1 instead, but that can't tell full
+// from free when there's only one slot, and -m 1 is the default here.
+_Atomic size_t *seqs;      // malloc in main()
+int *values;               // the items themselves, one per slot
+
+// next position to fill and get; each slot is position % max
+_Atomic size_t fill_pos = 0;
+_Atomic size_t use_pos  = 0;
+
+// Futex words bumped when an item is filled (or got) while someone's waiting,
+// and counts of who's waiting, so the fast path never makes a system call
+_Atomic uint32_t filled_event   = 0;
+_Atomic uint32_t emptied_event  = 0;
+_Atomic int consumers_waiting   = 0;
+_Atomic int producers_waiting   = 0;
+
+// how many times to retry a full or empty ring before sleeping
+#define SPINS_BEFORE_PARK (100)
+
+// lets main-common.c know there's no m to take around do_fill()
+#define LOCK_FREE_BUFFER
+
+#include "main-header.h"
+
+void futex_wait(_Atomic uint32_t *addr, uint32_t val) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+void futex_wake(_Atomic uint32_t *addr, int n) {
+    syscall(SYS_futex, (uint32_t *) addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// called by main-common.c once max is known
+void init_ring() {
+    seqs = (_Atomic size_t *) Malloc(max * sizeof(*seqs));
+    values = (int *) Malloc(max * sizeof(int));
+    int i;
+    for (i = 0; i < max; i++)
+	atomic_init(&seqs[i], 0);
+}
+
+// buffer, fill_ptr, use_ptr and num_full only mirror the ring for -v, and
+// are only touched with print_lock held
+void trace_fill(size_t pos, int value) {
+    if (do_trace == 0)
+	return;
+    Mutex_lock(&print_lock);
+    buffer[pos % max] = value;
+    fill_ptr = (pos + 1) % max;
+    num_full++;
+    Mutex_unlock(&print_lock);
+}
+
+void trace_get(size_t pos) {
+    if (do_trace == 0)
+	return;
+    Mutex_lock(&print_lock);
+    buffer[pos % max] = EMPTY;
+    use_ptr = (pos + 1) % max;
+    num_full--;
+    Mutex_unlock(&print_lock);
+}
+
+// Claims and fills up to n slots in a row starting at fill_pos, as many as
+// are free; returns how many (0 if the ring is full). A slot that's free for
+// its turn can only be filled by whoever claims its position, so checking
+// them before the CAS is enough.
+int try_fill_n(int *items, int n) {
+    size_t pos = atomic_load_explicit(&fill_pos, memory_order_relaxed);
+    while (1) {
+	int free_slots = 0;
+	while (free_slots < n) {
+	    size_t p = pos + free_slots;
+	    size_t want = 2 * (p / max);
+	    size_t have = atomic_load_explicit(&seqs[p % max], memory_order_acquire);
+	    if (have != want)
+		break;
+	    free_slots++;
+	}
+	if (free_slots == 0) {
+	    size_t want = 2 * (pos / max);
+	    size_t have = atomic_load_explicit(&seqs[pos % max], memory_order_relaxed);
+	    if ((intptr_t) (have - want) < 0)
+		return 0; // the last turn's item is still there
+	    // someone else filled pos already
+	    pos = atomic_load_explicit(&fill_pos, memory_order_relaxed);
+	    continue;
+	}
+	if (atomic_compare_exchange_weak_explicit(&fill_pos, &pos, pos + free_slots,
+						  memory_order_relaxed, memory_order_relaxed)) {
+	    int i;
+	    for (i = 0; i < free_slots; i++) {
+		size_t p = pos + i;
+		values[p % max] = items[i];
+		note_fill(p % max);
+		trace_fill(p, items[i]);
+		atomic_store_explicit(&seqs[p % max], 2 * (p / max) + 1, memory_order_release);
+	    }
+	    return free_slots;
+	}
+	// lost the race for pos; the failed CAS reloaded it
+    }
+}
+
+// Claims and gets up to n full slots in a row starting at use_pos; returns
+// how many (0 if the ring is empty)
+int try_get_n(int *items, int n) {
+    size_t pos = atomic_load_explicit(&use_pos, memory_order_relaxed);
+    while (1) {
+	int full_slots = 0;
+	while (full_slots < n) {
+	    size_t p = pos + full_slots;
+	    size_t want = 2 * (p / max) + 1;
+	    size_t have = atomic_load_explicit(&seqs[p % max], memory_order_acquire);
+	    if (have != want)
+		break;
+	    full_slots++;
+	}
+	if (full_slots == 0) {
+	    size_t want = 2 * (pos / max) + 1;
+	    size_t have = atomic_load_explicit(&seqs[pos % max], memory_order_relaxed);
+	    if ((intptr_t) (have - want) < 0)
+		return 0; // nothing filled for this turn yet
+	    pos = atomic_load_explicit(&use_pos, memory_order_relaxed);
+	    continue;
+	}
+	if (atomic_compare_exchange_weak_explicit(&use_pos, &pos, pos + full_slots,
+						  memory_order_relaxed, memory_order_relaxed)) {
+	    int i;
+	    for (i = 0; i < full_slots; i++) {
+		size_t p = pos + i;
+		items[i] = values[p % max];
+		note_get(p % max, items[i]);
+		trace_get(p);
+		atomic_store_explicit(&seqs[p % max], 2 * (p / max) + 2, memory_order_release);
+	    }
+	    return full_slots;
+	}
+    }
+}
+
+// Called after a fill or get of n items: wakes up to n threads sleeping on
+// event, with one system call, if there are any. The fence pairs with the
+// one in park(): either we see the sleeper's count, or it sees our items
+// (or free slots) and doesn't sleep.
+void wake_n(_Atomic uint32_t *event, _Atomic int *waiting, int n) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed) > 0) {
+	atomic_fetch_add_explicit(event, 1, memory_order_release);
+	futex_wake(event, n);
+    }
+}
+
+struct retry_args {
+    int *items;
+    int n;
+    int done;
+};
+
+// Sleeps until event is bumped, unless the retry gets somewhere first.
+// Taking the event's value before the retry means a bump after the retry
+// makes the futex wait return at once, rather than sleeping through it.
+void park(_Atomic uint32_t *event, _Atomic int *waiting,
+	  int (*retry)(int *, int), struct retry_args *args) {
+    atomic_fetch_add_explicit(waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t seen = atomic_load_explicit(event, memory_order_acquire);
+    args->done = retry(args->items, args->n);
+    if (args->done == 0) {
+	unsigned long long start = block_start();
+	futex_wait(event, seen);
+	note_blocked(start);
+    }
+    atomic_fetch_sub_explicit(waiting, 1, memory_order_relaxed);
+}
+
+// Waits until at least one of the n items goes in; returns how many did
+int do_fill_n(int *items, int n) {
+    struct retry_args args = { items, n, 0 };
+    int spins = 0;
+    while ((args.done = try_fill_n(items, n)) == 0) {
+	if (spins++ < SPINS_BEFORE_PARK) {
+	    cpu_relax();
+	    continue;
+	}
+	park(&emptied_event, &producers_waiting, try_fill_n, &args);
+	if (args.done > 0)
+	    break;
+    }
+    wake_n(&filled_event, &consumers_waiting, args.done);
+    return args.done;
+}
+
+// Waits until there's at least one item to get; returns how many it got, at
+// most n
+int do_get_n(int *items, int n) {
+    struct retry_args args = { items, n, 0 };
+    int spins = 0;
+    while ((args.done = try_get_n(items, n)) == 0) {
+	if (spins++ < SPINS_BEFORE_PARK) {
+	    cpu_relax();
+	    continue;
+	}
+	park(&filled_event, &consumers_waiting, try_get_n, &args);
+	if (args.done > 0)
+	    break;
+    }
+    wake_n(&emptied_event, &producers_waiting, args.done);
+    return args.done;
+}
+
+void do_fill(int value) {
+    do_fill_n(&value, 1);
+}
+
+void *producer(void *arg) {
+    int id = (int) (long long) arg;
+    // make sure each producer produces unique values
+    int base = id * loops;
+    int *items = (int *) Malloc(batch * sizeof(int));
+    int i;
+    for (i = 0; i < loops; ) {     p0;
+	int n = loops - i < batch ? loops - i : batch;
+	int j;
+	for (j = 0; j < n; j++)
+	    items[j] = base + i + j;
+	i += do_fill_n(items, n);   p4;
+    }
+    free(items);
+    return NULL;
+}
+
+void *consumer(void *arg) {
+    int id = (int) (long long) arg;
+    int *items = (int *) Malloc(batch * sizeof(int));
+    int eos_count = 0;
+    int consumed_count = 0;
+    while (eos_count == 0) {       c0;
+	int n = do_get_n(items, batch); c4;
+	int j;
+	for (j = 0; j < n; j++) {
+	    if (items[j] == END_OF_STREAM)
+		eos_count++;
+	    else
+		consumed_count++;
+	}
+    }
+    free(items);
+
+    // Everything after the first END_OF_STREAM is another consumer's
+    // END_OF_STREAM (main() only adds them once the producers are done), so
+    // put those back. There's always a consumer left to make room for them.
+    while (--eos_count > 0)
+	do_fill(END_OF_STREAM);
+
+    return (void *) (long long) consumed_count;
+}
+
+// lets main-common.c know -b works here
+#define HAS_BATCHES
+
+// all codes use this common base to start producers/consumers
+// and all the other related stuff
+#include "main-common.c"
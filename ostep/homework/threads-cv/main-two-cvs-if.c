@@ -21,6 +21,7 @@ void do_fill(int value) {
     // ensure empty before usage
     ensure(buffer[fill_ptr] == EMPTY, "error: tried to fill a non-empty buffer");
     buffer[fill_ptr] = value;
+    note_fill(fill_ptr);
     fill_ptr = (fill_ptr + 1) % max;
     num_full++;
 }
@@ -28,6 +29,7 @@ void do_fill(int value) {
 int do_get() {
     int tmp = buffer[use_ptr];
     ensure(tmp != EMPTY, "error: tried to get an empty buffer");
+    note_get(use_ptr, tmp);
     buffer[use_ptr] = EMPTY; 
     use_ptr = (use_ptr + 1) % max;
     num_full--;
@@ -23,6 +23,7 @@ void do_fill(int value) {
     // ensure empty before usage
     ensure(buffer[fill_ptr] == EMPTY, "error: tried to fill a non-empty buffer");
     buffer[fill_ptr] = value;
+    note_fill(fill_ptr);
     fill_ptr = (fill_ptr + 1) % max;
     num_full++;
 }
@@ -30,48 +31,86 @@ void do_fill(int value) {
 int do_get() {
     int tmp = buffer[use_ptr];
     ensure(tmp != EMPTY, "error: tried to get an empty buffer");
+    note_get(use_ptr, tmp);
     buffer[use_ptr] = EMPTY; 
     use_ptr = (use_ptr + 1) % max;
     num_full--;
     return tmp;
 }
 
+// fills up to n items, as many as there's room for; returns how many
+int do_fill_n(int *values, int n) {
+    int i;
+    for (i = 0; i < n && num_full < max; i++) 
+	do_fill(values[i]);
+    return i;
+}
+
+// gets up to n items, as many as there are; stops after an END_OF_STREAM
+// so that every consumer gets one of its own. returns how many
+int do_get_n(int *values, int n) {
+    int i;
+    for (i = 0; i < n && num_full > 0; i++) {
+	values[i] = do_get();
+	if (values[i] == END_OF_STREAM)
+	    return i + 1;
+    }
+    return i;
+}
+
 void *producer(void *arg) {
     int id = (int) arg;
     // make sure each producer produces unique values
     int base = id * loops; 
+    int *items = (int *) Malloc(batch * sizeof(int));
     int i;
-    for (i = 0; i < loops; i++) {   p0;
-	Mutex_lock(&m);             p1;
-	while (num_full == max) {   p2;
-	    Cond_wait(&empty, &m);  p3;
+    for (i = 0; i < loops; ) {          p0;
+	int n = loops - i < batch ? loops - i : batch;
+	int j;
+	for (j = 0; j < n; j++)
+	    items[j] = base + i + j;
+	Mutex_lock(&m);                 p1;
+	while (num_full == max) {       p2;
+	    Cond_wait(&empty, &m);      p3;
 	}
-	do_fill(base + i);          p4;
-	Cond_signal(&fill);         p5;
-	Mutex_unlock(&m);           p6;
+	// one signal for the lot, however many fit
+	i += do_fill_n(items, n);       p4;
+	Cond_signal(&fill);             p5;
+	Mutex_unlock(&m);               p6;
     }
+    free(items);
     return NULL;
 }
                                                                                
 void *consumer(void *arg) {
     int id = (int) arg;
-    int tmp = 0;
+    int *items = (int *) Malloc(batch * sizeof(int));
+    int done = 0;
     int consumed_count = 0;
-    while (tmp != END_OF_STREAM) { c0;
-	Mutex_lock(&m);            c1;
-	while (num_full == 0) {    c2;
-	    Cond_wait(&fill, &m);  c3;
+    while (!done) {                     c0;
+	Mutex_lock(&m);                 c1;
+	while (num_full == 0) {         c2;
+	    Cond_wait(&fill, &m);       c3;
         }
-	tmp = do_get();            c4;
-	Cond_signal(&empty);       c5;
-	Mutex_unlock(&m);          c6;
-	consumed_count++;
+	int n = do_get_n(items, batch); c4;
+	Cond_signal(&empty);            c5;
+	Mutex_unlock(&m);               c6;
+	int j;
+	for (j = 0; j < n; j++) {
+	    if (items[j] == END_OF_STREAM)
+		done = 1;
+	    else
+		consumed_count++;
+	}
     }
+    free(items);
 
-    // return consumer_count-1 because END_OF_STREAM does not count
-    return (void *) (long long) (consumed_count - 1);
+    return (void *) (long long) consumed_count;
 }
 
+// lets main-common.c know -b works here
+#define HAS_BATCHES
+
 // must set these appropriately to use "main-common.c"
 pthread_cond_t *fill_cv = &fill;
 pthread_cond_t *empty_cv = &empty;
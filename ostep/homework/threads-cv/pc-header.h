@@ -14,6 +14,7 @@ int fill_ptr = 0;          // tracks where next produce should go to
 int num_full = 0;          // counts how many entries are full
 
 int loops;                 // number of items that each producer produces
+int batch = 1;             // most items moved per lock acquisition
 
 #define EMPTY         (-2) // buffer slot has nothing in it
 #define END_OF_STREAM (-1) // consumer who grabs this should exit